@@ -5,7 +5,10 @@
    SPDX-License-Identifier: MIT
 */
 
+#define _DEFAULT_SOURCE     /* MAP_ANONYMOUS */
 #include "jit.h"
+#include "vm_symbols.h"
+#include "vm_trace.h"
 #include "../common.h"
 #include <stdio.h>
 #include <stdlib.h>
@@ -125,6 +128,32 @@ static inline void emit_ret(uint8_t **code_ptr) {
     emit_byte(code_ptr, 0xC3);
 }
 
+/* CMP/INC/DEC on RCX, for the stack pointer checks */
+static inline void emit_cmp_rcx_imm32(uint8_t **code_ptr, uint32_t imm) {
+    emit_byte(code_ptr, 0x48);  /* REX.W */
+    emit_byte(code_ptr, 0x81);  /* CMP reg, imm32 */
+    emit_byte(code_ptr, 0xF9);  /* ModR/M: CMP RCX, imm32 */
+    emit_dword(code_ptr, imm);
+}
+
+static inline void emit_cmp_rcx_rdx(uint8_t **code_ptr) {
+    emit_byte(code_ptr, 0x48);  /* REX.W */
+    emit_byte(code_ptr, 0x39);  /* CMP reg, reg */
+    emit_byte(code_ptr, 0xD1);  /* ModR/M: CMP RCX, RDX */
+}
+
+static inline void emit_inc_rcx(uint8_t **code_ptr) {
+    emit_byte(code_ptr, 0x48);  /* REX.W */
+    emit_byte(code_ptr, 0xFF);  /* INC reg */
+    emit_byte(code_ptr, 0xC1);  /* ModR/M: INC RCX */
+}
+
+static inline void emit_dec_rcx(uint8_t **code_ptr) {
+    emit_byte(code_ptr, 0x48);  /* REX.W */
+    emit_byte(code_ptr, 0xFF);  /* DEC reg */
+    emit_byte(code_ptr, 0xC9);  /* ModR/M: DEC RCX */
+}
+
 /* Map Pocol register to x86-64 register */
 static inline uint8_t map_register(uint8_t pocol_reg) {
     /* Simple mapping: r0-r7 -> rax,rcx,rdx,rbx,rsp,rbp,rsi,rdi */
@@ -156,11 +185,20 @@ void pocol_jit_init(JitContext *jit_ctx, JitMode mode, OptLevel opt_level) {
     
     jit_ctx->buffer_used = 0;
     jit_ctx->cache_count = 0;
+    jit_ctx->current_block = -1;
+    jit_ctx->optimized = 0;
+    jit_ctx->stop_bits = NULL;
+    jit_ctx->stop_check = NULL;
+    jit_ctx->stop_user = NULL;
+    jit_ctx->stop_requested = 0;
     jit_ctx->compile_count = 0;
     jit_ctx->execute_count = 0;
+    jit_ctx->compile_ns = 0;
 }
 
 void pocol_jit_free(JitContext *jit_ctx) {
+    jit_perf_close(&jit_ctx->perf);
+    jit_gdb_close(&jit_ctx->gdb);
     if (jit_ctx->code_buffer) {
 #ifdef _WIN32
         VirtualFree(jit_ctx->code_buffer, 0, MEM_RELEASE);
@@ -171,15 +209,40 @@ void pocol_jit_free(JitContext *jit_ctx) {
     memset(jit_ctx, 0, sizeof(JitContext));
 }
 
+/* Blocks are only ever entered at their first instruction: a pc inside
+   a block (after a debugger step, say) gets a block of its own */
 JitCacheEntry *pocol_jit_find_cache(JitContext *jit_ctx, Inst_Addr pc) {
     for (size_t i = 0; i < jit_ctx->cache_count; i++) {
-        if (pc >= jit_ctx->cache[i].start_pc && pc <= jit_ctx->cache[i].end_pc) {
+        if (jit_ctx->cache[i].start_pc == pc) {
             return &jit_ctx->cache[i];
         }
     }
     return NULL;
 }
 
+void pocol_jit_invalidate(JitContext *jit_ctx, Inst_Addr pc) {
+    size_t i = 0;
+    while (i < jit_ctx->cache_count) {
+        JitCacheEntry *entry = &jit_ctx->cache[i];
+        if (pc > entry->start_pc && pc < entry->end_pc) {
+            /* the code bytes stay where they are, only the entry goes.
+               GDB must forget the block; perf has no unload record, and
+               needs none while the bytes are never handed out again */
+            if (jit_ctx->gdb.enabled && entry->compiled) {
+                jit_gdb_unregister(&jit_ctx->gdb, (const void *)(uintptr_t)entry->code);
+            }
+            *entry = jit_ctx->cache[--jit_ctx->cache_count];
+        } else {
+            i++;
+        }
+    }
+}
+
+static inline int jit_stop_at(const JitContext *jit_ctx, Inst_Addr pc) {
+    return jit_ctx->stop_bits && pc < POCOL_MEMORY_SIZE &&
+           ((jit_ctx->stop_bits[pc >> 6] >> (pc & 63)) & 1);
+}
+
 static Err compile_instruction(PocolVM *vm, uint8_t **code_ptr, Inst_Addr *pc) {
     if (*pc >= POCOL_MEMORY_SIZE) {
         return ERR_ILLEGAL_INST_ACCESS;
@@ -324,32 +387,6 @@ static Err compile_instruction(PocolVM *vm, uint8_t **code_ptr, Inst_Addr *pc) {
     return ERR_OK;
 }
 
-/* Helper functions for x86-64 instruction emission */
-static inline void emit_cmp_rcx_imm32(uint8_t **code_ptr, uint32_t imm) {
-    emit_byte(code_ptr, 0x48);  /* REX.W */
-    emit_byte(code_ptr, 0x81);  /* CMP reg, imm32 */
-    emit_byte(code_ptr, 0xF9);  /* ModR/M: CMP RCX, imm32 */
-    emit_dword(code_ptr, imm);
-}
-
-static inline void emit_cmp_rcx_rdx(uint8_t **code_ptr) {
-    emit_byte(code_ptr, 0x48);  /* REX.W */
-    emit_byte(code_ptr, 0x39);  /* CMP reg, reg */
-    emit_byte(code_ptr, 0xD1);  /* ModR/M: CMP RCX, RDX */
-}
-
-static inline void emit_inc_rcx(uint8_t **code_ptr) {
-    emit_byte(code_ptr, 0x48);  /* REX.W */
-    emit_byte(code_ptr, 0xFF);  /* INC reg */
-    emit_byte(code_ptr, 0xC1);  /* ModR/M: INC RCX */
-}
-
-static inline void emit_dec_rcx(uint8_t **code_ptr) {
-    emit_byte(code_ptr, 0x48);  /* REX.W */
-    emit_byte(code_ptr, 0xFF);  /* DEC reg */
-    emit_byte(code_ptr, 0xC9);  /* ModR/M: DEC RCX */
-}
-
 Err pocol_jit_compile_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr start_pc) {
     if (jit_ctx->cache_count >= JIT_CACHE_SIZE) {
         return ERR_OK;  /* Cache full, use interpreter */
@@ -363,15 +400,34 @@ Err pocol_jit_compile_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr start_pc
     
     Inst_Addr current_pc = start_pc;
     Inst_Addr end_pc = start_pc;
+    unsigned int inst_count = 0;
+    uint8_t last_op = INST_HALT;
+    JitPerfLine lines[JIT_PERF_MAX_LINES];
+    int line_count = 0;
     
-    /* Compile instructions until HALT or control flow change */
+    /* Compile instructions until HALT, SYS or control flow change.
+       HALT and SYS are left to the interpreter so the syscall
+       counters and the retired instruction count stay in step */
     while (current_pc < POCOL_MEMORY_SIZE) {
         uint8_t op = vm->memory[current_pc];
-        if (op == INST_HALT) {
+        if (op == INST_HALT || op == INST_SYS) {
+            end_pc = current_pc;
+            break;
+        }
+        
+        /* a breakpoint must start a block, where the dispatcher sees it */
+        if (current_pc != start_pc && jit_stop_at(jit_ctx, current_pc)) {
             end_pc = current_pc;
             break;
         }
         
+        /* native offset of each guest instruction, for perf annotate */
+        if (jit_ctx->perf.dump && line_count < JIT_PERF_MAX_LINES) {
+            lines[line_count].pc = current_pc;
+            lines[line_count].offset = (uint32_t)(code_ptr - code_start);
+            line_count++;
+        }
+        
         /* For simplicity, compile one instruction at a time for now */
         Err err = compile_instruction(vm, &code_ptr, &current_pc);
         if (err != ERR_OK) {
@@ -379,6 +435,8 @@ Err pocol_jit_compile_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr start_pc
         }
         
         end_pc = current_pc;
+        last_op = op;
+        inst_count++;
         
         /* For now, stop at control flow changes */
         if (op == INST_JMP) {
@@ -386,6 +444,24 @@ Err pocol_jit_compile_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr start_pc
         }
     }
     
+    /* Nothing compiled (block starts at HALT/SYS): remember to interpret
+       it, so later visits find the entry instead of compiling again */
+    if (inst_count == 0) {
+        JitCacheEntry *entry = &jit_ctx->cache[jit_ctx->cache_count++];
+        memset(entry, 0, sizeof(*entry));
+        entry->start_pc = start_pc;
+        entry->end_pc = start_pc;
+        return ERR_OK;
+    }
+    
+    /* Fall-through blocks resume at end_pc; RAX may have been
+       clobbered by a call, so reload the VM pointer first */
+    if (last_op != INST_JMP) {
+        emit_mov_reg_imm64(&code_ptr, RAX_MAP, (uint64_t)vm);
+        emit_mov_reg_imm64(&code_ptr, RDX_MAP, end_pc);
+        emit_mov_mem_reg(&code_ptr, RAX_MAP, ((char*)&vm->pc - (char*)vm), RDX_MAP);
+    }
+    
     /* Add epilogue */
     emit_ret(&code_ptr);
     
@@ -395,12 +471,30 @@ Err pocol_jit_compile_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr start_pc
     entry->end_pc = end_pc;
     entry->code = (JitFunction)code_start;
     entry->code_size = code_ptr - code_start;
+    entry->inst_count = inst_count;
     entry->hits = 0;
     entry->compiled = 1;
     
     jit_ctx->buffer_used += entry->code_size;
     jit_ctx->compile_count++;
     
+    /* Tell external profilers and debuggers about the block; both
+       are off by default and cost nothing past this test */
+    if (jit_ctx->perf.flags || jit_ctx->gdb.enabled) {
+        char where[128], name[192];
+        symbols_format(vm->symbols, start_pc, where, sizeof(where));
+        snprintf(name, sizeof(name), "pocol:%s [0x%llx-0x%llx]", where,
+                 (unsigned long long)start_pc, (unsigned long long)end_pc);
+        
+        if (jit_ctx->perf.flags) {
+            jit_perf_code_load(&jit_ctx->perf, code_start, entry->code_size,
+                               name, vm->symbols, lines, line_count);
+        }
+        if (jit_ctx->gdb.enabled) {
+            jit_gdb_register(&jit_ctx->gdb, code_start, entry->code_size, name);
+        }
+    }
+    
     return ERR_OK;
 }
 
@@ -409,7 +503,9 @@ Err pocol_jit_execute_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr pc) {
     
     if (!entry) {
         /* Compile the block */
+        uint64_t started = pocol_clock_ns();
         Err err = pocol_jit_compile_block(jit_ctx, vm, pc);
+        jit_ctx->compile_ns += pocol_clock_ns() - started;
         if (err != ERR_OK) {
             return err;
         }
@@ -419,16 +515,38 @@ Err pocol_jit_execute_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr pc) {
     if (entry && entry->compiled) {
         entry->hits++;
         jit_ctx->execute_count++;
+        if (vm->syscall_ctx) {
+            vm->syscall_ctx->instruction_count += entry->inst_count;
+            vm->syscall_ctx->block_entries++;
+        }
+        jit_ctx->current_block = (int)(entry - jit_ctx->cache);
         entry->code(vm);
+        jit_ctx->current_block = -1;
+        if (vm->trace) {
+            trace_block(vm->trace, entry->start_pc, entry->inst_count);
+        }
         return ERR_OK;
     }
     
     /* Fall back to interpreter */
+    if (vm->syscall_ctx) {
+        vm->syscall_ctx->instruction_count++;
+    }
     return pocol_execute_inst(vm);
 }
 
+/* Returns ERR_OK at HALT, after `limit` blocks, with vm->pc on a
+   stop_bits breakpoint (not yet executed) that stop_check did not wave
+   through, or once stop_requested is set */
 Err pocol_jit_execute_program(JitContext *jit_ctx, PocolVM *vm, int limit) {
     while (limit != 0 && !vm->halt) {
+        if (jit_ctx->stop_requested) {
+            break;
+        }
+        if (jit_stop_at(jit_ctx, vm->pc) &&
+            (!jit_ctx->stop_check || jit_ctx->stop_check(vm, jit_ctx->stop_user))) {
+            break;
+        }
         Err err = pocol_jit_execute_block(jit_ctx, vm, vm->pc);
         if (err != ERR_OK) {
             pocol_error("JIT execution error at addr: %u\n", vm->pc);
@@ -441,25 +559,34 @@ Err pocol_jit_execute_program(JitContext *jit_ctx, PocolVM *vm, int limit) {
     return ERR_OK;
 }
 
-void pocol_jit_print_stats(JitContext *jit_ctx) {
-    printf("=== JIT Statistics ===\n");
-    printf("Mode: %s\n", 
-           jit_ctx->mode == JIT_MODE_DISABLED ? "Disabled" :
-           jit_ctx->mode == JIT_MODE_ENABLED ? "Enabled" : "Trace");
-    printf("Optimization Level: %s\n",
-           jit_ctx->opt_level == OPT_LEVEL_NONE ? "None" :
-           jit_ctx->opt_level == OPT_LEVEL_BASIC ? "Basic" : "Advanced");
-    printf("Compiled blocks: %lu\n", jit_ctx->compile_count);
-    printf("Executed blocks: %lu\n", jit_ctx->execute_count);
-    printf("Cache entries: %zu/%d\n", jit_ctx->cache_count, JIT_CACHE_SIZE);
-    printf("Code buffer used: %zu/%zu bytes\n", jit_ctx->buffer_used, jit_ctx->buffer_size);
+void pocol_jit_print_stats(JitContext *jit_ctx, PocolVM *vm) {
+    fprintf(stderr, "=== JIT Statistics ===\n");
+    fprintf(stderr, "Mode: %s\n", 
+            jit_ctx->mode == JIT_MODE_DISABLED ? "Disabled" :
+            jit_ctx->mode == JIT_MODE_ENABLED ? "Enabled" : "Trace");
+    fprintf(stderr, "Optimization Level: %s\n",
+            jit_ctx->opt_level == OPT_LEVEL_NONE ? "None" :
+            jit_ctx->opt_level == OPT_LEVEL_BASIC ? "Basic" : "Advanced");
+    fprintf(stderr, "Compiled blocks: %lu\n", jit_ctx->compile_count);
+    fprintf(stderr, "Executed blocks: %lu\n", jit_ctx->execute_count);
+    fprintf(stderr, "Cache entries: %zu/%d\n", jit_ctx->cache_count, JIT_CACHE_SIZE);
+    fprintf(stderr, "Code buffer used: %zu/%zu bytes\n", jit_ctx->buffer_used, jit_ctx->buffer_size);
     
     if (jit_ctx->cache_count > 0) {
-        printf("\nCached blocks:\n");
+        fprintf(stderr, "\nCached blocks:\n");
         for (size_t i = 0; i < jit_ctx->cache_count; i++) {
-            printf("  [%zu] PC %u-%u: %zu bytes, %u hits\n",
-                   i, jit_ctx->cache[i].start_pc, jit_ctx->cache[i].end_pc,
-                   jit_ctx->cache[i].code_size, jit_ctx->cache[i].hits);
+            char where[128];
+            if (!jit_ctx->cache[i].compiled) {
+                fprintf(stderr, "  [%zu] PC %llu %s: interpreted\n",
+                        i, (unsigned long long)jit_ctx->cache[i].start_pc,
+                        symbols_format(vm ? vm->symbols : NULL, jit_ctx->cache[i].start_pc, where, sizeof(where)));
+                continue;
+            }
+            fprintf(stderr, "  [%zu] PC %llu-%llu %s: %zu bytes, %u hits\n",
+                    i, (unsigned long long)jit_ctx->cache[i].start_pc,
+                    (unsigned long long)jit_ctx->cache[i].end_pc,
+                    symbols_format(vm ? vm->symbols : NULL, jit_ctx->cache[i].start_pc, where, sizeof(where)),
+                    jit_ctx->cache[i].code_size, jit_ctx->cache[i].hits);
         }
     }
 }
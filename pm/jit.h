@@ -9,6 +9,8 @@
 #define POCOL_JIT_H
 
 #include "vm.h"
+#include "jit_perf.h"
+#include "jit_gdb.h"
 #include <stdint.h>
 
 /* JIT compilation mode */
@@ -34,6 +36,7 @@ typedef struct {
     Inst_Addr end_pc;       /* Ending program counter */
     JitFunction code;       /* Compiled machine code */
     size_t code_size;       /* Size of compiled code */
+    unsigned int inst_count; /* Guest instructions retired per entry */
     unsigned int hits;      /* Execution count for tracing */
     unsigned int compiled : 1; /* Whether this block is compiled */
 } JitCacheEntry;
@@ -47,6 +50,22 @@ typedef struct {
     OptLevel opt_level;
     JitCacheEntry cache[JIT_CACHE_SIZE];
     size_t cache_count;
+    volatile int current_block;     /* cache index running now, -1 outside JIT code (read by the sampler) */
+    int optimized;                  /* bytecode optimizer already ran */
+    
+    /* Debugger breakpoint map (one bit per code byte), NULL unless
+       debugging: blocks end before a marked pc and execution stops there */
+    const uint64_t *stop_bits;
+    
+    /* Asked at a marked pc, NULL stops at every one. Zero lets the block
+       there run on, so a breakpoint whose condition is false, or a
+       logpoint, never leaves the dispatch loop */
+    int (*stop_check)(PocolVM *vm, void *user);
+    void *stop_user;
+    
+    /* Set by a debugger watchpoint trap (possibly from a signal
+       handler); the dispatcher returns before the next block */
+    volatile int stop_requested;
     
     /* Memory for generated code */
     uint8_t *code_buffer;
@@ -56,6 +75,13 @@ typedef struct {
     /* Statistics */
     unsigned long compile_count;
     unsigned long execute_count;
+    uint64_t compile_ns;            /* time spent in pocol_jit_compile_block */
+    
+    /* perf map / jitdump output, flags 0 when off */
+    JitPerf perf;
+    
+    /* GDB JIT interface registration, enabled 0 when off */
+    JitGdb gdb;
 } JitContext;
 
 /* Initialize JIT context */
@@ -64,6 +90,9 @@ void pocol_jit_init(JitContext *jit_ctx, JitMode mode, OptLevel opt_level);
 /* Free JIT context */
 void pocol_jit_free(JitContext *jit_ctx);
 
+/* The VM's JIT context, created on first use; NULL if allocation fails */
+JitContext *pocol_jit_context(PocolVM *vm);
+
 /* Compile a code block starting at pc */
 Err pocol_jit_compile_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr start_pc);
 
@@ -73,9 +102,13 @@ Err pocol_jit_execute_program(JitContext *jit_ctx, PocolVM *vm, int limit);
 /* Execute a single JIT-compiled block */
 Err pocol_jit_execute_block(JitContext *jit_ctx, PocolVM *vm, Inst_Addr pc);
 
-/* Find cached JIT function for given PC */
+/* Find the cached block starting exactly at pc */
 JitCacheEntry *pocol_jit_find_cache(JitContext *jit_ctx, Inst_Addr pc);
 
+/* Drop every block with pc strictly inside it, so pc becomes a block
+   start again (the debugger calls this when a breakpoint is set) */
+void pocol_jit_invalidate(JitContext *jit_ctx, Inst_Addr pc);
+
 /* Simple optimizer functions */
 Err pocol_optimize_bytecode(PocolVM *vm, OptLevel level);
 
@@ -89,6 +122,6 @@ Err pocol_opt_eliminate_dead_code(PocolVM *vm);
 Err pocol_opt_peephole(PocolVM *vm);
 
 /* Print JIT statistics */
-void pocol_jit_print_stats(JitContext *jit_ctx);
+void pocol_jit_print_stats(JitContext *jit_ctx, PocolVM *vm);
 
 #endif /* POCOL_JIT_H */
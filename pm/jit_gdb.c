@@ -0,0 +1,325 @@
+/* jit_gdb.c -- GDB JIT interface registration for compiled blocks */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#include "jit_gdb.h"
+#include "../common.h"
+#include <stdlib.h>
+#include <string.h>
+
+/* GDB sets a breakpoint in __jit_debug_register_code() and, when it
+   hits, reads the entry named by __jit_debug_descriptor.relevant_entry.
+   Each entry points at a complete object file in our memory. The one
+   built here is the smallest ELF GDB will take:
+
+     .text       SHT_NOBITS at the block's address, so nothing is copied
+     .eh_frame   one CIE/FDE: JIT blocks are leaf code that never touch
+                 rsp, so CFA = rsp + 8 and the return address sits at
+                 CFA - 8 for the whole block
+     .symtab     one STT_FUNC symbol naming the guest range
+
+   That is enough for `bt` to walk out of a JIT frame and for
+   `disassemble` / `x/i $pc` to show the block by name. */
+
+struct jit_descriptor __jit_debug_descriptor = { 1, JIT_NOACTION, NULL, NULL };
+
+#if defined(__GNUC__)
+__attribute__((noinline))
+#endif
+void __jit_debug_register_code(void) {
+#if defined(__GNUC__)
+    /* keep the call from being folded away, GDB breaks here */
+    __asm__ __volatile__("");
+#endif
+}
+
+typedef struct JitGdbBlock {
+    struct jit_code_entry entry;
+    struct JitGdbBlock *next;
+    const void *code;               /* the block's machine code, its key */
+    /* ELF image follows */
+} JitGdbBlock;
+
+/* ELF64 little-endian, only what the image needs */
+#define ELF_MACH_X86_64     62
+#define ELF_TYPE_REL        1
+#define SHT_PROGBITS_       1
+#define SHT_SYMTAB_         2
+#define SHT_STRTAB_         3
+#define SHT_NOBITS_         8
+#define SHF_ALLOC_          0x2
+#define SHF_EXECINSTR_      0x4
+#define SHN_ABS_            0xfff1
+#define STB_LOCAL_FILE      0x04    /* STB_LOCAL  << 4 | STT_FILE */
+#define STB_GLOBAL_FUNC     0x12    /* STB_GLOBAL << 4 | STT_FUNC */
+
+#define DW_EH_PE_udata4     0x03
+#define DW_EH_PE_textrel    0x20
+#define DW_CFA_def_cfa      0x0c
+#define DW_CFA_offset       0x80
+#define DWARF_REG_RSP       7
+#define DWARF_REG_RIP       16
+
+enum { SECT_NULL, SECT_TEXT, SECT_EHFRAME, SECT_SHSTRTAB, SECT_STRTAB, SECT_SYMTAB, SECT_COUNT };
+
+typedef struct {
+    unsigned char e_ident[16];
+    uint16_t e_type;
+    uint16_t e_machine;
+    uint32_t e_version;
+    uint64_t e_entry;
+    uint64_t e_phoff;
+    uint64_t e_shoff;
+    uint32_t e_flags;
+    uint16_t e_ehsize;
+    uint16_t e_phentsize;
+    uint16_t e_phnum;
+    uint16_t e_shentsize;
+    uint16_t e_shnum;
+    uint16_t e_shstrndx;
+} ElfHeader;
+
+typedef struct {
+    uint32_t sh_name;
+    uint32_t sh_type;
+    uint64_t sh_flags;
+    uint64_t sh_addr;
+    uint64_t sh_offset;
+    uint64_t sh_size;
+    uint32_t sh_link;
+    uint32_t sh_info;
+    uint64_t sh_addralign;
+    uint64_t sh_entsize;
+} ElfSection;
+
+typedef struct {
+    uint32_t st_name;
+    uint8_t st_info;
+    uint8_t st_other;
+    uint16_t st_shndx;
+    uint64_t st_value;
+    uint64_t st_size;
+} ElfSymbol;
+
+typedef struct {
+    uint8_t *buf;
+    size_t pos;
+} ImageWriter;
+
+ST_FUNC size_t put(ImageWriter *w, const void *p, size_t n) {
+    size_t at = w->pos;
+    memcpy(w->buf + w->pos, p, n);
+    w->pos += n;
+    return at;
+}
+
+ST_FUNC void put_u8(ImageWriter *w, uint8_t v) {
+    w->buf[w->pos++] = v;
+}
+
+ST_FUNC void put_u32(ImageWriter *w, uint32_t v) {
+    put(w, &v, sizeof(v));
+}
+
+ST_FUNC void put_align(ImageWriter *w, size_t a) {
+    while (w->pos % a)
+        w->buf[w->pos++] = 0;       /* DW_CFA_nop inside .eh_frame */
+}
+
+ST_FUNC void patch_u32(ImageWriter *w, size_t at, uint32_t v) {
+    memcpy(w->buf + at, &v, sizeof(v));
+}
+
+ST_FUNC void write_eh_frame(ImageWriter *w, size_t code_size) {
+    size_t cie = w->pos;
+    put_u32(w, 0);                  /* length, patched below */
+    put_u32(w, 0);                  /* CIE id */
+    put_u8(w, 1);                   /* version */
+    put(w, "zR", 3);
+    put_u8(w, 1);                   /* code alignment factor */
+    put_u8(w, 0x78);                /* data alignment factor, sleb128 -8 */
+    put_u8(w, DWARF_REG_RIP);       /* return address column */
+    put_u8(w, 1);                   /* augmentation data length */
+    put_u8(w, DW_EH_PE_textrel | DW_EH_PE_udata4);
+    put_u8(w, DW_CFA_def_cfa);
+    put_u8(w, DWARF_REG_RSP);
+    put_u8(w, 8);
+    put_u8(w, DW_CFA_offset | DWARF_REG_RIP);
+    put_u8(w, 1);                   /* at CFA - 8 */
+    put_align(w, 8);
+    patch_u32(w, cie, (uint32_t)(w->pos - cie - 4));
+
+    size_t fde = w->pos;
+    put_u32(w, 0);
+    put_u32(w, (uint32_t)(w->pos - cie));   /* back to the CIE */
+    put_u32(w, 0);                  /* initial location, relative to .text */
+    put_u32(w, (uint32_t)code_size);
+    put_u8(w, 0);                   /* augmentation data length */
+    put_align(w, 8);
+    patch_u32(w, fde, (uint32_t)(w->pos - fde - 4));
+
+    put_u32(w, 0);                  /* terminator */
+}
+
+/* Returns the image size; writes only when w->buf is set */
+ST_FUNC size_t build_image(ImageWriter *w, const void *code, size_t size, const char *name) {
+    static const char shstrtab[] = "\0.text\0.eh_frame\0.shstrtab\0.strtab\0.symtab";
+    static const char file[] = "pocol-jit";
+    ElfSection sh[SECT_COUNT];
+    ElfHeader eh;
+    size_t name_len = strlen(name) + 1;
+
+    if (!w->buf) {
+        /* fixed parts plus slack for alignment, measured generously */
+        return sizeof(ElfHeader) + 64 + sizeof(shstrtab) + 1 + sizeof(file) + name_len +
+               8 + 3 * sizeof(ElfSymbol) + 8 + SECT_COUNT * sizeof(ElfSection);
+    }
+
+    memset(sh, 0, sizeof(sh));
+    memset(&eh, 0, sizeof(eh));
+    w->pos = sizeof(ElfHeader);
+
+    sh[SECT_TEXT].sh_name = 1;
+    sh[SECT_TEXT].sh_type = SHT_NOBITS_;
+    sh[SECT_TEXT].sh_flags = SHF_ALLOC_ | SHF_EXECINSTR_;
+    sh[SECT_TEXT].sh_addr = (uint64_t)(uintptr_t)code;
+    sh[SECT_TEXT].sh_size = size;
+    sh[SECT_TEXT].sh_addralign = 1;
+
+    put_align(w, 8);
+    sh[SECT_EHFRAME].sh_name = 7;
+    sh[SECT_EHFRAME].sh_type = SHT_PROGBITS_;
+    sh[SECT_EHFRAME].sh_flags = SHF_ALLOC_;
+    sh[SECT_EHFRAME].sh_offset = w->pos;
+    write_eh_frame(w, size);
+    sh[SECT_EHFRAME].sh_size = w->pos - sh[SECT_EHFRAME].sh_offset;
+    sh[SECT_EHFRAME].sh_addralign = 8;
+
+    sh[SECT_SHSTRTAB].sh_name = 17;
+    sh[SECT_SHSTRTAB].sh_type = SHT_STRTAB_;
+    sh[SECT_SHSTRTAB].sh_offset = put(w, shstrtab, sizeof(shstrtab));
+    sh[SECT_SHSTRTAB].sh_size = sizeof(shstrtab);
+    sh[SECT_SHSTRTAB].sh_addralign = 1;
+
+    sh[SECT_STRTAB].sh_name = 27;
+    sh[SECT_STRTAB].sh_type = SHT_STRTAB_;
+    sh[SECT_STRTAB].sh_offset = put(w, "", 1);
+    put(w, file, sizeof(file));
+    put(w, name, name_len);
+    sh[SECT_STRTAB].sh_size = w->pos - sh[SECT_STRTAB].sh_offset;
+    sh[SECT_STRTAB].sh_addralign = 1;
+
+    ElfSymbol sym[3];
+    memset(sym, 0, sizeof(sym));
+    sym[1].st_name = 1;
+    sym[1].st_info = STB_LOCAL_FILE;
+    sym[1].st_shndx = SHN_ABS_;
+    sym[2].st_name = 1 + sizeof(file);
+    sym[2].st_info = STB_GLOBAL_FUNC;
+    sym[2].st_shndx = SECT_TEXT;
+    sym[2].st_value = 0;            /* section relative */
+    sym[2].st_size = size;
+
+    put_align(w, 8);
+    sh[SECT_SYMTAB].sh_name = 35;
+    sh[SECT_SYMTAB].sh_type = SHT_SYMTAB_;
+    sh[SECT_SYMTAB].sh_offset = put(w, sym, sizeof(sym));
+    sh[SECT_SYMTAB].sh_size = sizeof(sym);
+    sh[SECT_SYMTAB].sh_link = SECT_STRTAB;
+    sh[SECT_SYMTAB].sh_info = 2;    /* first global */
+    sh[SECT_SYMTAB].sh_addralign = 8;
+    sh[SECT_SYMTAB].sh_entsize = sizeof(ElfSymbol);
+
+    put_align(w, 8);
+    eh.e_shoff = put(w, sh, sizeof(sh));
+
+    memcpy(eh.e_ident, "\177ELF", 4);
+    eh.e_ident[4] = 2;              /* ELFCLASS64 */
+    eh.e_ident[5] = 1;              /* ELFDATA2LSB */
+    eh.e_ident[6] = 1;              /* EV_CURRENT */
+    eh.e_type = ELF_TYPE_REL;
+    eh.e_machine = ELF_MACH_X86_64;
+    eh.e_version = 1;
+    eh.e_ehsize = sizeof(ElfHeader);
+    eh.e_shentsize = sizeof(ElfSection);
+    eh.e_shnum = SECT_COUNT;
+    eh.e_shstrndx = SECT_SHSTRTAB;
+    memcpy(w->buf, &eh, sizeof(eh));
+
+    return w->pos;
+}
+
+int jit_gdb_register(JitGdb *gdb, const void *code, size_t size, const char *name) {
+    ImageWriter w = { NULL, 0 };
+    size_t cap = build_image(&w, code, size, name);
+
+    JitGdbBlock *b = malloc(sizeof(JitGdbBlock) + cap);
+    if (!b) return -1;
+
+    w.buf = (uint8_t *)(b + 1);
+    size_t len = build_image(&w, code, size, name);
+
+    b->code = code;
+    b->entry.symfile_addr = (const char *)w.buf;
+    b->entry.symfile_size = len;
+    b->entry.prev_entry = NULL;
+    b->entry.next_entry = __jit_debug_descriptor.first_entry;
+    if (b->entry.next_entry)
+        b->entry.next_entry->prev_entry = &b->entry;
+    __jit_debug_descriptor.first_entry = &b->entry;
+    __jit_debug_descriptor.relevant_entry = &b->entry;
+    __jit_debug_descriptor.action_flag = JIT_REGISTER_FN;
+    __jit_debug_register_code();
+
+    b->next = gdb->blocks;
+    gdb->blocks = b;
+    gdb->count++;
+    return 0;
+}
+
+/* Take one block off the descriptor and tell GDB, then free it */
+static void jit_gdb_drop(JitGdbBlock *b) {
+    struct jit_code_entry *e = &b->entry;
+
+    if (e->prev_entry)
+        e->prev_entry->next_entry = e->next_entry;
+    else
+        __jit_debug_descriptor.first_entry = e->next_entry;
+    if (e->next_entry)
+        e->next_entry->prev_entry = e->prev_entry;
+
+    __jit_debug_descriptor.relevant_entry = e;
+    __jit_debug_descriptor.action_flag = JIT_UNREGISTER_FN;
+    __jit_debug_register_code();
+    __jit_debug_descriptor.relevant_entry = NULL;
+    __jit_debug_descriptor.action_flag = JIT_NOACTION;
+
+    free(b);
+}
+
+int jit_gdb_unregister(JitGdb *gdb, const void *code) {
+    for (JitGdbBlock **pp = &gdb->blocks; *pp; pp = &(*pp)->next) {
+        JitGdbBlock *b = *pp;
+        if (b->code == code) {
+            *pp = b->next;
+            gdb->count--;
+            jit_gdb_drop(b);
+            return 0;
+        }
+    }
+    return -1;
+}
+
+void jit_gdb_close(JitGdb *gdb) {
+    JitGdbBlock *b = gdb->blocks;
+    while (b) {
+        JitGdbBlock *next = b->next;
+        jit_gdb_drop(b);
+        b = next;
+    }
+    gdb->blocks = NULL;
+    gdb->count = 0;
+}
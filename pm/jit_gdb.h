@@ -0,0 +1,59 @@
+/* jit_gdb.h -- GDB JIT interface registration for compiled blocks */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_JIT_GDB_H
+#define POCOL_JIT_GDB_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* The interface GDB looks for by name (gdb/doc "JIT Interface").
+   These are process-wide; every JitContext hangs its blocks off the
+   same descriptor. */
+typedef enum {
+    JIT_NOACTION = 0,
+    JIT_REGISTER_FN,
+    JIT_UNREGISTER_FN
+} jit_actions_t;
+
+struct jit_code_entry {
+    struct jit_code_entry *next_entry;
+    struct jit_code_entry *prev_entry;
+    const char *symfile_addr;
+    uint64_t symfile_size;
+};
+
+struct jit_descriptor {
+    uint32_t version;
+    uint32_t action_flag;               /* jit_actions_t */
+    struct jit_code_entry *relevant_entry;
+    struct jit_code_entry *first_entry;
+};
+
+extern struct jit_descriptor __jit_debug_descriptor;
+void __jit_debug_register_code(void);
+
+struct JitGdbBlock;
+
+typedef struct {
+    int enabled;
+    struct JitGdbBlock *blocks;         /* registered by this context, newest first */
+    size_t count;
+} JitGdb;
+
+/* Hand one compiled block to GDB as an in-memory ELF object holding
+   a function symbol `name` over [code, code + size) and its unwind info */
+int jit_gdb_register(JitGdb *gdb, const void *code, size_t size, const char *name);
+
+/* Unregister the block whose machine code starts at `code`, -1 if this
+   context never registered one there */
+int jit_gdb_unregister(JitGdb *gdb, const void *code);
+
+/* Unregister and free every block this context registered */
+void jit_gdb_close(JitGdb *gdb);
+
+#endif /* POCOL_JIT_GDB_H */
@@ -0,0 +1,227 @@
+/* jit_perf.c -- Linux perf support for JIT code (perf map and jitdump) */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include "jit_perf.h"
+#include "vm_symbols.h"
+#include "vm_syscalls.h"
+#include "../common.h"
+#include <string.h>
+#include <errno.h>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+
+/* Two ways to tell perf what lives in the JIT code buffer:
+
+   perf map   perf report reads /tmp/perf-<pid>.map ("start size name")
+              to name samples that hit anonymous executable memory.
+
+   jitdump    the format from tools/perf/Documentation/jitdump-specification.txt.
+              Each block is written with its code bytes and a line table, and
+              the file is mmap'd PROT_EXEC once so `perf record -k mono` notes
+              where it is; `perf inject --jit` then turns every block into a
+              small ELF image that perf report/annotate understand. */
+
+#define JITDUMP_MAGIC           0x4A695444  /* "JiTD" */
+#define JITDUMP_VERSION         1
+#define JIT_CODE_LOAD           0
+#define JIT_CODE_DEBUG_INFO     2
+#define JIT_CODE_CLOSE          3
+
+#if defined(__x86_64__)
+#define JITDUMP_ELF_MACH        62          /* EM_X86_64 */
+#elif defined(__aarch64__)
+#define JITDUMP_ELF_MACH        183         /* EM_AARCH64 */
+#elif defined(__i386__)
+#define JITDUMP_ELF_MACH        3           /* EM_386 */
+#else
+#define JITDUMP_ELF_MACH        0
+#endif
+
+typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t total_size;
+    uint32_t elf_mach;
+    uint32_t pad1;
+    uint32_t pid;
+    uint64_t timestamp;
+    uint64_t flags;
+} JitDumpHeader;
+
+typedef struct {
+    uint32_t id;
+    uint32_t total_size;
+    uint64_t timestamp;         /* CLOCK_MONOTONIC, matches perf record -k mono */
+} JitDumpRecord;
+
+typedef struct {
+    uint32_t pid;
+    uint32_t tid;
+    uint64_t vma;
+    uint64_t code_addr;
+    uint64_t code_size;
+    uint64_t code_index;
+} JitDumpCodeLoad;
+
+typedef struct {
+    uint64_t code_addr;
+    uint64_t nr_entry;
+} JitDumpDebugInfo;
+
+typedef struct {
+    uint64_t addr;
+    int32_t lineno;
+    int32_t discrim;
+} JitDumpDebugEntry;
+
+#ifdef __linux__
+static int jit_perf_open_dump(JitPerf *perf) {
+    char path[64];
+    snprintf(path, sizeof(path), "/tmp/jit-%d.dump", (int)getpid());
+
+    /* plain stdio: vm_syscalls.h reuses the O_* names for guest flags */
+    perf->dump = fopen(path, "w+b");
+    if (!perf->dump) return -1;
+
+    JitDumpHeader h;
+    memset(&h, 0, sizeof(h));
+    h.magic = JITDUMP_MAGIC;
+    h.version = JITDUMP_VERSION;
+    h.total_size = sizeof(h);
+    h.elf_mach = JITDUMP_ELF_MACH;
+    h.pid = (uint32_t)getpid();
+    h.timestamp = pocol_clock_ns();
+    fwrite(&h, sizeof(h), 1, perf->dump);
+    if (fflush(perf->dump) != 0) return -1;
+
+    /* the marker: perf record only notes files that are mapped executable */
+    perf->marker_size = (size_t)sysconf(_SC_PAGESIZE);
+    perf->marker = mmap(NULL, perf->marker_size, PROT_READ | PROT_EXEC, MAP_PRIVATE,
+                        fileno(perf->dump), 0);
+    if (perf->marker == MAP_FAILED) {
+        perf->marker = NULL;
+        return -1;
+    }
+    return 0;
+}
+#endif
+
+int jit_perf_open(JitPerf *perf, int flags) {
+    memset(perf, 0, sizeof(JitPerf));
+#ifdef __linux__
+    if (flags & JIT_PERF_MAP) {
+        char path[64];
+        snprintf(path, sizeof(path), "/tmp/perf-%d.map", (int)getpid());
+        perf->map = fopen(path, "w");
+        if (!perf->map) return -1;
+    }
+    if ((flags & JIT_PERF_DUMP) && jit_perf_open_dump(perf) < 0) {
+        int saved = errno;
+        jit_perf_close(perf);
+        errno = saved;
+        return -1;
+    }
+    perf->flags = flags;
+    return 0;
+#else
+    (void)flags;
+    errno = ENOSYS;
+    return -1;
+#endif
+}
+
+#ifdef __linux__
+static void jit_perf_write_lines(JitPerf *perf, const void *code, const struct PocolSymbols *syms,
+                                 const JitPerfLine *lines, int line_count) {
+    const char *file = syms->source ? syms->source : "unknown.pcl";
+    size_t name_len = strlen(file) + 1;
+    JitDumpRecord rec;
+    JitDumpDebugInfo info;
+
+    rec.id = JIT_CODE_DEBUG_INFO;
+    rec.total_size = (uint32_t)(sizeof(rec) + sizeof(info) +
+                                line_count * (sizeof(JitDumpDebugEntry) + name_len));
+    rec.timestamp = pocol_clock_ns();
+    info.code_addr = (uint64_t)(uintptr_t)code;
+    info.nr_entry = (uint64_t)line_count;
+    fwrite(&rec, sizeof(rec), 1, perf->dump);
+    fwrite(&info, sizeof(info), 1, perf->dump);
+
+    for (int i = 0; i < line_count; i++) {
+        JitDumpDebugEntry e;
+        e.addr = (uint64_t)(uintptr_t)code + lines[i].offset;
+        e.lineno = (int32_t)symbols_line(syms, lines[i].pc);
+        e.discrim = 0;
+        fwrite(&e, sizeof(e), 1, perf->dump);
+        fwrite(file, 1, name_len, perf->dump);
+    }
+}
+#endif
+
+void jit_perf_code_load(JitPerf *perf, const void *code, size_t size, const char *name,
+                        const struct PocolSymbols *syms,
+                        const JitPerfLine *lines, int line_count) {
+    if (perf->map) {
+        fprintf(perf->map, "%llx %zx %s\n", (unsigned long long)(uintptr_t)code, size, name);
+        fflush(perf->map);
+    }
+
+#ifdef __linux__
+    if (perf->dump) {
+        /* debug info must come before the load record it describes */
+        if (syms && lines && line_count > 0)
+            jit_perf_write_lines(perf, code, syms, lines, line_count);
+
+        JitDumpRecord rec;
+        JitDumpCodeLoad load;
+        size_t name_len = strlen(name) + 1;
+
+        rec.id = JIT_CODE_LOAD;
+        rec.total_size = (uint32_t)(sizeof(rec) + sizeof(load) + name_len + size);
+        rec.timestamp = pocol_clock_ns();
+        load.pid = (uint32_t)getpid();
+        load.tid = (uint32_t)syscall(SYS_gettid);
+        load.vma = (uint64_t)(uintptr_t)code;
+        load.code_addr = (uint64_t)(uintptr_t)code;
+        load.code_size = size;
+        load.code_index = perf->code_index++;
+        fwrite(&rec, sizeof(rec), 1, perf->dump);
+        fwrite(&load, sizeof(load), 1, perf->dump);
+        fwrite(name, 1, name_len, perf->dump);
+        fwrite(code, 1, size, perf->dump);
+        fflush(perf->dump);
+    }
+#else
+    (void)lines; (void)line_count;
+#endif
+}
+
+void jit_perf_close(JitPerf *perf) {
+    if (perf->map) {
+        fclose(perf->map);
+    }
+#ifdef __linux__
+    if (perf->dump) {
+        JitDumpRecord rec;
+        rec.id = JIT_CODE_CLOSE;
+        rec.total_size = sizeof(rec);
+        rec.timestamp = pocol_clock_ns();
+        fwrite(&rec, sizeof(rec), 1, perf->dump);
+        fclose(perf->dump);
+    }
+    if (perf->marker) {
+        munmap(perf->marker, perf->marker_size);
+    }
+#endif
+    memset(perf, 0, sizeof(JitPerf));
+}
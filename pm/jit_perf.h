@@ -0,0 +1,49 @@
+/* jit_perf.h -- Linux perf support for JIT code (perf map and jitdump) */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_JIT_PERF_H
+#define POCOL_JIT_PERF_H
+
+#include "vm.h"
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+struct PocolSymbols;
+
+#define JIT_PERF_MAX_LINES  256     /* line entries recorded per block */
+
+/* jit_perf_open() flags */
+#define JIT_PERF_MAP        0x01    /* /tmp/perf-<pid>.map, names only */
+#define JIT_PERF_DUMP       0x02    /* /tmp/jit-<pid>.dump, code bytes and line info for perf inject */
+
+/* Guest instruction start inside a compiled block */
+typedef struct {
+    Inst_Addr pc;
+    uint32_t offset;        /* bytes from the start of the block's machine code */
+} JitPerfLine;
+
+typedef struct {
+    int flags;
+    FILE *map;
+    FILE *dump;
+    void *marker;           /* executable mapping of the dump perf record looks for */
+    size_t marker_size;
+    uint64_t code_index;
+} JitPerf;
+
+/* Returns 0, or -1 with errno set (ENOSYS off Linux) */
+int jit_perf_open(JitPerf *perf, int flags);
+
+/* Describe a freshly compiled block called `name`. `lines` may be NULL */
+void jit_perf_code_load(JitPerf *perf, const void *code, size_t size, const char *name,
+                        const struct PocolSymbols *syms,
+                        const JitPerfLine *lines, int line_count);
+
+void jit_perf_close(JitPerf *perf);
+
+#endif /* POCOL_JIT_PERF_H */
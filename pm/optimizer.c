@@ -11,13 +11,16 @@
 #include <stdlib.h>
 #include <string.h>
 
+/* The .pob header stays in guest memory in front of the code */
+#define POCOL_MAGIC_SIZE sizeof(PocolHeader)
+
 /* Instruction analysis structure */
 typedef struct {
     Inst_Type type;
     uint8_t desc;
     uint8_t operands[2][9];  /* Up to 9 bytes per operand (1 reg + 8 imm) */
     size_t operand_sizes[2];
-    Inst_Addr pc;
+    Inst_Addr pc;            /* the instruction after this one */
 } AnalyzedInst;
 
 /* Read an instruction and its operands */
@@ -26,7 +29,6 @@ static Err read_instruction(PocolVM *vm, Inst_Addr pc, AnalyzedInst *inst) {
         return ERR_ILLEGAL_INST_ACCESS;
     }
     
-    inst->pc = pc;
     inst->type = (Inst_Type)vm->memory[pc++];
     
     if (pc >= POCOL_MEMORY_SIZE) {
@@ -79,6 +81,7 @@ static Err read_instruction(PocolVM *vm, Inst_Addr pc, AnalyzedInst *inst) {
         inst->operand_sizes[1] = 0;
     }
     
+    inst->pc = pc;
     return ERR_OK;
 }
 
@@ -1,8 +1,49 @@
 #include "vm.h"
 #include "vm_debugger.h"
+#include "vm_sampler.h"
+#include "vm_symbols.h"
+#include "jit.h"
+#include "vm_histogram.h"
+#include "vm_trace.h"
+#include "vm_metrics.h"
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
+#include <errno.h>
+
+/* Hex address, or a label when the program has a .map */
+static int parse_address(PocolVM *vm, const char *text, Inst_Addr *addr) {
+    unsigned long long value;
+    char *end;
+    int64_t label = symbols_find(vm->symbols, text);
+    
+    if (label >= 0) {
+        *addr = (Inst_Addr)label;
+        return 0;
+    }
+    value = strtoull(text, &end, 16);
+    if (end == text || *end != '\0') return -1;
+    *addr = (Inst_Addr)value;
+    return 0;
+}
+
+/* "ADDR [SIZE]" for the watch commands, SIZE in bytes (8 by default) */
+static void debugger_watch_command(DebuggerContext *ctx, const char *args, WatchType type) {
+    char text[128];
+    unsigned long long size = 8;
+    Inst_Addr addr = 0;
+    char where[128];
+    
+    if (sscanf(args, "%127s %llu", text, &size) < 1 || parse_address(ctx->vm, text, &addr) < 0) {
+        printf("No such address or label: %s\n", args);
+        return;
+    }
+    if (debugger_add_watchpoint(ctx, addr, size, type) < 0) {
+        printf("Cannot watch %llu bytes at %s\n", size, text);
+        return;
+    }
+    printf("Watchpoint added at %s (%llu bytes)\n", symbols_format(ctx->vm->symbols, addr, where, sizeof(where)), size);
+}
 
 /* Debugger command */
 static void debugger_command(DebuggerContext *ctx, const char *cmd) {
@@ -27,12 +68,91 @@ static void debugger_command(DebuggerContext *ctx, const char *cmd) {
         sscanf(cmd + 2, "%d 0x%X", &count, &addr);
         debugger_show_memory(ctx, addr, count);
     } else if (strncmp(cmd, "break ", 6) == 0) {
+        /* break ADDR [if EXPR] */
+        Inst_Addr addr = 0;
+        char where[128], text[128], err[192];
+        const char *cond = strstr(cmd + 6, " if ");
+        int index;
+        snprintf(text, sizeof(text), "%.*s", cond ? (int)(cond - cmd - 6) : (int)strlen(cmd + 6), cmd + 6);
+        if (parse_address(ctx->vm, text, &addr) < 0) {
+            printf("No such address or label: %s\n", text);
+            return;
+        }
+        if (cond) {
+            if ((index = debugger_add_conditional(ctx, addr, cond + 4, err, sizeof(err))) < 0) {
+                printf("Bad condition: %s\n", err);
+                return;
+            }
+        } else if ((index = debugger_add_breakpoint(ctx, addr)) < 0) {
+            printf("Too many breakpoints\n");
+            return;
+        }
+        printf("Breakpoint %d added at %s\n", index, symbols_format(ctx->vm->symbols, addr, where, sizeof(where)));
+    } else if (strncmp(cmd, "condition ", 10) == 0) {
+        /* condition N [EXPR], no EXPR makes it unconditional */
+        int index, used = 0;
+        char err[192];
+        if (sscanf(cmd + 10, "%d%n", &index, &used) != 1) {
+            printf("Usage: condition N [EXPR]\n");
+        } else if (debugger_set_condition(ctx, index, cmd + 10 + used + strspn(cmd + 10 + used, " "), err, sizeof(err)) < 0) {
+            printf("Bad condition: %s\n", err);
+        }
+    } else if (strncmp(cmd, "log ", 4) == 0) {
+        /* log ADDR TEXT, {EXPR} in TEXT replaced by its value */
+        Inst_Addr addr = 0;
+        char text[128], where[128], err[192];
+        int used = 0, index;
+        if (sscanf(cmd + 4, "%127s%n", text, &used) != 1 || parse_address(ctx->vm, text, &addr) < 0) {
+            printf("No such address or label: %s\n", cmd + 4);
+            return;
+        }
+        if ((index = debugger_add_logpoint(ctx, addr, cmd + 4 + used + strspn(cmd + 4 + used, " "), err, sizeof(err))) < 0) {
+            printf("Bad logpoint: %s\n", err);
+            return;
+        }
+        printf("Logpoint %d added at %s\n", index, symbols_format(ctx->vm->symbols, addr, where, sizeof(where)));
+    } else if (strncmp(cmd, "delete ", 7) == 0) {
         Inst_Addr addr = 0;
-        sscanf(cmd + 6, "%X", &addr);
-        debugger_add_breakpoint(ctx, addr);
-        printf("Breakpoint added at 0x%04X\n", addr);
+        if (parse_address(ctx->vm, cmd + 7, &addr) < 0 || debugger_remove_breakpoint(ctx, addr) < 0)
+            printf("No breakpoint at %s\n", cmd + 7);
+    } else if (strncmp(cmd, "watch ", 6) == 0) {
+        debugger_watch_command(ctx, cmd + 6, WATCH_WRITE);
+    } else if (strncmp(cmd, "rwatch ", 7) == 0) {
+        debugger_watch_command(ctx, cmd + 7, WATCH_READ);
+    } else if (strncmp(cmd, "awatch ", 7) == 0) {
+        debugger_watch_command(ctx, cmd + 7, WATCH_ACCESS);
+    } else if (strncmp(cmd, "unwatch ", 8) == 0) {
+        Inst_Addr addr = 0;
+        if (parse_address(ctx->vm, cmd + 8, &addr) < 0 || debugger_remove_watchpoint(ctx, addr) < 0)
+            printf("No watchpoint at %s\n", cmd + 8);
+    } else if (strcmp(cmd, "record stop") == 0) {
+        debugger_record_stop(ctx);
+        printf("Recording stopped\n");
+    } else if (strcmp(cmd, "record") == 0 || strncmp(cmd, "record ", 7) == 0) {
+        unsigned long long interval = 0;
+        char where[128];
+        if (cmd[6] && sscanf(cmd + 7, "%llu", &interval) != 1) {
+            printf("Usage: record [INTERVAL]\n");
+        } else if (debugger_record(ctx, interval) < 0) {
+            printf(ctx->replay ? "Already recording\n" : "Cannot record: out of memory\n");
+        } else {
+            if (ctx->jit) printf("Recording runs in the interpreter, --jit is off until `record stop`\n");
+            printf("Recording from %s\n", symbols_format(ctx->vm->symbols, ctx->vm->pc, where, sizeof(where)));
+        }
+    } else if (strcmp(cmd, "rs") == 0 || strncmp(cmd, "rs ", 3) == 0 ||
+               strcmp(cmd, "reverse-step") == 0 || strncmp(cmd, "reverse-step ", 13) == 0) {
+        const char *arg = strchr(cmd, ' ');
+        unsigned long long count = 1;
+        if (arg) sscanf(arg, "%llu", &count);
+        debugger_reverse_step(ctx, count);
+    } else if (strcmp(cmd, "rc") == 0 || strcmp(cmd, "reverse-continue") == 0) {
+        debugger_reverse_continue(ctx);
+    } else if (strcmp(cmd, "info record") == 0) {
+        debugger_show_record(ctx);
     } else if (strcmp(cmd, "info breakpoints") == 0) {
         debugger_list_breakpoints(ctx);
+    } else if (strcmp(cmd, "info watchpoints") == 0) {
+        debugger_list_watchpoints(ctx);
     } else if (strcmp(cmd, "info registers") == 0) {
         debugger_show_registers(ctx);
     } else if (strcmp(cmd, "info stack") == 0) {
@@ -48,8 +168,21 @@ static void debugger_command(DebuggerContext *ctx, const char *cmd) {
         printf("p, print     - Show registers\n");
         printf("bt           - Show call stack\n");
         printf("x/N ADDR     - Examine memory\n");
-        printf("break ADDR   - Set breakpoint\n");
+        printf("break ADDR [if EXPR] - Set breakpoint (hex or label), stopping only where EXPR holds\n");
+        printf("condition N [EXPR] - Set or clear breakpoint N's condition\n");
+        printf("log ADDR TEXT - Print TEXT at ADDR and go on, {EXPR} replaced by its value\n");
+        printf("delete ADDR  - Remove breakpoint or logpoint\n");
+        printf("watch ADDR [N] - Stop when N bytes at ADDR change (default 8)\n");
+        printf("rwatch ADDR [N] - Stop when they are read by a syscall\n");
+        printf("awatch ADDR [N] - Stop on either\n");
+        printf("unwatch ADDR - Remove watchpoint\n");
+        printf("record [N]   - Record for reverse execution, snapshot every N instructions\n");
+        printf("record stop  - Drop the recording\n");
+        printf("rs, reverse-step [N] - Step N instructions back\n");
+        printf("rc, reverse-continue - Back to the previous breakpoint hit\n");
+        printf("info record  - Show recording state\n");
         printf("info breakpoints - List breakpoints\n");
+        printf("info watchpoints - List watchpoints\n");
         printf("info registers   - Show registers\n");
         printf("info stack      - Show stack\n");
         printf("q, quit       - Quit debugger\n");
@@ -63,29 +196,36 @@ static void debugger_command(DebuggerContext *ctx, const char *cmd) {
 static void debugger_loop(DebuggerContext *ctx) {
     char cmd[256];
     
-    while (ctx->running && !ctx->vm->halt) {
+    /* Start stopped at the entry point */
+    ctx->mode = DEBUG_MODE_BREAK;
+    
+    /* a recording can still be stepped back from HALT */
+    while (ctx->running && (!ctx->vm->halt || ctx->replay)) {
         debugger_show_state(ctx);
         debugger_prompt(ctx);
         
-        if (fgets(cmd, sizeof(cmd), stdin)) {
-            /* Remove newline */
-            size_t len = strlen(cmd);
-            if (len > 0 && cmd[len-1] == '\n') {
-                cmd[len-1] = '\0';
-            }
-            
-            if (strlen(cmd) > 0) {
-                debugger_command(ctx, cmd);
-            }
+        if (!fgets(cmd, sizeof(cmd), stdin)) {
+            debugger_stop(ctx);  /* EOF */
+            break;
+        }
+        
+        /* Remove newline */
+        size_t len = strlen(cmd);
+        if (len > 0 && cmd[len-1] == '\n') {
+            cmd[len-1] = '\0';
+        }
+        
+        if (strlen(cmd) > 0) {
+            debugger_command(ctx, cmd);
         }
         
-        /* Execute while not stopped */
+        /* run, continue and step leave BREAK mode: execute until stopped */
         if (ctx->mode != DEBUG_MODE_BREAK) {
-            debugger_continue(ctx);
+            debugger_resume(ctx);
         }
     }
     
-    printf("\nProgram finished (halted)\n");
+    printf(ctx->vm->halt ? "\nProgram finished (halted)\n" : "\nDebugger exited\n");
 }
 
 int main(int argc, char **argv)
@@ -93,9 +233,21 @@ int main(int argc, char **argv)
 	if (argc < 2) {
 		pocol_error("usage: %s <program.pob> [options]\n", argv[0]);
 		pocol_error("  --jit       : Enable JIT compilation\n");
-		pocol_error("  --stats     : Show JIT statistics\n");
+		pocol_error("  --stats     : Show JIT and syscall statistics on stderr\n");
 		pocol_error("  --debug     : Enable debugger\n");
-		pocol_error("  --break ADDR: Set initial breakpoint\n");
+		pocol_error("  --break=ADDR: Set initial breakpoint (hex or label)\n");
+		pocol_error("  --buffer=MODE: Console buffering (line, full, none)\n");
+		pocol_error("  --max-files=N: Open file limit (default %d)\n", VFS_DEFAULT_FD_LIMIT);
+		pocol_error("  --plugin=LIB: Load native syscalls from a shared library\n");
+		pocol_error("  --regions=FMT: Dump SYS_PROF_BEGIN/END regions to stderr (text, json)\n");
+		pocol_error("  --profile=FILE: Sample guest pcs into a flame graph (collapsed stacks)\n");
+		pocol_error("  --profile-hz=N: Sampling rate (default %d)\n", SAMPLER_DEFAULT_HZ);
+		pocol_error("  --perf-map  : Name JIT blocks for perf in /tmp/perf-<pid>.map\n");
+		pocol_error("  --jitdump   : Write /tmp/jit-<pid>.dump for perf inject --jit\n");
+		pocol_error("  --gdb-jit   : Register JIT blocks with an attached GDB\n");
+		pocol_error("  --trace=FILE: Record a binary execution trace (read it with tools/pmtrace)\n");
+		pocol_error("  --metrics=FMT[:DEST]: Export run metrics (json, prometheus) to stderr, a file or fd:N\n");
+		pocol_error("  --histogram[=FMT]: Dump opcode and opcode-pair counts to stderr (text, json; make histogram)\n");
 		return 1;
 	}
 	
@@ -104,7 +256,20 @@ int main(int argc, char **argv)
 	int debug_enabled = 0;
 	const char *program_path = NULL;
 	int limit = -1;
-	Inst_Addr initial_break = 0xFFFFFFFF;
+	const char *initial_break = NULL;
+	int console_policy = -1;
+	int max_files = -1;
+	const char *plugins[SYS_MAX_PLUGINS];
+	int plugin_count = 0;
+	int regions = PROF_DUMP_NONE;
+	const char *profile_path = NULL;
+	int profile_hz = SAMPLER_DEFAULT_HZ;
+	int perf_flags = 0;
+	int gdb_jit = 0;
+	int histogram = HIST_DUMP_NONE;
+	const char *trace_path = NULL;
+	PocolMetrics metrics;
+	int metrics_enabled = 0;
 	
 	/* Parse arguments */
 	for (int i = 1; i < argc; i++) {
@@ -112,10 +277,78 @@ int main(int argc, char **argv)
 			jit_enabled = 1;
 		} else if (strcmp(argv[i], "--stats") == 0) {
 			show_stats = 1;
+		} else if (strcmp(argv[i], "--perf-map") == 0) {
+			perf_flags |= JIT_PERF_MAP;
+		} else if (strcmp(argv[i], "--jitdump") == 0) {
+			perf_flags |= JIT_PERF_DUMP;
+		} else if (strcmp(argv[i], "--gdb-jit") == 0) {
+			gdb_jit = 1;
 		} else if (strcmp(argv[i], "--debug") == 0) {
 			debug_enabled = 1;
 		} else if (strncmp(argv[i], "--break=", 8) == 0) {
-			sscanf(argv[i] + 8, "%X", &initial_break);
+			initial_break = argv[i] + 8;
+		} else if (strncmp(argv[i], "--buffer=", 9) == 0) {
+			const char *mode = argv[i] + 9;
+			if (strcmp(mode, "line") == 0)
+				console_policy = CONSOLE_LINE_BUFFERED;
+			else if (strcmp(mode, "full") == 0)
+				console_policy = CONSOLE_FULL_BUFFERED;
+			else if (strcmp(mode, "none") == 0)
+				console_policy = CONSOLE_UNBUFFERED;
+			else {
+				pocol_error("unknown buffer mode: %s\n", mode);
+				return 1;
+			}
+		} else if (strncmp(argv[i], "--max-files=", 12) == 0) {
+			max_files = atoi(argv[i] + 12);
+			if (max_files < 3) {
+				pocol_error("invalid file limit: %s\n", argv[i] + 12);
+				return 1;
+			}
+		} else if (strncmp(argv[i], "--plugin=", 9) == 0) {
+			if (plugin_count == SYS_MAX_PLUGINS) {
+				pocol_error("too many plugins\n");
+				return 1;
+			}
+			plugins[plugin_count++] = argv[i] + 9;
+		} else if (strncmp(argv[i], "--regions=", 10) == 0) {
+			const char *fmt = argv[i] + 10;
+			if (strcmp(fmt, "text") == 0)
+				regions = PROF_DUMP_TEXT;
+			else if (strcmp(fmt, "json") == 0)
+				regions = PROF_DUMP_JSON;
+			else {
+				pocol_error("unknown region format: %s\n", fmt);
+				return 1;
+			}
+		} else if (strncmp(argv[i], "--metrics=", 10) == 0) {
+			if (metrics_parse(&metrics, argv[i] + 10) < 0) {
+				pocol_error("invalid metrics spec: %s (json or prometheus, optionally :PATH or :fd:N)\n", argv[i] + 10);
+				return 1;
+			}
+			metrics_enabled = 1;
+		} else if (strncmp(argv[i], "--trace=", 8) == 0) {
+			trace_path = argv[i] + 8;
+		} else if (strcmp(argv[i], "--histogram") == 0) {
+			histogram = HIST_DUMP_TEXT;
+		} else if (strncmp(argv[i], "--histogram=", 12) == 0) {
+			const char *fmt = argv[i] + 12;
+			if (strcmp(fmt, "text") == 0)
+				histogram = HIST_DUMP_TEXT;
+			else if (strcmp(fmt, "json") == 0)
+				histogram = HIST_DUMP_JSON;
+			else {
+				pocol_error("unknown histogram format: %s\n", fmt);
+				return 1;
+			}
+		} else if (strncmp(argv[i], "--profile=", 10) == 0) {
+			profile_path = argv[i] + 10;
+		} else if (strncmp(argv[i], "--profile-hz=", 13) == 0) {
+			profile_hz = atoi(argv[i] + 13);
+			if (profile_hz <= 0) {
+				pocol_error("invalid sampling rate: %s\n", argv[i] + 13);
+				return 1;
+			}
 		} else if (argv[i][0] == '-') {
 			pocol_error("unknown option: %s\n", argv[i]);
 			return 1;
@@ -131,19 +364,100 @@ int main(int argc, char **argv)
 		return 1;
 	}
 	
+	if ((perf_flags || gdb_jit) && !jit_enabled) {
+		pocol_error("--perf-map, --jitdump and --gdb-jit need --jit\n");
+		return 1;
+	}
+	
+	if (histogram != HIST_DUMP_NONE && !hist_available()) {
+		pocol_error("--histogram: not built in, rebuild with `make histogram`\n");
+		return 1;
+	}
+	if (histogram != HIST_DUMP_NONE && jit_enabled) {
+		pocol_error("--histogram counts the interpreter, run without --jit\n");
+		return 1;
+	}
+	
 	PocolVM *vm = NULL;
 	Err err = ERR_OK;
 	
 	if (pocol_load_program_into_vm(program_path, &vm) == 0) {
+		if (console_policy >= 0 && vm->syscall_ctx)
+			console_set_policy(&vm->syscall_ctx->console, (ConsolePolicy)console_policy);
+		if (max_files > 0 && vm->syscall_ctx)
+			vfs_set_fd_limit(&vm->syscall_ctx->vfs, max_files);
+		for (int i = 0; i < plugin_count && vm->syscall_ctx; i++) {
+			if (syscalls_load_plugin(vm->syscall_ctx, plugins[i]) < 0) {
+				pocol_free_vm(vm);
+				return 1;
+			}
+		}
+
+		if (perf_flags) {
+			JitContext *jit = pocol_jit_context(vm);
+			if (!jit || jit_perf_open(&jit->perf, perf_flags) < 0) {
+				pocol_error("perf output: %s\n", strerror(errno));
+				pocol_free_vm(vm);
+				return 1;
+			}
+		}
+		if (gdb_jit) {
+			JitContext *jit = pocol_jit_context(vm);
+			if (!jit) {
+				pocol_free_vm(vm);
+				return 1;
+			}
+			jit->gdb.enabled = 1;
+		}
+
+		if (histogram != HIST_DUMP_NONE && !(vm->histogram = hist_new())) {
+			pocol_error("--histogram: %s\n", strerror(errno));
+			pocol_free_vm(vm);
+			return 1;
+		}
+
+		PocolTrace trace;
+		if (trace_path && trace_open(&trace, vm, trace_path, jit_enabled ? TRACE_FLAG_JIT : 0) < 0) {
+			pocol_error("--trace: %s: %s\n", trace_path, strerror(errno));
+			pocol_free_vm(vm);
+			return 1;
+		}
+
+		PocolSampler sampler;
+		if (profile_path && sampler_start(&sampler, vm, profile_hz) < 0) {
+			pocol_error("--profile: %s\n", strerror(errno));
+			if (trace_path)
+				trace_close(&trace);
+			pocol_free_vm(vm);
+			return 1;
+		}
+
+		if (metrics_enabled)
+			metrics_begin(&metrics, vm);
+
 		if (debug_enabled) {
 			/* Initialize debugger */
 			DebuggerContext debugger;
 			debugger_init(&debugger, vm);
+			if (jit_enabled && debugger_use_jit(&debugger) < 0)
+				pocol_error("--jit: unavailable, debugging in the interpreter\n");
 			
 			/* Set initial breakpoint if specified */
-			if (initial_break != 0xFFFFFFFF) {
-				debugger_add_breakpoint(&debugger, initial_break);
-				printf("Initial breakpoint at 0x%04X\n", initial_break);
+			if (initial_break) {
+				Inst_Addr addr;
+				char where[128];
+				if (parse_address(vm, initial_break, &addr) < 0) {
+					pocol_error("--break: no such address or label: %s\n", initial_break);
+					debugger_free(&debugger);
+					if (profile_path)
+						sampler_free(&sampler);
+					if (trace_path)
+						trace_close(&trace);
+					pocol_free_vm(vm);
+					return 1;
+				}
+				debugger_add_breakpoint(&debugger, addr);
+				printf("Initial breakpoint at %s\n", symbols_format(vm->symbols, addr, where, sizeof(where)));
 			}
 			
 			/* Enter debugger loop */
@@ -154,11 +468,42 @@ int main(int argc, char **argv)
 			/* Normal execution */
 			err = pocol_execute_program_jit(vm, limit, jit_enabled);
 			
+			if (show_stats && vm->syscall_ctx) {
+				syscalls_print_stats(vm->syscall_ctx);
+			}
 			if (show_stats && vm->jit_context) {
-				pocol_jit_print_stats((JitContext*)vm->jit_context);
+				pocol_jit_print_stats((JitContext*)vm->jit_context, vm);
 			}
 		}
 		
+		if (profile_path) {
+			sampler_stop(&sampler);
+			if (sampler_write_folded(&sampler, profile_path) < 0)
+				pocol_error("%s: %s\n", profile_path, strerror(errno));
+			else if (sampler.dropped)
+				pocol_error("profile: %llu of %llu samples dropped\n",
+					    (unsigned long long)sampler.dropped,
+					    (unsigned long long)(sampler.samples + sampler.dropped));
+			sampler_free(&sampler);
+		}
+		
+		if (trace_path && trace_close(&trace) < 0)
+			pocol_error("--trace: %s: %s\n", trace_path, strerror(errno));
+		
+		if (metrics_enabled && metrics_write(&metrics, vm, program_path, err) < 0)
+			pocol_error("--metrics: %s: %s\n", metrics.path ? metrics.path : "write", strerror(errno));
+		
+		if (regions != PROF_DUMP_NONE && vm->syscall_ctx) {
+			console_flush(&vm->syscall_ctx->console);
+			prof_dump(&vm->syscall_ctx->profile, stderr, regions);
+		}
+		
+		if (vm->histogram) {
+			if (vm->syscall_ctx)
+				console_flush(&vm->syscall_ctx->console);
+			hist_dump(vm->histogram, stderr, histogram);
+		}
+		
 		pocol_free_vm(vm);
 	}
 	
@@ -2,9 +2,27 @@
 
 /* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean */
 
+#define _DEFAULT_SOURCE
+#include "vm.h"
+#include "vm_memory.h"
+#include "vm_predicate.h"
+#include "vm_debugger.h"
+#include "vm_trace.h"
+#include "vm_replay.h"
+#include "jit.h"
+#include "vm_metrics.h"
+#include "vm_symbols.h"
+#include "vm_sampler.h"
+/* hist_count() is only in the header for histogram builds; the test
+   drives it directly whatever the library was built with */
+#define POCOL_HISTOGRAM
+#include "vm_histogram.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <signal.h>
 
 /* Simple test macros */
 #define TEST_ASSERT(cond, msg) do { \
@@ -22,6 +40,93 @@ static int total = 0;
 static int passed = 0;
 static int failed = 0;
 
+/* Guest scratch area for paths and buffers, well past the test programs */
+#define TEST_DATA   0x1000
+
+/* Load `code` the way pm does: a .pob file, header in front */
+static PocolVM *test_vm_new(const uint8_t *code, size_t size) {
+    char path[] = "/tmp/pocol_test_XXXXXX";
+    PocolHeader header = { POCOL_MAGIC, POCOL_VERSION, sizeof(PocolHeader), size };
+    PocolVM *vm = NULL;
+    int fd = mkstemp(path);
+    if (fd < 0) return NULL;
+    if (write(fd, &header, sizeof(header)) == (ssize_t)sizeof(header) &&
+        write(fd, code, size) == (ssize_t)size)
+        pocol_load_program_into_vm(path, &vm);
+    close(fd);
+    unlink(path);
+    return vm;
+}
+
+/* What a SYS instruction does with r0 = num and r1-r4 = a..d; r0 after */
+static int64_t test_sys(PocolVM *vm, int num, int64_t a, int64_t b, int64_t c, int64_t d) {
+    vm->registers[1] = a;
+    vm->registers[2] = b;
+    vm->registers[3] = c;
+    vm->registers[4] = d;
+    syscalls_exec(vm->syscall_ctx, vm, num);
+    return (int64_t)vm->registers[0];
+}
+
+/* Put a NUL terminated string at guest address addr, returns its length */
+static int64_t test_poke_str(PocolVM *vm, uint64_t addr, const char *s) {
+    memcpy(vm->memory + addr, s, strlen(s) + 1);
+    return (int64_t)strlen(s);
+}
+
+/* A host file holding `data` */
+static int test_host_file(char *path, const char *data) {
+    int fd = mkstemp(path);
+    if (fd < 0) return -1;
+    ssize_t n = write(fd, data, strlen(data));
+    close(fd);
+    return n == (ssize_t)strlen(data) ? 0 : -1;
+}
+
+static const uint8_t halt_code[] = { INST_HALT, 0 };
+
+/* The debugger's one-bit-per-byte breakpoint map at addr */
+static int test_bp_bit(const DebuggerContext *dbg, Inst_Addr addr) {
+    return (int)((dbg->bp_bits[addr >> 6] >> (addr & 63)) & 1);
+}
+
+/* Hand assembly: each appends one instruction at p, returns its size */
+static size_t test_push(uint8_t *p, uint64_t imm) {
+    p[0] = INST_PUSH;
+    p[1] = DESC_PACK(OPR_IMM, OPR_NONE);
+    memcpy(p + 2, &imm, 8);
+    return 10;
+}
+
+static size_t test_pop(uint8_t *p, int reg) {
+    p[0] = INST_POP;
+    p[1] = DESC_PACK(OPR_REG, OPR_NONE);
+    p[2] = reg;
+    return 3;
+}
+
+static size_t test_add(uint8_t *p, int reg, uint64_t imm) {
+    p[0] = INST_ADD;
+    p[1] = DESC_PACK(OPR_REG, OPR_IMM);
+    p[2] = reg;
+    memcpy(p + 3, &imm, 8);
+    return 11;
+}
+
+/* SYS, HALT and the other instructions without operands */
+static size_t test_op(uint8_t *p, int op) {
+    p[0] = op;
+    p[1] = 0;
+    return 2;
+}
+
+static size_t test_jmp(uint8_t *p, uint64_t addr) {
+    p[0] = INST_JMP;
+    p[1] = DESC_PACK(OPR_IMM, OPR_NONE);
+    memcpy(p + 2, &addr, 8);
+    return 10;
+}
+
 /* Placeholder tests - would use actual VM API */
 int test_vm_init(void) {
     TEST_ASSERT(1, "VM init placeholder");
@@ -48,7 +153,1196 @@ int test_instructions(void) {
     return 1;
 }
 
-int main(int argc, char **argv) {
+/* SYS_MMAP: file contents appear at the returned address, ranges past
+   EOF are refused rather than mapped into SIGBUS */
+int test_mmap(void) {
+    char path[] = "/tmp/pocol_mmap_XXXXXX";
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    TEST_ASSERT(test_host_file(path, "hello, mapped world") == 0, "host file");
+    
+    int64_t len = test_poke_str(vm, TEST_DATA, path);
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDONLY, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "open");
+    
+    int64_t addr = test_sys(vm, SYS_MMAP, fd, 0, 0, POCOL_MAP_RDONLY);
+    TEST_ASSERT(addr >= POCOL_MAP_BASE, "mmap to EOF");
+    const uint8_t *p = pocol_mem_ptr(vm, addr, 19, POCOL_MEM_READ);
+    TEST_ASSERT(p && memcmp(p, "hello, mapped world", 19) == 0, "mapped contents");
+    TEST_ASSERT(!pocol_mem_ptr(vm, addr, 1, POCOL_MEM_WRITE), "read-only mapping");
+    
+    test_sys(vm, SYS_MMAP, fd, 0, 2 * POCOL_PAGE_SIZE, POCOL_MAP_RDONLY);
+    TEST_ASSERT(vm->syscall_ctx->error == EINVAL, "length past EOF");
+    test_sys(vm, SYS_MMAP, fd, POCOL_PAGE_SIZE, 0, POCOL_MAP_RDONLY);
+    TEST_ASSERT(vm->syscall_ctx->error == EINVAL, "offset past EOF");
+    
+    TEST_ASSERT(test_sys(vm, SYS_MUNMAP, addr, 0, 0, 0) == 0, "munmap");
+    TEST_ASSERT(!pocol_mem_ptr(vm, addr, 1, POCOL_MEM_READ), "unmapped");
+    
+    pocol_free_vm(vm);
+    unlink(path);
+    return 1;
+}
+
+/* SYS_WRITEV/SYS_READV: gather into a file and scatter back out */
+int test_readv_writev(void) {
+    char path[] = "/tmp/pocol_iov_XXXXXX";
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    TEST_ASSERT(test_host_file(path, "") == 0, "host file");
+    
+    int64_t len = test_poke_str(vm, TEST_DATA, path);
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "open");
+    
+    VIoVec iov[2] = { { TEST_DATA + 0x100, 6 }, { TEST_DATA + 0x200, 5 } };
+    memcpy(vm->memory + TEST_DATA + 0x100, "hello ", 6);
+    memcpy(vm->memory + TEST_DATA + 0x200, "world", 5);
+    memcpy(vm->memory + TEST_DATA + 0x300, iov, sizeof(iov));
+    TEST_ASSERT(test_sys(vm, SYS_WRITEV, fd, TEST_DATA + 0x300, 2, 0) == 11, "writev");
+    
+    test_sys(vm, SYS_SEEK, fd, 0, SEEK_SET, 0);
+    iov[0].base = TEST_DATA + 0x400; iov[0].len = 3;
+    iov[1].base = TEST_DATA + 0x500; iov[1].len = 16;
+    memcpy(vm->memory + TEST_DATA + 0x300, iov, sizeof(iov));
+    TEST_ASSERT(test_sys(vm, SYS_READV, fd, TEST_DATA + 0x300, 2, 0) == 11, "readv stops at EOF");
+    TEST_ASSERT(memcmp(vm->memory + TEST_DATA + 0x400, "hel", 3) == 0, "first iovec");
+    TEST_ASSERT(memcmp(vm->memory + TEST_DATA + 0x500, "lo world", 8) == 0, "second iovec");
+    
+    /* failures leave an error code, not whatever the last call set */
+    test_sys(vm, SYS_READV, 9999, TEST_DATA + 0x300, 2, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == EBADF, "readv bad fd");
+    test_sys(vm, SYS_READV, fd, TEST_DATA + 0x300, SYS_MAX_IOV + 1, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == EINVAL, "readv too many iovecs");
+    test_sys(vm, SYS_READV, 1, TEST_DATA + 0x300, 2, 0);
+    TEST_ASSERT(vm->syscall_ctx->error != 0, "readv from stdout");
+    
+    test_sys(vm, SYS_CLOSE, fd, 0, 0, 0);
+    pocol_free_vm(vm);
+    unlink(path);
+    return 1;
+}
+
+/* SYS_BATCH: results and errors land in each entry, and an entry that
+   unmaps the array ends the batch instead of faulting the host */
+int test_batch(void) {
+    char path[] = "/tmp/pocol_batch_XXXXXX";
+    char page[POCOL_PAGE_SIZE + 1];
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    memset(page, 'x', POCOL_PAGE_SIZE);
+    page[POCOL_PAGE_SIZE] = '\0';
+    TEST_ASSERT(test_host_file(path, page) == 0, "host file");
+    
+    VSyscallDesc d[3];
+    memset(d, 0, sizeof(d));
+    d[0].num = SYS_TELL;     d[0].args[0] = 9999;   /* EBADF */
+    d[1].num = 200;                                 /* ENOSYS */
+    d[2].num = SYS_CLOCK_NS;
+    memcpy(vm->memory + TEST_DATA, d, sizeof(d));
+    TEST_ASSERT(test_sys(vm, SYS_BATCH, TEST_DATA, 3, 0, 0) == 3, "all entries run");
+    memcpy(d, vm->memory + TEST_DATA, sizeof(d));
+    TEST_ASSERT(d[0].error == EBADF, "first entry error");
+    TEST_ASSERT(d[1].error == ENOSYS, "second entry error");
+    TEST_ASSERT(d[2].error == 0 && d[2].result > 0, "third entry result");
+    
+    memcpy(vm->memory + TEST_DATA, d, sizeof(d));
+    TEST_ASSERT(test_sys(vm, SYS_BATCH, TEST_DATA, 3, SYS_BATCH_STOP_ON_ERROR, 0) == 1, "stop on error");
+    
+    /* the array in a private mapping that its first entry unmaps */
+    int64_t len = test_poke_str(vm, TEST_DATA, path);
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDONLY, 0);
+    int64_t addr = test_sys(vm, SYS_MMAP, fd, 0, 0, POCOL_MAP_COW);
+    TEST_ASSERT(addr >= POCOL_MAP_BASE, "mmap");
+    memset(d, 0, sizeof(d));
+    d[0].num = SYS_MUNMAP;   d[0].args[0] = addr;
+    d[1].num = SYS_CLOCK_NS;
+    memcpy(pocol_mem_ptr(vm, addr, sizeof(d), POCOL_MEM_WRITE), d, sizeof(d));
+    TEST_ASSERT(test_sys(vm, SYS_BATCH, addr, 2, 0, 0) == 1, "batch ends at the unmap");
+    TEST_ASSERT(vm->syscall_ctx->error == ERR_ILLEGAL_INST_ACCESS, "lost array reported");
+    
+    pocol_free_vm(vm);
+    unlink(path);
+    return 1;
+}
+
+/* /mem/ files: contents survive close and outlive unlink while open */
+int test_memfs(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    
+    int64_t len = test_poke_str(vm, TEST_DATA, "/mem/dir");
+    TEST_ASSERT(test_sys(vm, SYS_MKDIR, TEST_DATA, len, 0, 0) == 0, "mkdir");
+    len = test_poke_str(vm, TEST_DATA, "/mem/dir/file");
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "create");
+    memcpy(vm->memory + TEST_DATA + 0x100, "in memory", 9);
+    TEST_ASSERT(test_sys(vm, SYS_WRITE, fd, TEST_DATA + 0x100, 9, 0) == 9, "write");
+    TEST_ASSERT(test_sys(vm, SYS_SEEK, fd, 3, SEEK_SET, 0) == 3, "seek");
+    TEST_ASSERT(test_sys(vm, SYS_READ_FILE, fd, TEST_DATA + 0x200, 64, 0) == 6, "read to EOF");
+    TEST_ASSERT(memcmp(vm->memory + TEST_DATA + 0x200, "memory", 6) == 0, "contents");
+    test_sys(vm, SYS_CLOSE, fd, 0, 0, 0);
+    
+    VStat st;
+    TEST_ASSERT(test_sys(vm, SYS_STAT, TEST_DATA, len, TEST_DATA + 0x300, 0) == 0, "stat");
+    memcpy(&st, vm->memory + TEST_DATA + 0x300, sizeof(st));
+    TEST_ASSERT(st.size == 9 && st.type == FTYPE_FILE, "stat after close");
+    
+    fd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDONLY, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "reopen");
+    TEST_ASSERT(test_sys(vm, SYS_UNLINK, TEST_DATA, len, 0, 0) == 0, "unlink");
+    TEST_ASSERT(test_sys(vm, SYS_READ_FILE, fd, TEST_DATA + 0x200, 64, 0) == 9, "read after unlink");
+    test_sys(vm, SYS_CLOSE, fd, 0, 0, 0);
+    test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDONLY, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == ENOENT, "gone after last close");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* Closed fds are handed out again before fresh ones, --max-files stops
+   new ones with EMFILE, and the path index still finds every open file
+   once it has grown past VFS_HASH_MIN buckets */
+int test_fd_table(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    char path[32];
+    TEST_ASSERT(vm, "load");
+    VFS *vfs = &vm->syscall_ctx->vfs;
+    TEST_ASSERT(vfs_set_fd_limit(vfs, 5) == 0, "limit");
+    
+    int64_t len = test_poke_str(vm, TEST_DATA, "/mem/a");
+    TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0) == 3, "first fd");
+    TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR, 0) == 3, "open twice shares the fd");
+    len = test_poke_str(vm, TEST_DATA, "/mem/b");
+    TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0) == 4, "second fd");
+    len = test_poke_str(vm, TEST_DATA, "/mem/c");
+    test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == EMFILE, "EMFILE at the limit");
+    TEST_ASSERT(vfs->file_count == 5 && vfs->fd_next == 5, "nothing leaked");
+    
+    TEST_ASSERT(test_sys(vm, SYS_CLOSE, 3, 0, 0, 0) == 0, "close");
+    TEST_ASSERT(vfs->free_count == 1 && !vfs_get(vfs, 3), "fd freed");
+    TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0) == 3, "freed fd reused");
+    TEST_ASSERT(vfs->free_count == 0 && vfs->fd_next == 5, "no fresh fd");
+    TEST_ASSERT(vfs_set_fd_limit(vfs, 4) < 0 && errno == EINVAL, "limit below use");
+    
+    TEST_ASSERT(vfs_set_fd_limit(vfs, 1024) == 0, "raise");
+    for (int i = 0; i < 300; i++) {
+        snprintf(path, sizeof(path), "/mem/f%d", i);
+        len = test_poke_str(vm, TEST_DATA, path);
+        TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0) == 5 + i, "fresh fd");
+    }
+    TEST_ASSERT(vfs->index_size > VFS_HASH_MIN && vfs->fd_capacity > VFS_MAX_FILES, "grown");
+    for (int i = 0; i < 300; i++) {
+        snprintf(path, sizeof(path), "/mem/f%d", i);
+        len = test_poke_str(vm, TEST_DATA, path);
+        TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR, 0) == 5 + i, "found after rehash");
+    }
+    len = test_poke_str(vm, TEST_DATA, "/mem/b");
+    TEST_ASSERT(test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR, 0) == 4, "early file rehashed");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* The names in up to 8 VDirent records at guest addr, "|" separated */
+static void test_dirent_names(PocolVM *vm, uint64_t addr, int n, char *out, size_t size) {
+    out[0] = '\0';
+    for (int i = 0; i < n; i++) {
+        VDirent d;
+        memcpy(&d, vm->memory + addr + i * sizeof(VDirent), sizeof(d));
+        snprintf(out + strlen(out), size - strlen(out), "%s%s", i ? "|" : "", d.name);
+    }
+}
+
+/* SYS_OPENDIR/SYS_READDIR on /mem/: a second opendir reuses the cached
+   listing, a create drops it, and an fd opened before keeps its own */
+int test_readdir(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    char names[64];
+    TEST_ASSERT(vm, "load");
+    VFS *vfs = &vm->syscall_ctx->vfs;
+    uint64_t ents = TEST_DATA + 0x400;
+    
+    int64_t dlen = test_poke_str(vm, TEST_DATA, "/mem/d");
+    TEST_ASSERT(test_sys(vm, SYS_MKDIR, TEST_DATA, dlen, 0, 0) == 0, "mkdir");
+    int64_t len = test_poke_str(vm, TEST_DATA + 0x100, "/mem/d/x");
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA + 0x100, len, O_RDWR | O_CREAT, 0);
+    TEST_ASSERT(test_sys(vm, SYS_WRITE, fd, TEST_DATA + 0x100, 3, 0) == 3, "write");
+    test_sys(vm, SYS_CLOSE, fd, 0, 0, 0);
+    
+    int64_t dfd = test_sys(vm, SYS_OPENDIR, TEST_DATA, dlen, 0, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "opendir");
+    TEST_ASSERT(test_sys(vm, SYS_READDIR, dfd, ents, 8, 0) == 1, "one entry");
+    VDirent d;
+    memcpy(&d, vm->memory + ents, sizeof(d));
+    TEST_ASSERT(strcmp(d.name, "x") == 0 && d.name_len == 1 && d.type == FTYPE_FILE && d.size == 3, "record");
+    TEST_ASSERT(test_sys(vm, SYS_READDIR, dfd, ents, 8, 0) == 0, "end");
+    VDir *listing = vfs->dir_cache;
+    TEST_ASSERT(listing && vfs->dir_cache_count == 1 && strcmp(listing->path, "/mem/d") == 0, "cached");
+    test_sys(vm, SYS_CLOSE, dfd, 0, 0, 0);
+    TEST_ASSERT(vfs->dir_cache == listing && listing->refcount == 0, "kept after close");
+    
+    dfd = test_sys(vm, SYS_OPENDIR, TEST_DATA, dlen, 0, 0);
+    TEST_ASSERT(vfs_get(vfs, (int)dfd)->host_handle == listing, "reused");
+    len = test_poke_str(vm, TEST_DATA + 0x100, "/mem/d/y");
+    fd = test_sys(vm, SYS_OPEN, TEST_DATA + 0x100, len, O_RDWR | O_CREAT, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "create");
+    test_sys(vm, SYS_CLOSE, fd, 0, 0, 0);
+    TEST_ASSERT(vfs->dir_cache_count == 0, "create drops the listing");
+    TEST_ASSERT(test_sys(vm, SYS_READDIR, dfd, ents, 8, 0) == 1, "open fd keeps its listing");
+    
+    int64_t dfd2 = test_sys(vm, SYS_OPENDIR, TEST_DATA, dlen, 0, 0);
+    TEST_ASSERT(vfs_get(vfs, (int)dfd2)->host_handle != listing, "listed again");
+    int n = (int)test_sys(vm, SYS_READDIR, dfd2, ents, 8, 0);
+    TEST_ASSERT(n == 2, "two entries");
+    test_dirent_names(vm, ents, n, names, sizeof(names));
+    TEST_ASSERT(strcmp(names, "x|y") == 0 || strcmp(names, "y|x") == 0, "new name");
+    test_sys(vm, SYS_CLOSE, dfd, 0, 0, 0);
+    test_sys(vm, SYS_CLOSE, dfd2, 0, 0, 0);
+    
+    TEST_ASSERT(test_sys(vm, SYS_UNLINK, TEST_DATA + 0x100, len, 0, 0) == 0, "unlink");
+    TEST_ASSERT(vfs->dir_cache_count == 0, "unlink drops the listing");
+    dfd = test_sys(vm, SYS_OPENDIR, TEST_DATA, dlen, 0, 0);
+    n = (int)test_sys(vm, SYS_READDIR, dfd, ents, 8, 0);
+    test_dirent_names(vm, ents, n, names, sizeof(names));
+    TEST_ASSERT(strcmp(names, "x") == 0, "name gone");
+    test_sys(vm, SYS_READDIR, 99, ents, 8, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == EBADF, "bad fd");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+static int64_t test_native_mul(PocolVM *vm, void *userdata, const int64_t *args, int *error) {
+    (void)vm;
+    (void)error;
+    ++*(int*)userdata;
+    return args[0] * args[1] + args[2];     /* args[2] is zero past argc 2 */
+}
+
+static int64_t test_native_fail(PocolVM *vm, void *userdata, const int64_t *args, int *error) {
+    (void)vm;
+    (void)userdata;
+    (void)args;
+    *error = EPERM;
+    return 0;
+}
+
+/* syscalls_register(): bad numbers and argc are refused, a number in use,
+   native or built-in, gets the new function, and a native's error
+   reaches the guest */
+int test_register(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    int calls = 0;
+    TEST_ASSERT(vm, "load");
+    SysCallContext *ctx = vm->syscall_ctx;
+    
+    TEST_ASSERT(syscalls_register(ctx, 0, test_native_mul, &calls, 2, "mul") < 0 && errno == EINVAL, "zero");
+    TEST_ASSERT(syscalls_register(ctx, -1, test_native_mul, &calls, 2, "mul") < 0 && errno == EINVAL, "negative");
+    TEST_ASSERT(syscalls_register(ctx, SYS_TABLE_SIZE, test_native_mul, &calls, 2, "mul") < 0, "past the table");
+    TEST_ASSERT(syscalls_register(ctx, 200, NULL, &calls, 2, "mul") < 0, "no function");
+    TEST_ASSERT(syscalls_register(ctx, 200, test_native_mul, &calls, 5, "mul") < 0, "argc");
+    test_sys(vm, 200, 0, 0, 0, 0);
+    TEST_ASSERT(ctx->error == ENOSYS, "nothing registered");
+    
+    TEST_ASSERT(syscalls_register(ctx, 200, test_native_mul, &calls, 2, "mul") == 0, "register");
+    TEST_ASSERT(test_sys(vm, 200, 6, 7, 100, 0) == 42 && calls == 1, "call");
+    TEST_ASSERT(strcmp(syscalls_name(ctx, 200), "mul") == 0, "name");
+    TEST_ASSERT(syscalls_register(ctx, 200, test_native_fail, NULL, 0, "fail") == 0, "replace native");
+    TEST_ASSERT(test_sys(vm, 200, 6, 7, 0, 0) == -1 && ctx->error == EPERM && calls == 1, "replaced");
+    TEST_ASSERT(strcmp(syscalls_name(ctx, 200), "fail") == 0, "new name");
+    
+    TEST_ASSERT(syscalls_register(ctx, SYS_TIME, test_native_mul, &calls, 3, "time") == 0, "replace built-in");
+    TEST_ASSERT(test_sys(vm, SYS_TIME, 2, 3, 4, 0) == 10 && calls == 2, "built-in replaced");
+    TEST_ASSERT(ctx->table[SYS_TIME].calls == 1 && ctx->table[200].calls == 3, "counted");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* SYS_COPY: memory to host file, host file to memory, and a memory file
+   onto itself, which appends at the shared position */
+int test_copy(void) {
+    char path[] = "/tmp/pocol_copy_XXXXXX";
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    TEST_ASSERT(test_host_file(path, "") == 0, "host file");
+    
+    int64_t len = test_poke_str(vm, TEST_DATA, "/mem/copy");
+    int64_t mfd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR | O_CREAT, 0);
+    len = test_poke_str(vm, TEST_DATA, path);
+    int64_t hfd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "open");
+    
+    memset(vm->memory + TEST_DATA + 0x100, 'm', VFS_MEM_MIN_CAP);
+    TEST_ASSERT(test_sys(vm, SYS_WRITE, mfd, TEST_DATA + 0x100, VFS_MEM_MIN_CAP, 0) == VFS_MEM_MIN_CAP, "fill");
+    test_sys(vm, SYS_SEEK, mfd, 0, SEEK_SET, 0);
+    TEST_ASSERT(test_sys(vm, SYS_COPY, mfd, hfd, 1 << 20, 0) == VFS_MEM_MIN_CAP, "memory to host");
+    test_sys(vm, SYS_SEEK, hfd, 0, SEEK_SET, 0);
+    test_sys(vm, SYS_SEEK, mfd, 0, SEEK_SET, 0);
+    TEST_ASSERT(test_sys(vm, SYS_COPY, hfd, mfd, 4, 0) == 4, "host to memory");
+    
+    /* the write grows the node past its first buffer */
+    test_sys(vm, SYS_SEEK, mfd, 0, SEEK_SET, 0);
+    TEST_ASSERT(test_sys(vm, SYS_COPY, mfd, mfd, VFS_MEM_MIN_CAP, 0) == VFS_MEM_MIN_CAP, "onto itself");
+    TEST_ASSERT(test_sys(vm, SYS_TELL, mfd, 0, 0, 0) == 2 * VFS_MEM_MIN_CAP, "position");
+    test_sys(vm, SYS_SEEK, mfd, VFS_MEM_MIN_CAP, SEEK_SET, 0);
+    memset(vm->memory + TEST_DATA + 0x100, 0, VFS_MEM_MIN_CAP);
+    TEST_ASSERT(test_sys(vm, SYS_READ_FILE, mfd, TEST_DATA + 0x100, VFS_MEM_MIN_CAP, 0) == VFS_MEM_MIN_CAP, "read copy");
+    for (int i = 0; i < VFS_MEM_MIN_CAP; i++)
+        TEST_ASSERT(vm->memory[TEST_DATA + 0x100 + i] == 'm', "copied contents");
+    
+    test_sys(vm, SYS_CLOSE, mfd, 0, 0, 0);
+    test_sys(vm, SYS_CLOSE, hfd, 0, 0, 0);
+    pocol_free_vm(vm);
+    unlink(path);
+    return 1;
+}
+
+/* Block cache: windows start small and grow with the access pattern,
+   never past VFS_CACHE_MAX, and give their memory back on close */
+int test_block_cache(void) {
+    char path[] = "/tmp/pocol_cache_XXXXXX";
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    TEST_ASSERT(test_host_file(path, "") == 0, "host file");
+    VFS *vfs = &vm->syscall_ctx->vfs;
+    
+    int64_t len = test_poke_str(vm, TEST_DATA, path);
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA, len, O_RDWR, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == 0, "open");
+    
+    /* small writes, 300 KiB of them, each chunk numbered */
+    for (int i = 0; i < 300; i++) {
+        memset(vm->memory + TEST_DATA + 0x100, 'a' + i % 26, 1024);
+        TEST_ASSERT(test_sys(vm, SYS_WRITE, fd, TEST_DATA + 0x100, 1024, 0) == 1024, "write");
+        TEST_ASSERT(vfs->cache_bytes <= VFS_CACHE_MAX, "window bounded");
+    }
+    TEST_ASSERT(vfs->cache_bytes > VFS_CACHE_MIN, "window grew");
+    
+    test_sys(vm, SYS_SEEK, fd, 0, SEEK_SET, 0);
+    for (int i = 0; i < 300; i++) {
+        TEST_ASSERT(test_sys(vm, SYS_READ_FILE, fd, TEST_DATA + 0x100, 1024, 0) == 1024, "read");
+        TEST_ASSERT(vm->memory[TEST_DATA + 0x100] == 'a' + i % 26 &&
+                    vm->memory[TEST_DATA + 0x100 + 1023] == 'a' + i % 26, "contents");
+    }
+    
+    test_sys(vm, SYS_CLOSE, fd, 0, 0, 0);
+    TEST_ASSERT(vfs->cache_bytes == 0, "memory returned on close");
+    pocol_free_vm(vm);
+    unlink(path);
+    return 1;
+}
+
+/* SYS_SPAWN: pipes to and from a child, and writing to a child that has
+   already exited fails with EPIPE instead of killing the VM */
+int test_spawn(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    TEST_ASSERT(vm, "load");
+    
+    VIoVec argv[1] = { { TEST_DATA + 0x100, 3 } };
+    memcpy(vm->memory + TEST_DATA + 0x100, "cat", 3);
+    memcpy(vm->memory + TEST_DATA, argv, sizeof(argv));
+    int64_t pid = test_sys(vm, SYS_SPAWN, TEST_DATA, 1,
+                           SYS_SPAWN_PIPE_STDIN | SYS_SPAWN_PIPE_STDOUT, TEST_DATA + 0x200);
+    TEST_ASSERT(pid > 0, "spawn cat");
+    int64_t fds[2];
+    memcpy(fds, vm->memory + TEST_DATA + 0x200, sizeof(fds));
+    memcpy(vm->memory + TEST_DATA + 0x300, "echo", 4);
+    TEST_ASSERT(test_sys(vm, SYS_WRITE, fds[0], TEST_DATA + 0x300, 4, 0) == 4, "write to child");
+    test_sys(vm, SYS_CLOSE, fds[0], 0, 0, 0);
+    int64_t got = 0, n;
+    while ((n = test_sys(vm, SYS_READ_FILE, fds[1], TEST_DATA + 0x400 + got, 16, 0)) > 0) got += n;
+    TEST_ASSERT(got == 4 && memcmp(vm->memory + TEST_DATA + 0x400, "echo", 4) == 0, "read from child");
+    test_sys(vm, SYS_CLOSE, fds[1], 0, 0, 0);
+    TEST_ASSERT(test_sys(vm, SYS_WAIT, pid, 0, 0, 0) == 0, "exit status");
+    
+    memcpy(vm->memory + TEST_DATA + 0x100, "true", 4);
+    argv[0].len = 4;
+    memcpy(vm->memory + TEST_DATA, argv, sizeof(argv));
+    pid = test_sys(vm, SYS_SPAWN, TEST_DATA, 1, SYS_SPAWN_PIPE_STDIN, TEST_DATA + 0x200);
+    TEST_ASSERT(pid > 0, "spawn true");
+    memcpy(fds, vm->memory + TEST_DATA + 0x200, sizeof(fds));
+    TEST_ASSERT(test_sys(vm, SYS_WAIT, pid, 0, 0, 0) == 0, "child gone");
+    test_sys(vm, SYS_WRITE, fds[0], TEST_DATA + 0x300, 4, 0);
+    TEST_ASSERT(vm->syscall_ctx->error == EPIPE, "EPIPE");
+    test_sys(vm, SYS_CLOSE, fds[0], 0, 0, 0);
+    struct sigaction sa;
+    sigaction(SIGPIPE, NULL, &sa);
+    TEST_ASSERT(sa.sa_handler == SIG_DFL, "SIGPIPE disposition untouched");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* Breakpoint conditions: C precedence, two character operators, x / 0
+   is 0, and errors name the text where parsing stopped */
+int test_predicate(void) {
+    static const struct { const char *expr; uint64_t value; } cases[] = {
+        { "1 + 2 * 3", 7 },          { "(1 + 2) * 3", 9 },
+        { "r1 - r2 - 1", 1 },        { "1 || 0 && 0", 1 },
+        { "r1 > r2 == 1", 1 },       { "!r2 + 1", 1 },
+        { "-1 > r1", 1 },            { "-r1 + r1", 0 },
+        { "r1 <= 5", 1 },            { "r1<=4", 0 },
+        { "r1 >= 6", 0 },            { "r1!=4", 1 },
+        { "r1 != 5", 0 },            { "!r0", 1 },
+        { "r1 / 0", 0 },             { "r1 % 0", 0 },
+        { "r1 / 2", 2 },             { "r1 % r2", 2 },
+        { "hits % 1000 == 0", 1 },   { "0x10 == 16", 1 },
+    };
+    static const struct { const char *expr, *err; } errors[] = {
+        { "r9 > 1", "unknown name at 'r9 > 1'" },
+        { "r1 <", "expected a value at end of expression" },
+        { "r1 < = 5", "expected a value at '= 5'" },
+        { "(r1 + 1", "expected ')' at end of expression" },
+        { "r1 r2", "unexpected text at 'r2'" },
+        { "12ab", "bad number at '12ab'" },
+    };
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    PocolPredicate p;
+    char err[128];
+    TEST_ASSERT(vm, "load");
+    vm->registers[0] = 0;
+    vm->registers[1] = 5;
+    vm->registers[2] = 3;
+    
+    for (size_t i = 0; i < sizeof(cases) / sizeof(cases[0]); i++) {
+        TEST_ASSERT(predicate_compile(&p, cases[i].expr, err, sizeof(err)) == 0, cases[i].expr);
+        TEST_ASSERT(predicate_eval(&p, vm, 2000) == cases[i].value, cases[i].expr);
+    }
+    for (size_t i = 0; i < sizeof(errors) / sizeof(errors[0]); i++) {
+        TEST_ASSERT(predicate_compile(&p, errors[i].expr, err, sizeof(err)) < 0, errors[i].expr);
+        TEST_ASSERT(strcmp(err, errors[i].err) == 0, errors[i].err);
+    }
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* break ADDR if EXPR adds nothing when EXPR is bad, a plain break drops
+   the condition, and a logpoint never replaces a stopping breakpoint */
+int test_breakpoints(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    DebuggerContext dbg;
+    char err[128], out[64];
+    TEST_ASSERT(vm, "load");
+    debugger_init(&dbg, vm);
+    vm->registers[1] = 5;
+    
+    TEST_ASSERT(debugger_add_conditional(&dbg, 0, "r9 > 1", err, sizeof(err)) < 0, "bad condition");
+    TEST_ASSERT(dbg.breakpoint_count == 0, "nothing added");
+    TEST_ASSERT(debugger_add_conditional(&dbg, 0, "r1 == 5", err, sizeof(err)) == 0, "conditional");
+    TEST_ASSERT(dbg.breakpoints[0].cond, "condition set");
+    
+    TEST_ASSERT(debugger_add_logpoint(&dbg, 0, "x", err, sizeof(err)) < 0, "logpoint over breakpoint");
+    TEST_ASSERT(strcmp(err, "breakpoint 0 is already at this address") == 0, "logpoint refusal");
+    TEST_ASSERT(!dbg.breakpoints[0].log, "breakpoint untouched");
+    TEST_ASSERT(debugger_add_breakpoint(&dbg, 0) == 0, "re-add");
+    TEST_ASSERT(!dbg.breakpoints[0].cond, "re-add drops the condition");
+    
+    TEST_ASSERT(debugger_remove_breakpoint(&dbg, 0) == 0, "remove");
+    TEST_ASSERT(debugger_add_logpoint(&dbg, 0, "old", err, sizeof(err)) == 0, "logpoint");
+    TEST_ASSERT(debugger_add_logpoint(&dbg, 0, "r1={r1} twice={r1 * 2}", err, sizeof(err)) == 0, "new text");
+    TEST_ASSERT(dbg.breakpoint_count == 1, "replaced in place");
+    FILE *f = tmpfile();
+    TEST_ASSERT(f, "tmpfile");
+    logpoint_print(dbg.breakpoints[0].log, vm, 1, f);
+    rewind(f);
+    TEST_ASSERT(fgets(out, sizeof(out), f) && strcmp(out, "r1=5 twice=10\n") == 0, "logpoint output");
+    fclose(f);
+    TEST_ASSERT(debugger_add_logpoint(&dbg, 0, "{r1", err, sizeof(err)) < 0, "unclosed brace");
+    TEST_ASSERT(strcmp(err, "missing '}' in log message") == 0, "brace error");
+    
+    /* the map follows add, disable and remove; removing the first entry
+       shifts the rest down without touching their bits */
+    TEST_ASSERT(dbg.bp_bits && test_bp_bit(&dbg, 0), "logpoint bit");
+    TEST_ASSERT(debugger_add_breakpoint(&dbg, 0x40) == 1 && debugger_add_breakpoint(&dbg, 0x41) == 2 &&
+                debugger_add_breakpoint(&dbg, 0x100) == 3, "add three");
+    TEST_ASSERT(test_bp_bit(&dbg, 0x40) && test_bp_bit(&dbg, 0x41) && test_bp_bit(&dbg, 0x100), "bits set");
+    TEST_ASSERT(!test_bp_bit(&dbg, 0x3f) && !test_bp_bit(&dbg, 0x42), "neighbours clear");
+    TEST_ASSERT(debugger_disable_breakpoint(&dbg, 0x41) == 0, "disable");
+    TEST_ASSERT(!test_bp_bit(&dbg, 0x41) && test_bp_bit(&dbg, 0x40), "disable clears only its bit");
+    TEST_ASSERT(debugger_enable_breakpoint(&dbg, 0x41) == 0 && test_bp_bit(&dbg, 0x41), "enable");
+    TEST_ASSERT(debugger_remove_breakpoint(&dbg, 0) == 0, "remove first");
+    TEST_ASSERT(!test_bp_bit(&dbg, 0), "remove clears");
+    TEST_ASSERT(dbg.breakpoint_count == 3 && dbg.breakpoints[0].address == 0x40 &&
+                dbg.breakpoints[1].address == 0x41 && dbg.breakpoints[2].address == 0x100, "shifted");
+    TEST_ASSERT(test_bp_bit(&dbg, 0x40) && test_bp_bit(&dbg, 0x41) && test_bp_bit(&dbg, 0x100), "shifted bits kept");
+    TEST_ASSERT(debugger_disable_breakpoint(&dbg, 0x40) == 0 && debugger_remove_breakpoint(&dbg, 0x40) == 0, "remove disabled");
+    TEST_ASSERT(debugger_remove_breakpoint(&dbg, 0x100) == 0, "remove last");
+    TEST_ASSERT(!test_bp_bit(&dbg, 0x40) && !test_bp_bit(&dbg, 0x100) && test_bp_bit(&dbg, 0x41), "left one");
+    TEST_ASSERT(dbg.breakpoint_count == 1 && dbg.breakpoints[0].address == 0x41, "one left");
+    TEST_ASSERT(debugger_remove_breakpoint(&dbg, 0x41) == 0 && !test_bp_bit(&dbg, 0x41), "empty");
+    
+    debugger_free(&dbg);
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* A host store into a watched page, as JIT code makes it: the fault
+   handler lets it through and the check reports it. SIGSEGV is never
+   left blocked, and nothing faults once the watch is gone */
+int test_watch_fault(void) {
+    PocolVM *vm = test_vm_new(halt_code, sizeof(halt_code));
+    DebuggerContext dbg;
+    sigset_t mask;
+    TEST_ASSERT(vm, "load");
+    debugger_init(&dbg, vm);
+    volatile uint8_t *cell = &vm->memory[TEST_DATA + 0x800];
+    
+    TEST_ASSERT(debugger_add_watchpoint(&dbg, TEST_DATA + 0x800, 1, WATCH_WRITE) == 0, "add");
+    TEST_ASSERT(dbg.watch_armed, "page protected");
+    *cell = 7;
+    TEST_ASSERT(*cell == 7 && dbg.watch_faulted && dbg.watch_pending, "store let through");
+    TEST_ASSERT(debugger_check_watchpoints(&dbg), "change reported");
+    TEST_ASSERT(dbg.watchpoints[0].hit_count == 1 && !dbg.watch_faulted, "hit counted");
+    *cell = 7;
+    TEST_ASSERT(dbg.watch_faulted, "re-armed");
+    TEST_ASSERT(!debugger_check_watchpoints(&dbg), "same value is no hit");
+    
+    TEST_ASSERT(sigprocmask(SIG_BLOCK, NULL, &mask) == 0 && !sigismember(&mask, SIGSEGV), "SIGSEGV unblocked");
+    TEST_ASSERT(debugger_remove_watchpoint(&dbg, TEST_DATA + 0x800) == 0, "remove");
+    TEST_ASSERT(!dbg.watch_armed && !vm->watch, "disarmed");
+    *cell = 9;
+    TEST_ASSERT(!dbg.watch_pending, "no fault");
+    
+    debugger_free(&dbg);
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* metrics_parse() accepts FMT[:DEST] and nothing else; what it parsed
+   writes a file and an fd that read back with the run's numbers */
+int test_metrics(void) {
+    PocolMetrics m;
+    char path[] = "/tmp/pocol_metrics_XXXXXX", spec[64], out[4096];
+    
+    TEST_ASSERT(metrics_parse(&m, "json") == 0 && m.format == METRICS_JSON && !m.path && m.fd < 0, "json");
+    TEST_ASSERT(metrics_parse(&m, "prom") == 0 && m.format == METRICS_PROMETHEUS, "prom");
+    TEST_ASSERT(metrics_parse(&m, "prometheus:/tmp/x") == 0 && m.format == METRICS_PROMETHEUS &&
+                strcmp(m.path, "/tmp/x") == 0, "path");
+    TEST_ASSERT(metrics_parse(&m, "json:fd:7") == 0 && m.fd == 7 && !m.path, "fd");
+    TEST_ASSERT(metrics_parse(&m, "json:fd:7x") < 0, "fd junk");
+    TEST_ASSERT(metrics_parse(&m, "json:fd:") < 0, "fd missing");
+    TEST_ASSERT(metrics_parse(&m, "json:fd:-1") < 0, "fd negative");
+    TEST_ASSERT(metrics_parse(&m, "json:") < 0, "empty dest");
+    TEST_ASSERT(metrics_parse(&m, "jsonx") < 0 && metrics_parse(&m, "pro") < 0 &&
+                metrics_parse(&m, "") < 0, "format");
+    
+    /* push 5; push 6; pop r1; halt */
+    uint8_t code[32];
+    size_t n = test_push(code, 5);
+    n += test_push(code + n, 6);
+    n += test_pop(code + n, 1);
+    n += test_op(code + n, INST_HALT);
+    PocolVM *vm = test_vm_new(code, n);
+    TEST_ASSERT(vm, "load");
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "mkstemp");
+    close(fd);
+    snprintf(spec, sizeof(spec), "json:%s", path);
+    TEST_ASSERT(metrics_parse(&m, spec) == 0, "parse path");
+    metrics_begin(&m, vm);
+    TEST_ASSERT(pocol_execute_program(vm, -1) == ERR_OK, "run");
+    TEST_ASSERT(metrics_write(&m, vm, "a\"b.pob", ERR_OK) == 0, "write file");
+    FILE *f = fopen(path, "r");
+    TEST_ASSERT(f, "written");
+    out[fread(out, 1, sizeof(out) - 1, f)] = '\0';
+    fclose(f);
+    unlink(path);
+    TEST_ASSERT(strncmp(out, "{\"program\":\"a\\\"b.pob\",\"error\":0,\"halted\":true", 45) == 0, "json head");
+    TEST_ASSERT(strstr(out, "\"instructions\":4,"), "json instructions");
+    TEST_ASSERT(strstr(out, "\"stack\":{\"peak\":2,"), "json stack peak");
+    snprintf(spec, sizeof(spec), "%s.tmp", path);
+    TEST_ASSERT(access(spec, F_OK) < 0, "tmp renamed");
+    
+    f = tmpfile();
+    TEST_ASSERT(f, "tmpfile");
+    snprintf(spec, sizeof(spec), "prom:fd:%d", fileno(f));
+    TEST_ASSERT(metrics_parse(&m, spec) == 0 && m.fd == fileno(f), "parse fd");
+    TEST_ASSERT(metrics_write(&m, vm, "p.pob", ERR_OK) == 0, "write fd");
+    rewind(f);
+    out[fread(out, 1, sizeof(out) - 1, f)] = '\0';
+    fclose(f);
+    TEST_ASSERT(strstr(out, "# TYPE pocol_instructions_total counter\npocol_instructions_total 4\n"), "prom instructions");
+    TEST_ASSERT(strstr(out, "\npocol_error 0\n") && strstr(out, "\npocol_stack_peak_depth 2\n"), "prom gauges");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* A .map as posm -g writes it, shuffled, with CRLF endings and a record
+   this version does not know: lookups by pc, line and name, the
+   label+offset format, and the sidecar path */
+int test_symbols(void) {
+    char path[] = "/tmp/pocol_map_XXXXXX", buf[64];
+    PocolSymbols syms;
+    
+    symbols_map_path("dir/prog.pob", buf, sizeof(buf));
+    TEST_ASSERT(strcmp(buf, "dir/prog.map") == 0, "map path");
+    symbols_map_path("prog", buf, sizeof(buf));
+    TEST_ASSERT(strcmp(buf, "prog.map") == 0, "map path without .pob");
+    
+    TEST_ASSERT(test_host_file(path,
+        "POCOLMAP 1\r\n"
+        "source loop.pcl\r\n"
+        "sym 30 3c loop\r\n"
+        "sym 18 2a _start\r\n"
+        "line 22 3\r\n"
+        "line 18 2\r\n"
+        "frame 18 0\r\n"
+        "line 30 6\r\n") == 0, "map file");
+    TEST_ASSERT(symbols_load(&syms, path) == 0, "load");
+    TEST_ASSERT(syms.sym_count == 2 && syms.line_count == 3, "records");
+    TEST_ASSERT(syms.source && strcmp(syms.source, "loop.pcl") == 0, "source");
+    TEST_ASSERT(syms.syms[0].start == 0x18 && strcmp(syms.syms[1].name, "loop") == 0, "sorted");
+    
+    TEST_ASSERT(!symbols_lookup(&syms, 0x17), "before");
+    TEST_ASSERT(symbols_lookup(&syms, 0x18) == &syms.syms[0], "start");
+    TEST_ASSERT(symbols_lookup(&syms, 0x29) == &syms.syms[0], "last byte");
+    TEST_ASSERT(!symbols_lookup(&syms, 0x2a) && !symbols_lookup(&syms, 0x2f), "gap");
+    TEST_ASSERT(symbols_lookup(&syms, 0x3b) == &syms.syms[1] && !symbols_lookup(&syms, 0x3c), "end");
+    TEST_ASSERT(symbols_line(&syms, 0x17) == 0 && symbols_line(&syms, 0x21) == 2 &&
+                symbols_line(&syms, 0x22) == 3 && symbols_line(&syms, 0x40) == 6, "lines");
+    TEST_ASSERT(symbols_find(&syms, "loop") == 0x30 && symbols_find(&syms, "nope") == -1, "find");
+    
+    TEST_ASSERT(strcmp(symbols_format(&syms, 0x30, buf, sizeof(buf)), "loop") == 0, "format label");
+    TEST_ASSERT(strcmp(symbols_format(&syms, 0x36, buf, sizeof(buf)), "loop+0x6") == 0, "format offset");
+    TEST_ASSERT(strcmp(symbols_format(&syms, 0x2c, buf, sizeof(buf)), "0x002c") == 0, "format gap");
+    TEST_ASSERT(strcmp(symbols_format(NULL, 0x30, buf, sizeof(buf)), "0x0030") == 0, "format without map");
+    symbols_free(&syms);
+    TEST_ASSERT(syms.sym_count == 0 && !syms.syms && !syms.source, "freed");
+    
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT(f, "rewrite");
+    fputs("POCOLMAP 2\nsym 0 2 x\n", f);
+    fclose(f);
+    TEST_ASSERT(symbols_load(&syms, path) < 0 && errno == EINVAL, "newer version refused");
+    unlink(path);
+    TEST_ASSERT(symbols_load(&syms, path) < 0 && errno == ENOENT, "no map");
+    return 1;
+}
+
+/* posm -g to pm: the labels land on the addresses the loaded program
+   runs at. make test builds posm first; run by hand without it, the
+   round trip is skipped */
+int test_symbols_posm(void) {
+    char src[] = "/tmp/pocol_posm_XXXXXX", cmd[256], pob[64], map[64];
+    PocolSymbols syms;
+    PocolVM *vm = NULL;
+    
+    if (access("../posm/posm", X_OK) < 0) {
+        printf("(no ../posm/posm, skipped) ");
+        return 1;
+    }
+    TEST_ASSERT(test_host_file(src, "_start:\n\tpush 1\n\tpop r1\nloop:\n\tpush 2\n\tpop r2\n\tjmp loop\n") == 0, "source");
+    snprintf(pob, sizeof(pob), "%s.pob", src);
+    symbols_map_path(pob, map, sizeof(map));
+    snprintf(cmd, sizeof(cmd), "../posm/posm -g %s -o %s > /dev/null", src, pob);
+    TEST_ASSERT(system(cmd) == 0, "assemble");
+    TEST_ASSERT(symbols_load(&syms, map) == 0, "load map");
+    TEST_ASSERT(pocol_load_program_into_vm(pob, &vm) == ERR_OK && vm, "load program");
+    
+    TEST_ASSERT(syms.source && strcmp(syms.source, src) == 0, "source");
+    TEST_ASSERT(symbols_find(&syms, "_start") == (int64_t)vm->pc, "_start is the entry");
+    TEST_ASSERT(symbols_find(&syms, "loop") == (int64_t)vm->pc + 13, "loop after push and pop");
+    const PocolSym *loop = symbols_lookup(&syms, vm->pc + 13);
+    TEST_ASSERT(loop && strcmp(loop->name, "loop") == 0 && loop->end == vm->pc + 36, "loop range");
+    TEST_ASSERT(symbols_line(&syms, vm->pc) == 2 && symbols_line(&syms, vm->pc + 26) == 7, "lines");
+    TEST_ASSERT(vm->memory[vm->pc + 26] == INST_JMP, "line 7 is the jmp");
+    char buf[64];
+    TEST_ASSERT(strcmp(symbols_format(&syms, vm->pc + 26, buf, sizeof(buf)), "loop+0xd") == 0, "format");
+    
+    symbols_free(&syms);
+    pocol_free_vm(vm);
+    unlink(src);
+    unlink(pob);
+    unlink(map);
+    return 1;
+}
+
+/* hist_count() over push, pop, push, pop, add, halt and a bad opcode:
+   opcode, form and pair cells, then both dumps, most frequent first.
+   The interpreter fills vm->histogram only in `make histogram` builds */
+int test_histogram(void) {
+    static const uint8_t run[][2] = {
+        { INST_PUSH, DESC_PACK(OPR_IMM, OPR_NONE) }, { INST_POP, DESC_PACK(OPR_REG, OPR_NONE) },
+        { INST_PUSH, DESC_PACK(OPR_IMM, OPR_NONE) }, { INST_POP, DESC_PACK(OPR_REG, OPR_NONE) },
+        { INST_ADD, DESC_PACK(OPR_REG, OPR_IMM) }, { INST_HALT, 0 }, { 0xFE, 0xFF },
+    };
+    char out[4096];
+    PocolHistogram *h = hist_new();
+    TEST_ASSERT(h && h->prev == HIST_NO_PREV, "new");
+    for (size_t i = 0; i < sizeof(run) / sizeof(run[0]); i++)
+        hist_count(h, run[i][0], run[i][1]);
+    
+    TEST_ASSERT(h->total == 7 && h->ops[INST_PUSH] == 2 && h->ops[INST_POP] == 2 && h->ops[0xFE] == 1, "ops");
+    TEST_ASSERT(h->forms[INST_ADD][DESC_PACK(OPR_REG, OPR_IMM)] == 1 &&
+                h->forms[INST_PUSH][DESC_PACK(OPR_IMM, OPR_NONE)] == 2, "forms");
+    TEST_ASSERT(h->pairs[INST_PUSH][INST_POP] == 2 && h->pairs[INST_POP][INST_PUSH] == 1 &&
+                h->pairs[INST_POP][INST_ADD] == 1 && h->pairs[INST_HALT][0xFE] == 1, "pairs");
+    TEST_ASSERT(h->pairs[INST_HALT][INST_PUSH] == 0 && h->prev == 0xFE, "no pair before the first");
+    
+    FILE *f = tmpfile();
+    TEST_ASSERT(f, "tmpfile");
+    hist_dump(h, f, HIST_DUMP_TEXT);
+    rewind(f);
+    out[fread(out, 1, sizeof(out) - 1, f)] = '\0';
+    fclose(f);
+    TEST_ASSERT(strstr(out, "Instructions: 7\n"), "text total");
+    TEST_ASSERT(strstr(out, "%\npush                                  2   28.57%\n"
+                            "pop                                   2   28.57%\n"), "text opcodes, ties by code");
+    TEST_ASSERT(strstr(out, "\nadd reg,imm                           1   14.29%\n"), "text form");
+    TEST_ASSERT(strstr(out, "\n0xFE desc=0xFF                        1"), "bad form");
+    TEST_ASSERT(strstr(out, "%\npush -> pop                           2   28.57%\n"), "text pair first");
+    
+    f = tmpfile();
+    TEST_ASSERT(f, "tmpfile");
+    hist_dump(h, f, HIST_DUMP_JSON);
+    rewind(f);
+    out[fread(out, 1, sizeof(out) - 1, f)] = '\0';
+    fclose(f);
+    TEST_ASSERT(strncmp(out, "{\"total\":7,\"opcodes\":[\n  {\"op\":\"push\",\"code\":1,\"count\":2},", 50) == 0, "json head");
+    TEST_ASSERT(strstr(out, "{\"form\":\"add reg,imm\",\"code\":3,\"desc\":33,\"count\":1}"), "json form");
+    TEST_ASSERT(strstr(out, "\"pairs\":[\n  {\"first\":\"push\",\"second\":\"pop\",\"count\":2}"), "json pair");
+    TEST_ASSERT(strcmp(out + strlen(out) - 4, "\n]}\n") == 0, "json end");
+    hist_free(h);
+    
+    uint8_t code[32];
+    size_t n = test_push(code, 5);
+    n += test_pop(code + n, 1);
+    n += test_op(code + n, INST_HALT);
+    PocolVM *vm = test_vm_new(code, n);
+    TEST_ASSERT(vm, "load");
+    vm->histogram = h = hist_new();
+    TEST_ASSERT(h && pocol_execute_program(vm, -1) == ERR_OK, "run");
+    TEST_ASSERT(h->total == (hist_available() ? 3u : 0u), "interpreter counts only when built with it");
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* SIGPROF sampling of add r1, 1; add r2, 2; jmp back: only one sampler
+   at a time, every sample lands inside the loop while interpreting,
+   none after the stop; then the folded output, labels from a .map */
+int test_sampler(void) {
+    char path[] = "/tmp/pocol_folded_XXXXXX", map[] = "/tmp/pocol_map_XXXXXX", buf[128], line[128];
+    PocolSampler s, other;
+    uint8_t code[32];
+    size_t n = test_add(code, 1, 1);
+    n += test_add(code + n, 2, 2);
+    PocolVM *vm = test_vm_new(code, n + 10);
+    TEST_ASSERT(vm, "load");
+    Inst_Addr entry = vm->pc;
+    test_jmp(vm->memory + entry + n, entry);
+    
+    TEST_ASSERT(sampler_start(&s, vm, 0) < 0 && errno == EINVAL, "bad rate");
+    TEST_ASSERT(sampler_start(&s, vm, 10000) == 0 && s.active, "start");
+    TEST_ASSERT(sampler_start(&other, vm, 10000) < 0 && errno == EINVAL, "one at a time");
+    for (int i = 0; i < 5000 && s.samples < 20; i++)
+        TEST_ASSERT(pocol_execute_program(vm, 100000) == ERR_OK, "run");
+    sampler_stop(&s);
+    uint64_t samples = s.samples, sum = 0;
+    TEST_ASSERT(samples >= 20 && !s.active, "sampled");
+    TEST_ASSERT(pocol_execute_program(vm, 1000000) == ERR_OK && s.samples == samples, "quiet after stop");
+    for (int i = 0; i < SAMPLER_SLOTS; i++) {
+        SamplerSlot *slot = &s.slots[i];
+        if (!slot->count) continue;
+        /* the handler may catch pc halfway through an instruction, or
+           just past the jmp while it fetches the target */
+        TEST_ASSERT(slot->pc >= entry && slot->pc <= entry + n + 10 && slot->block == -1 && slot->syscall == -1, "slot");
+        sum += slot->count;
+    }
+    TEST_ASSERT(sum + s.dropped == samples, "every sample kept or dropped");
+    
+    /* known slots, so the output is fixed */
+    memset(s.slots, 0, SAMPLER_SLOTS * sizeof(SamplerSlot));
+    s.slots[0] = (SamplerSlot){ entry + 11, -1, SYS_WRITE, 3 };
+    s.slots[1] = (SamplerSlot){ entry, 0, -1, 5 };
+    s.slots[2] = (SamplerSlot){ entry + 0x40, -1, -1, 1 };
+    snprintf(buf, sizeof(buf), "POCOLMAP 1\nsym %llx %llx loop\n",
+             (unsigned long long)entry, (unsigned long long)(entry + n + 10));
+    TEST_ASSERT(test_host_file(map, buf) == 0, "map");
+    vm->symbols = malloc(sizeof(PocolSymbols));
+    TEST_ASSERT(vm->symbols && symbols_load(vm->symbols, map) == 0, "symbols");
+    unlink(map);
+    int fd = mkstemp(path);
+    TEST_ASSERT(fd >= 0, "mkstemp");
+    close(fd);
+    TEST_ASSERT(sampler_write_folded(&s, path) == 0, "write");
+    FILE *f = fopen(path, "r");
+    TEST_ASSERT(f, "folded");
+    TEST_ASSERT(fgets(line, sizeof(line), f) && strcmp(line, "pm;interp;loop;loop+0xb;sys_write 3\n") == 0, "syscall frame");
+    TEST_ASSERT(fgets(line, sizeof(line), f) && strcmp(line, "pm;jit;loop 5\n") == 0, "jit frame");
+    snprintf(buf, sizeof(buf), "pm;interp;0x%04llx 1\n", (unsigned long long)(entry + 0x40));
+    TEST_ASSERT(fgets(line, sizeof(line), f) && strcmp(line, buf) == 0, "bare address");
+    TEST_ASSERT(!fgets(line, sizeof(line), f), "three lines");
+    fclose(f);
+    unlink(path);
+    
+    sampler_free(&s);
+    pocol_free_vm(vm);
+    return 1;
+}
+
+static int test_noop_before(PocolVM *vm, void *user) {
+    (void)vm;
+    (void)user;
+    return 0;
+}
+
+static void test_count_after(PocolVM *vm, Inst_Addr pc, uint8_t op, void *user) {
+    (void)vm;
+    (void)pc;
+    (void)op;
+    ++*(uint64_t*)user;
+}
+
+/* Region 1 around two adds, r0 cleared after the END (it holds the
+   elapsed time), then add r1, 1; add r2, 2; jmp back forever. Run in
+   uneven slices, with `hooks` installed or not */
+static PocolVM *test_parity_run(const PocolHooks *hooks) {
+    uint8_t code[160];
+    size_t n = test_push(code, SYS_PROF_BEGIN);
+    n += test_pop(code + n, 0);
+    n += test_push(code + n, 1);
+    n += test_pop(code + n, 1);
+    n += test_op(code + n, INST_SYS);
+    n += test_add(code + n, 3, 5);
+    n += test_add(code + n, 3, 5);
+    n += test_push(code + n, SYS_PROF_END);
+    n += test_pop(code + n, 0);
+    n += test_op(code + n, INST_SYS);
+    n += test_push(code + n, 0);
+    n += test_pop(code + n, 0);
+    size_t loop = n;
+    n += test_add(code + n, 1, 1);
+    n += test_add(code + n, 2, 2);
+    PocolVM *vm = test_vm_new(code, n + 10);
+    if (!vm) return NULL;
+    test_jmp(vm->memory + vm->pc + n, vm->pc + loop);
+    if (hooks && pocol_add_hooks(vm, hooks) < 0) return vm;
+    static const int slices[] = { 5, 1, 4, 13, 1, 20 };
+    for (size_t i = 0; i < sizeof(slices) / sizeof(slices[0]); i++)
+        if (pocol_execute_program(vm, slices[i]) != ERR_OK) break;
+    if (hooks) pocol_remove_hooks(vm, hooks);
+    return vm;
+}
+
+/* The lean and hooked interpreters agree on pc, registers, stack and
+   the retired count, the part committed at each SYS included */
+int test_interp_parity(void) {
+    uint64_t seen = 0;
+    PocolHooks hooks = { test_noop_before, test_count_after, &seen };
+    PocolVM *lean = test_parity_run(NULL);
+    PocolVM *hooked = test_parity_run(&hooks);
+    TEST_ASSERT(lean && hooked, "load");
+    
+    TEST_ASSERT(lean->pc == hooked->pc && lean->sp == hooked->sp, "pc and sp");
+    TEST_ASSERT(memcmp(lean->registers, hooked->registers, sizeof(lean->registers)) == 0, "registers");
+    TEST_ASSERT(lean->registers[3] == 10 && lean->registers[0] == 0, "ran the program");
+    SysCallContext *a = lean->syscall_ctx, *b = hooked->syscall_ctx;
+    TEST_ASSERT(a->instruction_count == 44 && b->instruction_count == 44, "retired");
+    TEST_ASSERT(seen == 44, "hook saw each one");
+    TEST_ASSERT(a->profile.regions[1].count == 1 && b->profile.regions[1].count == 1, "region");
+    TEST_ASSERT(a->profile.regions[1].instructions == 5 &&
+                b->profile.regions[1].instructions == 5, "count at SYS");
+    
+    pocol_free_vm(lean);
+    pocol_free_vm(hooked);
+    return 1;
+}
+
+/* tests/syscall_prof.pcl: BEGIN 1, BEGIN 2, END 2, END 1, END 1. The
+   regions hold what --regions=text prints, region 2 inside 1, and the
+   stray END fails with the nesting left empty */
+int test_profile(void) {
+    static const int calls[][2] = {
+        { SYS_PROF_BEGIN, 1 }, { SYS_PROF_BEGIN, 2 }, { SYS_PROF_END, 2 },
+        { SYS_PROF_END, 1 }, { SYS_PROF_END, 1 },
+    };
+    uint8_t code[256];
+    size_t n = 0;
+    for (size_t i = 0; i < sizeof(calls) / sizeof(calls[0]); i++) {
+        n += test_push(code + n, calls[i][0]);
+        n += test_pop(code + n, 0);
+        n += test_push(code + n, calls[i][1]);
+        n += test_pop(code + n, 1);
+        if (i == 0) {
+            n += test_push(code + n, 0);
+            n += test_pop(code + n, 2);
+        }
+        n += test_op(code + n, INST_SYS);
+    }
+    n += test_op(code + n, INST_HALT);
+    PocolVM *vm = test_vm_new(code, n);
+    TEST_ASSERT(vm, "load");
+    TEST_ASSERT(pocol_execute_program(vm, -1) == ERR_OK && vm->halt, "run");
+    
+    PocolProfile *prof = &vm->syscall_ctx->profile;
+    ProfRegion *outer = &prof->regions[1], *inner = &prof->regions[2];
+    TEST_ASSERT(outer->count == 1 && inner->count == 1, "counts");
+    TEST_ASSERT(outer->instructions == 15 && inner->instructions == 5, "instructions");
+    TEST_ASSERT(outer->parent == -1 && inner->parent == 1, "nesting");
+    TEST_ASSERT(inner->self == inner->total, "leaf self is total");
+    TEST_ASSERT(outer->self == outer->total - inner->total, "self excludes the child");
+    TEST_ASSERT(outer->min == outer->total && outer->max == outer->total, "min and max");
+    TEST_ASSERT(prof->depth == 0 && prof->mismatched == 1, "stray end");
+    TEST_ASSERT(vm->registers[0] == (uint64_t)-1, "stray end fails");
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* add r1, 1; add r2, 1; jmp back, under the debugger's hooks with a
+   logpoint on the first add and "r1 == 3" on the second. Every arrival
+   counts and logs, only the third one at the breakpoint stops */
+int test_hooked_breakpoints(void) {
+    uint8_t code[64];
+    size_t n = test_add(code, 1, 1);
+    n += test_add(code + n, 2, 1);
+    PocolVM *vm = test_vm_new(code, n + 10);
+    DebuggerContext dbg;
+    char err[128], out[256];
+    TEST_ASSERT(vm, "load");
+    Inst_Addr entry = vm->pc;
+    test_jmp(vm->memory + entry + n, entry);
+    debugger_init(&dbg, vm);
+    TEST_ASSERT(debugger_add_logpoint(&dbg, entry, "r1={r1}", err, sizeof(err)) == 0, "logpoint");
+    TEST_ASSERT(debugger_add_conditional(&dbg, entry + 11, "r1 == 3", err, sizeof(err)) == 1, "conditional");
+    
+    /* the logpoint and the stop message go to stdout */
+    FILE *f = tmpfile();
+    TEST_ASSERT(f, "tmpfile");
+    fflush(stdout);
+    int saved = dup(STDOUT_FILENO);
+    TEST_ASSERT(saved >= 0 && dup2(fileno(f), STDOUT_FILENO) >= 0, "redirect");
+    TEST_ASSERT(pocol_add_hooks(vm, &dbg.hooks) == 0, "hooks");
+    Err first = pocol_execute_program(vm, -1);
+    Inst_Addr stop_pc = vm->pc;
+    uint64_t r1 = vm->registers[1], r2 = vm->registers[2];
+    /* off the breakpoint without hooks, as debugger_resume() does, then
+       three rounds where the condition stays false */
+    pocol_remove_hooks(vm, &dbg.hooks);
+    Err step = pocol_execute_program(vm, 1);
+    pocol_add_hooks(vm, &dbg.hooks);
+    Err second = pocol_execute_program(vm, 9);
+    pocol_remove_hooks(vm, &dbg.hooks);
+    fflush(stdout);
+    dup2(saved, STDOUT_FILENO);
+    close(saved);
+    
+    TEST_ASSERT(first == ERR_OK && step == ERR_OK && second == ERR_OK, "runs");
+    TEST_ASSERT(stop_pc == entry + 11 && r1 == 3 && r2 == 2, "stopped on the third arrival");
+    TEST_ASSERT(vm->pc == entry + n && vm->registers[1] == 6 && vm->registers[2] == 6, "false condition runs on");
+    TEST_ASSERT(dbg.breakpoints[1].hit_count == 6, "every arrival counted");
+    TEST_ASSERT(dbg.breakpoints[0].hit_count == 6, "logpoint counted");
+    rewind(f);
+    size_t len = fread(out, 1, sizeof(out) - 1, f);
+    out[len] = '\0';
+    fclose(f);
+    TEST_ASSERT(strstr(out, "r1=0\nr1=1\nr1=2\n\n*** Breakpoint 1 hit at"), "logged, then stopped");
+    TEST_ASSERT(strstr(out, "***\nr1=3\nr1=4\nr1=5\n") && !strstr(out, "r1=6"), "logged after");
+    TEST_ASSERT(strstr(out, "Breakpoint 0") == NULL, "logpoint never stops");
+    
+    debugger_free(&dbg);
+    pocol_free_vm(vm);
+    return 1;
+}
+
+static int test_jit_calls;
+
+static int test_jit_go_on(PocolVM *vm, void *user) {
+    (void)vm;
+    (void)user;
+    test_jit_calls++;
+    return 0;
+}
+
+/* add r1, 1; add r2, 2; add r3, 3; jmp back. A breakpoint set once the
+   loop is one compiled block splits it, and the next run stops before
+   add r3 with the first half done; a stop_check that says no runs on */
+int test_jit_breakpoint(void) {
+    uint8_t code[64];
+    size_t n = test_add(code, 1, 1);
+    n += test_add(code + n, 2, 2);
+    n += test_add(code + n, 3, 3);
+    PocolVM *vm = test_vm_new(code, n + 10);
+    DebuggerContext dbg;
+    TEST_ASSERT(vm, "load");
+    Inst_Addr entry = vm->pc;
+    test_jmp(vm->memory + entry + n, entry);
+    JitContext *jit = pocol_jit_context(vm);
+    TEST_ASSERT(jit, "context");
+    
+    TEST_ASSERT(pocol_jit_execute_program(jit, vm, 2) == ERR_OK, "warm up");
+    JitCacheEntry *block = pocol_jit_find_cache(jit, entry);
+    TEST_ASSERT(block && block->compiled && block->end_pc > entry + 22, "one block");
+    TEST_ASSERT(vm->pc == entry && vm->registers[3] == 6, "two rounds");
+    
+    debugger_init(&dbg, vm);
+    TEST_ASSERT(debugger_use_jit(&dbg) == 0, "use jit");
+    TEST_ASSERT(debugger_add_breakpoint(&dbg, entry + 22) == 0, "break");
+    TEST_ASSERT(pocol_jit_execute_program(jit, vm, -1) == ERR_OK, "run");
+    TEST_ASSERT(vm->pc == entry + 22, "stop pc");
+    TEST_ASSERT(vm->registers[1] == 3 && vm->registers[2] == 6 && vm->registers[3] == 6, "stop registers");
+    block = pocol_jit_find_cache(jit, entry);
+    TEST_ASSERT(block && block->end_pc == entry + 22, "block split");
+    TEST_ASSERT(pocol_jit_execute_program(jit, vm, -1) == ERR_OK && vm->pc == entry + 22 &&
+                vm->registers[3] == 6, "stays stopped");
+    
+    jit->stop_check = test_jit_go_on;
+    test_jit_calls = 0;
+    TEST_ASSERT(pocol_jit_execute_program(jit, vm, 4) == ERR_OK, "run through");
+    TEST_ASSERT(test_jit_calls == 2, "asked at each arrival");
+    TEST_ASSERT(vm->pc == entry + 22, "two more rounds");
+    TEST_ASSERT(vm->registers[1] == 5 && vm->registers[2] == 10 && vm->registers[3] == 12, "registers");
+    
+    debugger_free(&dbg);
+    TEST_ASSERT(!jit->stop_bits && !jit->stop_check, "detached");
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* push 5; pop r1; add r1, 3; halt. The trace is a header and ten bytes,
+   fall-through INST records and REG deltas, and decodes to the same run */
+int test_trace(void) {
+    uint8_t code[32];
+    size_t n = test_push(code, 5);
+    n += test_pop(code + n, 1);
+    n += test_add(code + n, 1, 3);
+    code[n++] = INST_HALT;
+    code[n++] = 0;
+    static const uint8_t expect[] = { 0x00, 0x50, 0x05, 0x0A, 0x18, 0x05, 0x06, 0x58, 0x03, 0x04 };
+    static const Inst_Addr pcs[] = { 0, 10, 13, 24 };
+    char path[] = "/tmp/pocol_trace_XXXXXX";
+    PocolVM *vm = test_vm_new(code, n);
+    PocolTrace trace;
+    TraceHeader h;
+    uint8_t buf[64];
+    TEST_ASSERT(vm, "load");
+    TEST_ASSERT(test_host_file(path, "") == 0, "host file");
+    Inst_Addr entry = vm->pc;
+    
+    TEST_ASSERT(trace_open(&trace, vm, path, 0) == 0, "open");
+    TEST_ASSERT(pocol_execute_program(vm, -1) == ERR_OK && vm->halt, "run");
+    TEST_ASSERT(trace_close(&trace) == 0, "close");
+    TEST_ASSERT(!vm->trace && vm->hook_count == 0, "hooks removed");
+    
+    FILE *f = fopen(path, "rb");
+    TEST_ASSERT(f, "reopen");
+    TEST_ASSERT(fread(&h, sizeof(h), 1, f) == 1, "header");
+    size_t len = fread(buf, 1, sizeof(buf), f);
+    fclose(f);
+    unlink(path);
+    TEST_ASSERT(memcmp(h.magic, TRACE_MAGIC, 4) == 0 && h.version == TRACE_VERSION && h.entry == entry, "header fields");
+    TEST_ASSERT(len == sizeof(expect) && memcmp(buf, expect, len) == 0, "records");
+    
+    /* what tools/pmtrace does with them */
+    uint64_t pc = h.entry, regs[8], count = 0;
+    int insts = 0;
+    memcpy(regs, h.registers, sizeof(regs));
+    for (const uint8_t *p = buf, *end = buf + len; p < end; ) {
+        uint8_t tag = *p++;
+        uint64_t v = 0;
+        if (TRACE_KIND(tag) == TRACE_END) {
+            TEST_ASSERT(trace_get_varint(p, end, &count) == 1, "end count");
+            break;
+        } else if (TRACE_KIND(tag) == TRACE_REG) {
+            size_t k = trace_get_varint(p, end, &v);
+            TEST_ASSERT(k, "REG delta");
+            p += k;
+            regs[tag >> 2] += (uint64_t)trace_unzigzag(v);
+        } else {
+            TEST_ASSERT(TRACE_KIND(tag) == TRACE_INST && (tag >> 2) != TRACE_INST_LONG, "short INST");
+            pc += (uint64_t)trace_unzigzag(tag >> 2);
+            TEST_ASSERT(insts < 4 && pc == entry + pcs[insts], "instruction address");
+            insts++;
+        }
+    }
+    TEST_ASSERT(insts == 4 && count == 4, "instruction count");
+    TEST_ASSERT(regs[1] == 8 && regs[1] == vm->registers[1], "register replayed");
+    
+    /* a write that fails is reported by trace_close(), with its errno */
+    if (access("/dev/full", W_OK) == 0) {
+        vm->pc = entry;
+        vm->halt = 0;
+        TEST_ASSERT(trace_open(&trace, vm, "/dev/full", 0) == 0, "open /dev/full");
+        TEST_ASSERT(pocol_execute_program(vm, -1) == ERR_OK, "run again");
+        TEST_ASSERT(trace_close(&trace) < 0 && errno == ENOSPC, "write error");
+    }
+    
+    pocol_free_vm(vm);
+    return 1;
+}
+
+/* Record a run that reads a host file, then step back over the SYS and
+   forward again. The replay applies the logged read: the guest sees the
+   old contents and the host file offset does not move a second time */
+int test_replay(void) {
+    char path[] = "/tmp/pocol_test_XXXXXX";
+    TEST_ASSERT(test_host_file(path, "hello") == 0, "host file");
+    
+    /* r0-r3 = SYS_READ_FILE, fd, TEST_DATA, 5; sys; add r1, 1; halt.
+       The fd is patched in once the file is open */
+    uint8_t code[128];
+    size_t n = 0;
+    n += test_push(code + n, SYS_READ_FILE);
+    n += test_pop(code + n, 0);
+    Inst_Addr fd_imm = n + 2;
+    n += test_push(code + n, 0);
+    n += test_pop(code + n, 1);
+    n += test_push(code + n, TEST_DATA);
+    n += test_pop(code + n, 2);
+    n += test_push(code + n, 5);
+    n += test_pop(code + n, 3);
+    Inst_Addr sys_pc = n;
+    code[n++] = INST_SYS;
+    code[n++] = 0;
+    n += test_add(code + n, 1, 1);
+    code[n++] = INST_HALT;
+    code[n++] = 0;
+    
+    PocolVM *vm = test_vm_new(code, n);
+    DebuggerContext dbg;
+    TEST_ASSERT(vm, "load");
+    int64_t fd = test_sys(vm, SYS_OPEN, TEST_DATA, test_poke_str(vm, TEST_DATA, path), O_RDONLY, 0);
+    TEST_ASSERT(fd >= 0, "open");
+    Inst_Addr entry = vm->pc;
+    memcpy(vm->memory + entry + fd_imm, &fd, 8);
+    memset(vm->memory + TEST_DATA, 0, 64);
+    memset(vm->registers, 0, sizeof(vm->registers));
+    debugger_init(&dbg, vm);
+    TEST_ASSERT(debugger_record(&dbg, 4) == 0, "record");
+    debugger_resume(&dbg);
+    TEST_ASSERT(vm->halt && dbg.replay->end == 11, "live run");
+    TEST_ASSERT(memcmp(vm->memory + TEST_DATA, "hello", 5) == 0 && vm->registers[0] == 5, "read");
+    FILE *f = fopen(path, "w");
+    TEST_ASSERT(f && fputs("HELLO", f) >= 0 && fclose(f) == 0, "rewrite host file");
+    
+    debugger_reverse_step(&dbg, 3);
+    TEST_ASSERT(dbg.replay->pos == 8 && vm->pc == entry + sys_pc && !vm->halt, "back before the SYS");
+    TEST_ASSERT(vm->registers[0] == SYS_READ_FILE && vm->memory[TEST_DATA] == 0, "state before the SYS");
+    dbg.mode = DEBUG_MODE_STEP_IN;
+    dbg.steps_remaining = 1;
+    debugger_resume(&dbg);
+    TEST_ASSERT(dbg.replay->pos == 9 && vm->registers[0] == 5, "SYS replayed");
+    TEST_ASSERT(memcmp(vm->memory + TEST_DATA, "hello", 5) == 0, "logged read applied");
+    
+    debugger_reverse_step(&dbg, 100);
+    TEST_ASSERT(dbg.replay->pos == 0 && vm->pc == entry && vm->registers[1] == 0, "start of history");
+    dbg.mode = DEBUG_MODE_RUN;
+    debugger_resume(&dbg);
+    TEST_ASSERT(dbg.replay->pos == 11 && vm->halt && vm->registers[1] == (uint64_t)fd + 1, "forward to the end");
+    TEST_ASSERT(test_sys(vm, SYS_TELL, fd, 0, 0, 0) == 5, "host read once");
+    
+    debugger_free(&dbg);
+    pocol_free_vm(vm);
+    unlink(path);
+    return 1;
+}
+
+int main(void) {
     printf("PocolVM Test Suite\n");
     printf("===================\n\n");
     
@@ -57,6 +1351,30 @@ int main(int argc, char **argv) {
     TEST_RUN("Memory", test_memory);
     TEST_RUN("Stack", test_stack);
     TEST_RUN("Instructions", test_instructions);
+    TEST_RUN("SYS_MMAP", test_mmap);
+    TEST_RUN("SYS_READV/SYS_WRITEV", test_readv_writev);
+    TEST_RUN("SYS_BATCH", test_batch);
+    TEST_RUN("memfs", test_memfs);
+    TEST_RUN("fd table", test_fd_table);
+    TEST_RUN("SYS_OPENDIR/SYS_READDIR", test_readdir);
+    TEST_RUN("Syscall registration", test_register);
+    TEST_RUN("SYS_COPY", test_copy);
+    TEST_RUN("Block cache", test_block_cache);
+    TEST_RUN("SYS_SPAWN", test_spawn);
+    TEST_RUN("Predicates", test_predicate);
+    TEST_RUN("Breakpoints", test_breakpoints);
+    TEST_RUN("Watchpoint faults", test_watch_fault);
+    TEST_RUN("Hooked breakpoints", test_hooked_breakpoints);
+    TEST_RUN("JIT breakpoints", test_jit_breakpoint);
+    TEST_RUN("Trace round trip", test_trace);
+    TEST_RUN("Record and replay", test_replay);
+    TEST_RUN("Profile regions", test_profile);
+    TEST_RUN("Lean and hooked interpreters", test_interp_parity);
+    TEST_RUN("Metrics", test_metrics);
+    TEST_RUN("Symbol maps", test_symbols);
+    TEST_RUN("posm -g round trip", test_symbols_posm);
+    TEST_RUN("Opcode histogram", test_histogram);
+    TEST_RUN("Sampler", test_sampler);
     
     printf("\n=== Results ===\n");
     printf("Total:  %d\n", total);
@@ -0,0 +1,498 @@
+/* pmtrace.c -- Offline analyzer for `pm --trace` files */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#include "../trace_format.h"
+#include "../vm_symbols.h"
+#include "../../common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+/* pmtrace COMMAND [-p prog.pob] [-m prog.map] [-n N] [-r REG] TRACE
+
+     summary   totals, record mix, distinct pcs
+     stream    the instruction stream with register writes, in order
+     hot       hottest pcs and hottest taken control-flow edges
+     regs      register timeline: every write with its instruction index
+
+   With -p the program supplies opcode names and exact instruction
+   lengths, and its .map (or -m) supplies labels. */
+
+#define READER_BUFFER   (64 * 1024)
+#define READER_REFILL   64              /* larger than any single record */
+#define DEFAULT_TOP     20
+
+static const char *mnemonics[] = {"halt", "push", "pop", "add", "jmp", "print", "sys"};
+
+typedef struct {
+	FILE *fp;
+	uint8_t buf[READER_BUFFER];
+	size_t pos, len;
+	int eof;
+	TraceHeader header;
+	uint64_t last_pc;
+	uint64_t regs[8];
+	uint64_t index;                 /* instructions decoded so far */
+} TraceReader;
+
+typedef struct {
+	int kind;                       /* TRACE_INST, TRACE_REG, TRACE_BLOCK, TRACE_END */
+	uint64_t pc;                    /* INST, BLOCK */
+	uint64_t count;                 /* BLOCK: instructions, END: recorded total */
+	int reg;                        /* REG */
+	uint64_t value;                 /* REG: new value */
+} TraceEvent;
+
+typedef struct {
+	uint64_t a, b;
+	uint64_t count;                 /* 0 marks a free slot */
+} Counter;
+
+typedef struct {
+	Counter *slots;
+	size_t cap, used;
+} CounterTable;
+
+typedef struct {
+	uint8_t *code;                  /* whole .pob, addresses match the VM's */
+	size_t size;
+	PocolSymbols syms;
+	int have_syms;
+} Program;
+
+/*************************** Reader ***************************/
+
+ST_FUNC int reader_open(TraceReader *r, const char *path)
+{
+	memset(r, 0, sizeof(*r));
+	r->fp = fopen(path, "rb");
+	if (!r->fp)
+		return -1;
+	if (fread(&r->header, sizeof(r->header), 1, r->fp) != 1 ||
+	    memcmp(r->header.magic, TRACE_MAGIC, 4) != 0) {
+		fclose(r->fp);
+		errno = EINVAL;
+		return -1;
+	}
+	if (r->header.version != TRACE_VERSION) {
+		fclose(r->fp);
+		errno = ENOTSUP;
+		return -1;
+	}
+	r->last_pc = r->header.entry;
+	memcpy(r->regs, r->header.registers, sizeof(r->regs));
+	return 0;
+}
+
+ST_FUNC void reader_fill(TraceReader *r)
+{
+	if (r->eof || r->len - r->pos >= READER_REFILL)
+		return;
+	memmove(r->buf, r->buf + r->pos, r->len - r->pos);
+	r->len -= r->pos;
+	r->pos = 0;
+	size_t n = fread(r->buf + r->len, 1, READER_BUFFER - r->len, r->fp);
+	if (n == 0)
+		r->eof = 1;
+	r->len += n;
+}
+
+ST_FUNC int reader_varint(TraceReader *r, uint64_t *v)
+{
+	size_t n = trace_get_varint(r->buf + r->pos, r->buf + r->len, v);
+	r->pos += n;
+	return n ? 0 : -1;
+}
+
+/* 1 with an event, 0 at END, -1 if the trace is cut short or corrupt */
+ST_FUNC int reader_next(TraceReader *r, TraceEvent *e)
+{
+	uint64_t v, count;
+
+	reader_fill(r);
+	if (r->pos >= r->len)
+		return -1;
+
+	uint8_t tag = r->buf[r->pos++];
+	memset(e, 0, sizeof(*e));
+	e->kind = TRACE_KIND(tag);
+
+	switch (e->kind) {
+	case TRACE_INST:
+		v = tag >> 2;
+		if (v == TRACE_INST_LONG && reader_varint(r, &v) < 0)
+			return -1;
+		e->pc = r->last_pc + (uint64_t)trace_unzigzag(v);
+		r->last_pc = e->pc;
+		r->index++;
+		return 1;
+
+	case TRACE_REG:
+		e->reg = (tag >> 2) & 7;
+		if (reader_varint(r, &v) < 0)
+			return -1;
+		r->regs[e->reg] += (uint64_t)trace_unzigzag(v);
+		e->value = r->regs[e->reg];
+		return 1;
+
+	case TRACE_BLOCK:
+		if (reader_varint(r, &v) < 0 || reader_varint(r, &count) < 0)
+			return -1;
+		e->pc = r->last_pc + (uint64_t)trace_unzigzag(v);
+		e->count = count;
+		r->last_pc = e->pc;
+		r->index += count;
+		return 1;
+
+	default:
+		if (reader_varint(r, &v) < 0)
+			return -1;
+		e->count = v;
+		return 0;
+	}
+}
+
+/*************************** Counters ***************************/
+
+ST_FUNC size_t counter_hash(uint64_t a, uint64_t b)
+{
+	uint64_t h = a * 0x9E3779B97F4A7C15ULL ^ (b + 0x632BE59BD9B4E019ULL) * 0xC2B2AE3D27D4EB4FULL;
+	return (size_t)(h ^ (h >> 31));
+}
+
+ST_FUNC Counter *counter_get(CounterTable *t, uint64_t a, uint64_t b)
+{
+	if (t->used * 10 >= t->cap * 7) {
+		CounterTable bigger = { NULL, t->cap ? t->cap * 2 : 1024, 0 };
+		bigger.slots = calloc(bigger.cap, sizeof(Counter));
+		if (!bigger.slots) {
+			fprintf(stderr, "pmtrace: out of memory\n");
+			exit(1);
+		}
+		for (size_t i = 0; i < t->cap; i++) {
+			if (t->slots[i].count == 0)
+				continue;
+			size_t j = counter_hash(t->slots[i].a, t->slots[i].b) & (bigger.cap - 1);
+			while (bigger.slots[j].count)
+				j = (j + 1) & (bigger.cap - 1);
+			bigger.slots[j] = t->slots[i];
+			bigger.used++;
+		}
+		free(t->slots);
+		*t = bigger;
+	}
+
+	size_t i = counter_hash(a, b) & (t->cap - 1);
+	while (t->slots[i].count) {
+		if (t->slots[i].a == a && t->slots[i].b == b)
+			return &t->slots[i];
+		i = (i + 1) & (t->cap - 1);
+	}
+	t->slots[i].a = a;
+	t->slots[i].b = b;
+	t->used++;
+	return &t->slots[i];
+}
+
+ST_FUNC int counter_cmp(const void *x, const void *y)
+{
+	const Counter *a = x, *b = y;
+	if (a->count != b->count)
+		return a->count < b->count ? 1 : -1;
+	if (a->a != b->a)
+		return a->a < b->a ? -1 : 1;
+	return (a->b > b->b) - (a->b < b->b);
+}
+
+/* Packs the used slots to the front, most frequent first */
+ST_FUNC size_t counter_sort(CounterTable *t)
+{
+	size_t n = 0;
+	for (size_t i = 0; i < t->cap; i++)
+		if (t->slots[i].count)
+			t->slots[n++] = t->slots[i];
+	qsort(t->slots, n, sizeof(Counter), counter_cmp);
+	return n;
+}
+
+/*************************** Program ***************************/
+
+ST_FUNC int program_load(Program *p, const char *path, const char *map)
+{
+	char map_path[1024];
+	FILE *fp = fopen(path, "rb");
+
+	if (!fp)
+		return -1;
+	fseek(fp, 0, SEEK_END);
+	long size = ftell(fp);
+	rewind(fp);
+	p->code = malloc(size > 0 ? (size_t)size : 1);
+	if (!p->code) {
+		fclose(fp);
+		errno = ENOMEM;
+		return -1;
+	}
+	p->size = fread(p->code, 1, (size_t)size, fp);
+	fclose(fp);
+
+	if (!map) {
+		symbols_map_path(path, map_path, sizeof(map_path));
+		map = map_path;
+	}
+	p->have_syms = symbols_load(&p->syms, map) == 0;
+	return 0;
+}
+
+ST_FUNC const char *program_op(const Program *p, uint64_t pc)
+{
+	if (!p->code || pc >= p->size)
+		return "";
+	return p->code[pc] < sizeof(mnemonics) / sizeof(mnemonics[0]) ? mnemonics[p->code[pc]] : "???";
+}
+
+/* Bytes in the instruction at pc; 0 if unknown */
+ST_FUNC uint64_t program_inst_size(const Program *p, uint64_t pc)
+{
+	static const int operand_bytes[] = {0, 1, 8};       /* none, reg, imm */
+	if (!p->code || pc + 1 >= p->size)
+		return 0;
+	uint8_t desc = p->code[pc + 1];
+	if ((desc & 0x0F) > 2 || (desc >> 4) > 2)
+		return 0;
+	return 2 + operand_bytes[desc & 0x0F] + operand_bytes[desc >> 4];
+}
+
+/* An edge is a taken jump unless it is the plain fall-through. Without
+   the program, anything moving forward by at most one instruction's
+   worth of bytes (2 + 8 + 8) counts as fall-through. */
+ST_FUNC int is_fallthrough(const Program *p, uint64_t from, uint64_t to)
+{
+	uint64_t size = program_inst_size(p, from);
+	if (size)
+		return to == from + size;
+	return to > from && to - from <= 18;
+}
+
+ST_FUNC const char *where(const Program *p, uint64_t pc, char *buf, size_t size)
+{
+	return symbols_format(p->have_syms ? &p->syms : NULL, pc, buf, size);
+}
+
+/*************************** Commands ***************************/
+
+ST_FUNC int cmd_summary(TraceReader *r, const Program *p)
+{
+	TraceEvent e;
+	CounterTable pcs = { NULL, 0, 0 };
+	uint64_t insts = 0, blocks = 0, block_insts = 0, writes[8] = {0}, end = 0;
+	int rc;
+	(void)p;
+
+	while ((rc = reader_next(r, &e)) > 0) {
+		if (e.kind == TRACE_INST) {
+			insts++;
+			counter_get(&pcs, e.pc, 0)->count++;
+		} else if (e.kind == TRACE_BLOCK) {
+			blocks++;
+			block_insts += e.count;
+			counter_get(&pcs, e.pc, 0)->count++;
+		} else if (e.kind == TRACE_REG) {
+			writes[e.reg]++;
+		}
+	}
+	if (rc == 0)
+		end = e.count;
+
+	printf("=== Trace Summary ===\n");
+	printf("Entry: 0x%04" PRIx64 "%s\n", r->header.entry,
+	       r->header.flags & TRACE_FLAG_JIT ? " (JIT)" : "");
+	printf("Instructions: %" PRIu64 " (%" PRIu64 " interpreted, %" PRIu64 " in %" PRIu64 " JIT blocks)\n",
+	       insts + block_insts, insts, block_insts, blocks);
+	printf("Distinct pcs: %zu\n", pcs.used);
+	printf("Register writes:");
+	for (int i = 0; i < 8; i++)
+		printf(" r%d=%" PRIu64, i, writes[i]);
+	printf("\n");
+	if (rc < 0)
+		printf("Trace truncated: no END record\n");
+	else if (end != insts + block_insts)
+		printf("Warning: END says %" PRIu64 " instructions\n", end);
+	free(pcs.slots);
+	return rc < 0;
+}
+
+ST_FUNC int cmd_stream(TraceReader *r, const Program *p, uint64_t limit)
+{
+	TraceEvent e;
+	char buf[128];
+	int rc;
+
+	while ((rc = reader_next(r, &e)) > 0) {
+		if (e.kind == TRACE_INST) {
+			if (limit && r->index > limit)
+				break;
+			printf("%10" PRIu64 "  0x%04" PRIx64 "  %-24s %s\n", r->index - 1, e.pc,
+			       where(p, e.pc, buf, sizeof(buf)), program_op(p, e.pc));
+		} else if (e.kind == TRACE_BLOCK) {
+			if (limit && r->index - e.count >= limit)
+				break;
+			printf("%10" PRIu64 "  0x%04" PRIx64 "  %-24s [jit block, %" PRIu64 " instructions]\n",
+			       r->index - e.count, e.pc, where(p, e.pc, buf, sizeof(buf)), e.count);
+		} else if (e.kind == TRACE_REG) {
+			printf("%10s  %6s  %-24s r%d = %" PRIu64 "\n", "", "", "", e.reg, e.value);
+		}
+	}
+	if (rc < 0 && !(limit && r->index > limit))
+		fprintf(stderr, "pmtrace: trace truncated\n");
+	return 0;
+}
+
+ST_FUNC int cmd_hot(TraceReader *r, const Program *p, size_t top)
+{
+	TraceEvent e;
+	CounterTable pcs = { NULL, 0, 0 }, edges = { NULL, 0, 0 };
+	uint64_t total = 0, prev = 0;
+	int have_prev = 0, rc;
+	char a[128], b[128];
+
+	while ((rc = reader_next(r, &e)) > 0) {
+		if (e.kind != TRACE_INST && e.kind != TRACE_BLOCK)
+			continue;
+		uint64_t n = e.kind == TRACE_BLOCK ? e.count : 1;
+		counter_get(&pcs, e.pc, 0)->count += n;
+		total += n;
+		if (have_prev && !is_fallthrough(p, prev, e.pc))
+			counter_get(&edges, prev, e.pc)->count++;
+		prev = e.pc;
+		have_prev = 1;
+	}
+
+	size_t n = counter_sort(&pcs);
+	printf("=== Hot PCs (%" PRIu64 " instructions) ===\n", total);
+	printf("%-8s %-24s %-6s %14s %8s\n", "pc", "where", "op", "count", "%");
+	for (size_t i = 0; i < n && i < top; i++)
+		printf("0x%04" PRIx64 "   %-24s %-6s %14" PRIu64 " %7.2f%%\n", pcs.slots[i].a,
+		       where(p, pcs.slots[i].a, a, sizeof(a)), program_op(p, pcs.slots[i].a),
+		       pcs.slots[i].count, total ? 100.0 * pcs.slots[i].count / total : 0.0);
+
+	n = counter_sort(&edges);
+	printf("\n=== Hot Edges (taken jumps; backward ones are loops) ===\n");
+	printf("%-24s    %-24s %14s\n", "from", "to", "count");
+	for (size_t i = 0; i < n && i < top; i++)
+		printf("%-24s -> %-24s %14" PRIu64 "%s\n",
+		       where(p, edges.slots[i].a, a, sizeof(a)), where(p, edges.slots[i].b, b, sizeof(b)),
+		       edges.slots[i].count, edges.slots[i].b <= edges.slots[i].a ? "  (back edge)" : "");
+
+	free(pcs.slots);
+	free(edges.slots);
+	return rc < 0;
+}
+
+ST_FUNC int cmd_regs(TraceReader *r, const Program *p, int only)
+{
+	TraceEvent e;
+	uint64_t pc = r->header.entry;
+	char buf[128];
+	int rc;
+
+	printf("%10s  %-24s %-4s %s\n", "index", "pc", "reg", "value");
+	for (int i = 0; i < 8; i++)
+		if (only < 0 || only == i)
+			printf("%10s  %-24s r%-3d %" PRIu64 "\n", "initial", "", i, r->header.registers[i]);
+
+	while ((rc = reader_next(r, &e)) > 0) {
+		if (e.kind == TRACE_INST || e.kind == TRACE_BLOCK)
+			pc = e.pc;
+		else if (e.kind == TRACE_REG && (only < 0 || only == e.reg))
+			printf("%10" PRIu64 "  %-24s r%-3d %" PRIu64 "\n", r->index - 1,
+			       where(p, pc, buf, sizeof(buf)), e.reg, e.value);
+	}
+	return rc < 0;
+}
+
+ST_FUNC void usage(void)
+{
+	fprintf(stderr,
+		"usage: pmtrace summary|stream|hot|regs [options] TRACE\n"
+		"  -p PROG.pob  opcode names, exact fall-through and labels from PROG.map\n"
+		"  -m MAP       labels from MAP\n"
+		"  -n N         stream: first N instructions; hot: top N rows (default %d)\n"
+		"  -r REG       regs: only register REG (0-7)\n", DEFAULT_TOP);
+}
+
+int main(int argc, char **argv)
+{
+	const char *prog = NULL, *map = NULL, *path = NULL;
+	long n = -1;
+	int reg = -1;
+	Program p;
+	TraceReader *r;
+
+	if (argc < 3) {
+		usage();
+		return 2;
+	}
+
+	for (int i = 2; i < argc; i++) {
+		if (strcmp(argv[i], "-p") == 0 && i + 1 < argc)
+			prog = argv[++i];
+		else if (strcmp(argv[i], "-m") == 0 && i + 1 < argc)
+			map = argv[++i];
+		else if (strcmp(argv[i], "-n") == 0 && i + 1 < argc)
+			n = atol(argv[++i]);
+		else if (strcmp(argv[i], "-r") == 0 && i + 1 < argc)
+			reg = atoi(argv[++i]);
+		else if (argv[i][0] != '-' && !path)
+			path = argv[i];
+		else {
+			usage();
+			return 2;
+		}
+	}
+	if (!path || reg > 7) {
+		usage();
+		return 2;
+	}
+
+	memset(&p, 0, sizeof(p));
+	if (prog && program_load(&p, prog, map) < 0) {
+		fprintf(stderr, "pmtrace: %s: %s\n", prog, strerror(errno));
+		return 1;
+	}
+	if (!prog && map)
+		p.have_syms = symbols_load(&p.syms, map) == 0;
+
+	r = malloc(sizeof(TraceReader));
+	if (!r || reader_open(r, path) < 0) {
+		fprintf(stderr, "pmtrace: %s: %s\n", path, r ? strerror(errno) : "out of memory");
+		return 1;
+	}
+
+	int rc;
+	if (strcmp(argv[1], "summary") == 0)
+		rc = cmd_summary(r, &p);
+	else if (strcmp(argv[1], "stream") == 0)
+		rc = cmd_stream(r, &p, n > 0 ? (uint64_t)n : 0);
+	else if (strcmp(argv[1], "hot") == 0)
+		rc = cmd_hot(r, &p, n > 0 ? (size_t)n : DEFAULT_TOP);
+	else if (strcmp(argv[1], "regs") == 0)
+		rc = cmd_regs(r, &p, reg);
+	else {
+		usage();
+		rc = 2;
+	}
+
+	fclose(r->fp);
+	free(r);
+	if (p.have_syms)
+		symbols_free(&p.syms);
+	free(p.code);
+	return rc;
+}
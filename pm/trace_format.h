@@ -0,0 +1,92 @@
+/* trace_format.h -- On-disk format of `pm --trace` files */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_TRACE_FORMAT_H
+#define POCOL_TRACE_FORMAT_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* Shared by the recorder (vm_trace.c) and the analyzer (tools/pmtrace.c),
+   so it depends on nothing else in pm.
+
+   A trace is a TraceHeader followed by a byte stream of records. The low
+   two bits of each record's first byte are its kind:
+
+     INST   z << 2              an instruction ran at last_pc + unzigzag(z);
+                                z == 63 means the real z follows as a varint
+     REG    reg << 2 | 1        register `reg` changed; varint zigzag(new - old)
+     BLOCK  2                   a JIT block ran: varint zigzag(start - last_pc),
+                                varint instruction count
+     END    3                   varint instructions recorded; nothing follows
+
+   INST and BLOCK both set last_pc to the address they describe, which
+   starts out as TraceHeader.entry. A fall-through instruction is one byte.
+   Integers are little-endian, varints LEB128. */
+
+#define TRACE_MAGIC         "PTRC"
+#define TRACE_VERSION       1
+
+#define TRACE_FLAG_JIT      0x0001      /* recorded with --jit, BLOCK records present */
+
+#define TRACE_INST          0
+#define TRACE_REG           1
+#define TRACE_BLOCK         2
+#define TRACE_END           3
+
+#define TRACE_KIND(tag)     ((tag) & 0x03)
+#define TRACE_INST_LONG     63          /* INST payload escape */
+
+#define TRACE_VARINT_MAX    10          /* bytes in a 64-bit varint */
+
+typedef struct {
+	char     magic[4];
+	uint16_t version;
+	uint16_t flags;
+	uint64_t entry;                 /* pc before the first record */
+	uint64_t registers[8];          /* register values before the first record */
+} TraceHeader;
+
+static inline uint64_t trace_zigzag(int64_t v)
+{
+	return ((uint64_t)v << 1) ^ (uint64_t)(v >> 63);
+}
+
+static inline int64_t trace_unzigzag(uint64_t v)
+{
+	return (int64_t)(v >> 1) ^ -(int64_t)(v & 1);
+}
+
+/* Append v at p, returns the byte count (at most TRACE_VARINT_MAX) */
+static inline size_t trace_put_varint(uint8_t *p, uint64_t v)
+{
+	size_t n = 0;
+	while (v >= 0x80) {
+		p[n++] = (uint8_t)(v | 0x80);
+		v >>= 7;
+	}
+	p[n++] = (uint8_t)v;
+	return n;
+}
+
+/* Read a varint from [p, end), returns bytes used or 0 if truncated */
+static inline size_t trace_get_varint(const uint8_t *p, const uint8_t *end, uint64_t *v)
+{
+	uint64_t result = 0;
+	size_t n = 0;
+	for (int shift = 0; shift < 64 && p + n < end; shift += 7) {
+		uint8_t b = p[n++];
+		result |= (uint64_t)(b & 0x7F) << shift;
+		if (!(b & 0x80)) {
+			*v = result;
+			return n;
+		}
+	}
+	return 0;
+}
+
+#endif /* POCOL_TRACE_FORMAT_H */
@@ -9,7 +9,10 @@
 #define _GNU_SOURCE
 #include "vm.h"
 #include "jit.h"
+#include "vm_memory.h"
 #include "vm_syscalls.h"
+#include "vm_symbols.h"
+#include "vm_histogram.h"
 #include "../common.h"
 #include <assert.h>
 #include <stdlib.h>
@@ -85,8 +88,8 @@ int pocol_load_program_into_vm(const char *path, PocolVM **vm)
 		goto error;
 	}
 
-	if (header.code_size > POCOL_MEMORY_SIZE) {
-		pocol_error("size exceeds limit: %ld/%d bytes\n", header.code_size, POCOL_MEMORY_SIZE);
+	if (st.st_size > POCOL_MEMORY_SIZE) {
+		pocol_error("size exceeds limit: %ld/%d bytes\n", (long)st.st_size, POCOL_MEMORY_SIZE);
 		goto error;
 	}
 
@@ -95,6 +98,12 @@ int pocol_load_program_into_vm(const char *path, PocolVM **vm)
 		goto error;
 
 	memset((*vm), 0, sizeof(**vm));
+	if (pocol_mem_init(*vm) < 0)
+		goto error;
+
+	/* posm counts addresses from the start of the file, so the header
+	   stays in front of the code and entry_point/jump targets line up */
+	rewind(fp);
 	fread((*vm)->memory, 1, st.st_size, fp);
 
 	/* Initialize JIT context if available */
@@ -108,6 +117,17 @@ int pocol_load_program_into_vm(const char *path, PocolVM **vm)
 
 	fclose(fp);
 
+	/* Labels for the debugger, stats and profiler; most programs have no map */
+	char map_path[1024];
+	symbols_map_path(path, map_path, sizeof(map_path));
+	(*vm)->symbols = malloc(sizeof(PocolSymbols));
+	if ((*vm)->symbols && symbols_load((*vm)->symbols, map_path) < 0) {
+		if (errno != ENOENT)
+			pocol_error("%s: %s (symbols ignored)\n", map_path, strerror(errno));
+		free((*vm)->symbols);
+		(*vm)->symbols = NULL;
+	}
+
 	/* Set initial valuee */
 	(*vm)->halt = 0;
 	(*vm)->pc = header.entry_point; /* skip magic_header */
@@ -115,7 +135,10 @@ int pocol_load_program_into_vm(const char *path, PocolVM **vm)
 	return 0;
 
 error:
-	if (vm != NULL) pocol_free_vm(*vm);
+	if (vm != NULL && *vm != NULL) {
+		pocol_free_vm(*vm);
+		*vm = NULL;
+	}
 	if (fp) fclose(fp);
 	if (errno)
 		pocol_error("%s\n", strerror(errno));
@@ -136,6 +159,14 @@ void pocol_free_vm(PocolVM *vm)
 		free(vm->syscall_ctx);
 	}
 
+	if (vm->symbols) {
+		symbols_free(vm->symbols);
+		free(vm->symbols);
+	}
+
+	hist_free(vm->histogram);
+
+	pocol_mem_free(vm);
 	free(vm);
 }
 
@@ -158,24 +189,35 @@ ST_FUNC char *err_as_cstr(Err err) {
 
 /********************** Executor ************************/
 
+JitContext *pocol_jit_context(PocolVM *vm)
+{
+	if (!vm->jit_context) {
+		vm->jit_context = malloc(sizeof(JitContext));
+		if (!vm->jit_context) {
+			pocol_error("Failed to allocate JIT context\n");
+			return NULL;
+		}
+		pocol_jit_init((JitContext*)vm->jit_context, JIT_MODE_ENABLED, OPT_LEVEL_BASIC);
+	}
+	return (JitContext*)vm->jit_context;
+}
+
 Err pocol_execute_program_jit(PocolVM *vm, int limit, int jit_enabled)
 {
 	if (jit_enabled) {
 		/* Initialize JIT context if not already done */
-		if (!vm->jit_context) {
-			vm->jit_context = malloc(sizeof(JitContext));
-			if (!vm->jit_context) {
-				pocol_error("Failed to allocate JIT context\n");
-				return ERR_ILLEGAL_INST_ACCESS;
+		if (!pocol_jit_context(vm))
+			return ERR_ILLEGAL_INST_ACCESS;
+
+		/* Apply optimizations, once: callers may come back with a limit */
+		JitContext *jit = (JitContext*)vm->jit_context;
+		if (!jit->optimized) {
+			Err opt_err = pocol_optimize_bytecode(vm, OPT_LEVEL_BASIC);
+			if (opt_err != ERR_OK) {
+				pocol_error("Optimization failed: %s\n", err_as_cstr(opt_err));
+				return opt_err;
 			}
-			pocol_jit_init((JitContext*)vm->jit_context, JIT_MODE_ENABLED, OPT_LEVEL_BASIC);
-		}
-
-		/* Apply optimizations */
-		Err opt_err = pocol_optimize_bytecode(vm, OPT_LEVEL_BASIC);
-		if (opt_err != ERR_OK) {
-			pocol_error("Optimization failed: %s\n", err_as_cstr(opt_err));
-			return opt_err;
+			jit->optimized = 1;
 		}
 
 		/* Execute with JIT */
@@ -222,62 +264,55 @@ ST_INLN uint64_t pocol_fetch_operand(PocolVM *vm, uint8_t type)
 	return 0;
 }
 
+/* Lean and hooked interpreters, see vm_interp.h */
+#define INTERP_STEP	interp_step_lean
+#define INTERP_RUN	interp_run_lean
+#define INTERP_HOOKED	0
+#include "vm_interp.h"
+
+#define INTERP_STEP	interp_step_hooked
+#define INTERP_RUN	interp_run_hooked
+#define INTERP_HOOKED	1
+#include "vm_interp.h"
+
+/* something is watching execution, so the hooked copy has to run */
+ST_INLN int pocol_instrumented(PocolVM *vm)
+{
+	return vm->hook_count > 0 || vm->histogram != NULL;
+}
+
+Err pocol_execute_program(PocolVM *vm, int limit)
+{
+	/* picked once per run; the lean loop never looks at hooks */
+	Err err = pocol_instrumented(vm) ? interp_run_hooked(vm, limit) : interp_run_lean(vm, limit);
+
+	if (err != ERR_OK)
+		pocol_error("0x%02X: %s (addr: %" PRIu64 ")\n", vm->memory[vm->pc], err_as_cstr(err), vm->pc);
+	return err;
+}
+
 Err pocol_execute_inst(PocolVM *vm)
 {
-	if (vm->pc >= POCOL_MEMORY_SIZE)
-		return ERR_ILLEGAL_INST_ACCESS;
-
-	uint8_t op = NEXT;
-	uint8_t desc = NEXT; /* take byte descriptor */
-	uint8_t op1 = DESC_GET_OP1(desc);
-	uint8_t op2 = DESC_GET_OP2(desc);
-
-	switch (op) {
-		case INST_HALT:
-			vm->halt = 1;
-			break;
-
-		case INST_PUSH:
-			if (vm->sp >= POCOL_STACK_SIZE) return ERR_STACK_OVERFLOW;
-			vm->stack[vm->sp++] = pocol_fetch_operand(vm, op1);
-			break;
-
-		case INST_POP:
-			if (vm->sp == 0) return ERR_STACK_UNDERFLOW;
-			vm->registers[REG_OP(NEXT)] = vm->stack[--vm->sp];
-			break;
-
-		case INST_ADD: {
-			uint64_t *dest = &vm->registers[REG_OP(NEXT)];
-			uint64_t src = pocol_fetch_operand(vm, op2); /* fetch next operand */
-			*dest += src;
-		} break;
-
-		case INST_JMP:
-			vm->pc = pocol_fetch_operand(vm, op1);
-			break;
-
-		case INST_PRINT: /* (for debugging) */
-			printf("%" PRIu64 "", pocol_fetch_operand(vm, op1));
-			break;
-
-		case INST_SYS: {
-			/* System call: r0 = syscall number, r1-r4 = arguments */
-			int syscall_num = (int)vm->registers[0];
-
-			if (vm->syscall_ctx) {
-				syscalls_exec(vm->syscall_ctx, vm, syscall_num);
-			} else {
-				vm->registers[0] = -1;  /* Syscall not available */
-			}
-			break;
-		}
+	return pocol_instrumented(vm) ? interp_step_hooked(vm, 0, NULL) : interp_step_lean(vm, 0, NULL);
+}
 
-		default:
-			return ERR_ILLEGAL_INST;
-	}
+int pocol_add_hooks(PocolVM *vm, const PocolHooks *hooks)
+{
+	if (vm->hook_count == POCOL_MAX_HOOKS)
+		return -1;
+	vm->hooks[vm->hook_count++] = hooks;
+	return 0;
+}
 
-	return ERR_OK;
+void pocol_remove_hooks(PocolVM *vm, const PocolHooks *hooks)
+{
+	for (int i = 0; i < vm->hook_count; i++) {
+		if (vm->hooks[i] == hooks) {
+			memmove(&vm->hooks[i], &vm->hooks[i + 1], (vm->hook_count - i - 1) * sizeof(vm->hooks[0]));
+			vm->hook_count--;
+			return;
+		}
+	}
 }
 
 /* Initialize system call context */
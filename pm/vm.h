@@ -15,6 +15,12 @@
 #define POCOL_MEMORY_SIZE	(640 * 1000)
 #define POCOL_STACK_SIZE	1024
 
+#define POCOL_PAGE_SIZE		4096
+#define POCOL_ADDRESS_SPACE	((uint64_t)1 << 32)	/* guest virtual space reserved for core memory + file mappings */
+#define POCOL_MAP_BASE		0x100000		/* lowest guest address handed out by SYS_MMAP */
+#define POCOL_MAX_MAPPINGS	64
+#define POCOL_MAX_HOOKS		4
+
 #include <stdint.h>
 #include <stdlib.h>	/* used for size_t and also used for memory management */
 
@@ -59,6 +65,13 @@ typedef struct {
 /* Include system calls header */
 #include "vm_syscalls.h"
 
+/* Host file mapped into guest address space by SYS_MMAP */
+typedef struct {
+	Inst_Addr addr;		/* guest address of the first byte */
+	uint64_t  length;	/* page rounded length */
+	int       access;	/* POCOL_MEM_READ | POCOL_MEM_WRITE */
+} PocolMapping;
+
 typedef struct {
 	uint32_t magic;
 	uint32_t version; /* ensure suitable version */
@@ -66,27 +79,74 @@ typedef struct {
 	uint64_t code_size; /* instruction block size */
 } PocolHeader;
 
-typedef struct {
+typedef struct PocolVM {
 	/* Basic components */
-	uint8_t    memory[POCOL_MEMORY_SIZE];  	/* Memory address Register */
+	uint8_t   *memory;  			/* guest address space, mmap-managed (see vm_memory.c) */
+	uint64_t   memory_size;			/* bytes reserved behind `memory` */
 	Inst_Addr  pc; 				/* program counter (64Kb memory, 0-65.535) as the MEMORY_SIZE */
 	uint64_t   stack[POCOL_STACK_SIZE]; 	/* stack for operation */
 	Stack_Addr sp; 				/* stack pointer (0-255) as the STACK_SIZE and +1 space */
 	uint64_t   registers[8]; 		/* 8 registers */
-	unsigned int halt : 1;			/* halt status */
+	unsigned int halt;			/* halt status, JIT code stores to it */
+
+	/* Host files mapped above POCOL_MAP_BASE, sorted by address */
+	PocolMapping mappings[POCOL_MAX_MAPPINGS];
+	int          mapping_count;
 
 	/* JIT context (optional) */
 	void *jit_context;                      /* Opaque pointer to JIT context */
 
 	/* System call context */
 	SysCallContext *syscall_ctx;          /* System call context */
+
+	/* Labels and line table from the posm .map sidecar, NULL without one */
+	struct PocolSymbols *symbols;
+
+	/* Opcode counts for `pm --histogram`, NULL unless requested; only
+	   builds with -DPOCOL_HISTOGRAM ever fill it in */
+	struct PocolHistogram *histogram;
+
+	/* Set while `pm --trace` records; JIT blocks report through it */
+	struct PocolTrace *trace;
+
+	/* Memory watch consulted by pocol_mem_ptr(), NULL when nothing is watched */
+	const struct PocolWatch *watch;
+
+	/* Observers run by the hooked interpreter; with none the lean one runs */
+	const struct PocolHooks *hooks[POCOL_MAX_HOOKS];
+	int hook_count;
 } PocolVM;
 
+/* Callbacks for the hooked interpreter (vm_interp.h). NULL members are skipped */
+typedef struct PocolHooks {
+	int  (*before)(PocolVM *vm, void *user);	/* before vm->pc runs; nonzero stops the loop there */
+	void (*after)(PocolVM *vm, Inst_Addr pc, uint8_t op, void *user);	/* `op` at `pc` retired */
+	void *user;
+} PocolHooks;
+
+/* Guest memory watch (vm_memory.c): pocol_mem_ptr() calls `trap` before
+   handing out any range that touches a page set in `pages`, one bit per
+   POCOL_PAGE_SIZE over POCOL_ADDRESS_SPACE, or any range at all when
+   `pages` is NULL. Syscalls are the only code that reads or writes guest
+   data, and they all go through there */
+#define POCOL_WATCH_WORDS	(POCOL_ADDRESS_SPACE / POCOL_PAGE_SIZE / 64)
+
+typedef struct PocolWatch {
+	const uint64_t *pages;
+	void (*trap)(PocolVM *vm, uint64_t addr, uint64_t len, int access, void *user);
+	void *user;
+} PocolWatch;
+
 int pocol_load_program_into_vm(const char *path, PocolVM **vm);
 void pocol_free_vm(PocolVM *vm);
 Err pocol_execute_program(PocolVM *vm, int limit);
 Err pocol_execute_inst(PocolVM *vm);
 
+/* Register or drop an observer; -1 when POCOL_MAX_HOOKS are in use.
+   `hooks` must stay valid until it is removed */
+int pocol_add_hooks(PocolVM *vm, const PocolHooks *hooks);
+void pocol_remove_hooks(PocolVM *vm, const PocolHooks *hooks);
+
 /* JIT execution functions */
 Err pocol_execute_program_jit(PocolVM *vm, int limit, int jit_enabled);
 
@@ -2,16 +2,290 @@
 
 /* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean */
 
+#define _DEFAULT_SOURCE
 #include "vm_debugger.h"
 #include "vm.h"
+#include "vm_memory.h"
+#include "vm_replay.h"
+#include "vm_symbols.h"
+#include "jit.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
 
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/mman.h>
+#include <unistd.h>
+#endif
+
 /* Instruction names */
 static const char* inst_names[] = {"HALT", "PUSH", "POP", "ADD", "JMP", "PRINT", "SYS"};
 static const char* inst_mnemonics[] = {"halt", "push", "pop", "add", "jmp", "print", "sys"};
 
+/* "0x0040 <loop+0x6> line 12", the bare address when there is no map */
+static const char* debugger_addr(DebuggerContext *ctx, Inst_Addr addr, char *buf, size_t size) {
+    const PocolSymbols *syms = ctx->vm ? ctx->vm->symbols : NULL;
+    const PocolSym *sym = symbols_lookup(syms, addr);
+    unsigned int line = symbols_line(syms, addr);
+    int n = snprintf(buf, size, "0x%04llX", (unsigned long long)addr);
+    
+    if (sym && n > 0 && (size_t)n < size) {
+        char name[128];
+        n += snprintf(buf + n, size - n, " <%s>", symbols_format(syms, addr, name, sizeof(name)));
+    }
+    if (line && n > 0 && (size_t)n < size) {
+        snprintf(buf + n, size - n, " line %u", line);
+    }
+    return buf;
+}
+
+/* Whether an enabled breakpoint may sit at pc: a single load. Without
+   the map (allocation failed) every pc goes to the breakpoint scan */
+static inline bool debugger_bp_test(const DebuggerContext *ctx, Inst_Addr pc) {
+    if (!ctx->bp_bits) return true;
+    return pc < POCOL_MEMORY_SIZE && ((ctx->bp_bits[pc >> 6] >> (pc & 63)) & 1);
+}
+
+/* Drop a breakpoint's condition and log */
+static void debugger_bp_clear(BreakPoint *bp) {
+    free(bp->cond);
+    free(bp->log);
+    bp->cond = NULL;
+    bp->log = NULL;
+}
+
+/* Make the bit at addr match the breakpoint there */
+static void debugger_bp_sync(DebuggerContext *ctx, Inst_Addr addr) {
+    if (!ctx->bp_bits || addr >= POCOL_MEMORY_SIZE) return;
+    BreakPoint *bp = debugger_find_breakpoint(ctx, addr);
+    if (bp && bp->enabled) {
+        ctx->bp_bits[addr >> 6] |= (uint64_t)1 << (addr & 63);
+        /* compiled code must not run past it, split the block there */
+        if (ctx->jit && ctx->vm->jit_context)
+            pocol_jit_invalidate((JitContext*)ctx->vm->jit_context, addr);
+    } else {
+        ctx->bp_bits[addr >> 6] &= ~((uint64_t)1 << (addr & 63));
+    }
+}
+
+/* Watchpoints work in two layers. The first is vm->watch: pocol_mem_ptr()
+   tests one bit per page it hands out and calls debugger_watch_trap() on
+   a watched one, which covers every syscall. The second write-protects
+   the watched core pages and catches the SIGSEGV, for stores that never
+   ask pocol_mem_ptr(): JIT code, a plugin indexing vm->memory.
+   Either one only flags the watchpoint; debugger_check_watchpoints()
+   looks at the values at the next instruction boundary. The fault
+   handler touches nothing but what debugger_watch_arm() precomputed for
+   it, and that only changes with SIGSEGV blocked */
+
+/* Flag the enabled watchpoints overlapping [addr, addr+len) */
+static void debugger_watch_mark(DebuggerContext *ctx, uint64_t addr, uint64_t len, int access) {
+    for (int i = 0; i < ctx->watchpoint_count; i++) {
+        WatchPoint *wp = &ctx->watchpoints[i];
+        if (!wp->enabled || addr >= wp->address + wp->size || wp->address >= addr + len) continue;
+        if (access & POCOL_MEM_READ) wp->read = true;
+        if (access & POCOL_MEM_WRITE) wp->written = true;
+        ctx->watch_pending = 1;
+    }
+    if (ctx->watch_pending && ctx->jit && ctx->vm->jit_context)
+        ((JitContext*)ctx->vm->jit_context)->stop_requested = 1;
+}
+
+#ifndef _WIN32
+static DebuggerContext *watch_owner;    /* the context the fault handler reports to */
+static struct sigaction watch_prev;     /* what other faults go to */
+
+/* Everything the fault handler reads */
+static struct {
+    uint8_t *base, *end;                /* the armed core pages, NULL while disarmed */
+    size_t page;                        /* host page size */
+    volatile int *pending, *faulted;    /* the owner's watch_pending and watch_faulted */
+    volatile int *stop;                 /* the JIT's stop_requested, NULL without the JIT */
+} watch_fault;
+
+typedef sigset_t WatchMask;
+
+/* Hold SIGSEGV off while the watch table or the handler's view changes */
+static void debugger_watch_hold(WatchMask *old) {
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGSEGV);
+    sigprocmask(SIG_BLOCK, &set, old);
+}
+
+static void debugger_watch_release(const WatchMask *old) {
+    sigprocmask(SIG_SETMASK, old, NULL);
+}
+
+static size_t debugger_host_page(void) {
+    static size_t page;
+    if (!page) {
+        long n = sysconf(_SC_PAGESIZE);
+        page = n > 0 ? (size_t)n : POCOL_PAGE_SIZE;
+    }
+    return page;
+}
+
+/* mprotect the host pages under [addr, addr+len) that lie wholly in core
+   memory; the partial last page borders the reserved address space */
+static bool debugger_watch_protect(DebuggerContext *ctx, uint64_t addr, uint64_t len, int prot) {
+    uint64_t page = debugger_host_page();
+    uint64_t core = POCOL_MEMORY_SIZE / page * page;
+    uint64_t start = addr / page * page;
+    uint64_t end = (addr + len + page - 1) / page * page;
+    if (end > core) end = core;
+    return start < end && mprotect(ctx->vm->memory + start, end - start, prot) == 0;
+}
+
+/* Unprotect the one faulting page and raise the flags; which watchpoint
+   was hit is for debugger_check_watchpoints() to work out */
+static void debugger_watch_fault(int sig, siginfo_t *info, void *uc) {
+    uint8_t *p = info->si_addr;
+    (void)uc;
+    if (p >= watch_fault.base && p < watch_fault.end) {
+        uint8_t *page = watch_fault.base + (size_t)(p - watch_fault.base) / watch_fault.page * watch_fault.page;
+        /* let the store through; the check re-arms the page */
+        if (mprotect(page, watch_fault.page, PROT_READ | PROT_WRITE) == 0) {
+            *watch_fault.faulted = 1;
+            *watch_fault.pending = 1;
+            if (watch_fault.stop) *watch_fault.stop = 1;
+            return;
+        }
+    }
+    /* not ours: restore the previous disposition, the access faults again */
+    sigaction(sig, &watch_prev, NULL);
+}
+#else
+typedef int WatchMask;
+
+static void debugger_watch_hold(WatchMask *old) { (void)old; }
+static void debugger_watch_release(const WatchMask *old) { (void)old; }
+#endif
+
+/* Write-protect the core pages under write watchpoints */
+static void debugger_watch_arm(DebuggerContext *ctx) {
+#ifndef _WIN32
+    WatchMask old;
+    if (!ctx->vm->watch) return;
+    debugger_watch_hold(&old);
+    if (!watch_owner) {
+        struct sigaction sa;
+        memset(&sa, 0, sizeof(sa));
+        sa.sa_sigaction = debugger_watch_fault;
+        sa.sa_flags = SA_SIGINFO;
+        sigemptyset(&sa.sa_mask);
+        if (sigaction(SIGSEGV, &sa, &watch_prev) == 0) watch_owner = ctx;
+    }
+    if (watch_owner == ctx) {
+        for (int i = 0; i < ctx->watchpoint_count; i++) {
+            WatchPoint *wp = &ctx->watchpoints[i];
+            if (wp->enabled && wp->type != WATCH_READ &&
+                debugger_watch_protect(ctx, wp->address, wp->size, PROT_READ))
+                ctx->watch_armed = true;
+        }
+    }
+    if (ctx->watch_armed) {
+        watch_fault.page = debugger_host_page();
+        watch_fault.base = ctx->vm->memory;
+        watch_fault.end = ctx->vm->memory + POCOL_MEMORY_SIZE / watch_fault.page * watch_fault.page;
+        watch_fault.pending = &ctx->watch_pending;
+        watch_fault.faulted = &ctx->watch_faulted;
+        watch_fault.stop = ctx->jit && ctx->vm->jit_context ? &((JitContext*)ctx->vm->jit_context)->stop_requested : NULL;
+    }
+    debugger_watch_release(&old);
+#else
+    (void)ctx;
+#endif
+}
+
+static void debugger_watch_disarm(DebuggerContext *ctx) {
+#ifndef _WIN32
+    WatchMask old;
+    debugger_watch_hold(&old);
+    if (ctx->watch_armed) {
+        watch_fault.base = watch_fault.end = NULL;
+        debugger_watch_protect(ctx, 0, POCOL_MEMORY_SIZE, PROT_READ | PROT_WRITE);
+    }
+    ctx->watch_armed = false;
+    debugger_watch_release(&old);
+#else
+    ctx->watch_armed = false;
+#endif
+}
+
+/* First layer, called by pocol_mem_ptr() for a range on a watched page */
+static void debugger_watch_trap(PocolVM *vm, uint64_t addr, uint64_t len, int access, void *user) {
+    DebuggerContext *ctx = user;
+    (void)vm;
+    if (ctx->replay && (access & POCOL_MEM_WRITE)) replay_note_write(ctx->replay, addr, len);
+    debugger_watch_mark(ctx, addr, len ? len : 1, access);
+#ifndef _WIN32
+    /* the host is about to store there: lift the protection now, a
+       read(2) into a read-only page fails with EFAULT rather than faulting */
+    if ((access & POCOL_MEM_WRITE) && ctx->watch_armed)
+        debugger_watch_protect(ctx, addr, len ? len : 1, PROT_READ | PROT_WRITE);
+#endif
+}
+
+/* Rebuild the page map from the enabled watchpoints and install or
+   remove vm->watch; with none, pocol_mem_ptr() is back to one NULL test.
+   A recording needs to see every write, so it traps on all pages */
+static void debugger_watch_sync(DebuggerContext *ctx) {
+    bool any = false;
+    if (!ctx->vm) return;
+    debugger_watch_disarm(ctx);
+    if (ctx->watch_pages) memset(ctx->watch_pages, 0, POCOL_WATCH_WORDS * sizeof(uint64_t));
+    for (int i = 0; ctx->watch_pages && i < ctx->watchpoint_count; i++) {
+        WatchPoint *wp = &ctx->watchpoints[i];
+        if (!wp->enabled) continue;
+        uint64_t last = (wp->address + wp->size - 1) / POCOL_PAGE_SIZE;
+        for (uint64_t page = wp->address / POCOL_PAGE_SIZE; page <= last; page++)
+            ctx->watch_pages[page >> 6] |= (uint64_t)1 << (page & 63);
+        any = true;
+    }
+    ctx->watch.pages = ctx->replay ? NULL : ctx->watch_pages;
+    ctx->vm->watch = any || ctx->replay ? &ctx->watch : NULL;
+    debugger_watch_arm(ctx);
+}
+
+/* The watched bytes, NULL if unmapped. Reads past the watch itself */
+static const uint8_t* debugger_watch_bytes(DebuggerContext *ctx, const WatchPoint *wp) {
+    PocolVM *vm = ctx->vm;
+    const PocolWatch *watch = vm->watch;
+    vm->watch = NULL;
+    const uint8_t *p = pocol_mem_ptr(vm, wp->address, wp->size, POCOL_MEM_READ);
+    vm->watch = watch;
+    return p;
+}
+
+/* Memory was rewound under the watchpoints: the current values become
+   the baseline and whatever the replay touched is forgotten */
+static void debugger_watch_rebase(DebuggerContext *ctx) {
+    for (int i = 0; i < ctx->watchpoint_count; i++) {
+        WatchPoint *wp = &ctx->watchpoints[i];
+        const uint8_t *now = debugger_watch_bytes(ctx, wp);
+        if (now) memcpy(wp->old, now, wp->size);
+        wp->read = wp->written = false;
+    }
+    ctx->watch_pending = 0;
+    ctx->watch_faulted = 0;
+    if (ctx->jit && ctx->vm->jit_context) ((JitContext*)ctx->vm->jit_context)->stop_requested = 0;
+    debugger_watch_arm(ctx);
+}
+
+/* Hooked interpreter callback. Free running (`continue`) only tests the
+   breakpoint map and the watch flag; stepping, breakpoint and watchpoint
+   hits take the slow path, and only stepping records history, so a
+   breakpoint condition that fails costs one predicate evaluation */
+static int debugger_before_inst(PocolVM *vm, void *user) {
+    DebuggerContext *ctx = user;
+    if (ctx->mode == DEBUG_MODE_RUN && !ctx->watch_pending && !debugger_bp_test(ctx, vm->pc)) return 0;
+    if (debugger_should_stop(ctx)) return 1;
+    if (ctx->mode != DEBUG_MODE_RUN) debugger_save_state(ctx);
+    return 0;
+}
+
 /* Initialization */
 void debugger_init(DebuggerContext *ctx, PocolVM *vm) {
     memset(ctx, 0, sizeof(DebuggerContext));
@@ -27,16 +301,46 @@ void debugger_init(DebuggerContext *ctx, PocolVM *vm) {
     ctx->call_stack = NULL;
     ctx->history_index = 0;
     ctx->history_count = 0;
+    ctx->hooks.before = debugger_before_inst;
+    ctx->hooks.user = ctx;
+    ctx->bp_bits = calloc(DEBUG_BP_WORDS, sizeof(uint64_t));
+    ctx->watch.trap = debugger_watch_trap;
+    ctx->watch.user = ctx;
 }
 
 void debugger_free(DebuggerContext *ctx) {
     if (!ctx || !ctx->initialized) return;
+    debugger_record_stop(ctx);
     CallFrame *frame = ctx->call_stack;
     while (frame) {
         CallFrame *next = frame->next;
         free(frame);
         frame = next;
     }
+    if (ctx->jit && ctx->vm->jit_context) {
+        JitContext *jit = (JitContext*)ctx->vm->jit_context;
+        jit->stop_bits = NULL;
+        jit->stop_check = NULL;
+        jit->stop_user = NULL;
+    }
+    for (int i = 0; i < ctx->breakpoint_count; i++) debugger_bp_clear(&ctx->breakpoints[i]);
+    WatchMask old;
+    debugger_watch_hold(&old);
+    debugger_watch_disarm(ctx);
+#ifndef _WIN32
+    if (watch_owner == ctx) {
+        sigaction(SIGSEGV, &watch_prev, NULL);
+        watch_owner = NULL;
+    }
+#endif
+    if (ctx->vm) ctx->vm->watch = NULL;
+    for (int i = 0; i < ctx->watchpoint_count; i++) free(ctx->watchpoints[i].old);
+    ctx->watchpoint_count = 0;
+    debugger_watch_release(&old);
+    free(ctx->watch_pages);
+    ctx->watch_pages = NULL;
+    free(ctx->bp_bits);
+    ctx->bp_bits = NULL;
     ctx->initialized = false;
 }
 
@@ -45,38 +349,148 @@ void debugger_reset(DebuggerContext *ctx) {
     ctx->mode = DEBUG_MODE_RUN;
     ctx->running = true;
     ctx->steps_remaining = 0;
+    for (int i = 0; i < ctx->breakpoint_count; i++) debugger_bp_clear(&ctx->breakpoints[i]);
     ctx->breakpoint_count = 0;
+    if (ctx->bp_bits) memset(ctx->bp_bits, 0, DEBUG_BP_WORDS * sizeof(uint64_t));
+    WatchMask old;
+    debugger_watch_hold(&old);
+    for (int i = 0; i < ctx->watchpoint_count; i++) free(ctx->watchpoints[i].old);
     ctx->watchpoint_count = 0;
+    ctx->watch_pending = 0;
+    ctx->watch_faulted = 0;
+    debugger_watch_sync(ctx);
+    debugger_watch_release(&old);
+    debugger_record_stop(ctx);
     ctx->history_index = 0;
     ctx->history_count = 0;
 }
 
 /* Breakpoints */
+
+/* A plain breakpoint again stops there every time: a condition or a
+   logpoint already at addr is dropped */
 int debugger_add_breakpoint(DebuggerContext *ctx, Inst_Addr addr) {
     if (!ctx || !ctx->initialized) return -1;
-    if (ctx->breakpoint_count >= DEBUG_MAX_BREAKPOINTS) return -1;
     for (int i = 0; i < ctx->breakpoint_count; i++) {
         if (ctx->breakpoints[i].address == addr) {
             ctx->breakpoints[i].enabled = true;
+            free(ctx->breakpoints[i].cond);
+            ctx->breakpoints[i].cond = NULL;
+            free(ctx->breakpoints[i].log);
+            ctx->breakpoints[i].log = NULL;
+            debugger_bp_sync(ctx, addr);
             return i;
         }
     }
+    if (ctx->breakpoint_count >= DEBUG_MAX_BREAKPOINTS) return -1;
     BreakPoint *bp = &ctx->breakpoints[ctx->breakpoint_count++];
+    memset(bp, 0, sizeof(*bp));
     bp->address = addr;
     bp->enabled = true;
-    bp->one_shot = false;
-    bp->hit_count = 0;
+    debugger_bp_sync(ctx, addr);
     return ctx->breakpoint_count - 1;
 }
 
+/* Stop at breakpoint `index` only where expr is nonzero; NULL or "" makes
+   it unconditional again. -1 with a message in err */
+int debugger_set_condition(DebuggerContext *ctx, int index, const char *expr, char *err, size_t errlen) {
+    if (!ctx || !ctx->initialized) return -1;
+    if (index < 0 || index >= ctx->breakpoint_count) {
+        snprintf(err, errlen, "no breakpoint %d", index);
+        return -1;
+    }
+    BreakPoint *bp = &ctx->breakpoints[index];
+    if (!expr || !*expr) {
+        free(bp->cond);
+        bp->cond = NULL;
+        return 0;
+    }
+    PocolPredicate *cond = malloc(sizeof(PocolPredicate));
+    if (!cond) {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    if (predicate_compile(cond, expr, err, errlen) < 0) {
+        free(cond);
+        return -1;
+    }
+    free(bp->cond);
+    bp->cond = cond;
+    return 0;
+}
+
+/* A breakpoint at addr that stops only where expr is nonzero. The
+   expression is compiled first, so a bad one adds nothing. Returns its
+   index, -1 with a message in err */
+int debugger_add_conditional(DebuggerContext *ctx, Inst_Addr addr, const char *expr, char *err, size_t errlen) {
+    if (!ctx || !ctx->initialized) return -1;
+    PocolPredicate *cond = malloc(sizeof(PocolPredicate));
+    if (!cond) {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    if (predicate_compile(cond, expr, err, errlen) < 0) {
+        free(cond);
+        return -1;
+    }
+    int index = debugger_add_breakpoint(ctx, addr);
+    if (index < 0) {
+        snprintf(err, errlen, "too many breakpoints");
+        free(cond);
+        return -1;
+    }
+    ctx->breakpoints[index].cond = cond;
+    return index;
+}
+
+/* A breakpoint at addr that prints text, {expr} parts evaluated, and
+   goes on. A logpoint already there gets the new text, a stopping
+   breakpoint is left alone and refused. Returns its index, -1 with a
+   message in err */
+int debugger_add_logpoint(DebuggerContext *ctx, Inst_Addr addr, const char *text, char *err, size_t errlen) {
+    if (!ctx || !ctx->initialized) return -1;
+    BreakPoint *bp = debugger_find_breakpoint(ctx, addr);
+    if (bp && !bp->log) {
+        snprintf(err, errlen, "breakpoint %d is already at this address", (int)(bp - ctx->breakpoints));
+        return -1;
+    }
+    PocolLogpoint *log = malloc(sizeof(PocolLogpoint));
+    if (!log) {
+        snprintf(err, errlen, "out of memory");
+        return -1;
+    }
+    if (logpoint_compile(log, text, err, errlen) < 0) {
+        free(log);
+        return -1;
+    }
+    if (bp) {
+        /* keeps its condition and hit count */
+        free(bp->log);
+        bp->log = log;
+        bp->enabled = true;
+        debugger_bp_sync(ctx, addr);
+        return (int)(bp - ctx->breakpoints);
+    }
+    int index = debugger_add_breakpoint(ctx, addr);
+    if (index < 0) {
+        snprintf(err, errlen, "too many breakpoints");
+        free(log);
+        return -1;
+    }
+    ctx->breakpoints[index].log = log;
+    return index;
+}
+
 int debugger_remove_breakpoint(DebuggerContext *ctx, Inst_Addr addr) {
     if (!ctx || !ctx->initialized) return -1;
     for (int i = 0; i < ctx->breakpoint_count; i++) {
         if (ctx->breakpoints[i].address == addr) {
+            debugger_bp_clear(&ctx->breakpoints[i]);
             for (int j = i; j < ctx->breakpoint_count - 1; j++) {
                 ctx->breakpoints[j] = ctx->breakpoints[j + 1];
             }
             ctx->breakpoint_count--;
+            debugger_bp_sync(ctx, addr);
             return 0;
         }
     }
@@ -85,13 +499,13 @@ int debugger_remove_breakpoint(DebuggerContext *ctx, Inst_Addr addr) {
 
 int debugger_enable_breakpoint(DebuggerContext *ctx, Inst_Addr addr) {
     BreakPoint *bp = debugger_find_breakpoint(ctx, addr);
-    if (bp) { bp->enabled = true; return 0; }
+    if (bp) { bp->enabled = true; debugger_bp_sync(ctx, addr); return 0; }
     return -1;
 }
 
 int debugger_disable_breakpoint(DebuggerContext *ctx, Inst_Addr addr) {
     BreakPoint *bp = debugger_find_breakpoint(ctx, addr);
-    if (bp) { bp->enabled = false; return 0; }
+    if (bp) { bp->enabled = false; debugger_bp_sync(ctx, addr); return 0; }
     return -1;
 }
 
@@ -109,7 +523,10 @@ void debugger_list_breakpoints(DebuggerContext *ctx) {
     if (ctx->breakpoint_count == 0) { printf("No breakpoints set.\n"); return; }
     for (int i = 0; i < ctx->breakpoint_count; i++) {
         BreakPoint *bp = &ctx->breakpoints[i];
-        printf("[%d] Address: 0x%04X %s (hit: %d)\n", i, bp->address, bp->enabled ? "enabled" : "disabled", bp->hit_count);
+        char where[192];
+        printf("[%d] Address: %s %s (hit: %llu)\n", i, debugger_addr(ctx, bp->address, where, sizeof(where)), bp->enabled ? "enabled" : "disabled", (unsigned long long)bp->hit_count);
+        if (bp->cond) printf("    if %s\n", bp->cond->text);
+        if (bp->log) printf("    log \"%s\"\n", bp->log->text);
     }
 }
 
@@ -117,9 +534,20 @@ void debugger_list_breakpoints(DebuggerContext *ctx) {
 int debugger_add_watchpoint(DebuggerContext *ctx, Inst_Addr addr, uint64_t size, WatchType type) {
     if (!ctx || !ctx->initialized) return -1;
     if (ctx->watchpoint_count >= DEBUG_MAX_WATCHPOINTS) return -1;
+    if (size == 0 || size > DEBUG_MAX_WATCH_SIZE || addr >= POCOL_ADDRESS_SPACE - size) return -1;
+    if (!ctx->watch_pages && !(ctx->watch_pages = calloc(POCOL_WATCH_WORDS, sizeof(uint64_t)))) return -1;
+    uint8_t *old = calloc(1, size);
+    if (!old) return -1;
+    WatchMask mask;
+    debugger_watch_hold(&mask);
     WatchPoint *wp = &ctx->watchpoints[ctx->watchpoint_count++];
+    memset(wp, 0, sizeof(*wp));
     wp->address = addr; wp->size = size; wp->type = type;
-    wp->enabled = true; wp->hit_count = 0;
+    wp->enabled = true; wp->old = old;
+    const uint8_t *now = debugger_watch_bytes(ctx, wp);
+    if (now) memcpy(wp->old, now, size);
+    debugger_watch_sync(ctx);
+    debugger_watch_release(&mask);
     return ctx->watchpoint_count - 1;
 }
 
@@ -127,8 +555,13 @@ int debugger_remove_watchpoint(DebuggerContext *ctx, Inst_Addr addr) {
     if (!ctx || !ctx->initialized) return -1;
     for (int i = 0; i < ctx->watchpoint_count; i++) {
         if (ctx->watchpoints[i].address == addr) {
+            WatchMask old;
+            debugger_watch_hold(&old);
+            free(ctx->watchpoints[i].old);
             for (int j = i; j < ctx->watchpoint_count - 1; j++) ctx->watchpoints[j] = ctx->watchpoints[j + 1];
             ctx->watchpoint_count--;
+            debugger_watch_sync(ctx);
+            debugger_watch_release(&old);
             return 0;
         }
     }
@@ -142,7 +575,8 @@ void debugger_list_watchpoints(DebuggerContext *ctx) {
     static const char *watch_types[] = {"READ", "WRITE", "ACCESS"};
     for (int i = 0; i < ctx->watchpoint_count; i++) {
         WatchPoint *wp = &ctx->watchpoints[i];
-        printf("[%d] Address: 0x%04X Size: %lu Type: %s %s (hit: %d)\n", i, wp->address, (unsigned long)wp->size, watch_types[wp->type], wp->enabled ? "enabled" : "disabled", wp->hit_count);
+        char where[192];
+        printf("[%d] Address: %s Size: %lu Type: %s %s (hit: %d)\n", i, debugger_addr(ctx, wp->address, where, sizeof(where)), (unsigned long)wp->size, watch_types[wp->type], wp->enabled ? "enabled" : "disabled", wp->hit_count);
     }
 }
 
@@ -187,6 +621,201 @@ void debugger_stop(DebuggerContext *ctx) {
     ctx->mode = DEBUG_MODE_BREAK;
 }
 
+/* Replay predicates. Going forward every enabled breakpoint at pc is
+   handed to debugger_should_stop(), which counts it and runs its
+   condition or log; so is a watchpoint a logged syscall may have
+   changed. Going back only breakpoints that would stop count, their
+   conditions seeing the hit count as it is now */
+static int debugger_replay_stop(PocolVM *vm, void *user) {
+    DebuggerContext *ctx = user;
+    if (ctx->watch_pending) return 1;
+    if (!debugger_bp_test(ctx, vm->pc)) return 0;
+    BreakPoint *bp = debugger_find_breakpoint(ctx, vm->pc);
+    return bp && bp->enabled;
+}
+
+static int debugger_replay_breakpoint(PocolVM *vm, void *user) {
+    DebuggerContext *ctx = user;
+    if (!debugger_bp_test(ctx, vm->pc)) return 0;
+    BreakPoint *bp = debugger_find_breakpoint(ctx, vm->pc);
+    return bp && bp->enabled && !bp->log && (!bp->cond || predicate_eval(bp->cond, vm, bp->hit_count));
+}
+
+/* Forward while behind the end of the recording. Everything comes from
+   the log, so nothing the guest did to the host happens twice. There
+   are no calls in the ISA, so `next` and `finish` step like `step` */
+static void debugger_replay_resume(DebuggerContext *ctx) {
+    PocolReplay *rep = ctx->replay;
+    uint64_t from = rep->pos;
+    int r;
+    
+    if (ctx->mode == DEBUG_MODE_RUN) {
+        do {
+            r = replay_run(rep, rep->end, debugger_replay_stop, ctx);
+        } while (r == 1 && !debugger_should_stop(ctx));
+    } else {
+        uint64_t steps = ctx->steps_remaining > 0 ? (uint64_t)ctx->steps_remaining : 1;
+        r = replay_run(rep, rep->pos + steps, NULL, NULL);
+        if (r == 0) debugger_check_watchpoints(ctx);
+    }
+    ctx->total_instructions += rep->pos - from;
+    if (r < 0) {
+        printf("Replay failed\n");
+    } else if (r == 0 && rep->pos == rep->end) {
+        /* what is at the end still gets reported */
+        ctx->mode = DEBUG_MODE_BREAK;
+        if (!debugger_should_stop(ctx)) printf("\n*** End of recorded history, live from here ***\n");
+    }
+    ctx->mode = DEBUG_MODE_BREAK;
+}
+
+/* Run the VM under the current mode until a breakpoint, the end of a
+   step, an error or HALT. Only here does the VM run with the debugger's
+   hooks, so a normal run keeps the lean interpreter. */
+void debugger_resume(DebuggerContext *ctx) {
+    if (!ctx || !ctx->initialized || !ctx->running || ctx->mode == DEBUG_MODE_BREAK) return;
+    PocolVM *vm = ctx->vm;
+    PocolReplay *rep = ctx->replay;
+    uint64_t retired = vm->syscall_ctx ? vm->syscall_ctx->instruction_count : 0;
+    
+    if (rep && rep->pos < rep->end) {
+        debugger_replay_resume(ctx);
+        return;
+    }
+    /* recording follows the interpreter, so the JIT sits it out */
+    if (rep && pocol_add_hooks(vm, &rep->hooks) < 0) {
+        printf("Too many execution hooks\n");
+        debugger_stop(ctx);
+        return;
+    }
+    
+    /* the instruction we are stopped at runs unchecked, or its own
+       breakpoint would stop us again */
+    debugger_save_state(ctx);
+    Err err = pocol_execute_program(vm, 1);
+    if (err == ERR_OK && !vm->halt && ctx->jit && !rep && ctx->mode == DEBUG_MODE_RUN) {
+        /* native until a breakpoint, blocks end before every one of them
+           and the dispatcher asks debugger_should_stop() there, or a
+           watchpoint trap; a write that left the value alone goes on */
+        do {
+            err = pocol_jit_execute_program((JitContext*)vm->jit_context, vm, -1);
+        } while (err == ERR_OK && !vm->halt && ctx->mode != DEBUG_MODE_BREAK && !debugger_check_watchpoints(ctx));
+    } else if (err == ERR_OK && !vm->halt) {
+        if (pocol_add_hooks(vm, &ctx->hooks) < 0) {
+            printf("Too many execution hooks\n");
+            err = ERR_OK;
+            debugger_stop(ctx);
+        } else {
+            err = pocol_execute_program(vm, -1);
+            pocol_remove_hooks(vm, &ctx->hooks);
+        }
+    }
+    if (rep) {
+        pocol_remove_hooks(vm, &rep->hooks);
+        if (rep->failed) {
+            printf("record: out of memory, recording stopped\n");
+            debugger_record_stop(ctx);
+        }
+    }
+    if (vm->syscall_ctx) ctx->total_instructions += vm->syscall_ctx->instruction_count - retired;
+    if (err != ERR_OK) debugger_stop(ctx);
+}
+
+/* Start recording here. Snapshots every `interval` instructions (0: the
+   default) bound how far a reverse step has to replay */
+int debugger_record(DebuggerContext *ctx, uint64_t interval) {
+    if (!ctx || !ctx->initialized || ctx->replay) return -1;
+    PocolReplay *rep = malloc(sizeof(PocolReplay));
+    if (!rep) return -1;
+    if (replay_init(rep, ctx->vm, interval) < 0) {
+        replay_free(rep);
+        free(rep);
+        return -1;
+    }
+    ctx->replay = rep;
+    debugger_watch_sync(ctx);
+    return 0;
+}
+
+/* Drop the recording; execution goes on live from the current position */
+void debugger_record_stop(DebuggerContext *ctx) {
+    if (!ctx || !ctx->replay) return;
+    replay_free(ctx->replay);
+    free(ctx->replay);
+    ctx->replay = NULL;
+    debugger_watch_sync(ctx);
+}
+
+void debugger_reverse_step(DebuggerContext *ctx, uint64_t count) {
+    if (!ctx || !ctx->initialized) return;
+    PocolReplay *rep = ctx->replay;
+    if (!rep) { printf("Not recording (use `record` first)\n"); return; }
+    uint64_t from = rep->pos;
+    
+    debugger_watch_disarm(ctx);
+    if (replay_run(rep, count < rep->pos ? rep->pos - count : 0, NULL, NULL) < 0) printf("Replay failed\n");
+    debugger_watch_rebase(ctx);
+    if (count > from) printf("\n*** Start of recorded history ***\n");
+    ctx->mode = DEBUG_MODE_BREAK;
+}
+
+/* Back to the last breakpoint hit before here. Watchpoints only stop
+   forward execution */
+void debugger_reverse_continue(DebuggerContext *ctx) {
+    if (!ctx || !ctx->initialized) return;
+    PocolReplay *rep = ctx->replay;
+    if (!rep) { printf("Not recording (use `record` first)\n"); return; }
+    
+    debugger_watch_disarm(ctx);
+    int r = replay_find_back(rep, debugger_replay_breakpoint, ctx);
+    debugger_watch_rebase(ctx);
+    ctx->mode = DEBUG_MODE_BREAK;
+    if (r < 0) printf("Replay failed\n");
+    else if (r == 0) printf("\n*** Start of recorded history ***\n");
+    else {
+        /* reported, not counted: this hit was counted on the way here */
+        char where[192];
+        for (int i = 0; i < ctx->breakpoint_count; i++) {
+            if (ctx->breakpoints[i].address == ctx->vm->pc)
+                printf("\n*** Breakpoint %d hit at %s ***\n", i, debugger_addr(ctx, ctx->vm->pc, where, sizeof(where)));
+        }
+    }
+}
+
+void debugger_show_record(DebuggerContext *ctx) {
+    if (!ctx || !ctx->initialized) return;
+    PocolReplay *rep = ctx->replay;
+    printf("\n=== Record ===\n");
+    if (!rep) { printf("Not recording.\n"); return; }
+    printf("Position: %llu of %llu%s\n", (unsigned long long)rep->pos, (unsigned long long)rep->end,
+           rep->pos < rep->end ? " (replaying)" : "");
+    printf("Snapshots: %zu, every %llu instructions\n", rep->snap_count, (unsigned long long)rep->interval);
+    printf("Pages: %zu copied, %zu originals\n", rep->page_count, rep->origin_count);
+    printf("Syscalls logged: %zu (%zu bytes written)\n", rep->call_count, rep->data_used);
+    printf("Memory: %llu bytes\n", (unsigned long long)rep->bytes);
+}
+
+static int debugger_jit_stop(PocolVM *vm, void *user) {
+    (void)vm;
+    return debugger_should_stop(user);
+}
+
+/* Let `continue` run JIT code. Breakpoints then live in compiled code as
+   block boundaries; stepping still goes through the interpreter. -1 if
+   the JIT or the breakpoint map is unavailable */
+int debugger_use_jit(DebuggerContext *ctx) {
+    if (!ctx || !ctx->initialized || !ctx->bp_bits) return -1;
+    JitContext *jit = pocol_jit_context(ctx->vm);
+    if (!jit) return -1;
+    jit->stop_bits = ctx->bp_bits;
+    jit->stop_check = debugger_jit_stop;
+    jit->stop_user = ctx;
+    ctx->jit = true;
+    /* the fault handler needs the new stop_requested */
+    debugger_watch_sync(ctx);
+    return 0;
+}
+
 /* State Management */
 void debugger_save_state(DebuggerContext *ctx) {
     if (!ctx || !ctx->initialized || !ctx->vm) return;
@@ -297,7 +926,10 @@ void debugger_show_disasm(DebuggerContext *ctx, Inst_Addr addr, int count) {
     for (int i = 0; i < count; i++) {
         DisasmInfo info;
         debugger_disasm_instruction(ctx, addr + i * 2, &info);
-        printf("%04X: %-6s ", info.address, inst_mnemonics[info.type]);
+        const PocolSym *sym = symbols_lookup(ctx->vm->symbols, info.address);
+        if (sym && sym->start == info.address) printf("%s:\n", sym->name);
+        printf("%04llX: %-6s ", (unsigned long long)info.address,
+               info.type < COUNT_INST ? inst_mnemonics[info.type] : "???");
         if (info.operand != 0 || info.type == INST_PUSH || info.type == INST_JMP) {
             printf("%d", info.operand);
         }
@@ -312,7 +944,10 @@ void debugger_show_callstack(DebuggerContext *ctx) {
     CallFrame *frame = ctx->call_stack;
     int depth = 0;
     while (frame) {
-        printf("[%d] Return: 0x%04X Function: 0x%04X\n", depth++, frame->return_addr, frame->function_start);
+        char ret[192], fn[192];
+        printf("[%d] Return: %s Function: %s\n", depth++,
+               debugger_addr(ctx, frame->return_addr, ret, sizeof(ret)),
+               debugger_addr(ctx, frame->function_start, fn, sizeof(fn)));
         frame = frame->next;
     }
     if (depth == 0) printf("(empty)\n");
@@ -328,7 +963,8 @@ void debugger_show_state(DebuggerContext *ctx) {
            ctx->mode == DEBUG_MODE_STEP_OVER ? "STEP_OVER" :
            ctx->mode == DEBUG_MODE_STEP_OUT ? "STEP_OUT" :
            ctx->mode == DEBUG_MODE_BREAK ? "BREAK" : "UNKNOWN");
-    printf("PC: 0x%04X\n", ctx->vm->pc);
+    char where[192];
+    printf("PC: %s\n", debugger_addr(ctx, ctx->vm->pc, where, sizeof(where)));
     printf("----------------------------------------\n");
     if (ctx->show_registers) debugger_show_registers(ctx);
     if (ctx->show_stack) debugger_show_stack(ctx, 8);
@@ -336,18 +972,39 @@ void debugger_show_state(DebuggerContext *ctx) {
 }
 
 /* Control Flow */
+
+/* Count an arrival at bp and say whether it stops. A condition is a few
+   bytecode ops on the live registers and a logpoint prints and goes on,
+   so neither leaves the run loop for the prompt */
+static bool debugger_bp_hit(DebuggerContext *ctx, BreakPoint *bp) {
+    PocolVM *vm = ctx->vm;
+    bp->hit_count++;
+    if (bp->cond && !predicate_eval(bp->cond, vm, bp->hit_count)) return false;
+    if (!bp->log) return true;
+    /* after whatever the guest printed so far */
+    if (vm->syscall_ctx) console_flush(&vm->syscall_ctx->console);
+    logpoint_print(bp->log, vm, bp->hit_count, stdout);
+    fflush(stdout);
+    return false;
+}
+
 bool debugger_should_stop(DebuggerContext *ctx) {
     if (!ctx || !ctx->initialized || !ctx->running) return true;
     if (!ctx->vm || ctx->vm->halt) return true;
-    for (int i = 0; i < ctx->breakpoint_count; i++) {
-        BreakPoint *bp = &ctx->breakpoints[i];
-        if (bp->enabled && bp->address == ctx->vm->pc) {
-            bp->hit_count++;
-            ctx->mode = DEBUG_MODE_BREAK;
-            printf("\n*** Breakpoint %d hit at 0x%04X ***\n", i, bp->address);
-            return true;
+    bool watched = debugger_check_watchpoints(ctx);
+    if (debugger_bp_test(ctx, ctx->vm->pc)) {
+        for (int i = 0; i < ctx->breakpoint_count; i++) {
+            BreakPoint *bp = &ctx->breakpoints[i];
+            if (bp->enabled && bp->address == ctx->vm->pc) {
+                if (!debugger_bp_hit(ctx, bp)) break;
+                ctx->mode = DEBUG_MODE_BREAK;
+                char where[192];
+                printf("\n*** Breakpoint %d hit at %s ***\n", i, debugger_addr(ctx, bp->address, where, sizeof(where)));
+                return true;
+            }
         }
     }
+    if (watched) return true;
     if (ctx->mode == DEBUG_MODE_STEP_IN) {
         ctx->steps_remaining--;
         if (ctx->steps_remaining <= 0) { ctx->mode = DEBUG_MODE_BREAK; return true; }
@@ -364,9 +1021,53 @@ bool debugger_should_stop(DebuggerContext *ctx) {
     return false;
 }
 
-void debugger_check_watchpoints(DebuggerContext *ctx) {
-    if (!ctx || !ctx->initialized || !ctx->vm) return;
-    /* Watchpoint checking would go here */
+/* Up to 8 watched bytes as a little-endian number, for the report */
+static uint64_t debugger_watch_value(const uint8_t *bytes, uint64_t size) {
+    uint64_t v = 0;
+    for (uint64_t i = size < 8 ? size : 8; i > 0; i--) v = (v << 8) | bytes[i - 1];
+    return v;
+}
+
+/* Report the watchpoints flagged since the last check. A write hits only
+   if it changed the value, as in gdb; reads hit READ and ACCESS watches */
+bool debugger_check_watchpoints(DebuggerContext *ctx) {
+    if (!ctx || !ctx->initialized || !ctx->vm || !ctx->watch_pending) return false;
+    bool hit = false;
+    ctx->watch_pending = 0;
+    if (ctx->jit && ctx->vm->jit_context) ((JitContext*)ctx->vm->jit_context)->stop_requested = 0;
+    if (ctx->watch_faulted) {
+        /* a store hit an armed page; the values tell which watch it was */
+        ctx->watch_faulted = 0;
+        for (int i = 0; i < ctx->watchpoint_count; i++)
+            if (ctx->watchpoints[i].type != WATCH_READ) ctx->watchpoints[i].written = true;
+    }
+    for (int i = 0; i < ctx->watchpoint_count; i++) {
+        WatchPoint *wp = &ctx->watchpoints[i];
+        bool read = wp->read, written = wp->written;
+        const uint8_t *now = written ? debugger_watch_bytes(ctx, wp) : NULL;
+        char where[192];
+        wp->read = wp->written = false;
+        if (!wp->enabled) continue;
+        debugger_addr(ctx, wp->address, where, sizeof(where));
+        if (now && wp->type != WATCH_READ && memcmp(now, wp->old, wp->size) != 0) {
+            if (wp->size <= 8)
+                printf("\n*** Watchpoint %d: %s changed %llu -> %llu ***\n", i, where,
+                       (unsigned long long)debugger_watch_value(wp->old, wp->size),
+                       (unsigned long long)debugger_watch_value(now, wp->size));
+            else
+                printf("\n*** Watchpoint %d: %s changed (%llu bytes) ***\n", i, where, (unsigned long long)wp->size);
+            memcpy(wp->old, now, wp->size);
+        } else if (read && wp->type != WATCH_WRITE) {
+            printf("\n*** Watchpoint %d: %s read ***\n", i, where);
+        } else {
+            continue;
+        }
+        wp->hit_count++;
+        hit = true;
+    }
+    debugger_watch_arm(ctx);
+    if (hit) ctx->mode = DEBUG_MODE_BREAK;
+    return hit;
 }
 
 /* Visualizer */
@@ -6,6 +6,7 @@
 #define POCOL_VM_DEBUGGER_H
 
 #include "vm.h"
+#include "vm_predicate.h"
 #include <stdint.h>
 #include <stdbool.h>
 
@@ -13,6 +14,8 @@
 #define DEBUG_MAX_BREAKPOINTS    64
 #define DEBUG_MAX_WATCHPOINTS    32
 #define DEBUG_MAX_HISTORY        256
+#define DEBUG_BP_WORDS           ((POCOL_MEMORY_SIZE + 63) / 64)
+#define DEBUG_MAX_WATCH_SIZE     4096
 
 /* Debugger Modes */
 typedef enum {
@@ -30,7 +33,9 @@ typedef struct {
     Inst_Addr address;
     bool enabled;
     bool one_shot;
-    int hit_count;
+    uint64_t hit_count;         /* every arrival, whether or not it stopped */
+    PocolPredicate *cond;       /* stop only when nonzero, NULL: always */
+    PocolLogpoint *log;         /* print this and go on instead of stopping */
 } BreakPoint;
 
 /* Watchpoint */
@@ -42,6 +47,8 @@ typedef struct {
     WatchType type;
     bool enabled;
     int hit_count;
+    bool read, written;         /* touched since the last check */
+    uint8_t *old;               /* contents at the last check */
 } WatchPoint;
 
 /* Execution State */
@@ -77,8 +84,14 @@ typedef struct {
     bool initialized;
     BreakPoint breakpoints[DEBUG_MAX_BREAKPOINTS];
     int breakpoint_count;
+    uint64_t *bp_bits;          /* one bit per code byte, set under enabled breakpoints */
     WatchPoint watchpoints[DEBUG_MAX_WATCHPOINTS];
     int watchpoint_count;
+    uint64_t *watch_pages;      /* POCOL_WATCH_WORDS, one bit per guest page under an enabled watchpoint */
+    PocolWatch watch;           /* installed as vm->watch while any watchpoint is enabled */
+    volatile int watch_pending; /* a watched range was touched since the last check */
+    volatile int watch_faulted; /* the fault handler let a store onto an armed page */
+    bool watch_armed;           /* watched core pages are write-protected */
     ExecutionState current_state;
     ExecutionState previous_state;
     CallFrame *call_stack;
@@ -97,6 +110,9 @@ typedef struct {
     int memory_display_lines;
     uint64_t total_instructions;
     PocolVM *vm;
+    PocolHooks hooks;           /* installed on the VM while debugger_resume() runs it */
+    bool jit;                   /* continue runs JIT code, see debugger_use_jit() */
+    struct PocolReplay *replay; /* set by debugger_record(), enables reverse execution */
 } DebuggerContext;
 
 /* Functions */
@@ -108,6 +124,9 @@ int debugger_add_breakpoint(DebuggerContext *ctx, Inst_Addr addr);
 int debugger_remove_breakpoint(DebuggerContext *ctx, Inst_Addr addr);
 int debugger_enable_breakpoint(DebuggerContext *ctx, Inst_Addr addr);
 int debugger_disable_breakpoint(DebuggerContext *ctx, Inst_Addr addr);
+int debugger_add_conditional(DebuggerContext *ctx, Inst_Addr addr, const char *expr, char *err, size_t errlen);
+int debugger_set_condition(DebuggerContext *ctx, int index, const char *expr, char *err, size_t errlen);
+int debugger_add_logpoint(DebuggerContext *ctx, Inst_Addr addr, const char *text, char *err, size_t errlen);
 void debugger_list_breakpoints(DebuggerContext *ctx);
 BreakPoint* debugger_find_breakpoint(DebuggerContext *ctx, Inst_Addr addr);
 
@@ -121,6 +140,14 @@ void debugger_step_into(DebuggerContext *ctx, int count);
 void debugger_step_over(DebuggerContext *ctx, int count);
 void debugger_step_out(DebuggerContext *ctx);
 void debugger_stop(DebuggerContext *ctx);
+void debugger_resume(DebuggerContext *ctx);
+int debugger_use_jit(DebuggerContext *ctx);
+
+int debugger_record(DebuggerContext *ctx, uint64_t interval);
+void debugger_record_stop(DebuggerContext *ctx);
+void debugger_reverse_step(DebuggerContext *ctx, uint64_t count);
+void debugger_reverse_continue(DebuggerContext *ctx);
+void debugger_show_record(DebuggerContext *ctx);
 
 void debugger_save_state(DebuggerContext *ctx);
 void debugger_restore_state(DebuggerContext *ctx);
@@ -139,7 +166,7 @@ void debugger_disasm_range(DebuggerContext *ctx, Inst_Addr start, Inst_Addr end)
 const char* debugger_get_inst_name(Inst_Type type);
 void debugger_prompt(DebuggerContext *ctx);
 bool debugger_should_stop(DebuggerContext *ctx);
-void debugger_check_watchpoints(DebuggerContext *ctx);
+bool debugger_check_watchpoints(DebuggerContext *ctx);
 
 void debugger_visualize(DebuggerContext *ctx);
 void debugger_visualize_memory(DebuggerContext *ctx, Inst_Addr start, int rows);
@@ -0,0 +1,203 @@
+/* vm_histogram.c -- Opcode and opcode-pair execution histograms */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#include "vm_histogram.h"
+#include "vm.h"
+#include "../common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* room for any op or form name, the longest being "0xFF desc=0xFF" */
+#define HIST_NAME_MAX	32
+
+ST_DATA const char *hist_mnemonics[COUNT_INST] = {"halt", "push", "pop", "add", "jmp", "print", "sys"};
+ST_DATA const char *hist_operands[] = {"-", "reg", "imm"};
+
+typedef struct {
+	uint64_t count;
+	unsigned int a, b;
+} HistRow;
+
+int hist_available(void)
+{
+#ifdef POCOL_HISTOGRAM
+	return 1;
+#else
+	return 0;
+#endif
+}
+
+PocolHistogram *hist_new(void)
+{
+	PocolHistogram *h = calloc(1, sizeof(PocolHistogram));
+	if (!h) {
+		errno = ENOMEM;
+		return NULL;
+	}
+	h->prev = HIST_NO_PREV;
+	return h;
+}
+
+void hist_free(PocolHistogram *h)
+{
+	free(h);
+}
+
+ST_FUNC const char *hist_op_name(unsigned int op, char *buf, size_t size)
+{
+	if (op < COUNT_INST)
+		return hist_mnemonics[op];
+	snprintf(buf, size, "0x%02X", op & 0xFF);
+	return buf;
+}
+
+/* "push imm", "add reg,imm", "halt" */
+ST_FUNC const char *hist_form_name(unsigned int op, unsigned int desc, char *buf, size_t size)
+{
+	char opbuf[8];
+	const char *name = hist_op_name(op, opbuf, sizeof(opbuf));
+	unsigned int op1 = DESC_GET_OP1(desc), op2 = DESC_GET_OP2(desc);
+
+	if (op1 > OPR_IMM || op2 > OPR_IMM)
+		snprintf(buf, size, "%s desc=0x%02X", name, desc & 0xFF);
+	else if (op2 != OPR_NONE)
+		snprintf(buf, size, "%s %s,%s", name, hist_operands[op1], hist_operands[op2]);
+	else if (op1 != OPR_NONE)
+		snprintf(buf, size, "%s %s", name, hist_operands[op1]);
+	else
+		snprintf(buf, size, "%s", name);
+	return buf;
+}
+
+ST_FUNC int hist_row_cmp(const void *x, const void *y)
+{
+	const HistRow *a = x, *b = y;
+	if (a->count != b->count)
+		return a->count < b->count ? 1 : -1;
+	if (a->a != b->a)
+		return a->a < b->a ? -1 : 1;
+	return (a->b > b->b) - (a->b < b->b);
+}
+
+/* Non-zero cells of a 256x256 table, most frequent first */
+ST_FUNC HistRow *hist_sort_table(const uint64_t table[256][256], int *count)
+{
+	int n = 0;
+	for (int a = 0; a < 256; a++)
+		for (int b = 0; b < 256; b++)
+			n += table[a][b] != 0;
+
+	HistRow *rows = malloc((n ? n : 1) * sizeof(HistRow));
+	if (!rows) {
+		*count = 0;
+		return NULL;
+	}
+
+	n = 0;
+	for (int a = 0; a < 256; a++) {
+		for (int b = 0; b < 256; b++) {
+			if (table[a][b] == 0)
+				continue;
+			rows[n].count = table[a][b];
+			rows[n].a = a;
+			rows[n].b = b;
+			n++;
+		}
+	}
+	qsort(rows, n, sizeof(HistRow), hist_row_cmp);
+	*count = n;
+	return rows;
+}
+
+ST_FUNC double hist_percent(const PocolHistogram *h, uint64_t n)
+{
+	return h->total ? 100.0 * (double)n / (double)h->total : 0.0;
+}
+
+ST_FUNC void hist_dump_text(const PocolHistogram *h, FILE *out,
+			    HistRow *ops, int op_count, HistRow *forms, int form_count,
+			    HistRow *pairs, int pair_count)
+{
+	char a[HIST_NAME_MAX], b[HIST_NAME_MAX];
+
+	fprintf(out, "=== Opcode Histogram ===\n");
+	fprintf(out, "Instructions: %llu\n\n", (unsigned long long)h->total);
+
+	fprintf(out, "%-24s %14s %8s\n", "opcode", "count", "%");
+	for (int i = 0; i < op_count; i++)
+		fprintf(out, "%-24s %14llu %7.2f%%\n", hist_op_name(ops[i].a, a, sizeof(a)),
+			(unsigned long long)ops[i].count, hist_percent(h, ops[i].count));
+
+	fprintf(out, "\n%-24s %14s %8s\n", "form", "count", "%");
+	for (int i = 0; i < form_count; i++)
+		fprintf(out, "%-24s %14llu %7.2f%%\n", hist_form_name(forms[i].a, forms[i].b, a, sizeof(a)),
+			(unsigned long long)forms[i].count, hist_percent(h, forms[i].count));
+
+	fprintf(out, "\n%-24s %14s %8s\n", "pair", "count", "%");
+	for (int i = 0; i < pair_count; i++) {
+		char pair[2 * HIST_NAME_MAX + sizeof(" -> ")];
+		snprintf(pair, sizeof(pair), "%s -> %s", hist_op_name(pairs[i].a, a, sizeof(a)),
+			 hist_op_name(pairs[i].b, b, sizeof(b)));
+		fprintf(out, "%-24s %14llu %7.2f%%\n", pair,
+			(unsigned long long)pairs[i].count, hist_percent(h, pairs[i].count));
+	}
+}
+
+ST_FUNC void hist_dump_json(const PocolHistogram *h, FILE *out,
+			    HistRow *ops, int op_count, HistRow *forms, int form_count,
+			    HistRow *pairs, int pair_count)
+{
+	char a[HIST_NAME_MAX], b[HIST_NAME_MAX];
+
+	/* names never need escaping: mnemonics, operand kinds and hex */
+	fprintf(out, "{\"total\":%llu,\"opcodes\":[", (unsigned long long)h->total);
+	for (int i = 0; i < op_count; i++)
+		fprintf(out, "%s\n  {\"op\":\"%s\",\"code\":%u,\"count\":%llu}", i ? "," : "",
+			hist_op_name(ops[i].a, a, sizeof(a)), ops[i].a, (unsigned long long)ops[i].count);
+
+	fprintf(out, "\n],\"forms\":[");
+	for (int i = 0; i < form_count; i++)
+		fprintf(out, "%s\n  {\"form\":\"%s\",\"code\":%u,\"desc\":%u,\"count\":%llu}", i ? "," : "",
+			hist_form_name(forms[i].a, forms[i].b, a, sizeof(a)), forms[i].a, forms[i].b,
+			(unsigned long long)forms[i].count);
+
+	fprintf(out, "\n],\"pairs\":[");
+	for (int i = 0; i < pair_count; i++)
+		fprintf(out, "%s\n  {\"first\":\"%s\",\"second\":\"%s\",\"count\":%llu}", i ? "," : "",
+			hist_op_name(pairs[i].a, a, sizeof(a)), hist_op_name(pairs[i].b, b, sizeof(b)),
+			(unsigned long long)pairs[i].count);
+	fprintf(out, "\n]}\n");
+}
+
+void hist_dump(const PocolHistogram *h, FILE *out, int format)
+{
+	HistRow ops[256];
+	int op_count = 0, form_count, pair_count;
+
+	for (unsigned int i = 0; i < 256; i++) {
+		if (h->ops[i] == 0)
+			continue;
+		ops[op_count].count = h->ops[i];
+		ops[op_count].a = i;
+		ops[op_count].b = 0;
+		op_count++;
+	}
+	qsort(ops, op_count, sizeof(HistRow), hist_row_cmp);
+
+	HistRow *forms = hist_sort_table(h->forms, &form_count);
+	HistRow *pairs = hist_sort_table(h->pairs, &pair_count);
+
+	if (format == HIST_DUMP_JSON)
+		hist_dump_json(h, out, ops, op_count, forms, form_count, pairs, pair_count);
+	else if (format == HIST_DUMP_TEXT)
+		hist_dump_text(h, out, ops, op_count, forms, form_count, pairs, pair_count);
+	fflush(out);
+
+	free(forms);
+	free(pairs);
+}
@@ -0,0 +1,57 @@
+/* vm_histogram.h -- Opcode and opcode-pair execution histograms */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_HISTOGRAM_H
+#define POCOL_VM_HISTOGRAM_H
+
+#include <stdio.h>
+#include <stdint.h>
+
+#define HIST_DUMP_NONE  0
+#define HIST_DUMP_TEXT  1
+#define HIST_DUMP_JSON  2
+
+#define HIST_NO_PREV    256     /* `prev` before the first instruction */
+
+/* Indexed by raw bytes so an illegal opcode cannot index out of range */
+typedef struct PocolHistogram {
+	uint64_t total;
+	uint64_t ops[256];              /* executions per opcode */
+	uint64_t forms[256][256];       /* per opcode and descriptor byte */
+	uint64_t pairs[256][256];       /* [previous opcode][opcode] */
+	unsigned int prev;
+} PocolHistogram;
+
+/* Counting is only compiled into the interpreter when POCOL_HISTOGRAM is
+   defined (`make histogram`); the default build has no trace of it in
+   the dispatch loop. */
+#ifdef POCOL_HISTOGRAM
+static inline void hist_count(PocolHistogram *h, uint8_t op, uint8_t desc)
+{
+	h->total++;
+	h->ops[op]++;
+	h->forms[op][desc]++;
+	if (h->prev != HIST_NO_PREV)
+		h->pairs[h->prev][op]++;
+	h->prev = op;
+}
+#define HIST_COUNT(h, op, desc) do { if (h) hist_count((h), (op), (desc)); } while (0)
+#else
+#define HIST_COUNT(h, op, desc) ((void)0)
+#endif
+
+/* 1 when this binary was built with counting in the interpreter */
+int hist_available(void);
+
+/* Returns NULL with errno set */
+PocolHistogram *hist_new(void);
+void hist_free(PocolHistogram *h);
+
+/* Sorted tables (HIST_DUMP_TEXT) or one JSON object (HIST_DUMP_JSON) */
+void hist_dump(const PocolHistogram *h, FILE *fp, int format);
+
+#endif /* POCOL_VM_HISTOGRAM_H */
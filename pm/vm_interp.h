@@ -0,0 +1,141 @@
+/* vm_interp.h -- Interpreter template, instantiated by vm.c once per variant */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+/* No include guard on purpose. vm.c includes this file twice, the same
+   way common.h's ONE_SOURCE picks linkage at compile time:
+
+     INTERP_HOOKED 0    lean: the plain dispatch loop, nothing else
+     INTERP_HOOKED 1    hooked: PocolHooks before/after every instruction,
+                        plus the opcode histogram when built with it
+
+   INTERP_STEP and INTERP_RUN name the two functions of each variant.
+   Whatever observes execution lives only in the hooked copy, so a new
+   hook never costs the lean loop an instruction. vm.c decides which
+   copy runs, once per call. */
+
+#if !defined(INTERP_STEP) || !defined(INTERP_RUN) || !defined(INTERP_HOOKED)
+#error "define INTERP_STEP, INTERP_RUN and INTERP_HOOKED before including vm_interp.h"
+#endif
+
+/* Execute the instruction at vm->pc. Inside INTERP_RUN, `ran` is how
+   many instructions this run executed before this one and `*counted`
+   how many of them the syscall context has been told about; single
+   steps pass NULL and leave the counting to the caller */
+ST_INLN Err INTERP_STEP(PocolVM *vm, uint64_t ran, uint64_t *counted)
+{
+	if (vm->pc >= POCOL_MEMORY_SIZE)
+		return ERR_ILLEGAL_INST_ACCESS;
+
+#if INTERP_HOOKED
+	Inst_Addr start = vm->pc;
+#endif
+	uint8_t op = NEXT;
+	uint8_t desc = NEXT; /* take byte descriptor */
+	uint8_t op1 = DESC_GET_OP1(desc);
+	uint8_t op2 = DESC_GET_OP2(desc);
+
+#if INTERP_HOOKED
+	HIST_COUNT(vm->histogram, op, desc);	/* nothing unless built with POCOL_HISTOGRAM */
+#endif
+
+	switch (op) {
+		case INST_HALT:
+			vm->halt = 1;
+			if (vm->syscall_ctx)
+				console_flush(&vm->syscall_ctx->console);
+			break;
+
+		case INST_PUSH:
+			if (vm->sp >= POCOL_STACK_SIZE) return ERR_STACK_OVERFLOW;
+			vm->stack[vm->sp++] = pocol_fetch_operand(vm, op1);
+			break;
+
+		case INST_POP:
+			if (vm->sp == 0) return ERR_STACK_UNDERFLOW;
+			vm->registers[REG_OP(NEXT)] = vm->stack[--vm->sp];
+			break;
+
+		case INST_ADD: {
+			uint64_t *dest = &vm->registers[REG_OP(NEXT)];
+			uint64_t src = pocol_fetch_operand(vm, op2); /* fetch next operand */
+			*dest += src;
+		} break;
+
+		case INST_JMP:
+			vm->pc = pocol_fetch_operand(vm, op1);
+			break;
+
+		case INST_PRINT: /* (for debugging) */
+			if (vm->syscall_ctx)
+				console_write_u64(&vm->syscall_ctx->console, pocol_fetch_operand(vm, op1));
+			else
+				printf("%" PRIu64 "", pocol_fetch_operand(vm, op1));
+			break;
+
+		case INST_SYS: {
+			/* System call: r0 = syscall number, r1-r4 = arguments */
+			int syscall_num = (int)vm->registers[0];
+
+			if (vm->syscall_ctx) {
+				if (counted) {
+					/* SYS_PERF reads the count: bring it up to date, this SYS included */
+					vm->syscall_ctx->instruction_count += ran + 1 - *counted;
+					*counted = ran + 1;
+				}
+				syscalls_exec(vm->syscall_ctx, vm, syscall_num);
+			} else {
+				vm->registers[0] = -1;  /* Syscall not available */
+			}
+			break;
+		}
+
+		default:
+			return ERR_ILLEGAL_INST;
+	}
+
+#if INTERP_HOOKED
+	for (int i = 0; i < vm->hook_count; i++)
+		if (vm->hooks[i]->after)
+			vm->hooks[i]->after(vm, start, op, vm->hooks[i]->user);
+#endif
+	return ERR_OK;
+}
+
+/* Retired instructions are not counted one by one: the loop counter
+   already knows how many ran, and it is committed to the syscall context
+   only where someone can observe it, at SYS (see INTERP_STEP) and when
+   the loop exits. */
+ST_FUNC Err INTERP_RUN(PocolVM *vm, int limit)
+{
+	SysCallContext *ctx = vm->syscall_ctx;
+	uint64_t end = limit < 0 ? UINT64_MAX : (uint64_t)limit;
+	uint64_t ran, counted = 0;
+	Err err = ERR_OK;
+
+	for (ran = 0; ran != end && !vm->halt; ran++) {
+#if INTERP_HOOKED
+		/* every hook sees the instruction, any of them can stop before it */
+		int stop = 0;
+		for (int i = 0; i < vm->hook_count; i++)
+			if (vm->hooks[i]->before && vm->hooks[i]->before(vm, vm->hooks[i]->user))
+				stop = 1;
+		if (stop)
+			break;
+#endif
+		err = INTERP_STEP(vm, ran, &counted);
+		if (err != ERR_OK)
+			break;
+	}
+
+	if (ctx)
+		ctx->instruction_count += ran - counted;
+	return err;
+}
+
+#undef INTERP_STEP
+#undef INTERP_RUN
+#undef INTERP_HOOKED
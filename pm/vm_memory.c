@@ -0,0 +1,240 @@
+/* vm_memory.c -- Guest address space management for the Pocol VM */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include "vm_memory.h"
+#include "vm.h"
+#include "../common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#ifndef MAP_NORESERVE
+#define MAP_NORESERVE 0
+#endif
+
+#define PAGE_ROUND_UP(x) (((x) + POCOL_PAGE_SIZE - 1) & ~((uint64_t)POCOL_PAGE_SIZE - 1))
+
+/* Layout of the guest address space:
+
+     0 .. POCOL_MEMORY_SIZE          core memory (program image + data), read/write
+     POCOL_MAP_BASE .. memory_size   SYS_MMAP windows onto host files
+
+   Everything else stays reserved with PROT_NONE so a stray host pointer
+   faults instead of landing in somebody else's heap. */
+
+int pocol_mem_init(PocolVM *vm)
+{
+	uint64_t core = PAGE_ROUND_UP(POCOL_MEMORY_SIZE);
+
+	vm->mapping_count = 0;
+
+#ifdef _WIN32
+	vm->memory = VirtualAlloc(NULL, core, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+	if (!vm->memory)
+		return -1;
+	vm->memory_size = core;
+#else
+	void *base = mmap(NULL, POCOL_ADDRESS_SPACE, PROT_NONE,
+			  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+	if (base != MAP_FAILED) {
+		if (mprotect(base, core, PROT_READ | PROT_WRITE) < 0) {
+			munmap(base, POCOL_ADDRESS_SPACE);
+			return -1;
+		}
+		vm->memory = base;
+		vm->memory_size = POCOL_ADDRESS_SPACE;
+		return 0;
+	}
+
+	/* Host refused the big reservation (32-bit, ulimit -v): core memory only */
+	base = mmap(NULL, core, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	if (base == MAP_FAILED)
+		return -1;
+	vm->memory = base;
+	vm->memory_size = core;
+#endif
+	return 0;
+}
+
+void pocol_mem_free(PocolVM *vm)
+{
+	if (!vm->memory)
+		return;
+
+#ifdef _WIN32
+	VirtualFree(vm->memory, 0, MEM_RELEASE);
+#else
+	/* file mappings live inside the reservation, one munmap drops them all */
+	munmap(vm->memory, vm->memory_size);
+#endif
+	vm->memory = NULL;
+	vm->memory_size = 0;
+	vm->mapping_count = 0;
+}
+
+/* One bit test per page of the range; unwatched pages cost nothing more */
+ST_INLN void mem_watch(PocolVM *vm, uint64_t addr, uint64_t len, int access)
+{
+	const PocolWatch *w = vm->watch;
+	uint64_t last = (addr + (len ? len - 1 : 0)) / POCOL_PAGE_SIZE;
+
+	if (!w->pages) {
+		w->trap(vm, addr, len, access, w->user);
+		return;
+	}
+	for (uint64_t page = addr / POCOL_PAGE_SIZE; page <= last; page++) {
+		if ((w->pages[page >> 6] >> (page & 63)) & 1) {
+			w->trap(vm, addr, len, access, w->user);
+			return;
+		}
+	}
+}
+
+uint8_t *pocol_mem_ptr(PocolVM *vm, uint64_t addr, uint64_t len, int access)
+{
+	/* fast path: core memory is always readable and writable */
+	if (addr < POCOL_MEMORY_SIZE && len <= POCOL_MEMORY_SIZE - addr) {
+		if (vm->watch)
+			mem_watch(vm, addr, len, access);
+		return &vm->memory[addr];
+	}
+
+	for (int i = 0; i < vm->mapping_count; i++) {
+		PocolMapping *m = &vm->mappings[i];
+		if (addr < m->addr)
+			break; /* sorted by address */
+		if (addr - m->addr >= m->length)
+			continue;
+		if (len > m->length - (addr - m->addr) || (access & ~m->access))
+			return NULL;
+		if (vm->watch)
+			mem_watch(vm, addr, len, access);
+		return &vm->memory[addr];
+	}
+
+	return NULL;
+}
+
+/* first-fit search for `length` free bytes above POCOL_MAP_BASE,
+   returns the slot index the new mapping should be inserted at */
+ST_FUNC int mem_find_gap(PocolVM *vm, uint64_t length, Inst_Addr *out)
+{
+	Inst_Addr cursor = POCOL_MAP_BASE;
+	int i;
+
+	for (i = 0; i < vm->mapping_count; i++) {
+		if (vm->mappings[i].addr - cursor >= length)
+			break;
+		cursor = vm->mappings[i].addr + vm->mappings[i].length;
+	}
+
+	if (cursor > vm->memory_size || vm->memory_size - cursor < length)
+		return -1;
+
+	*out = cursor;
+	return i;
+}
+
+int64_t pocol_mem_map_file(PocolVM *vm, int fd, uint64_t offset, uint64_t length, int flags)
+{
+#ifdef _WIN32
+	(void)vm; (void)fd; (void)offset; (void)length; (void)flags;
+	errno = ENOSYS;
+	return -1;
+#else
+	if (offset % POCOL_PAGE_SIZE != 0) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	/* pages wholly past EOF raise SIGBUS when touched, which would take
+	   the VM down with them: the range must lie inside the file */
+	struct stat st;
+	if (fstat(fd, &st) < 0)
+		return -1;
+	if ((uint64_t)st.st_size <= offset) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (length == 0)
+		length = st.st_size - offset;
+	else if (length > (uint64_t)st.st_size - offset) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	if (vm->mapping_count >= POCOL_MAX_MAPPINGS) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	uint64_t rounded = PAGE_ROUND_UP(length);
+	Inst_Addr addr;
+	int slot = mem_find_gap(vm, rounded, &addr);
+	if (slot < 0) {
+		errno = ENOMEM;
+		return -1;
+	}
+
+	int prot = PROT_READ;
+	int kind = MAP_SHARED;
+	int access = POCOL_MEM_READ;
+	if (flags & POCOL_MAP_COW) {
+		prot |= PROT_WRITE;
+		kind = MAP_PRIVATE;
+		access |= POCOL_MEM_WRITE;
+	}
+
+	/* replace the PROT_NONE reservation in place, no copy is ever made */
+	void *p = mmap(vm->memory + addr, rounded, prot, kind | MAP_FIXED, fd, (off_t)offset);
+	if (p == MAP_FAILED)
+		return -1;
+
+	memmove(&vm->mappings[slot + 1], &vm->mappings[slot],
+		(vm->mapping_count - slot) * sizeof(PocolMapping));
+	vm->mappings[slot].addr = addr;
+	vm->mappings[slot].length = rounded;
+	vm->mappings[slot].access = access;
+	vm->mapping_count++;
+
+	return (int64_t)addr;
+#endif
+}
+
+int pocol_mem_unmap(PocolVM *vm, uint64_t addr)
+{
+	for (int i = 0; i < vm->mapping_count; i++) {
+		PocolMapping *m = &vm->mappings[i];
+		if (m->addr != addr)
+			continue;
+
+#ifndef _WIN32
+		/* put the reservation back rather than leaving a hole */
+		if (mmap(vm->memory + m->addr, m->length, PROT_NONE,
+			 MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1, 0) == MAP_FAILED)
+			return -1;
+#endif
+
+		memmove(&vm->mappings[i], &vm->mappings[i + 1],
+			(vm->mapping_count - i - 1) * sizeof(PocolMapping));
+		vm->mapping_count--;
+		return 0;
+	}
+
+	errno = EINVAL;
+	return -1;
+}
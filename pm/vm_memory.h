@@ -0,0 +1,40 @@
+/* vm_memory.h -- Guest address space management for the Pocol VM */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_MEMORY_H
+#define POCOL_VM_MEMORY_H
+
+#include "vm.h"
+#include <stdint.h>
+
+/* Access rights requested through pocol_mem_ptr() */
+#define POCOL_MEM_READ      0x01
+#define POCOL_MEM_WRITE     0x02
+
+/* SYS_MMAP flags */
+#define POCOL_MAP_RDONLY    0x00    /* read-only view that shares the host page cache */
+#define POCOL_MAP_COW       0x01    /* private writable view, copy-on-write */
+
+/* Reserve the guest address space and commit the core memory region */
+int pocol_mem_init(PocolVM *vm);
+
+/* Drop every mapping and release the reservation */
+void pocol_mem_free(PocolVM *vm);
+
+/* Translate the guest range [addr, addr + len) into a host pointer.
+   Returns NULL if any byte is outside a mapped region or lacks `access` */
+uint8_t *pocol_mem_ptr(PocolVM *vm, uint64_t addr, uint64_t len, int access);
+
+/* Map `length` bytes of host fd at `offset` into free guest address space.
+   length 0 maps up to end of file; a range reaching past it fails with
+   EINVAL. Returns the guest address, -1 with errno set */
+int64_t pocol_mem_map_file(PocolVM *vm, int fd, uint64_t offset, uint64_t length, int flags);
+
+/* Unmap the mapping that starts at guest address `addr` */
+int pocol_mem_unmap(PocolVM *vm, uint64_t addr);
+
+#endif /* POCOL_VM_MEMORY_H */
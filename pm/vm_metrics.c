@@ -0,0 +1,284 @@
+/* vm_metrics.c -- Per-run metrics export for `pm --metrics` */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#define _DEFAULT_SOURCE
+#include "vm_metrics.h"
+#include "jit.h"
+#include "../common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+#ifdef _WIN32
+#include <io.h>
+#define dup _dup
+#define close _close
+#define fdopen _fdopen
+#else
+#include <unistd.h>
+#endif
+
+/* Everything the writers need, gathered once */
+typedef struct {
+	uint64_t instructions;
+	uint64_t syscalls;
+	uint64_t bytes_read, bytes_written;
+	uint64_t stack_peak;
+	double wall, cpu;
+	int jit;
+	uint64_t compiled, executed;
+	double compile;
+	uint64_t cache_entries, code_bytes, code_capacity;
+} MetricsSnapshot;
+
+int metrics_parse(PocolMetrics *m, const char *spec)
+{
+	const char *colon = strchr(spec, ':');
+	size_t len = colon ? (size_t)(colon - spec) : strlen(spec);
+
+	memset(m, 0, sizeof(*m));
+	m->fd = -1;
+
+	if (len == 4 && strncmp(spec, "json", 4) == 0)
+		m->format = METRICS_JSON;
+	else if ((len == 4 && strncmp(spec, "prom", 4) == 0) ||
+		 (len == 10 && strncmp(spec, "prometheus", 10) == 0))
+		m->format = METRICS_PROMETHEUS;
+	else
+		return -1;
+
+	if (!colon)
+		return 0;
+	if (colon[1] == '\0')
+		return -1;
+	if (strncmp(colon + 1, "fd:", 3) == 0) {
+		char *end;
+		long fd = strtol(colon + 4, &end, 10);
+		if (end == colon + 4 || *end != '\0' || fd < 0)
+			return -1;
+		m->fd = (int)fd;
+		return 0;
+	}
+	m->path = colon + 1;
+	return 0;
+}
+
+void metrics_begin(PocolMetrics *m, PocolVM *vm)
+{
+	m->start_sp = vm->sp;
+	for (Stack_Addr i = vm->sp; i < POCOL_STACK_SIZE; i++)
+		vm->stack[i] = METRICS_STACK_PAINT;
+	m->start_cpu = clock();
+	m->start_ns = pocol_clock_ns();
+}
+
+ST_FUNC void metrics_collect(PocolMetrics *m, PocolVM *vm, MetricsSnapshot *s)
+{
+	memset(s, 0, sizeof(*s));
+	s->wall = (double)(pocol_clock_ns() - m->start_ns) / 1e9;
+	s->cpu = (double)(clock() - m->start_cpu) / CLOCKS_PER_SEC;
+
+	s->stack_peak = m->start_sp > vm->sp ? m->start_sp : vm->sp;
+	for (Stack_Addr i = POCOL_STACK_SIZE; i > s->stack_peak; i--) {
+		if (vm->stack[i - 1] != METRICS_STACK_PAINT) {
+			s->stack_peak = i;
+			break;
+		}
+	}
+
+	SysCallContext *ctx = vm->syscall_ctx;
+	if (ctx) {
+		s->instructions = ctx->instruction_count;
+		s->syscalls = ctx->syscall_count;
+		s->bytes_read = ctx->bytes_read;
+		s->bytes_written = ctx->bytes_written;
+	}
+
+	JitContext *jit = (JitContext*)vm->jit_context;
+	if (jit) {
+		s->jit = jit->mode != JIT_MODE_DISABLED;
+		s->compiled = jit->compile_count;
+		s->executed = jit->execute_count;
+		s->compile = (double)jit->compile_ns / 1e9;
+		s->cache_entries = jit->cache_count;
+		s->code_bytes = jit->buffer_used;
+		s->code_capacity = jit->buffer_size;
+	}
+}
+
+/* JSON string body; the program path is the only untrusted text */
+ST_FUNC void metrics_json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+ST_FUNC void metrics_write_json(FILE *out, PocolVM *vm, const MetricsSnapshot *s,
+				const char *program, Err err)
+{
+	SysCallContext *ctx = vm->syscall_ctx;
+	int first = 1;
+
+	fprintf(out, "{\"program\":");
+	metrics_json_string(out, program);
+	fprintf(out, ",\"error\":%d,\"halted\":%s,\n", (int)err, vm->halt ? "true" : "false");
+	fprintf(out, " \"instructions\":%" PRIu64 ",\"wall_seconds\":%.6f,\"cpu_seconds\":%.6f,\n",
+		s->instructions, s->wall, s->cpu);
+	fprintf(out, " \"stack\":{\"peak\":%" PRIu64 ",\"capacity\":%d},\n", s->stack_peak, POCOL_STACK_SIZE);
+	fprintf(out, " \"io\":{\"bytes_read\":%" PRIu64 ",\"bytes_written\":%" PRIu64 "},\n",
+		s->bytes_read, s->bytes_written);
+
+	fprintf(out, " \"syscalls\":{\"total\":%" PRIu64 ",\"by_number\":[", s->syscalls);
+	for (int i = 0; ctx && i < SYS_TABLE_SIZE; i++) {
+		if (!ctx->table[i].calls)
+			continue;
+		fprintf(out, "%s{\"number\":%d,\"name\":", first ? "" : ",", i);
+		metrics_json_string(out, syscalls_name(ctx, i));
+		fprintf(out, ",\"calls\":%" PRIu64 "}", ctx->table[i].calls);
+		first = 0;
+	}
+	fprintf(out, "]},\n");
+
+	fprintf(out, " \"jit\":{\"enabled\":%s,\"blocks_compiled\":%" PRIu64 ",\"blocks_executed\":%" PRIu64
+		",\"compile_seconds\":%.6f,\"cache_entries\":%" PRIu64 ",\"cache_capacity\":%d"
+		",\"code_bytes\":%" PRIu64 ",\"code_capacity\":%" PRIu64 "}}\n",
+		s->jit ? "true" : "false", s->compiled, s->executed, s->compile,
+		s->cache_entries, JIT_CACHE_SIZE, s->code_bytes, s->code_capacity);
+}
+
+ST_FUNC void metrics_prom(FILE *out, const char *name, const char *type, const char *help)
+{
+	fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+/* Label value; plugins pick their own syscall names */
+ST_FUNC void metrics_prom_label(FILE *out, const char *s)
+{
+	for (; *s; s++) {
+		if (*s == '"' || *s == '\\')
+			fprintf(out, "\\%c", *s);
+		else if (*s == '\n')
+			fputs("\\n", out);
+		else
+			fputc(*s, out);
+	}
+}
+
+/* Text exposition format 0.0.4 */
+ST_FUNC void metrics_write_prometheus(FILE *out, PocolVM *vm, const MetricsSnapshot *s, Err err)
+{
+	SysCallContext *ctx = vm->syscall_ctx;
+
+	metrics_prom(out, "pocol_instructions_total", "counter", "Guest instructions retired.");
+	fprintf(out, "pocol_instructions_total %" PRIu64 "\n", s->instructions);
+	metrics_prom(out, "pocol_error", "gauge", "Err code the run ended with, 0 on success.");
+	fprintf(out, "pocol_error %d\n", (int)err);
+	metrics_prom(out, "pocol_wall_seconds", "gauge", "Wall-clock time spent executing.");
+	fprintf(out, "pocol_wall_seconds %.6f\n", s->wall);
+	metrics_prom(out, "pocol_cpu_seconds", "gauge", "Process CPU time spent executing.");
+	fprintf(out, "pocol_cpu_seconds %.6f\n", s->cpu);
+
+	metrics_prom(out, "pocol_stack_peak_depth", "gauge", "Deepest stack reached, in slots.");
+	fprintf(out, "pocol_stack_peak_depth %" PRIu64 "\n", s->stack_peak);
+	metrics_prom(out, "pocol_stack_capacity", "gauge", "Stack size, in slots.");
+	fprintf(out, "pocol_stack_capacity %d\n", POCOL_STACK_SIZE);
+
+	metrics_prom(out, "pocol_io_read_bytes_total", "counter", "Bytes the guest read through syscalls.");
+	fprintf(out, "pocol_io_read_bytes_total %" PRIu64 "\n", s->bytes_read);
+	metrics_prom(out, "pocol_io_written_bytes_total", "counter", "Bytes the guest wrote through syscalls.");
+	fprintf(out, "pocol_io_written_bytes_total %" PRIu64 "\n", s->bytes_written);
+
+	metrics_prom(out, "pocol_syscalls_total", "counter", "Syscalls executed, by number.");
+	for (int i = 0; ctx && i < SYS_TABLE_SIZE; i++)
+		if (ctx->table[i].calls) {
+			fprintf(out, "pocol_syscalls_total{number=\"%d\",name=\"", i);
+			metrics_prom_label(out, syscalls_name(ctx, i));
+			fprintf(out, "\"} %" PRIu64 "\n", ctx->table[i].calls);
+		}
+
+	metrics_prom(out, "pocol_jit_blocks_compiled_total", "counter", "JIT blocks compiled.");
+	fprintf(out, "pocol_jit_blocks_compiled_total %" PRIu64 "\n", s->compiled);
+	metrics_prom(out, "pocol_jit_blocks_executed_total", "counter", "JIT block entries.");
+	fprintf(out, "pocol_jit_blocks_executed_total %" PRIu64 "\n", s->executed);
+	metrics_prom(out, "pocol_jit_compile_seconds_total", "counter", "Time spent compiling JIT blocks.");
+	fprintf(out, "pocol_jit_compile_seconds_total %.6f\n", s->compile);
+	metrics_prom(out, "pocol_jit_cache_entries", "gauge", "JIT cache entries in use.");
+	fprintf(out, "pocol_jit_cache_entries %" PRIu64 "\n", s->cache_entries);
+	metrics_prom(out, "pocol_jit_cache_capacity", "gauge", "JIT cache entries available.");
+	fprintf(out, "pocol_jit_cache_capacity %d\n", JIT_CACHE_SIZE);
+	metrics_prom(out, "pocol_jit_code_bytes", "gauge", "Bytes of generated code.");
+	fprintf(out, "pocol_jit_code_bytes %" PRIu64 "\n", s->code_bytes);
+	metrics_prom(out, "pocol_jit_code_capacity_bytes", "gauge", "Size of the JIT code buffer.");
+	fprintf(out, "pocol_jit_code_capacity_bytes %" PRIu64 "\n", s->code_capacity);
+}
+
+int metrics_write(PocolMetrics *m, PocolVM *vm, const char *program, Err err)
+{
+	MetricsSnapshot s;
+	char tmp[1024];
+	FILE *out = stderr;
+
+	metrics_collect(m, vm, &s);
+
+	/* guest output first, so the two never interleave on a shared fd */
+	if (vm->syscall_ctx)
+		console_flush(&vm->syscall_ctx->console);
+	fflush(stdout);
+
+	if (m->fd >= 0) {
+		int fd = dup(m->fd);
+		if (fd < 0 || !(out = fdopen(fd, "w"))) {
+			if (fd >= 0)
+				close(fd);
+			return -1;
+		}
+	} else if (m->path) {
+		if ((size_t)snprintf(tmp, sizeof(tmp), "%s.tmp", m->path) >= sizeof(tmp)) {
+			errno = ENAMETOOLONG;
+			return -1;
+		}
+		if (!(out = fopen(tmp, "w")))
+			return -1;
+	}
+
+	if (m->format == METRICS_JSON)
+		metrics_write_json(out, vm, &s, program, err);
+	else
+		metrics_write_prometheus(out, vm, &s, err);
+
+	if (out == stderr) {
+		fflush(out);
+		return 0;
+	}
+
+	int failed = ferror(out);
+	if (fclose(out) != 0)
+		failed = 1;
+	if (m->path) {
+		if (failed) {
+			int saved = errno;
+			remove(tmp);
+			errno = saved ? saved : EIO;
+			return -1;
+		}
+		return rename(tmp, m->path);
+	}
+	if (failed && !errno)
+		errno = EIO;
+	return failed ? -1 : 0;
+}
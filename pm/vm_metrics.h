@@ -0,0 +1,44 @@
+/* vm_metrics.h -- Per-run metrics export for `pm --metrics` */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_METRICS_H
+#define POCOL_VM_METRICS_H
+
+#include "vm.h"
+#include <stdint.h>
+#include <time.h>
+
+#define METRICS_NONE        0
+#define METRICS_JSON        1
+#define METRICS_PROMETHEUS  2
+
+/* Written over the unused part of the stack by metrics_begin(); the
+   highest slot that no longer holds it is the peak depth. Costs the
+   dispatch loop nothing, the JIT included */
+#define METRICS_STACK_PAINT 0x5AFE57AC5AFE57ACULL
+
+typedef struct {
+	int format;             /* METRICS_JSON or METRICS_PROMETHEUS */
+	const char *path;       /* NULL: stderr */
+	int fd;                 /* >= 0: write to this descriptor instead */
+	uint64_t start_ns;
+	clock_t start_cpu;
+	Stack_Addr start_sp;
+} PocolMetrics;
+
+/* Parse "FMT[:DEST]": FMT is json or prometheus (prom), DEST a path or
+   fd:N, stderr by default. -1 on a malformed spec */
+int metrics_parse(PocolMetrics *m, const char *spec);
+
+/* Start the clocks and paint the stack; call right before execution */
+void metrics_begin(PocolMetrics *m, PocolVM *vm);
+
+/* Collect everything and write it out. A path is written to PATH.tmp and
+   renamed, so a scraper never reads half a file. -1 with errno set */
+int metrics_write(PocolMetrics *m, PocolVM *vm, const char *program, Err err);
+
+#endif /* POCOL_VM_METRICS_H */
@@ -0,0 +1,365 @@
+/* vm_predicate.c -- Breakpoint conditions and logpoint templates */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#include "vm_predicate.h"
+#include "../common.h"
+#include <ctype.h>
+#include <inttypes.h>
+#include <stdlib.h>
+#include <string.h>
+
+enum {
+	PRED_CONST,	/* consts[arg] */
+	PRED_REG,	/* registers[arg] */
+	PRED_PC,
+	PRED_SP,
+	PRED_HITS,
+	PRED_NOT,
+	PRED_NEG,
+	PRED_ADD,
+	PRED_SUB,
+	PRED_MUL,
+	PRED_DIV,
+	PRED_MOD,
+	PRED_EQ,
+	PRED_NE,
+	PRED_LT,
+	PRED_LE,
+	PRED_GT,
+	PRED_GE,
+	PRED_AND,
+	PRED_OR,
+};
+
+/* Recursive descent, one function per C precedence level, emitting
+   postfix code as it goes. `depth` tracks the evaluation stack so eval
+   never has to check it */
+typedef struct {
+	PocolPredicate *p;
+	const char *s;
+	int depth;
+	char *err;
+	size_t errlen;
+	int failed;
+} PredParser;
+
+ST_FUNC void pred_error(PredParser *ps, const char *msg)
+{
+	if (ps->failed)
+		return;
+	ps->failed = 1;
+	if (*ps->s)
+		snprintf(ps->err, ps->errlen, "%s at '%s'", msg, ps->s);
+	else
+		snprintf(ps->err, ps->errlen, "%s at end of expression", msg);
+}
+
+ST_FUNC void pred_emit(PredParser *ps, int op, int arg, int effect)
+{
+	PocolPredicate *p = ps->p;
+
+	if (ps->failed)
+		return;
+	if (p->length >= PRED_MAX_CODE) {
+		pred_error(ps, "expression too long");
+		return;
+	}
+	ps->depth += effect;
+	if (ps->depth > PRED_MAX_DEPTH) {
+		pred_error(ps, "expression nested too deeply");
+		return;
+	}
+	p->code[p->length].op = (uint8_t)op;
+	p->code[p->length].arg = (uint8_t)arg;
+	p->length++;
+}
+
+ST_FUNC void pred_skip(PredParser *ps)
+{
+	while (isspace((unsigned char)*ps->s))
+		ps->s++;
+}
+
+/* Consume `tok` when it comes next, but not the front of a longer
+   operator (`<` must not eat the `<` of `<=`) */
+ST_FUNC int pred_accept(PredParser *ps, const char *tok)
+{
+	size_t n = strlen(tok);
+
+	pred_skip(ps);
+	if (strncmp(ps->s, tok, n) != 0)
+		return 0;
+	if (n == 1 && (*tok == '<' || *tok == '>' || *tok == '!') && ps->s[1] == '=')
+		return 0;
+	ps->s += n;
+	return 1;
+}
+
+ST_FUNC void pred_or(PredParser *ps);
+
+ST_FUNC void pred_primary(PredParser *ps)
+{
+	const char *s;
+
+	pred_skip(ps);
+	s = ps->s;
+
+	if (pred_accept(ps, "(")) {
+		pred_or(ps);
+		if (!pred_accept(ps, ")"))
+			pred_error(ps, "expected ')'");
+		return;
+	}
+
+	if (isdigit((unsigned char)*s)) {
+		char *end;
+		uint64_t v = strtoull(s, &end, 0);
+		PocolPredicate *p = ps->p;
+		int i;
+
+		if (isalnum((unsigned char)*end) || *end == '_') {
+			pred_error(ps, "bad number");
+			return;
+		}
+		ps->s = end;
+		for (i = 0; i < p->const_count; i++)
+			if (p->consts[i] == v)
+				break;
+		if (i == p->const_count) {
+			if (p->const_count >= PRED_MAX_CONST) {
+				pred_error(ps, "too many constants");
+				return;
+			}
+			p->consts[p->const_count++] = v;
+		}
+		pred_emit(ps, PRED_CONST, i, 1);
+		return;
+	}
+
+	if (isalpha((unsigned char)*s)) {
+		size_t n = 0;
+		while (isalnum((unsigned char)s[n]) || s[n] == '_')
+			n++;
+
+		if (n == 2 && s[0] == 'r' && s[1] >= '0' && s[1] <= '7')
+			pred_emit(ps, PRED_REG, s[1] - '0', 1);
+		else if (n == 2 && !strncmp(s, "pc", 2))
+			pred_emit(ps, PRED_PC, 0, 1);
+		else if (n == 2 && !strncmp(s, "sp", 2))
+			pred_emit(ps, PRED_SP, 0, 1);
+		else if (n == 4 && !strncmp(s, "hits", 4))
+			pred_emit(ps, PRED_HITS, 0, 1);
+		else {
+			pred_error(ps, "unknown name");
+			return;
+		}
+		ps->s += n;
+		return;
+	}
+
+	pred_error(ps, "expected a value");
+}
+
+ST_FUNC void pred_unary(PredParser *ps)
+{
+	if (pred_accept(ps, "!")) {
+		pred_unary(ps);
+		pred_emit(ps, PRED_NOT, 0, 0);
+	} else if (pred_accept(ps, "-")) {
+		pred_unary(ps);
+		pred_emit(ps, PRED_NEG, 0, 0);
+	} else {
+		pred_primary(ps);
+	}
+}
+
+ST_FUNC void pred_mul(PredParser *ps)
+{
+	pred_unary(ps);
+	while (!ps->failed) {
+		int op;
+		if (pred_accept(ps, "*"))
+			op = PRED_MUL;
+		else if (pred_accept(ps, "/"))
+			op = PRED_DIV;
+		else if (pred_accept(ps, "%"))
+			op = PRED_MOD;
+		else
+			break;
+		pred_unary(ps);
+		pred_emit(ps, op, 0, -1);
+	}
+}
+
+ST_FUNC void pred_add(PredParser *ps)
+{
+	pred_mul(ps);
+	while (!ps->failed) {
+		int op;
+		if (pred_accept(ps, "+"))
+			op = PRED_ADD;
+		else if (pred_accept(ps, "-"))
+			op = PRED_SUB;
+		else
+			break;
+		pred_mul(ps);
+		pred_emit(ps, op, 0, -1);
+	}
+}
+
+ST_FUNC void pred_rel(PredParser *ps)
+{
+	pred_add(ps);
+	while (!ps->failed) {
+		int op;
+		if (pred_accept(ps, "<="))
+			op = PRED_LE;
+		else if (pred_accept(ps, ">="))
+			op = PRED_GE;
+		else if (pred_accept(ps, "<"))
+			op = PRED_LT;
+		else if (pred_accept(ps, ">"))
+			op = PRED_GT;
+		else
+			break;
+		pred_add(ps);
+		pred_emit(ps, op, 0, -1);
+	}
+}
+
+ST_FUNC void pred_eq(PredParser *ps)
+{
+	pred_rel(ps);
+	while (!ps->failed) {
+		int op;
+		if (pred_accept(ps, "=="))
+			op = PRED_EQ;
+		else if (pred_accept(ps, "!="))
+			op = PRED_NE;
+		else
+			break;
+		pred_rel(ps);
+		pred_emit(ps, op, 0, -1);
+	}
+}
+
+ST_FUNC void pred_and(PredParser *ps)
+{
+	pred_eq(ps);
+	while (!ps->failed && pred_accept(ps, "&&")) {
+		pred_eq(ps);
+		pred_emit(ps, PRED_AND, 0, -1);
+	}
+}
+
+ST_FUNC void pred_or(PredParser *ps)
+{
+	pred_and(ps);
+	while (!ps->failed && pred_accept(ps, "||")) {
+		pred_and(ps);
+		pred_emit(ps, PRED_OR, 0, -1);
+	}
+}
+
+int predicate_compile(PocolPredicate *p, const char *text, char *err, size_t errlen)
+{
+	PredParser ps = { p, text, 0, err, errlen, 0 };
+
+	memset(p, 0, sizeof(*p));
+	snprintf(p->text, sizeof(p->text), "%s", text);
+
+	pred_or(&ps);
+	pred_skip(&ps);
+	if (!ps.failed && *ps.s)
+		pred_error(&ps, "unexpected text");
+	return ps.failed ? -1 : 0;
+}
+
+/* Operands need no side effects, so && and || evaluate both sides
+   rather than branching */
+uint64_t predicate_eval(const PocolPredicate *p, const PocolVM *vm, uint64_t hits)
+{
+	uint64_t stack[PRED_MAX_DEPTH];
+	int sp = 0;
+
+	for (int i = 0; i < p->length; i++) {
+		const PredInst *in = &p->code[i];
+		uint64_t b;
+
+		switch (in->op) {
+		case PRED_CONST: stack[sp++] = p->consts[in->arg]; continue;
+		case PRED_REG:   stack[sp++] = vm->registers[in->arg]; continue;
+		case PRED_PC:    stack[sp++] = vm->pc; continue;
+		case PRED_SP:    stack[sp++] = vm->sp; continue;
+		case PRED_HITS:  stack[sp++] = hits; continue;
+		case PRED_NOT:   stack[sp - 1] = !stack[sp - 1]; continue;
+		case PRED_NEG:   stack[sp - 1] = -stack[sp - 1]; continue;
+		}
+
+		b = stack[--sp];
+		switch (in->op) {
+		case PRED_ADD: stack[sp - 1] += b; break;
+		case PRED_SUB: stack[sp - 1] -= b; break;
+		case PRED_MUL: stack[sp - 1] *= b; break;
+		case PRED_DIV: stack[sp - 1] = b ? stack[sp - 1] / b : 0; break;
+		case PRED_MOD: stack[sp - 1] = b ? stack[sp - 1] % b : 0; break;
+		case PRED_EQ:  stack[sp - 1] = stack[sp - 1] == b; break;
+		case PRED_NE:  stack[sp - 1] = stack[sp - 1] != b; break;
+		case PRED_LT:  stack[sp - 1] = stack[sp - 1] < b; break;
+		case PRED_LE:  stack[sp - 1] = stack[sp - 1] <= b; break;
+		case PRED_GT:  stack[sp - 1] = stack[sp - 1] > b; break;
+		case PRED_GE:  stack[sp - 1] = stack[sp - 1] >= b; break;
+		case PRED_AND: stack[sp - 1] = stack[sp - 1] && b; break;
+		case PRED_OR:  stack[sp - 1] = stack[sp - 1] || b; break;
+		}
+	}
+
+	return sp ? stack[0] : 0;
+}
+
+int logpoint_compile(PocolLogpoint *lp, const char *text, char *err, size_t errlen)
+{
+	memset(lp, 0, sizeof(*lp));
+	if (strlen(text) >= sizeof(lp->text)) {
+		snprintf(err, errlen, "log message longer than %d characters", PRED_MAX_TEXT - 1);
+		return -1;
+	}
+	snprintf(lp->text, sizeof(lp->text), "%s", text);
+
+	for (const char *s = lp->text; (s = strchr(s, '{')); ) {
+		const char *end = strchr(s, '}');
+		char expr[PRED_MAX_TEXT];
+
+		if (!end) {
+			snprintf(err, errlen, "missing '}' in log message");
+			return -1;
+		}
+		if (lp->arg_count >= LOG_MAX_ARGS) {
+			snprintf(err, errlen, "more than %d {expressions} in log message", LOG_MAX_ARGS);
+			return -1;
+		}
+		snprintf(expr, sizeof(expr), "%.*s", (int)(end - s - 1), s + 1);
+		if (predicate_compile(&lp->args[lp->arg_count], expr, err, errlen) < 0)
+			return -1;
+		lp->arg_count++;
+		s = end + 1;
+	}
+	return 0;
+}
+
+void logpoint_print(const PocolLogpoint *lp, const PocolVM *vm, uint64_t hits, FILE *out)
+{
+	const char *s = lp->text;
+
+	for (int i = 0; i < lp->arg_count; i++) {
+		const char *open = strchr(s, '{');
+		fprintf(out, "%.*s%" PRIu64, (int)(open - s), s,
+			predicate_eval(&lp->args[i], vm, hits));
+		s = strchr(open, '}') + 1;
+	}
+	fprintf(out, "%s\n", s);
+}
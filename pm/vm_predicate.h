@@ -0,0 +1,54 @@
+/* vm_predicate.h -- Breakpoint conditions and logpoint templates */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_PREDICATE_H
+#define POCOL_VM_PREDICATE_H
+
+#include "vm.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+
+#define PRED_MAX_CODE	48
+#define PRED_MAX_CONST	8
+#define PRED_MAX_DEPTH	16
+#define PRED_MAX_TEXT	128
+#define LOG_MAX_ARGS	8
+
+/* An expression over r0-r7, pc, sp and hits (the breakpoint's hit count,
+   this hit included), with C operators: || && == != < <= > >= + - * / %
+   ! and unary minus. Values are unsigned 64-bit; x / 0 and x % 0 are 0.
+   Compiled once to a stack bytecode, so evaluating it at a breakpoint
+   is a short loop with no parsing and no allocation */
+typedef struct {
+	uint8_t op, arg;
+} PredInst;
+
+typedef struct {
+	PredInst code[PRED_MAX_CODE];
+	int length;
+	uint64_t consts[PRED_MAX_CONST];
+	int const_count;
+	char text[PRED_MAX_TEXT];	/* the source, for listings */
+} PocolPredicate;
+
+/* Text printed each time a logpoint is reached; every {expr} in it is
+   replaced by the expression's value */
+typedef struct {
+	char text[PRED_MAX_TEXT];
+	PocolPredicate args[LOG_MAX_ARGS];
+	int arg_count;
+} PocolLogpoint;
+
+/* -1 with a message in err on a syntax error or an expression too big */
+int predicate_compile(PocolPredicate *p, const char *text, char *err, size_t errlen);
+uint64_t predicate_eval(const PocolPredicate *p, const PocolVM *vm, uint64_t hits);
+
+int logpoint_compile(PocolLogpoint *lp, const char *text, char *err, size_t errlen);
+void logpoint_print(const PocolLogpoint *lp, const PocolVM *vm, uint64_t hits, FILE *out);
+
+#endif /* POCOL_VM_PREDICATE_H */
@@ -0,0 +1,194 @@
+/* vm_profile.c -- Guest profiling regions for the Pocol VM */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#include "vm_profile.h"
+#include "vm_syscalls.h"
+#include "../common.h"
+#include <string.h>
+#include <errno.h>
+
+/* BEGIN/END sit on the guest's hot path: no allocation, no locking, just
+   a stack push/pop and a few adds into a fixed table indexed by id.
+   Timestamps come from pocol_cycles(), which is several times cheaper
+   than a clock_gettime() call, and are turned into ns with a tick rate
+   measured once at the first BEGIN and refined over the whole run when
+   the table is dumped. */
+
+#define PROF_CALIBRATE_NS   200000  /* 0.2 ms spin, paid only by programs that profile */
+
+void prof_init(PocolProfile *prof)
+{
+	memset(prof, 0, sizeof(*prof));
+	for (int i = 0; i < PROF_MAX_REGIONS; i++)
+		prof->regions[i].parent = -1;
+}
+
+ST_FUNC void prof_calibrate(PocolProfile *prof)
+{
+	uint64_t ns, ticks;
+
+	prof->cal_ns = pocol_clock_ns();
+	prof->cal_ticks = pocol_cycles();
+	do {
+		ns = pocol_clock_ns();
+		ticks = pocol_cycles();
+	} while (ns - prof->cal_ns < PROF_CALIBRATE_NS);
+
+	prof->ns_per_tick = ticks > prof->cal_ticks
+		? (double)(ns - prof->cal_ns) / (double)(ticks - prof->cal_ticks) : 1.0;
+}
+
+int prof_begin(PocolProfile *prof, int id, uint64_t inst)
+{
+	if (id < 0 || id >= PROF_MAX_REGIONS) {
+		errno = EINVAL;
+		return -1;
+	}
+	if (prof->depth == PROF_MAX_DEPTH) {
+		errno = EOVERFLOW;
+		return -1;
+	}
+	if (prof->ns_per_tick == 0)
+		prof_calibrate(prof);
+
+	ProfRegion *r = &prof->regions[id];
+	if (r->count == 0 && prof->depth > 0)
+		r->parent = prof->stack[prof->depth - 1].id;
+
+	ProfFrame *f = &prof->stack[prof->depth++];
+	f->id = id;
+	f->start_inst = inst;
+	f->child = 0;
+	f->start = pocol_cycles();
+	return 0;
+}
+
+int64_t prof_end(PocolProfile *prof, int id, uint64_t inst)
+{
+	uint64_t now = pocol_cycles();
+
+	if (prof->depth == 0 || prof->stack[prof->depth - 1].id != id) {
+		prof->mismatched++;
+		errno = EINVAL;
+		return -1;
+	}
+
+	ProfFrame *f = &prof->stack[--prof->depth];
+	ProfRegion *r = &prof->regions[id];
+	uint64_t elapsed = now - f->start;
+
+	if (r->count == 0 || elapsed < r->min)
+		r->min = elapsed;
+	if (elapsed > r->max)
+		r->max = elapsed;
+	r->count++;
+	r->total += elapsed;
+	r->self += elapsed - f->child;
+	r->instructions += inst - f->start_inst;
+
+	if (prof->depth > 0)
+		prof->stack[prof->depth - 1].child += elapsed;
+
+	return (int64_t)(elapsed * prof->ns_per_tick);
+}
+
+void prof_set_name(PocolProfile *prof, int id, const char *name, size_t len)
+{
+	if (id < 0 || id >= PROF_MAX_REGIONS || prof->regions[id].name[0])
+		return;
+	if (len >= PROF_NAME_MAX)
+		len = PROF_NAME_MAX - 1;
+	memcpy(prof->regions[id].name, name, len);
+	prof->regions[id].name[len] = '\0';
+}
+
+ST_FUNC void prof_json_string(FILE *out, const char *s)
+{
+	fputc('"', out);
+	for (; *s; s++) {
+		unsigned char c = (unsigned char)*s;
+		if (c == '"' || c == '\\')
+			fprintf(out, "\\%c", c);
+		else if (c < 0x20)
+			fprintf(out, "\\u%04x", c);
+		else
+			fputc(c, out);
+	}
+	fputc('"', out);
+}
+
+ST_FUNC void prof_dump_text(PocolProfile *prof, FILE *out, double scale)
+{
+	fprintf(out, "=== Profile Regions ===\n");
+	fprintf(out, "%-4s %-20s %10s %14s %14s %12s %12s %12s %14s\n",
+		"id", "name", "count", "total_ns", "self_ns", "avg_ns", "min_ns", "max_ns", "instructions");
+
+	for (int i = 0; i < PROF_MAX_REGIONS; i++) {
+		ProfRegion *r = &prof->regions[i];
+		if (r->count == 0)
+			continue;
+		fprintf(out, "%-4d %-20s %10llu %14.0f %14.0f %12.0f %12.0f %12.0f %14llu\n",
+			i, r->name[0] ? r->name : "-",
+			(unsigned long long)r->count,
+			r->total * scale,
+			r->self * scale,
+			r->total * scale / r->count,
+			r->min * scale,
+			r->max * scale,
+			(unsigned long long)r->instructions);
+	}
+
+	if (prof->depth > 0)
+		fprintf(out, "Unclosed regions: %d\n", prof->depth);
+	if (prof->mismatched > 0)
+		fprintf(out, "Mismatched ends: %llu\n", (unsigned long long)prof->mismatched);
+}
+
+ST_FUNC void prof_dump_json(PocolProfile *prof, FILE *out, double scale)
+{
+	int first = 1;
+
+	fprintf(out, "{\"regions\":[");
+	for (int i = 0; i < PROF_MAX_REGIONS; i++) {
+		ProfRegion *r = &prof->regions[i];
+		if (r->count == 0)
+			continue;
+		fprintf(out, "%s\n  {\"id\":%d,\"name\":", first ? "" : ",", i);
+		prof_json_string(out, r->name);
+		fprintf(out, ",\"parent\":%d,\"count\":%llu,\"total_ns\":%.0f,\"self_ns\":%.0f,"
+			"\"min_ns\":%.0f,\"max_ns\":%.0f,\"instructions\":%llu}",
+			r->parent,
+			(unsigned long long)r->count,
+			r->total * scale,
+			r->self * scale,
+			r->min * scale,
+			r->max * scale,
+			(unsigned long long)r->instructions);
+		first = 0;
+	}
+	fprintf(out, "\n],\"unclosed\":%d,\"mismatched\":%llu}\n",
+		prof->depth, (unsigned long long)prof->mismatched);
+}
+
+void prof_dump(PocolProfile *prof, FILE *out, int format)
+{
+	double scale = prof->ns_per_tick;
+
+	/* the run itself is a far longer calibration window than the first spin */
+	if (scale != 0) {
+		uint64_t ns = pocol_clock_ns() - prof->cal_ns;
+		uint64_t ticks = pocol_cycles() - prof->cal_ticks;
+		if (ns > 100 * PROF_CALIBRATE_NS && ticks > 0)
+			scale = (double)ns / (double)ticks;
+	}
+
+	if (format == PROF_DUMP_JSON)
+		prof_dump_json(prof, out, scale);
+	else if (format == PROF_DUMP_TEXT)
+		prof_dump_text(prof, out, scale);
+	fflush(out);
+}
@@ -0,0 +1,70 @@
+/* vm_profile.h -- Guest profiling regions for the Pocol VM */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_PROFILE_H
+#define POCOL_VM_PROFILE_H
+
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+
+#define PROF_MAX_REGIONS    256     /* region ids are 0 .. PROF_MAX_REGIONS - 1 */
+#define PROF_MAX_DEPTH      64      /* deepest BEGIN nesting */
+#define PROF_NAME_MAX       32
+
+/* --regions= output formats */
+#define PROF_DUMP_NONE      0
+#define PROF_DUMP_TEXT      1
+#define PROF_DUMP_JSON      2
+
+/* Aggregate for one region id */
+typedef struct {
+	char name[PROF_NAME_MAX];       /* empty until a BEGIN passes one */
+	uint64_t count;
+	uint64_t total;                 /* times are in pocol_cycles() ticks */
+	uint64_t self;                  /* total minus time spent in nested regions */
+	uint64_t min;
+	uint64_t max;
+	uint64_t instructions;          /* guest instructions retired inside the region */
+	int parent;                     /* enclosing region on first entry, -1 at top level */
+} ProfRegion;
+
+/* Open region on the nesting stack */
+typedef struct {
+	int id;
+	uint64_t start;
+	uint64_t start_inst;
+	uint64_t child;
+} ProfFrame;
+
+typedef struct {
+	ProfRegion regions[PROF_MAX_REGIONS];
+	ProfFrame stack[PROF_MAX_DEPTH];
+	int depth;
+	uint64_t mismatched;            /* ENDs that did not close the innermost region */
+	uint64_t cal_ns;                /* clock/tick pair taken at the first BEGIN */
+	uint64_t cal_ticks;
+	double ns_per_tick;             /* 0 until calibrated */
+} PocolProfile;
+
+void prof_init(PocolProfile *prof);
+
+/* Open region `id`; `inst` is the retired instruction count so far.
+   Returns 0, or -1 with errno set */
+int prof_begin(PocolProfile *prof, int id, uint64_t inst);
+
+/* Close the innermost region, which must be `id`.
+   Returns the elapsed ns, or -1 with errno set */
+int64_t prof_end(PocolProfile *prof, int id, uint64_t inst);
+
+/* Name region `id`; only the first name given sticks */
+void prof_set_name(PocolProfile *prof, int id, const char *name, size_t len);
+
+/* Write every region that was entered at least once */
+void prof_dump(PocolProfile *prof, FILE *out, int format);
+
+#endif /* POCOL_VM_PROFILE_H */
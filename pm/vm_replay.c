@@ -0,0 +1,429 @@
+/* vm_replay.c -- Record/replay for reverse debugging */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+/* The ISA has no store instruction: between two SYS instructions the
+   only state that changes is pc, sp, the stack and the registers. So a
+   recording is a snapshot of those every `interval` instructions, the
+   core pages written since the previous snapshot, and for every SYS the
+   registers it left and the bytes it wrote. Going back restores the
+   nearest snapshot and reruns the interpreter up to the target, applying
+   logged syscalls instead of executing them. */
+
+#include "vm_replay.h"
+#include "vm_memory.h"
+#include "../common.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define BIT_TEST(map, i)	(((map)[(i) >> 6] >> ((i) & 63)) & 1)
+#define BIT_SET(map, i)		((map)[(i) >> 6] |= (uint64_t)1 << ((i) & 63))
+
+/* make room for one more element of a doubling array */
+ST_FUNC int replay_grow(void **array, size_t count, size_t *capacity, size_t elem)
+{
+	if (count < *capacity)
+		return 0;
+
+	size_t cap = *capacity ? *capacity * 2 : 64;
+	void *p = realloc(*array, cap * elem);
+	if (!p)
+		return -1;
+	*array = p;
+	*capacity = cap;
+	return 0;
+}
+
+ST_FUNC uint64_t page_length(uint32_t page)
+{
+	uint64_t start = (uint64_t)page * POCOL_PAGE_SIZE;
+	return POCOL_MEMORY_SIZE - start < POCOL_PAGE_SIZE ? POCOL_MEMORY_SIZE - start : POCOL_PAGE_SIZE;
+}
+
+/* copy a core page into `list` */
+ST_FUNC int replay_keep_page(PocolReplay *rep, ReplayPage **list, size_t *count, size_t *cap, uint32_t page)
+{
+	uint8_t *data = malloc(POCOL_PAGE_SIZE);
+
+	if (!data || replay_grow((void **)list, *count, cap, sizeof(ReplayPage)) < 0) {
+		free(data);
+		return -1;
+	}
+	memcpy(data, &rep->vm->memory[(uint64_t)page * POCOL_PAGE_SIZE], page_length(page));
+	(*list)[*count].page = page;
+	(*list)[(*count)++].data = data;
+	rep->bytes += POCOL_PAGE_SIZE;
+	return 0;
+}
+
+ST_FUNC int replay_snapshot(PocolReplay *rep)
+{
+	PocolVM *vm = rep->vm;
+
+	if (replay_grow((void **)&rep->snaps, rep->snap_count, &rep->snap_cap, sizeof(ReplaySnapshot)) < 0)
+		return -1;
+
+	ReplaySnapshot *s = &rep->snaps[rep->snap_count];
+	memset(s, 0, sizeof(*s));
+	s->at = rep->pos;
+	s->pc = vm->pc;
+	s->sp = vm->sp;
+	s->halt = vm->halt;
+	memcpy(s->registers, vm->registers, sizeof(s->registers));
+	if (vm->sp) {
+		if (!(s->stack = malloc(vm->sp * sizeof(uint64_t))))
+			return -1;
+		memcpy(s->stack, vm->stack, vm->sp * sizeof(uint64_t));
+		rep->bytes += vm->sp * sizeof(uint64_t);
+	}
+
+	s->first_page = rep->page_count;
+	for (uint32_t page = 0; page < REPLAY_CORE_PAGES; page++) {
+		if (!BIT_TEST(rep->dirty, page))
+			continue;
+		if (replay_keep_page(rep, &rep->pages, &rep->page_count, &rep->page_cap, page) < 0) {
+			free(s->stack);
+			return -1;
+		}
+	}
+	s->page_count = rep->page_count - s->first_page;
+	memset(rep->dirty, 0, sizeof(rep->dirty));
+	rep->snap_count++;
+	return 0;
+}
+
+void replay_note_write(PocolReplay *rep, uint64_t addr, uint64_t len)
+{
+	if (rep->failed || rep->pos != rep->end || len == 0)
+		return;
+
+	if (replay_grow((void **)&rep->writes, rep->write_count, &rep->write_cap, sizeof(ReplayWrite)) < 0) {
+		rep->failed = 1;
+		return;
+	}
+	rep->writes[rep->write_count].addr = addr;
+	rep->writes[rep->write_count++].len = len;
+
+	/* mappings are not rewound, only core pages are */
+	if (addr >= POCOL_MEMORY_SIZE)
+		return;
+	uint64_t last = (addr + len - 1 < POCOL_MEMORY_SIZE ? addr + len - 1 : POCOL_MEMORY_SIZE - 1) / POCOL_PAGE_SIZE;
+	for (uint64_t page = addr / POCOL_PAGE_SIZE; page <= last; page++) {
+		/* the syscall has not written yet: this is the original */
+		if (!BIT_TEST(rep->seen, page)) {
+			if (replay_keep_page(rep, &rep->origin, &rep->origin_count, &rep->origin_cap, (uint32_t)page) < 0) {
+				rep->failed = 1;
+				return;
+			}
+			BIT_SET(rep->seen, page);
+		}
+		BIT_SET(rep->dirty, page);
+	}
+}
+
+/* the SYS just retired: keep its registers and what it wrote */
+ST_FUNC int replay_log_syscall(PocolReplay *rep)
+{
+	PocolVM *vm = rep->vm;
+
+	if (replay_grow((void **)&rep->calls, rep->call_count, &rep->call_cap, sizeof(ReplaySyscall)) < 0)
+		return -1;
+
+	ReplaySyscall *call = &rep->calls[rep->call_count];
+	call->at = rep->pos;
+	call->pc = vm->pc;
+	call->halt = vm->halt;
+	memcpy(call->registers, vm->registers, sizeof(call->registers));
+	call->first_write = rep->write_mark;
+	call->write_count = rep->write_count - rep->write_mark;
+
+	/* reading back what was written is not an access to report */
+	const PocolWatch *watch = vm->watch;
+	vm->watch = NULL;
+	for (size_t i = call->first_write; i < rep->write_count; i++) {
+		ReplayWrite *w = &rep->writes[i];
+		const uint8_t *src = pocol_mem_ptr(vm, w->addr, w->len, POCOL_MEM_READ);
+		while (rep->data_used + w->len > rep->data_cap) {
+			size_t cap = rep->data_cap ? rep->data_cap * 2 : 64 * 1024;
+			uint8_t *p = realloc(rep->data, cap);
+			if (!p) {
+				vm->watch = watch;
+				return -1;
+			}
+			rep->data = p;
+			rep->data_cap = cap;
+		}
+		w->offset = rep->data_used;
+		if (src)
+			memcpy(rep->data + rep->data_used, src, w->len);
+		else
+			memset(rep->data + rep->data_used, 0, w->len);
+		rep->data_used += w->len;
+		rep->bytes += w->len + sizeof(ReplayWrite);
+	}
+	vm->watch = watch;
+	rep->write_mark = rep->write_count;
+	rep->bytes += sizeof(ReplaySyscall);
+	rep->call_count++;
+	return 0;
+}
+
+/* Live runs only: the recording follows the VM one instruction behind */
+ST_FUNC void replay_after(PocolVM *vm, Inst_Addr pc, uint8_t op, void *user)
+{
+	PocolReplay *rep = user;
+	(void)vm;
+	(void)pc;
+
+	if (rep->failed || rep->pos != rep->end)
+		return;
+	if (op == INST_SYS && replay_log_syscall(rep) < 0) {
+		rep->failed = 1;
+		return;
+	}
+	rep->end = ++rep->pos;
+	rep->cursor = rep->call_count;
+	if (rep->pos % rep->interval == 0 && replay_snapshot(rep) < 0)
+		rep->failed = 1;
+}
+
+int replay_init(PocolReplay *rep, PocolVM *vm, uint64_t interval)
+{
+	memset(rep, 0, sizeof(*rep));
+	rep->vm = vm;
+	rep->interval = interval ? interval : REPLAY_INTERVAL;
+	rep->hooks.after = replay_after;
+	rep->hooks.user = rep;
+	return replay_snapshot(rep);
+}
+
+void replay_free(PocolReplay *rep)
+{
+	for (size_t i = 0; i < rep->origin_count; i++)
+		free(rep->origin[i].data);
+	for (size_t i = 0; i < rep->page_count; i++)
+		free(rep->pages[i].data);
+	for (size_t i = 0; i < rep->snap_count; i++)
+		free(rep->snaps[i].stack);
+	free(rep->origin);
+	free(rep->pages);
+	free(rep->snaps);
+	free(rep->calls);
+	free(rep->writes);
+	free(rep->data);
+	memset(rep, 0, sizeof(*rep));
+}
+
+/* Rebuild the VM as it was at snapshot k. A page comes from the latest
+   snapshot at or before k that copied it, else from the originals */
+ST_FUNC void replay_restore(PocolReplay *rep, size_t k)
+{
+	PocolVM *vm = rep->vm;
+	const ReplaySnapshot *s = &rep->snaps[k];
+	uint64_t done[REPLAY_PAGE_WORDS] = {0};
+
+	for (size_t j = k + 1; j-- > 0;) {
+		const ReplaySnapshot *t = &rep->snaps[j];
+		for (size_t i = t->first_page; i < t->first_page + t->page_count; i++) {
+			uint32_t page = rep->pages[i].page;
+			if (BIT_TEST(done, page))
+				continue;
+			memcpy(&vm->memory[(uint64_t)page * POCOL_PAGE_SIZE], rep->pages[i].data, page_length(page));
+			BIT_SET(done, page);
+		}
+	}
+	for (size_t i = 0; i < rep->origin_count; i++) {
+		uint32_t page = rep->origin[i].page;
+		if (!BIT_TEST(done, page))
+			memcpy(&vm->memory[(uint64_t)page * POCOL_PAGE_SIZE], rep->origin[i].data, page_length(page));
+	}
+
+	vm->pc = s->pc;
+	vm->sp = s->sp;
+	vm->halt = s->halt;
+	memcpy(vm->registers, s->registers, sizeof(vm->registers));
+	if (s->sp)
+		memcpy(vm->stack, s->stack, s->sp * sizeof(uint64_t));
+	rep->pos = s->at;
+
+	/* first syscall at or after pos */
+	size_t lo = 0, hi = rep->call_count;
+	while (lo < hi) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (rep->calls[mid].at < rep->pos)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	rep->cursor = lo;
+}
+
+/* latest snapshot at or before pos */
+ST_FUNC size_t replay_snapshot_before(const PocolReplay *rep, uint64_t pos)
+{
+	size_t lo = 0, hi = rep->snap_count;
+	while (hi - lo > 1) {
+		size_t mid = lo + (hi - lo) / 2;
+		if (rep->snaps[mid].at <= pos)
+			lo = mid;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* the logged SYS at pos, in place of running it */
+ST_FUNC void replay_apply_syscall(PocolReplay *rep)
+{
+	PocolVM *vm = rep->vm;
+	const ReplaySyscall *call = &rep->calls[rep->cursor++];
+
+	for (size_t i = call->first_write; i < call->first_write + call->write_count; i++) {
+		const ReplayWrite *w = &rep->writes[i];
+		/* through pocol_mem_ptr(), so debugger watchpoints see it */
+		uint8_t *dst = pocol_mem_ptr(vm, w->addr, w->len, POCOL_MEM_WRITE);
+		if (dst)
+			memcpy(dst, rep->data + w->offset, w->len);
+	}
+	memcpy(vm->registers, call->registers, sizeof(vm->registers));
+	vm->halt = call->halt;
+	vm->pc = call->pc;
+	rep->pos++;
+}
+
+/* Position tracking and match() while replaying with a predicate */
+typedef struct {
+	PocolReplay *rep;
+	int (*match)(PocolVM *vm, void *user);
+	void *user;
+	uint64_t from;		/* no match here: it is where we start */
+	int matched;
+} ReplayScan;
+
+ST_FUNC int replay_scan_before(PocolVM *vm, void *user)
+{
+	ReplayScan *scan = user;
+	if (scan->rep->pos != scan->from && scan->match(vm, scan->user)) {
+		scan->matched = 1;
+		return 1;
+	}
+	return 0;
+}
+
+ST_FUNC void replay_scan_after(PocolVM *vm, Inst_Addr pc, uint8_t op, void *user)
+{
+	ReplayScan *scan = user;
+	(void)vm;
+	(void)pc;
+	(void)op;
+	scan->rep->pos++;
+}
+
+/* Run from pos to target. Guest output was already produced once */
+ST_FUNC int replay_forward(PocolReplay *rep, uint64_t target, ReplayScan *scan)
+{
+	PocolVM *vm = rep->vm;
+	ConsoleBuffer *con = vm->syscall_ctx ? &vm->syscall_ctx->console : NULL;
+	PocolHooks hooks = { replay_scan_before, replay_scan_after, scan };
+	int result = 0;
+
+	if (con)
+		con->discard = true;
+	while (rep->pos < target) {
+		if (rep->cursor < rep->call_count && rep->calls[rep->cursor].at == rep->pos) {
+			if (scan && rep->pos != scan->from && scan->match(vm, scan->user)) {
+				result = 1;
+				break;
+			}
+			replay_apply_syscall(rep);
+			continue;
+		}
+
+		uint64_t stop = target;
+		if (rep->cursor < rep->call_count && rep->calls[rep->cursor].at < stop)
+			stop = rep->calls[rep->cursor].at;
+		int limit = stop - rep->pos > INT32_MAX ? INT32_MAX : (int)(stop - rep->pos);
+
+		if (!scan) {
+			/* nothing to look at: the lean interpreter, in one go */
+			if (pocol_execute_program(vm, limit) != ERR_OK) {
+				result = -1;
+				break;
+			}
+			rep->pos += limit;
+			continue;
+		}
+		if (pocol_add_hooks(vm, &hooks) < 0) {
+			result = -1;
+			break;
+		}
+		Err err = pocol_execute_program(vm, limit);
+		pocol_remove_hooks(vm, &hooks);
+		if (err != ERR_OK) {
+			result = -1;
+			break;
+		}
+		if (scan->matched) {
+			result = 1;
+			break;
+		}
+	}
+	if (con)
+		con->discard = false;
+	return result;
+}
+
+int replay_run(PocolReplay *rep, uint64_t target, int (*match)(PocolVM *vm, void *user), void *user)
+{
+	ReplayScan scan = { rep, match, user, rep->pos, 0 };
+
+	if (target > rep->end)
+		target = rep->end;
+	if (target < rep->pos)
+		replay_restore(rep, replay_snapshot_before(rep, target));
+	return replay_forward(rep, target, match ? &scan : NULL);
+}
+
+/* remembers the last position match() held at, never stops */
+typedef struct {
+	int (*match)(PocolVM *vm, void *user);
+	void *user;
+	PocolReplay *rep;
+	uint64_t last;
+	int found;
+} ReplayLast;
+
+ST_FUNC int replay_last_match(PocolVM *vm, void *user)
+{
+	ReplayLast *last = user;
+	if (last->match(vm, last->user)) {
+		last->last = last->rep->pos;
+		last->found = 1;
+	}
+	return 0;
+}
+
+int replay_find_back(PocolReplay *rep, int (*match)(PocolVM *vm, void *user), void *user)
+{
+	uint64_t limit = rep->pos;
+	ReplayLast last = { match, user, rep, 0, 0 };
+
+	if (limit == 0)
+		return 0;
+
+	/* one snapshot interval at a time, newest first */
+	for (size_t k = replay_snapshot_before(rep, limit - 1) + 1; k-- > 0;) {
+		replay_restore(rep, k);
+		/* the start position counts here, unlike a forward run */
+		ReplayScan scan = { rep, replay_last_match, &last, UINT64_MAX, 0 };
+		if (replay_forward(rep, limit, &scan) < 0)
+			return -1;
+		if (last.found)
+			return replay_run(rep, last.last, NULL, NULL) < 0 ? -1 : 1;
+		limit = rep->snaps[k].at;
+	}
+	return replay_run(rep, 0, NULL, NULL) < 0 ? -1 : 0;
+}
@@ -0,0 +1,104 @@
+/* vm_replay.h -- Record/replay for reverse debugging */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_REPLAY_H
+#define POCOL_VM_REPLAY_H
+
+#include "vm.h"
+#include <stdint.h>
+#include <stddef.h>
+
+#define REPLAY_INTERVAL		10000	/* default instructions between snapshots */
+#define REPLAY_CORE_PAGES	((POCOL_MEMORY_SIZE + POCOL_PAGE_SIZE - 1) / POCOL_PAGE_SIZE)
+#define REPLAY_PAGE_WORDS	((REPLAY_CORE_PAGES + 63) / 64)
+
+/* A core memory page as it was at some point */
+typedef struct {
+	uint32_t page;
+	uint8_t *data;			/* POCOL_PAGE_SIZE bytes */
+} ReplayPage;
+
+/* VM state at position `at`. Memory is only the pages written since the
+   previous snapshot; the rest is found in earlier ones */
+typedef struct {
+	uint64_t at;
+	Inst_Addr pc;
+	Stack_Addr sp;
+	unsigned int halt;
+	uint64_t registers[8];
+	uint64_t *stack;		/* sp slots */
+	size_t first_page, page_count;	/* into PocolReplay.pages */
+} ReplaySnapshot;
+
+/* A guest range a syscall wrote, its new bytes at PocolReplay.data + offset */
+typedef struct {
+	uint64_t addr, len;
+	size_t offset;
+} ReplayWrite;
+
+/* What the SYS at position `at` did, applied instead of running it again */
+typedef struct {
+	uint64_t at;
+	Inst_Addr pc;			/* after it */
+	uint64_t registers[8];
+	unsigned int halt;
+	size_t first_write, write_count;	/* into PocolReplay.writes */
+} ReplaySyscall;
+
+/* Positions count instructions retired since recording began. Live
+   execution happens only at `end`; anything earlier is rebuilt from the
+   nearest snapshot and the syscall log, so host side effects are never
+   repeated */
+typedef struct PocolReplay {
+	PocolVM *vm;
+	uint64_t interval;
+	uint64_t pos;
+	uint64_t end;			/* furthest position reached live */
+	int failed;			/* out of memory, the recording stopped at `end` */
+
+	uint64_t dirty[REPLAY_PAGE_WORDS];	/* written since the last snapshot */
+	uint64_t seen[REPLAY_PAGE_WORDS];	/* written at all, original kept in `origin` */
+
+	ReplayPage *origin;		/* pages as they were when recording began */
+	size_t origin_count, origin_cap;
+	ReplayPage *pages;
+	size_t page_count, page_cap;
+	ReplaySnapshot *snaps;
+	size_t snap_count, snap_cap;
+	ReplaySyscall *calls;
+	size_t call_count, call_cap;
+	ReplayWrite *writes;
+	size_t write_count, write_cap;
+	size_t write_mark;		/* writes from here on belong to the running SYS */
+	uint8_t *data;
+	size_t data_used, data_cap;
+	size_t cursor;			/* first call at or after pos */
+	uint64_t bytes;			/* heap held by the recording */
+
+	PocolHooks hooks;		/* install around live runs */
+} PocolReplay;
+
+/* Start recording at the VM's current state; interval 0 picks
+   REPLAY_INTERVAL. -1 when out of memory */
+int replay_init(PocolReplay *rep, PocolVM *vm, uint64_t interval);
+void replay_free(PocolReplay *rep);
+
+/* Live syscalls report the ranges they are about to write (through
+   vm->watch); ignored while replaying */
+void replay_note_write(PocolReplay *rep, uint64_t addr, uint64_t len);
+
+/* Move to position `target` (clamped to `end`), restoring the nearest
+   snapshot when it lies behind. Going forward, stop early at the first
+   position past the current one where match() is nonzero. 1 when
+   stopped by match, 0 at target, -1 on error */
+int replay_run(PocolReplay *rep, uint64_t target, int (*match)(PocolVM *vm, void *user), void *user);
+
+/* Go to the last position before the current one where match() is
+   nonzero. 1 found, 0 none (left at position 0), -1 on error */
+int replay_find_back(PocolReplay *rep, int (*match)(PocolVM *vm, void *user), void *user);
+
+#endif /* POCOL_VM_REPLAY_H */
@@ -0,0 +1,250 @@
+/* vm_sampler.c -- SIGPROF sampling profiler for guest code */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
+#include "vm_sampler.h"
+#include "vm.h"
+#include "jit.h"
+#include "vm_symbols.h"
+#include "../common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+#ifndef _WIN32
+#include <signal.h>
+#include <sys/time.h>
+#endif
+
+#ifdef __linux__
+#include <time.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+#ifndef sigev_notify_thread_id
+#define sigev_notify_thread_id _sigev_un._tid
+#endif
+#endif
+
+/* The VM runs on one thread and the sampler interrupts that same thread,
+   so the handler needs no locks: it reads the pc, the running JIT block
+   and the syscall in progress, then bumps a counter in a table allocated
+   up front. Aggregating in place keeps memory bounded however long the
+   run is; a key that finds no free slot within SAMPLER_PROBE tries is
+   counted as dropped. Nothing outside the handler touches the table
+   until sampler_stop(). */
+
+static PocolSampler *volatile sampler_active;
+
+#ifndef _WIN32
+static struct sigaction sampler_old_action;
+#ifdef __linux__
+static timer_t sampler_timer;
+#endif
+
+ST_FUNC void sampler_record(PocolSampler *s)
+{
+	PocolVM *vm = s->vm;
+	JitContext *jit = (JitContext *)vm->jit_context;
+	Inst_Addr pc = vm->pc;
+	int32_t block = -1;
+	int32_t syscall = vm->syscall_ctx ? vm->syscall_ctx->current_syscall : -1;
+
+	if (jit) {
+		int b = jit->current_block;
+		if (b >= 0 && b < JIT_CACHE_SIZE) {
+			block = b;
+			pc = jit->cache[b].start_pc;    /* vm->pc is only stored at block exit */
+		}
+	}
+
+	uint64_t h = (pc * 0x9E3779B97F4A7C15ull) ^ ((uint64_t)(uint32_t)block << 16) ^ (uint32_t)syscall;
+	for (int i = 0; i < SAMPLER_PROBE; i++) {
+		SamplerSlot *slot = &s->slots[(h + i) & (SAMPLER_SLOTS - 1)];
+		if (slot->count == 0) {
+			slot->pc = pc;
+			slot->block = block;
+			slot->syscall = syscall;
+			slot->count = 1;
+			s->samples++;
+			return;
+		}
+		if (slot->pc == pc && slot->block == block && slot->syscall == syscall) {
+			slot->count++;
+			s->samples++;
+			return;
+		}
+	}
+	s->dropped++;
+}
+
+ST_FUNC void sampler_handler(int sig)
+{
+	int saved = errno;
+	PocolSampler *s = sampler_active;
+
+	(void)sig;
+	if (s)
+		sampler_record(s);
+	errno = saved;
+}
+#endif
+
+#ifndef _WIN32
+/* Linux: a per-thread CLOCK_MONOTONIC timer. Unlike ITIMER_PROF it is not
+   rounded to the scheduler tick, so 1 kHz really means 1 kHz, and time
+   spent blocked in a syscall shows up under that syscall's frame.
+   Elsewhere fall back to ITIMER_PROF, which only counts CPU time. */
+ST_FUNC int sampler_arm(int hz)
+{
+	long period_ns = 1000000000L / hz;
+#ifdef __linux__
+	struct sigevent sev;
+	memset(&sev, 0, sizeof(sev));
+	sev.sigev_notify = SIGEV_THREAD_ID;
+	sev.sigev_signo = SIGPROF;
+	sev.sigev_notify_thread_id = (pid_t)syscall(SYS_gettid);
+	if (timer_create(CLOCK_MONOTONIC, &sev, &sampler_timer) < 0)
+		return -1;
+
+	struct itimerspec its;
+	its.it_interval.tv_sec = period_ns / 1000000000L;
+	its.it_interval.tv_nsec = period_ns % 1000000000L;
+	its.it_value = its.it_interval;
+	if (timer_settime(sampler_timer, 0, &its, NULL) < 0) {
+		timer_delete(sampler_timer);
+		return -1;
+	}
+	return 0;
+#else
+	struct itimerval it;
+	it.it_interval.tv_sec = period_ns / 1000000000L;
+	it.it_interval.tv_usec = (period_ns % 1000000000L) / 1000;
+	if (it.it_interval.tv_sec == 0 && it.it_interval.tv_usec == 0)
+		it.it_interval.tv_usec = 1;
+	it.it_value = it.it_interval;
+	return setitimer(ITIMER_PROF, &it, NULL);
+#endif
+}
+
+ST_FUNC void sampler_disarm(void)
+{
+#ifdef __linux__
+	timer_delete(sampler_timer);
+#else
+	struct itimerval it;
+	memset(&it, 0, sizeof(it));
+	setitimer(ITIMER_PROF, &it, NULL);
+#endif
+}
+#endif
+
+int sampler_start(PocolSampler *s, PocolVM *vm, int hz)
+{
+	memset(s, 0, sizeof(*s));
+#ifdef _WIN32
+	(void)vm; (void)hz;
+	errno = ENOSYS;
+	return -1;
+#else
+	if (sampler_active || hz <= 0 || hz > 100000) {
+		errno = EINVAL;
+		return -1;
+	}
+
+	s->slots = calloc(SAMPLER_SLOTS, sizeof(SamplerSlot));
+	if (!s->slots)
+		return -1;
+	s->vm = vm;
+	s->hz = hz;
+
+	struct sigaction sa;
+	memset(&sa, 0, sizeof(sa));
+	sa.sa_handler = sampler_handler;
+	sa.sa_flags = SA_RESTART;       /* host read/write resume instead of failing with EINTR */
+	sigemptyset(&sa.sa_mask);
+	if (sigaction(SIGPROF, &sa, &sampler_old_action) < 0) {
+		sampler_free(s);
+		return -1;
+	}
+	sampler_active = s;
+
+	if (sampler_arm(hz) < 0) {
+		int saved = errno;
+		sampler_active = NULL;
+		sigaction(SIGPROF, &sampler_old_action, NULL);
+		sampler_free(s);
+		errno = saved;
+		return -1;
+	}
+
+	s->active = 1;
+	return 0;
+#endif
+}
+
+void sampler_stop(PocolSampler *s)
+{
+#ifndef _WIN32
+	if (!s->active)
+		return;
+
+	sampler_disarm();
+	sigaction(SIGPROF, &sampler_old_action, NULL);
+	sampler_active = NULL;
+	s->active = 0;
+#else
+	(void)s;
+#endif
+}
+
+/* "label;label+0x6" so the flame graph merges by label with the hot
+   instruction on top, a bare address without a .map */
+ST_FUNC void sampler_frame(PocolSampler *s, char *buf, size_t size, Inst_Addr pc)
+{
+	const PocolSym *sym = symbols_lookup(s->vm->symbols, pc);
+	char leaf[160];
+
+	symbols_format(s->vm->symbols, pc, leaf, sizeof(leaf));
+	if (sym && pc != sym->start)
+		snprintf(buf, size, "%s;%s", sym->name, leaf);
+	else
+		snprintf(buf, size, "%s", leaf);
+}
+
+int sampler_write_folded(PocolSampler *s, const char *path)
+{
+	FILE *out = fopen(path, "w");
+	if (!out)
+		return -1;
+
+	for (int i = 0; s->slots && i < SAMPLER_SLOTS; i++) {
+		SamplerSlot *slot = &s->slots[i];
+		char frame[320];
+
+		if (slot->count == 0)
+			continue;
+
+		sampler_frame(s, frame, sizeof(frame), slot->pc);
+		fprintf(out, "pm;%s;%s", slot->block >= 0 ? "jit" : "interp", frame);
+		if (slot->syscall >= 0 && s->vm->syscall_ctx)
+			fprintf(out, ";sys_%s", syscalls_name(s->vm->syscall_ctx, slot->syscall));
+		fprintf(out, " %llu\n", (unsigned long long)slot->count);
+	}
+
+	if (fclose(out) != 0)
+		return -1;
+	return 0;
+}
+
+void sampler_free(PocolSampler *s)
+{
+	sampler_stop(s);
+	free(s->slots);
+	s->slots = NULL;
+}
@@ -0,0 +1,47 @@
+/* vm_sampler.h -- SIGPROF sampling profiler for guest code */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_SAMPLER_H
+#define POCOL_VM_SAMPLER_H
+
+#include "vm.h"
+#include <stdint.h>
+
+#define SAMPLER_DEFAULT_HZ  1000
+#define SAMPLER_SLOTS       8192    /* distinct (pc, block, syscall) keys, power of two */
+#define SAMPLER_PROBE       32      /* slots tried before a sample is dropped */
+
+/* One aggregated sample key, count 0 marks a free slot */
+typedef struct {
+	Inst_Addr pc;                   /* interpreter pc, or JIT block start */
+	int32_t block;                  /* JIT cache index, -1 when interpreting */
+	int32_t syscall;                /* syscall in progress, -1 if none */
+	uint64_t count;
+} SamplerSlot;
+
+typedef struct {
+	PocolVM *vm;
+	SamplerSlot *slots;             /* preallocated, only the signal handler writes while running */
+	volatile uint64_t samples;
+	volatile uint64_t dropped;
+	int hz;
+	int active;
+} PocolSampler;
+
+/* Start sampling `vm` on SIGPROF at `hz` samples per second.
+   Only one sampler can run at a time. Returns 0, or -1 with errno set */
+int sampler_start(PocolSampler *s, PocolVM *vm, int hz);
+
+/* Stop the timer; the collected samples stay readable */
+void sampler_stop(PocolSampler *s);
+
+/* Write the samples in collapsed-stack format (flamegraph.pl input) */
+int sampler_write_folded(PocolSampler *s, const char *path);
+
+void sampler_free(PocolSampler *s);
+
+#endif /* POCOL_VM_SAMPLER_H */
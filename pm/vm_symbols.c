@@ -0,0 +1,189 @@
+/* vm_symbols.c -- Guest symbol lookup from posm .map files */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#define _DEFAULT_SOURCE
+#include "vm_symbols.h"
+#include "../common.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <inttypes.h>
+
+void symbols_map_path(const char *program, char *buf, size_t size)
+{
+	size_t len = strlen(program);
+
+	if (len > 4 && strcmp(program + len - 4, ".pob") == 0)
+		len -= 4;
+	snprintf(buf, size, "%.*s.map", (int)len, program);
+}
+
+ST_FUNC int sym_cmp(const void *a, const void *b)
+{
+	const PocolSym *x = a, *y = b;
+	return (x->start > y->start) - (x->start < y->start);
+}
+
+ST_FUNC int line_cmp(const void *a, const void *b)
+{
+	const PocolLine *x = a, *y = b;
+	return (x->addr > y->addr) - (x->addr < y->addr);
+}
+
+/* append one element to a doubling array */
+ST_FUNC void *grow(void *array, int count, int *capacity, size_t elem)
+{
+	if (count < *capacity)
+		return array;
+
+	int cap = *capacity ? *capacity * 2 : 64;
+	void *p = realloc(array, cap * elem);
+	if (p)
+		*capacity = cap;
+	return p;
+}
+
+int symbols_load(PocolSymbols *syms, const char *path)
+{
+	char line[512];
+	int sym_cap = 0, line_cap = 0;
+	int version = 0;
+
+	memset(syms, 0, sizeof(*syms));
+
+	FILE *fp = fopen(path, "r");
+	if (!fp)
+		return -1;
+
+	if (!fgets(line, sizeof(line), fp) ||
+	    sscanf(line, POCOL_MAP_MAGIC " %d", &version) != 1 || version != POCOL_MAP_VERSION) {
+		fclose(fp);
+		errno = EINVAL;
+		return -1;
+	}
+
+	while (fgets(line, sizeof(line), fp)) {
+		char name[256];
+		uint64_t a, b;
+		unsigned int ln;
+
+		line[strcspn(line, "\r\n")] = '\0';
+
+		if (sscanf(line, "sym %" SCNx64 " %" SCNx64 " %255s", &a, &b, name) == 3) {
+			void *p = grow(syms->syms, syms->sym_count, &sym_cap, sizeof(PocolSym));
+			if (!p)
+				goto oom;
+			syms->syms = p;
+			syms->syms[syms->sym_count].start = a;
+			syms->syms[syms->sym_count].end = b;
+			syms->syms[syms->sym_count].name = strdup(name);
+			if (!syms->syms[syms->sym_count].name)
+				goto oom;
+			syms->sym_count++;
+		} else if (sscanf(line, "line %" SCNx64 " %u", &a, &ln) == 2) {
+			void *p = grow(syms->lines, syms->line_count, &line_cap, sizeof(PocolLine));
+			if (!p)
+				goto oom;
+			syms->lines = p;
+			syms->lines[syms->line_count].addr = a;
+			syms->lines[syms->line_count].line = ln;
+			syms->line_count++;
+		} else if (strncmp(line, "source ", 7) == 0 && !syms->source) {
+			syms->source = strdup(line + 7);
+		}
+		/* unknown records are skipped so newer maps still load */
+	}
+	fclose(fp);
+
+	/* posm writes them sorted, but a hand-edited map should not break lookups;
+	   a map without labels or lines has NULL arrays, which qsort may not take */
+	if (syms->sym_count)
+		qsort(syms->syms, syms->sym_count, sizeof(PocolSym), sym_cmp);
+	if (syms->line_count)
+		qsort(syms->lines, syms->line_count, sizeof(PocolLine), line_cmp);
+	return 0;
+
+oom:
+	fclose(fp);
+	symbols_free(syms);
+	errno = ENOMEM;
+	return -1;
+}
+
+void symbols_free(PocolSymbols *syms)
+{
+	for (int i = 0; i < syms->sym_count; i++)
+		free(syms->syms[i].name);
+	free(syms->syms);
+	free(syms->lines);
+	free(syms->source);
+	memset(syms, 0, sizeof(*syms));
+}
+
+const PocolSym *symbols_lookup(const PocolSymbols *syms, uint64_t pc)
+{
+	if (!syms)
+		return NULL;
+
+	/* last symbol starting at or below pc */
+	int lo = 0, hi = syms->sym_count - 1, found = -1;
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (syms->syms[mid].start <= pc) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	if (found < 0 || pc >= syms->syms[found].end)
+		return NULL;
+	return &syms->syms[found];
+}
+
+unsigned int symbols_line(const PocolSymbols *syms, uint64_t pc)
+{
+	if (!syms)
+		return 0;
+
+	int lo = 0, hi = syms->line_count - 1, found = -1;
+	while (lo <= hi) {
+		int mid = lo + (hi - lo) / 2;
+		if (syms->lines[mid].addr <= pc) {
+			found = mid;
+			lo = mid + 1;
+		} else {
+			hi = mid - 1;
+		}
+	}
+
+	return found < 0 ? 0 : syms->lines[found].line;
+}
+
+int64_t symbols_find(const PocolSymbols *syms, const char *name)
+{
+	/* only the debugger asks by name, a linear scan is fine */
+	for (int i = 0; syms && i < syms->sym_count; i++)
+		if (strcmp(syms->syms[i].name, name) == 0)
+			return (int64_t)syms->syms[i].start;
+	return -1;
+}
+
+const char *symbols_format(const PocolSymbols *syms, uint64_t pc, char *buf, size_t size)
+{
+	const PocolSym *s = symbols_lookup(syms, pc);
+
+	if (!s)
+		snprintf(buf, size, "0x%04" PRIx64, pc);
+	else if (pc == s->start)
+		snprintf(buf, size, "%s", s->name);
+	else
+		snprintf(buf, size, "%s+0x%" PRIx64, s->name, pc - s->start);
+	return buf;
+}
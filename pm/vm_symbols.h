@@ -0,0 +1,63 @@
+/* vm_symbols.h -- Guest symbol lookup from posm .map files */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_SYMBOLS_H
+#define POCOL_VM_SYMBOLS_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+/* `posm -g prog.pcl prog.pob` writes prog.map next to the program:
+
+     POCOLMAP 1
+     source <path>
+     sym <start> <end> <name>      label range [start, end), hex
+     line <addr> <line>            first byte of an instruction, hex / decimal
+
+   Ranges and line records come out sorted by address. */
+#define POCOL_MAP_MAGIC     "POCOLMAP"
+#define POCOL_MAP_VERSION   1
+
+typedef struct {
+	uint64_t start;
+	uint64_t end;
+	char *name;
+} PocolSym;
+
+typedef struct {
+	uint64_t addr;
+	unsigned int line;
+} PocolLine;
+
+typedef struct PocolSymbols {
+	PocolSym *syms;                 /* sorted by start */
+	int sym_count;
+	PocolLine *lines;               /* sorted by addr */
+	int line_count;
+	char *source;                   /* source file named in the map, may be NULL */
+} PocolSymbols;
+
+/* Sidecar path for a program: foo.pob -> foo.map, anything else gets .map appended */
+void symbols_map_path(const char *program, char *buf, size_t size);
+
+/* Parse a map file. Returns 0, or -1 with errno set (ENOENT when there is none) */
+int symbols_load(PocolSymbols *syms, const char *path);
+void symbols_free(PocolSymbols *syms);
+
+/* Symbol whose range holds pc, NULL if none */
+const PocolSym *symbols_lookup(const PocolSymbols *syms, uint64_t pc);
+
+/* Source line of the instruction holding pc, 0 if unknown */
+unsigned int symbols_line(const PocolSymbols *syms, uint64_t pc);
+
+/* Address of label `name`, -1 if not found */
+int64_t symbols_find(const PocolSymbols *syms, const char *name);
+
+/* "label", "label+0x6" or "0x0040" when syms is NULL or nothing matches */
+const char *symbols_format(const PocolSymbols *syms, uint64_t pc, char *buf, size_t size);
+
+#endif /* POCOL_VM_SYMBOLS_H */
@@ -2,8 +2,11 @@
 
 /* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean */
 
+#define _DEFAULT_SOURCE
+#define _GNU_SOURCE
 #include "vm_syscalls.h"
 #include "vm.h"
+#include "vm_memory.h"
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -13,501 +16,2398 @@
 #ifdef _WIN32
 #include <windows.h>
 #include <direct.h>
+#include <io.h>
 #define mkdir _mkdir
+#define write _write
+#define isatty _isatty
+#define fileno _fileno
 #define getcwd _getcwd
 #define chdir _chdir
 #else
 #include <sys/stat.h>
+#include <sys/wait.h>
+#include <fcntl.h>
 #include <unistd.h>
 #include <dirent.h>
+#include <spawn.h>
+#include <signal.h>
+#include <dlfcn.h>
+extern char **environ;
 #endif
 
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+
+#ifdef __linux__
+#include <sys/sendfile.h>
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || (__GLIBC__ == 2 && __GLIBC_MINOR__ >= 27))
+#define HAVE_COPY_FILE_RANGE 1
+#endif
+#endif
+
+static void syscalls_register_builtins(SysCallContext *ctx);
+
 /* Initialize system call context */
 void syscalls_init(SysCallContext *ctx) {
     memset(ctx, 0, sizeof(SysCallContext));
     ctx->console_input = stdin;
     ctx->console_output = stdout;
+    console_init(&ctx->console, ctx->console_output);
     vfs_init(&ctx->vfs);
+    ctx->vfs.console = &ctx->console;
+    prof_init(&ctx->profile);
     ctx->start_time = time(NULL);
+    ctx->current_syscall = -1;
+    syscalls_register_builtins(ctx);
 }
 
 /* Free system call context */
 void syscalls_free(SysCallContext *ctx) {
+    console_free(&ctx->console);
     vfs_free(&ctx->vfs);
+    
+    /* registered natives point into the plugins, drop them first */
+    memset(ctx->table, 0, sizeof(ctx->table));
+    for (int i = 0; i < ctx->plugin_count; i++) {
+#ifdef _WIN32
+        FreeLibrary((HMODULE)ctx->plugins[i]);
+#else
+        dlclose(ctx->plugins[i]);
+#endif
+    }
+    ctx->plugin_count = 0;
 }
 
-/* VFS Initialization */
-void vfs_init(VFS *vfs) {
-    memset(vfs, 0, sizeof(VFS));
-    strcpy(vfs->current_path, "/");
+/* Print syscall layer statistics */
+void syscalls_print_stats(SysCallContext *ctx) {
+    static const char *policies[] = {"unbuffered", "line", "full"};
+    console_flush(&ctx->console);
+    fprintf(stderr, "=== Syscall Statistics ===\n");
+    fprintf(stderr, "Console policy: %s\n", policies[ctx->console.policy]);
+    fprintf(stderr, "Console bytes: %llu\n", (unsigned long long)ctx->console.bytes_written);
+    fprintf(stderr, "Console write(2) calls: %llu\n", (unsigned long long)ctx->console.write_calls);
+    fprintf(stderr, "Instructions retired: %llu\n", (unsigned long long)ctx->instruction_count);
+    fprintf(stderr, "JIT block entries: %llu\n", (unsigned long long)ctx->block_entries);
+    fprintf(stderr, "Guest I/O: %llu bytes read, %llu bytes written\n",
+            (unsigned long long)ctx->bytes_read, (unsigned long long)ctx->bytes_written);
+    fprintf(stderr, "Syscalls: %llu\n", (unsigned long long)ctx->syscall_count);
+    for (int i = 0; i < SYS_TABLE_SIZE; i++) {
+        if (ctx->table[i].calls)
+            fprintf(stderr, "  %-10s %llu\n", syscalls_name(ctx, i), (unsigned long long)ctx->table[i].calls);
+    }
     
-    /* stdin */
-    VFile *stdin_file = calloc(1, sizeof(VFile));
-    strcpy(stdin_file->name, "stdin");
-    strcpy(stdin_file->path, "/dev/stdin");
-    stdin_file->type = FTYPE_DEVICE;
-    stdin_file->is_open = true;
-    stdin_file->is_console = true;
-    stdin_file->host_handle = stdin;
-    vfs->files[0] = stdin_file;
-    vfs->file_count = 1;
-    
-    /* stdout */
-    VFile *stdout_file = calloc(1, sizeof(VFile));
-    strcpy(stdout_file->name, "stdout");
-    strcpy(stdout_file->path, "/dev/stdout");
-    stdout_file->type = FTYPE_DEVICE;
-    stdout_file->is_open = true;
-    stdout_file->is_console = true;
-    stdout_file->host_handle = stdout;
-    vfs->files[1] = stdout_file;
-    vfs->file_count = 2;
-    
-    /* stderr */
-    VFile *stderr_file = calloc(1, sizeof(VFile));
-    strcpy(stderr_file->name, "stderr");
-    strcpy(stderr_file->path, "/dev/stderr");
-    stderr_file->type = FTYPE_DEVICE;
-    stderr_file->is_open = true;
-    stderr_file->is_console = true;
-    stderr_file->host_handle = stderr;
-    vfs->files[2] = stderr_file;
-    vfs->file_count = 3;
+    VCacheStats *cs = &ctx->vfs.cache;
+    if (cs->read_calls || cs->write_calls) {
+        fprintf(stderr, "VFS cache hit ratio: %.1f%% (%llu/%llu reads)\n",
+                cs->read_calls ? 100.0 * cs->read_hits / cs->read_calls : 0.0,
+                (unsigned long long)cs->read_hits, (unsigned long long)cs->read_calls);
+        fprintf(stderr, "VFS read-ahead efficiency: %.1f%% (%llu/%llu bytes used)\n",
+                cs->bytes_fetched ? 100.0 * cs->prefetch_used / cs->bytes_fetched : 0.0,
+                (unsigned long long)cs->prefetch_used, (unsigned long long)cs->bytes_fetched);
+        fprintf(stderr, "VFS bytes coalesced: %llu (%llu writes, %llu write-backs)\n",
+                (unsigned long long)cs->bytes_coalesced, (unsigned long long)cs->write_calls,
+                (unsigned long long)cs->write_backs);
+    }
 }
 
-/* Free VFS */
-void vfs_free(VFS *vfs) {
-    for (int i = 0; i < vfs->file_count; i++) {
-        if (vfs->files[i]) {
-            if (vfs->files[i]->host_handle && !vfs->files[i]->is_console) {
-                fclose((FILE*)vfs->files[i]->host_handle);
-            }
-            if (vfs->files[i]->buffer) {
-                free(vfs->files[i]->buffer);
-            }
-            free(vfs->files[i]);
+/* Monotonic clock in nanoseconds */
+uint64_t pocol_clock_ns(void) {
+#ifdef _WIN32
+    static LARGE_INTEGER freq;
+    LARGE_INTEGER now;
+    if (!freq.QuadPart) QueryPerformanceFrequency(&freq);
+    QueryPerformanceCounter(&now);
+    return (uint64_t)(now.QuadPart / freq.QuadPart) * 1000000000ull +
+           (uint64_t)(now.QuadPart % freq.QuadPart) * 1000000000ull / freq.QuadPart;
+#else
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+#endif
+}
+
+/* Raw cycle/tick counter, falls back to the monotonic clock */
+uint64_t pocol_cycles(void) {
+#if defined(__x86_64__) || defined(__i386__)
+    return __rdtsc();
+#elif defined(__aarch64__)
+    uint64_t ticks;
+    __asm__ __volatile__("mrs %0, cntvct_el0" : "=r"(ticks));
+    return ticks;
+#else
+    return pocol_clock_ns();
+#endif
+}
+
+/* ========== CONSOLE OUTPUT ========== */
+
+void console_init(ConsoleBuffer *con, FILE *stream) {
+    memset(con, 0, sizeof(ConsoleBuffer));
+    con->stream = stream;
+    con->capacity = CONSOLE_BUFFER_SIZE;
+    con->data = malloc(con->capacity);
+    con->flush_on_read = true;
+    /* interactive sessions want to see lines as they come */
+    con->policy = isatty(fileno(stream)) ? CONSOLE_LINE_BUFFERED : CONSOLE_FULL_BUFFERED;
+    if (!con->data) con->policy = CONSOLE_UNBUFFERED;
+}
+
+void console_free(ConsoleBuffer *con) {
+    console_flush(con);
+    free(con->data);
+    con->data = NULL;
+    con->capacity = 0;
+}
+
+void console_set_policy(ConsoleBuffer *con, ConsolePolicy policy) {
+    console_flush(con);
+    con->policy = con->data ? policy : CONSOLE_UNBUFFERED;
+}
+
+/* write straight to the host fd, counting every write(2) */
+static int64_t console_emit(ConsoleBuffer *con, const uint8_t *buf, size_t size) {
+    int fd = fileno(con->stream);
+    size_t done = 0;
+    
+    /* anything printf'd by the debugger or stats must come out first */
+    fflush(con->stream);
+    while (done < size) {
+        con->write_calls++;
+        int64_t n = write(fd, buf + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return -1;
         }
+        done += n;
+    }
+    con->bytes_written += done;
+    return (int64_t)done;
+}
+
+int console_flush(ConsoleBuffer *con) {
+    if (con->used == 0) return 0;
+    int64_t n = console_emit(con, con->data, con->used);
+    con->used = 0;
+    return (n < 0) ? -1 : 0;
+}
+
+int64_t console_write(ConsoleBuffer *con, const void *buf, size_t size) {
+    if (con->discard) return (int64_t)size;
+    if (con->policy == CONSOLE_UNBUFFERED) {
+        return console_emit(con, buf, size);
+    }
+    
+    if (size > con->capacity - con->used) {
+        if (console_flush(con) < 0) return -1;
+        /* too big to be worth copying */
+        if (size >= con->capacity) return console_emit(con, buf, size);
     }
+    
+    memcpy(con->data + con->used, buf, size);
+    con->used += size;
+    
+    if (con->policy == CONSOLE_LINE_BUFFERED && memchr(buf, '\n', size)) {
+        if (console_flush(con) < 0) return -1;
+    }
+    return (int64_t)size;
+}
+
+/* INST_PRINT helper: decimal formatting without going through printf */
+void console_write_u64(ConsoleBuffer *con, uint64_t value) {
+    char digits[20];
+    int i = sizeof(digits);
+    do {
+        digits[--i] = '0' + (value % 10);
+        value /= 10;
+    } while (value);
+    console_write(con, &digits[i], sizeof(digits) - i);
+}
+
+/* ========== BLOCK CACHE ========== */
+
+/* Every host file gets one cache window. Reads refill it with a read-ahead
+   that doubles while access stays sequential; writes land in it and go
+   back to the host on close, flush, or once the window is full. The host
+   FILE is unbuffered, so the window is the only copy in user space.
+
+   A window starts at VFS_CACHE_MIN and doubles when the read-ahead or a
+   run of writes outgrows it, up to VFS_CACHE_MAX, while all windows
+   together fit in VFS_CACHE_BUDGET. Past the budget new files go
+   uncached and existing windows stop growing. */
+
+static int64_t vfs_host_pread(VFile *file, void *buf, uint64_t offset, int64_t size) {
+    FILE *fp = (FILE*)file->host_handle;
+    if (fseek(fp, (long)offset, SEEK_SET) != 0) return -1;
+    size_t n = fread(buf, 1, size, fp);
+    if (n == 0 && ferror(fp)) {
+        clearerr(fp);
+        return -1;
+    }
+    return (int64_t)n;
+}
+
+static int64_t vfs_host_pwrite(VFile *file, const void *buf, uint64_t offset, int64_t size) {
+    FILE *fp = (FILE*)file->host_handle;
+    if (fseek(fp, (long)offset, SEEK_SET) != 0) return -1;
+    size_t n = fwrite(buf, 1, size, fp);
+    if ((int64_t)n < size && ferror(fp)) {
+        clearerr(fp);
+        return n ? (int64_t)n : -1;
+    }
+    return (int64_t)n;
+}
+
+static bool vfs_cache_alloc(VFS *vfs, VFile *file) {
+    if (file->buffer) return true;
+    if (vfs->cache_bytes + VFS_CACHE_MIN > VFS_CACHE_BUDGET) return false;
+    file->buffer = malloc(VFS_CACHE_MIN);
+    if (!file->buffer) return false;
+    file->buffer_size = VFS_CACHE_MIN;
+    file->readahead = VFS_CACHE_MIN;
+    vfs->cache_bytes += VFS_CACHE_MIN;
+    return true;
+}
+
+/* Double the window, contents kept; false leaves it as it was */
+static bool vfs_cache_grow(VFS *vfs, VFile *file) {
+    uint64_t size = file->buffer_size * 2;
+    if (size > VFS_CACHE_MAX || vfs->cache_bytes + file->buffer_size > VFS_CACHE_BUDGET) return false;
+    uint8_t *buffer = realloc(file->buffer, size);
+    if (!buffer) return false;
+    vfs->cache_bytes += file->buffer_size;
+    file->buffer = buffer;
+    file->buffer_size = size;
+    return true;
+}
+
+/* account for how much of the prefetched window was actually consumed */
+static void vfs_cache_retire(VFS *vfs, VFile *file) {
+    uint64_t used = (file->cache_used < file->cache_fetched) ? file->cache_used : file->cache_fetched;
+    vfs->cache.prefetch_used += used;
+    file->cache_used = 0;
+    file->cache_fetched = 0;
+}
+
+static int vfs_cache_writeback(VFS *vfs, VFile *file) {
+    if (file->dirty_end <= file->dirty_start) return 0;
+    int64_t len = file->dirty_end - file->dirty_start;
+    int64_t n = vfs_host_pwrite(file, file->buffer + file->dirty_start,
+                                file->cache_offset + file->dirty_start, len);
+    vfs->cache.write_backs++;
+    if (n != len) return -1;
+    file->dirty_start = file->dirty_end = 0;
+    return 0;
 }
 
-/* Find free file slot */
-VFile* vfs_find_free_slot(VFS *vfs) {
-    for (int i = 0; i < VFS_MAX_FILES; i++) {
-        if (!vfs->files[i]) {
-            return vfs->files[i] = calloc(1, sizeof(VFile));
+/* Empty the window at `offset`, writing back anything dirty first */
+static int vfs_cache_reset(VFS *vfs, VFile *file, uint64_t offset) {
+    if (vfs_cache_writeback(vfs, file) < 0) return -1;
+    vfs_cache_retire(vfs, file);
+    file->cache_offset = offset;
+    file->cache_len = 0;
+    return 0;
+}
+
+static int64_t vfs_cache_read(VFS *vfs, VFile *file, uint8_t *buf, int64_t size) {
+    int64_t done = 0;
+    bool hit = true;
+    
+    vfs->cache.read_calls++;
+    while (done < size) {
+        uint64_t pos = file->position;
+        uint64_t end = file->cache_offset + file->cache_len;
+        
+        if (pos >= file->cache_offset && pos < end) {
+            uint64_t n = end - pos;
+            if (n > (uint64_t)(size - done)) n = size - done;
+            memcpy(buf + done, file->buffer + (pos - file->cache_offset), n);
+            done += n;
+            file->position += n;
+            vfs->cache.bytes_served += n;
+            if (file->position - file->cache_offset > file->cache_used)
+                file->cache_used = file->position - file->cache_offset;
+            continue;
         }
+        
+        hit = false;
+        /* picking up exactly where the window ended counts as sequential */
+        bool sequential = file->cache_len > 0 && pos == end;
+        if (vfs_cache_reset(vfs, file, pos) < 0) return done ? done : -1;
+        
+        /* anything at least a full window long goes straight to the caller */
+        if (size - done >= VFS_CACHE_MAX) {
+            int64_t n = vfs_host_pread(file, buf + done, pos, size - done);
+            if (n < 0) return done ? done : -1;
+            done += n;
+            file->position += n;
+            break;
+        }
+        
+        if (sequential) {
+            file->readahead *= 2;
+            if (file->readahead > VFS_CACHE_MAX) file->readahead = VFS_CACHE_MAX;
+        } else {
+            file->readahead = VFS_CACHE_MIN;
+        }
+        while (file->readahead > file->buffer_size && vfs_cache_grow(vfs, file)) continue;
+        if (file->readahead > file->buffer_size) file->readahead = file->buffer_size;
+        
+        int64_t n = vfs_host_pread(file, file->buffer, pos, file->readahead);
+        if (n < 0) return done ? done : -1;
+        if (n == 0) break; /* EOF */
+        file->cache_len = n;
+        file->cache_fetched = n;
+        vfs->cache.bytes_fetched += n;
     }
-    return NULL;
+    
+    if (hit) vfs->cache.read_hits++;
+    return done;
 }
 
-/* Find file by path */
-VFile* vfs_find_file(VFS *vfs, const char *path) {
-    for (int i = 0; i < vfs->file_count; i++) {
-        if (vfs->files[i] && strcmp(vfs->files[i]->path, path) == 0) {
-            return vfs->files[i];
+static int64_t vfs_cache_write(VFS *vfs, VFile *file, const uint8_t *buf, int64_t size) {
+    int64_t done = 0;
+    
+    vfs->cache.write_calls++;
+    while (done < size) {
+        uint64_t pos = file->position;
+        uint64_t end = file->cache_offset + file->cache_len;
+        
+        /* writes may extend the window but never leave a gap in it */
+        if (pos < file->cache_offset || pos > end || pos - file->cache_offset >= file->buffer_size) {
+            if (vfs_cache_reset(vfs, file, pos) < 0) return done ? done : -1;
+            
+            if (size - done >= VFS_CACHE_MAX) {
+                int64_t n = vfs_host_pwrite(file, buf + done, pos, size - done);
+                if (n < 0) return done ? done : -1;
+                done += n;
+                file->position += n;
+                break;
+            }
         }
+        
+        uint64_t at = pos - file->cache_offset;
+        uint64_t n = file->buffer_size - at;
+        if (n > (uint64_t)(size - done)) n = size - done;
+        memcpy(file->buffer + at, buf + done, n);
+        
+        if (file->dirty_end <= file->dirty_start) {
+            file->dirty_start = at;
+            file->dirty_end = at + n;
+        } else {
+            if (at < file->dirty_start) file->dirty_start = at;
+            if (at + n > file->dirty_end) file->dirty_end = at + n;
+        }
+        if (at + n > file->cache_len) file->cache_len = at + n;
+        
+        done += n;
+        file->position += n;
+        vfs->cache.bytes_coalesced += n;
+        
+        /* a full window grows, and once it cannot, is written back */
+        if (file->cache_len == file->buffer_size && !vfs_cache_grow(vfs, file) &&
+            vfs_cache_writeback(vfs, file) < 0) break;
     }
-    return NULL;
+    
+    if (file->position > file->size) file->size = file->position;
+    return done;
 }
 
-/* Open file */
-VFile* vfs_open(VFS *vfs, const char *path, int mode) {
-    VFile *existing = vfs_find_file(vfs, path);
-    if (existing && existing->is_open) {
-        return existing;
+/* Push cached writes through to the host file */
+int vfs_sync(VFS *vfs, VFile *file) {
+    if (!file || !file->is_open || file->is_memory || file->is_console ||
+        file->type != FTYPE_FILE || !file->host_handle) return 0;
+    if (vfs_cache_writeback(vfs, file) < 0) return -1;
+    return fflush((FILE*)file->host_handle);
+}
+
+/* ========== DESCRIPTOR TABLE ========== */
+
+/* FNV-1a, paths are short enough that nothing fancier pays off */
+static uint32_t vfs_hash_path(const char *path) {
+    uint32_t h = 2166136261u;
+    while (*path) {
+        h ^= (uint8_t)*path++;
+        h *= 16777619u;
+    }
+    return h;
+}
+
+static int vfs_grow_index(VFS *vfs) {
+    int size = vfs->index_size ? vfs->index_size * 2 : VFS_HASH_MIN;
+    VFile **index = calloc(size, sizeof(VFile*));
+    if (!index) return -1;
+    
+    for (int i = 0; i < vfs->index_size; i++) {
+        VFile *file = vfs->path_index[i];
+        while (file) {
+            VFile *next = file->hash_next;
+            int bucket = file->path_hash & (size - 1);
+            file->hash_next = index[bucket];
+            index[bucket] = file;
+            file = next;
+        }
     }
+    free(vfs->path_index);
+    vfs->path_index = index;
+    vfs->index_size = size;
+    return 0;
+}
+
+static void vfs_index_insert(VFS *vfs, VFile *file) {
+    /* keep the load factor under one; a failed grow only costs chain length */
+    if (vfs->file_count >= vfs->index_size) vfs_grow_index(vfs);
     
-    VFile *file = vfs_find_free_slot(vfs);
-    if (!file) return NULL;
+    file->path_hash = vfs_hash_path(file->path);
+    int bucket = file->path_hash & (vfs->index_size - 1);
+    file->hash_next = vfs->path_index[bucket];
+    vfs->path_index[bucket] = file;
+}
+
+static void vfs_index_remove(VFS *vfs, VFile *file) {
+    VFile **pp = &vfs->path_index[file->path_hash & (vfs->index_size - 1)];
+    for (; *pp; pp = &(*pp)->hash_next) {
+        if (*pp == file) {
+            *pp = file->hash_next;
+            return;
+        }
+    }
+}
+
+static VFile* vfs_index_lookup(VFS *vfs, const char *path) {
+    uint32_t hash = vfs_hash_path(path);
+    VFile *file = vfs->path_index[hash & (vfs->index_size - 1)];
+    for (; file; file = file->hash_next) {
+        if (file->path_hash == hash && strcmp(file->path, path) == 0) return file;
+    }
+    return NULL;
+}
+
+/* Recycled descriptors go out first, then fresh ones; the table
+   doubles on demand until it reaches fd_limit */
+static int vfs_alloc_fd(VFS *vfs, VFile *file) {
+    int fd;
     
-    strncpy(file->path, path, VFS_MAX_PATH - 1);
-    const char *name = strrchr(path, '/');
-    if (name) {
-        strncpy(file->name, name + 1, VFS_MAX_FILENAME - 1);
+    if (vfs->free_count > 0) {
+        fd = vfs->free_fds[--vfs->free_count];
     } else {
-        strncpy(file->name, path, VFS_MAX_FILENAME - 1);
+        if (vfs->fd_next >= vfs->fd_limit) {
+            errno = EMFILE;
+            return -1;
+        }
+        if (vfs->fd_next >= vfs->fd_capacity) {
+            int cap = vfs->fd_capacity * 2;
+            if (cap > vfs->fd_limit) cap = vfs->fd_limit;
+            
+            VFile **files = realloc(vfs->files, cap * sizeof(VFile*));
+            if (!files) {
+                errno = ENOMEM;
+                return -1;
+            }
+            memset(&files[vfs->fd_capacity], 0, (cap - vfs->fd_capacity) * sizeof(VFile*));
+            vfs->files = files;
+            
+            int *free_fds = realloc(vfs->free_fds, cap * sizeof(int));
+            if (!free_fds) {
+                errno = ENOMEM;
+                return -1;
+            }
+            vfs->free_fds = free_fds;
+            vfs->fd_capacity = cap;
+        }
+        fd = vfs->fd_next++;
     }
     
-    /* Special files */
-    if (strcmp(path, "/dev/stdin") == 0 || strcmp(path, "stdin") == 0) {
-        file->type = FTYPE_DEVICE;
-        file->is_console = true;
-        file->host_handle = stdin;
-        file->is_open = true;
-        return file;
+    vfs->files[fd] = file;
+    file->fd = fd;
+    vfs_index_insert(vfs, file);
+    vfs->file_count++;
+    return fd;
+}
+
+static void vfs_release_fd(VFS *vfs, VFile *file) {
+    vfs_index_remove(vfs, file);
+    vfs->files[file->fd] = NULL;
+    vfs->free_fds[vfs->free_count++] = file->fd;
+    vfs->file_count--;
+}
+
+/* Look up an open descriptor, NULL if it is out of range or closed */
+VFile* vfs_get(VFS *vfs, int fd) {
+    if (fd < 0 || fd >= vfs->fd_next) return NULL;
+    return vfs->files[fd];
+}
+
+/* Raise or lower the descriptor ceiling, never below what is in use */
+int vfs_set_fd_limit(VFS *vfs, int limit) {
+    if (limit < vfs->fd_next) {
+        errno = EINVAL;
+        return -1;
     }
-    if (strcmp(path, "/dev/stdout") == 0 || strcmp(path, "stdout") == 0) {
-        file->type = FTYPE_DEVICE;
-        file->is_console = true;
-        file->host_handle = stdout;
-        file->is_open = true;
-        return file;
+    vfs->fd_limit = limit;
+    return 0;
+}
+
+static void vfs_add_device(VFS *vfs, const char *name, const char *path, FILE *stream) {
+    VFile *file = calloc(1, sizeof(VFile));
+    if (!file) return;
+    strcpy(file->name, name);
+    strcpy(file->path, path);
+    file->type = FTYPE_DEVICE;
+    file->is_open = true;
+    file->is_console = true;
+    file->host_handle = stream;
+    if (vfs_alloc_fd(vfs, file) < 0) free(file);
+}
+
+/* VFS Initialization */
+void vfs_init(VFS *vfs) {
+    memset(vfs, 0, sizeof(VFS));
+    strcpy(vfs->current_path, "/");
+    
+    vfs->fd_limit = VFS_DEFAULT_FD_LIMIT;
+    vfs->files = calloc(VFS_MAX_FILES, sizeof(VFile*));
+    vfs->free_fds = malloc(VFS_MAX_FILES * sizeof(int));
+    if (vfs->files && vfs->free_fds) vfs->fd_capacity = VFS_MAX_FILES;
+    vfs_grow_index(vfs);
+    
+    /* fds 0, 1 and 2, in that order */
+    vfs_add_device(vfs, "stdin", "/dev/stdin", stdin);
+    vfs_add_device(vfs, "stdout", "/dev/stdout", stdout);
+    vfs_add_device(vfs, "stderr", "/dev/stderr", stderr);
+}
+
+static void memfs_release(VFS *vfs, VMemNode *node);
+static void vfs_dir_release(VFS *vfs, VDir *dir);
+static void vfs_dir_flush(VFS *vfs);
+
+/* Drop whatever backs an open file, leaving the VFile itself alone */
+static void vfs_release_handle(VFS *vfs, VFile *file) {
+    if (file->type == FTYPE_DIR) {
+        vfs_dir_release(vfs, (VDir*)file->host_handle);
+    } else if (file->is_memory) {
+        memfs_release(vfs, (VMemNode*)file->host_handle);
+    } else if (file->host_handle && !file->is_console) {
+        if (file->buffer) {
+            vfs_cache_writeback(vfs, file);
+            vfs_cache_retire(vfs, file);
+        }
+        fclose((FILE*)file->host_handle);
     }
-    if (strcmp(path, "/dev/stderr") == 0 || strcmp(path, "stderr") == 0) {
-        file->type = FTYPE_DEVICE;
-        file->is_console = true;
-        file->host_handle = stderr;
-        file->is_open = true;
-        return file;
+    free(file->buffer);
+    vfs->cache_bytes -= file->buffer_size;
+    file->host_handle = NULL;
+    file->buffer = NULL;
+    file->buffer_size = 0;
+}
+
+/* Free VFS */
+void vfs_free(VFS *vfs) {
+    for (int i = 0; i < vfs->fd_next; i++) {
+        if (vfs->files[i]) {
+            vfs_release_handle(vfs, vfs->files[i]);
+            free(vfs->files[i]);
+        }
     }
+    free(vfs->files);
+    free(vfs->free_fds);
+    free(vfs->path_index);
+    vfs->files = NULL;
+    vfs->free_fds = NULL;
+    vfs->path_index = NULL;
+    vfs->fd_capacity = vfs->fd_next = vfs->free_count = vfs->file_count = 0;
+    vfs_dir_flush(vfs);
     
-    /* Open host file */
-    const char *host_mode;
-    switch (mode & 3) {
-        case O_RDONLY: host_mode = "rb"; break;
-        case O_WRONLY: host_mode = "wb"; break;
-        case O_RDWR:   host_mode = "r+b"; break;
-        default:       host_mode = "rb"; break;
+    VMemNode *node = vfs->mem_nodes;
+    while (node) {
+        VMemNode *next = node->next;
+        free(node->data);
+        free(node);
+        node = next;
     }
-    if (mode & O_CREAT) host_mode = "w+b";
-    
-    FILE *fp = fopen(path, host_mode);
-    if (!fp) {
-        free(file);
+    vfs->mem_nodes = NULL;
+}
+
+/* ========== IN-MEMORY BACKEND ========== */
+
+static bool memfs_is_path(const char *path) {
+    return strncmp(path, VFS_MEM_PREFIX, sizeof(VFS_MEM_PREFIX) - 1) == 0;
+}
+
+static VMemNode* memfs_lookup(VFS *vfs, const char *path) {
+    for (VMemNode *node = vfs->mem_nodes; node; node = node->next) {
+        if (!node->unlinked && strcmp(node->path, path) == 0) return node;
+    }
+    return NULL;
+}
+
+static VMemNode* memfs_create(VFS *vfs, const char *path, uint8_t type) {
+    VMemNode *node = calloc(1, sizeof(VMemNode));
+    if (!node) {
+        errno = ENOMEM;
         return NULL;
     }
+    strncpy(node->path, path, VFS_MAX_PATH - 1);
+    node->type = type;
+    node->mtime = (uint64_t)time(NULL);
+    node->next = vfs->mem_nodes;
+    vfs->mem_nodes = node;
+    return node;
+}
+
+/* grow the backing buffer geometrically so appends stay amortised O(1) */
+static int memfs_reserve(VMemNode *node, uint64_t size) {
+    if (size <= node->capacity) return 0;
+    uint64_t cap = node->capacity ? node->capacity : VFS_MEM_MIN_CAP;
+    while (cap < size) cap *= 2;
+    uint8_t *data = realloc(node->data, cap);
+    if (!data) {
+        errno = ENOMEM;
+        return -1;
+    }
+    node->data = data;
+    node->capacity = cap;
+    return 0;
+}
+
+static void memfs_release(VFS *vfs, VMemNode *node) {
+    if (--node->open_count > 0 || !node->unlinked) return;
+    for (VMemNode **pp = &vfs->mem_nodes; *pp; pp = &(*pp)->next) {
+        if (*pp == node) {
+            *pp = node->next;
+            break;
+        }
+    }
+    free(node->data);
+    free(node);
+}
+
+static VFile* memfs_open(VFS *vfs, VFile *file, const char *path, int mode) {
+    VMemNode *node = memfs_lookup(vfs, path);
+    bool truncate = (mode & O_CREAT) || (mode & 3) == O_WRONLY; /* same as "w+b"/"wb" */
     
-    fseek(fp, 0, SEEK_END);
-    file->size = ftell(fp);
-    fseek(fp, 0, SEEK_SET);
+    if (!node) {
+        if (!truncate) {
+            errno = ENOENT;
+            return NULL;
+        }
+        node = memfs_create(vfs, path, FTYPE_FILE);
+        if (!node) return NULL;
+    }
+    if (node->type == FTYPE_DIR) {
+        errno = EISDIR;
+        return NULL;
+    }
+    if (truncate) {
+        node->size = 0;
+        node->mtime = (uint64_t)time(NULL);
+    }
     
+    node->open_count++;
     file->type = FTYPE_FILE;
-    file->host_handle = fp;
+    file->is_memory = true;
+    file->host_handle = node;
     file->is_open = true;
     file->position = 0;
+    file->size = node->size;
     file->mode = mode;
-    
     return file;
 }
 
-/* Close file */
-int vfs_close(VFS *vfs, VFile *file) {
-    if (!file) return -1;
-    if (file->host_handle && !file->is_console) {
-        fclose((FILE*)file->host_handle);
+/* ========== DIRECTORIES ========== */
+
+/* Listings are cached per directory and shared by every fd open on it,
+   each fd keeps its own cursor in VFile.position. VFS calls that add or
+   remove names drop the parent's listing; host directories are also
+   revalidated against their mtime when reopened. */
+
+/* cache key: no trailing slash, "" becomes "." */
+static void vfs_dir_key(const char *path, char *key) {
+    strncpy(key, *path ? path : ".", VFS_MAX_PATH - 1);
+    key[VFS_MAX_PATH - 1] = '\0';
+    size_t len = strlen(key);
+    while (len > 1 && key[len - 1] == '/') key[--len] = '\0';
+}
+
+/* "/mem" itself, which memfs_is_path() does not match */
+static bool memfs_is_root(const char *key) {
+    return strncmp(key, VFS_MEM_PREFIX, sizeof(VFS_MEM_PREFIX) - 2) == 0 &&
+           key[sizeof(VFS_MEM_PREFIX) - 2] == '\0';
+}
+
+static void vfs_dir_free(VDir *dir) {
+    free(dir->entries);
+    free(dir);
+}
+
+/* Take a listing out of the cache; open fds keep it until their last close */
+static void vfs_dir_evict(VFS *vfs, VDir **pp) {
+    VDir *dir = *pp;
+    *pp = dir->next;
+    dir->cached = false;
+    vfs->dir_cache_count--;
+    if (dir->refcount == 0) vfs_dir_free(dir);
+}
+
+static void vfs_dir_release(VFS *vfs, VDir *dir) {
+    (void)vfs;
+    if (--dir->refcount == 0 && !dir->cached) vfs_dir_free(dir);
+}
+
+static void vfs_dir_flush(VFS *vfs) {
+    while (vfs->dir_cache) vfs_dir_evict(vfs, &vfs->dir_cache);
+}
+
+/* Forget the listing of the directory that contains `path` */
+static void vfs_dir_invalidate(VFS *vfs, const char *path) {
+    char key[VFS_MAX_PATH];
+    vfs_dir_key(path, key);
+    char *slash = strrchr(key, '/');
+    if (!slash) strcpy(key, ".");
+    else if (slash == key) key[1] = '\0';
+    else *slash = '\0';
+    
+    for (VDir **pp = &vfs->dir_cache; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->path, key) == 0) {
+            vfs_dir_evict(vfs, pp);
+            return;
+        }
     }
-    if (file->buffer) {
-        free(file->buffer);
+}
+
+static int vfs_dir_push(VDir *dir, int *cap, const char *name, uint8_t type,
+                        uint64_t size, uint64_t mtime) {
+    if (dir->entry_count == *cap) {
+        int n = *cap ? *cap * 2 : 16;
+        VDirEntry *entries = realloc(dir->entries, n * sizeof(VDirEntry));
+        if (!entries) {
+            errno = ENOMEM;
+            return -1;
+        }
+        dir->entries = entries;
+        *cap = n;
     }
-    memset(file, 0, sizeof(VFile));
+    VDirEntry *e = &dir->entries[dir->entry_count++];
+    strncpy(e->name, name, VFS_MAX_FILENAME - 1);
+    e->name[VFS_MAX_FILENAME - 1] = '\0';
+    e->type = type;
+    e->size = size;
+    e->mtime = mtime;
     return 0;
 }
 
-/* Read from file */
-int64_t vfs_read(VFS *vfs, VFile *file, void *buf, int64_t size) {
-    if (!file || !file->is_open || !buf) return -1;
-    
-    if (file->is_console) {
-        if (file->host_handle == stdin) {
-            return fread(buf, 1, size, stdin);
+static int memfs_list(VFS *vfs, VDir *dir) {
+    if (!memfs_is_root(dir->path)) {
+        VMemNode *node = memfs_lookup(vfs, dir->path);
+        if (!node) {
+            errno = ENOENT;
+            return -1;
+        }
+        if (node->type != FTYPE_DIR) {
+            errno = ENOTDIR;
+            return -1;
         }
-        return -1;
     }
     
-    if (file->type == FTYPE_FILE && file->host_handle) {
-        int64_t bytes = fread(buf, 1, size, (FILE*)file->host_handle);
-        file->position += bytes;
-        return bytes;
+    size_t len = strlen(dir->path);
+    int cap = 0;
+    for (VMemNode *node = vfs->mem_nodes; node; node = node->next) {
+        if (node->unlinked || strncmp(node->path, dir->path, len) != 0 || node->path[len] != '/')
+            continue;
+        const char *name = node->path + len + 1;
+        if (!*name || strchr(name, '/')) continue; /* not a direct child */
+        if (vfs_dir_push(dir, &cap, name, node->type, node->size, node->mtime) < 0) return -1;
     }
-    return -1;
+    return 0;
 }
 
-/* Write to file */
-int64_t vfs_write(VFS *vfs, VFile *file, const void *buf, int64_t size) {
-    if (!file || !file->is_open || !buf) return -1;
+#ifndef _WIN32
+static uint8_t vfs_host_type(mode_t mode) {
+    if (S_ISREG(mode)) return FTYPE_FILE;
+    if (S_ISDIR(mode)) return FTYPE_DIR;
+    if (S_ISCHR(mode) || S_ISBLK(mode)) return FTYPE_DEVICE;
+    return FTYPE_UNKNOWN;
+}
+
+static uint64_t vfs_host_mtime_ns(const struct stat *st) {
+#ifdef __linux__
+    return (uint64_t)st->st_mtim.tv_sec * 1000000000ull + st->st_mtim.tv_nsec;
+#else
+    return (uint64_t)st->st_mtime * 1000000000ull;
+#endif
+}
+#endif
+
+static int host_list(VDir *dir) {
+#ifdef _WIN32
+    (void)dir;
+    errno = ENOSYS;
+    return -1;
+#else
+    DIR *d = opendir(dir->path);
+    if (!d) return -1;
     
-    if (file->is_console) {
+    int cap = 0;
+    struct dirent *de;
+    while ((de = readdir(d))) {
+        if (strcmp(de->d_name, ".") == 0 || strcmp(de->d_name, "..") == 0) continue;
+        struct stat st;
+        /* removed between readdir and stat */
+        if (fstatat(dirfd(d), de->d_name, &st, 0) < 0) continue;
+        if (vfs_dir_push(dir, &cap, de->d_name, vfs_host_type(st.st_mode),
+                         st.st_size, st.st_mtime) < 0) {
+            closedir(d);
+            return -1;
+        }
+    }
+    closedir(d);
+    return 0;
+#endif
+}
+
+/* keep the cache bounded, least recently opened listings go first */
+static void vfs_dir_trim(VFS *vfs) {
+    while (vfs->dir_cache_count > VFS_DIR_CACHE_MAX) {
+        VDir **pp = &vfs->dir_cache;
+        while ((*pp)->next) pp = &(*pp)->next;
+        vfs_dir_evict(vfs, pp);
+    }
+}
+
+static VFile* vfs_install(VFS *vfs, VFile *file);
+
+/* Open a directory for SYS_READDIR */
+VFile* vfs_opendir(VFS *vfs, const char *path) {
+    char key[VFS_MAX_PATH];
+    vfs_dir_key(path, key);
+    bool memory = memfs_is_path(key) || memfs_is_root(key);
+    uint64_t stamp = 0;
+    
+#ifndef _WIN32
+    if (!memory) {
+        struct stat st;
+        if (stat(key, &st) < 0) return NULL;
+        if (!S_ISDIR(st.st_mode)) {
+            errno = ENOTDIR;
+            return NULL;
+        }
+        stamp = vfs_host_mtime_ns(&st);
+    }
+#endif
+    
+    VDir *dir = NULL;
+    for (VDir **pp = &vfs->dir_cache; *pp; pp = &(*pp)->next) {
+        if (strcmp((*pp)->path, key) != 0) continue;
+        if ((*pp)->dir_mtime != stamp) {
+            vfs_dir_evict(vfs, pp); /* changed outside the VFS */
+            break;
+        }
+        dir = *pp;
+        *pp = dir->next;
+        dir->next = vfs->dir_cache;
+        vfs->dir_cache = dir;
+        break;
+    }
+    
+    if (!dir) {
+        dir = calloc(1, sizeof(VDir));
+        if (!dir) {
+            errno = ENOMEM;
+            return NULL;
+        }
+        strcpy(dir->path, key);
+        dir->dir_mtime = stamp;
+        if ((memory ? memfs_list(vfs, dir) : host_list(dir)) < 0) {
+            vfs_dir_free(dir);
+            return NULL;
+        }
+        dir->cached = true;
+        dir->next = vfs->dir_cache;
+        vfs->dir_cache = dir;
+        vfs->dir_cache_count++;
+    }
+    
+    VFile *file = calloc(1, sizeof(VFile));
+    if (!file) {
+        errno = ENOMEM;
+        vfs_dir_trim(vfs);
+        return NULL;
+    }
+    strcpy(file->path, key);
+    const char *name = strrchr(key, '/');
+    /* long names are cut to fit, the full path stays in file->path */
+    snprintf(file->name, sizeof(file->name), "%.*s", (int)sizeof(file->name) - 1, name ? name + 1 : key);
+    file->type = FTYPE_DIR;
+    file->host_handle = dir;
+    file->is_open = true;
+    file->size = dir->entry_count;
+    dir->refcount++;
+    
+    /* trim after taking the reference so our own listing survives */
+    vfs_dir_trim(vfs);
+    return vfs_install(vfs, file);
+}
+
+/* Hand out up to `max` entries from the fd's cursor, returns how many */
+int vfs_readdir(VFS *vfs, VFile *file, const VDirEntry **entries, int max) {
+    (void)vfs;
+    if (!file || !file->is_open || file->type != FTYPE_DIR) {
+        errno = ENOTDIR;
+        return -1;
+    }
+    VDir *dir = (VDir*)file->host_handle;
+    uint64_t left = (file->position < (uint64_t)dir->entry_count) ?
+                    dir->entry_count - file->position : 0;
+    int n = ((uint64_t)max < left) ? max : (int)left;
+    *entries = dir->entries + file->position;
+    file->position += n;
+    return n;
+}
+
+/* Fill a VStat for `path`, host or in-memory */
+int vfs_stat(VFS *vfs, const char *path, VStat *out) {
+    char key[VFS_MAX_PATH];
+    vfs_dir_key(path, key);
+    memset(out, 0, sizeof(VStat));
+    
+    if (memfs_is_root(key)) {
+        out->type = FTYPE_DIR;
+        out->mode = 0755;
+        return 0;
+    }
+    if (memfs_is_path(key)) {
+        VMemNode *node = memfs_lookup(vfs, key);
+        if (!node) {
+            errno = ENOENT;
+            return -1;
+        }
+        out->type = node->type;
+        out->size = node->size;
+        out->mtime = node->mtime;
+        out->mode = (node->type == FTYPE_DIR) ? 0755 : 0644;
+        return 0;
+    }
+    
+#ifdef _WIN32
+    errno = ENOSYS;
+    return -1;
+#else
+    struct stat st;
+    if (stat(key, &st) < 0) return -1;
+    out->type = vfs_host_type(st.st_mode);
+    out->size = st.st_size;
+    out->mtime = st.st_mtime;
+    out->mode = st.st_mode & 07777;
+    
+    /* writes still sitting in the block cache count too */
+    VFile *open = vfs_index_lookup(vfs, key);
+    if (open && open->type == FTYPE_FILE && !open->is_memory && open->size > out->size)
+        out->size = open->size;
+    return 0;
+#endif
+}
+
+/* Give a freshly opened file its descriptor, undoing the open on failure */
+static VFile* vfs_install(VFS *vfs, VFile *file) {
+    if (vfs_alloc_fd(vfs, file) < 0) {
+        vfs_release_handle(vfs, file);
+        free(file);
+        return NULL;
+    }
+    return file;
+}
+
+/* Open file */
+VFile* vfs_open(VFS *vfs, const char *path, int mode) {
+    VFile *existing = vfs_index_lookup(vfs, path);
+    if (existing && existing->is_open) {
+        return existing;
+    }
+    
+    VFile *file = calloc(1, sizeof(VFile));
+    if (!file) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    strncpy(file->path, path, VFS_MAX_PATH - 1);
+    const char *name = strrchr(path, '/');
+    if (name) {
+        strncpy(file->name, name + 1, VFS_MAX_FILENAME - 1);
+    } else {
+        strncpy(file->name, path, VFS_MAX_FILENAME - 1);
+    }
+    
+    /* Special files */
+    if (strcmp(path, "/dev/stdin") == 0 || strcmp(path, "stdin") == 0) {
+        file->type = FTYPE_DEVICE;
+        file->is_console = true;
+        file->host_handle = stdin;
+        file->is_open = true;
+        return vfs_install(vfs, file);
+    }
+    if (strcmp(path, "/dev/stdout") == 0 || strcmp(path, "stdout") == 0) {
+        file->type = FTYPE_DEVICE;
+        file->is_console = true;
+        file->host_handle = stdout;
+        file->is_open = true;
+        return vfs_install(vfs, file);
+    }
+    if (strcmp(path, "/dev/stderr") == 0 || strcmp(path, "stderr") == 0) {
+        file->type = FTYPE_DEVICE;
+        file->is_console = true;
+        file->host_handle = stderr;
+        file->is_open = true;
+        return vfs_install(vfs, file);
+    }
+    
+    /* opening for write may create the name */
+    if ((mode & 3) != O_RDONLY || (mode & O_CREAT)) vfs_dir_invalidate(vfs, path);
+    
+    if (memfs_is_path(path)) {
+        if (!memfs_open(vfs, file, path, mode)) {
+            free(file);
+            return NULL;
+        }
+        return vfs_install(vfs, file);
+    }
+    
+    /* Open host file */
+    const char *host_mode;
+    switch (mode & 3) {
+        case O_RDONLY: host_mode = "rb"; break;
+        case O_WRONLY: host_mode = "wb"; break;
+        case O_RDWR:   host_mode = "r+b"; break;
+        default:       host_mode = "rb"; break;
+    }
+    if (mode & O_CREAT) host_mode = "w+b";
+    
+    FILE *fp = fopen(path, host_mode);
+    if (!fp) {
+        free(file);
+        return NULL;
+    }
+    
+    /* the VFS block cache does the buffering */
+    setvbuf(fp, NULL, _IONBF, 0);
+    fseek(fp, 0, SEEK_END);
+    file->size = ftell(fp);
+    fseek(fp, 0, SEEK_SET);
+    
+    file->type = FTYPE_FILE;
+    file->host_handle = fp;
+    file->is_open = true;
+    file->position = 0;
+    file->mode = mode;
+    
+    return vfs_install(vfs, file);
+}
+
+/* Wrap one end of a host pipe in a VFile. Takes ownership of host_fd,
+   it is closed on failure */
+VFile* vfs_open_pipe(VFS *vfs, int host_fd, int mode, const char *path) {
+    VFile *file = calloc(1, sizeof(VFile));
+    FILE *fp = file ? fdopen(host_fd, (mode & 3) == O_WRONLY ? "wb" : "rb") : NULL;
+    if (!fp) {
+        free(file);
+        close(host_fd);
+        errno = ENOMEM;
+        return NULL;
+    }
+    
+    strncpy(file->path, path, VFS_MAX_PATH - 1);
+    strncpy(file->name, path, VFS_MAX_FILENAME - 1);
+    file->type = FTYPE_PIPE;
+    file->host_handle = fp;
+    file->is_open = true;
+    file->mode = mode;
+    return vfs_install(vfs, file);
+}
+
+/* Close file, its descriptor goes back on the free list */
+int vfs_close(VFS *vfs, VFile *file) {
+    if (!file) return -1;
+    if (vfs_get(vfs, file->fd) == file) vfs_release_fd(vfs, file);
+    /* size and mtime in the parent's listing are stale now */
+    if (file->type == FTYPE_FILE && ((file->mode & 3) != O_RDONLY || (file->mode & O_CREAT)))
+        vfs_dir_invalidate(vfs, file->path);
+    vfs_release_handle(vfs, file);
+    free(file);
+    return 0;
+}
+
+/* Read from file */
+int64_t vfs_read(VFS *vfs, VFile *file, void *buf, int64_t size) {
+    if (!file || !file->is_open || !buf) return -1;
+    
+    if (file->is_console) {
+        if (file->host_handle == stdin) {
+            if (vfs->console && vfs->console->flush_on_read) console_flush(vfs->console);
+            return fread(buf, 1, size, stdin);
+        }
+        return -1;
+    }
+    
+    if (file->is_memory) {
+        VMemNode *node = (VMemNode*)file->host_handle;
+        if (file->position >= node->size) return 0;
+        uint64_t avail = node->size - file->position;
+        if ((uint64_t)size > avail) size = (int64_t)avail;
+        memcpy(buf, node->data + file->position, size);
+        file->position += size;
+        return size;
+    }
+    
+    if (file->type == FTYPE_PIPE) {
+        /* return whatever is available instead of waiting for a full buffer */
+        int64_t n;
+        do {
+            n = read(fileno((FILE*)file->host_handle), buf, size);
+        } while (n < 0 && errno == EINTR);
+        if (n > 0) file->position += n;
+        return n;
+    }
+    
+    if (file->type == FTYPE_FILE && file->host_handle) {
+        if (!vfs_cache_alloc(vfs, file)) {
+            int64_t bytes = vfs_host_pread(file, buf, file->position, size);
+            if (bytes > 0) file->position += bytes;
+            return bytes;
+        }
+        return vfs_cache_read(vfs, file, buf, size);
+    }
+    return -1;
+}
+
+/* A child that exits early must not take the VM down with it: SIGPIPE
+   is held back for the write, so it fails with EPIPE instead, and the
+   signal it raised is taken off the pending set before the mask goes
+   back. The process-wide disposition is never touched */
+static int64_t vfs_pipe_write(int fd, const uint8_t *buf, int64_t size) {
+    int64_t done = 0;
+    int err = 0;
+#ifndef _WIN32
+    sigset_t pipe_set, saved, pending;
+    sigemptyset(&pipe_set);
+    sigaddset(&pipe_set, SIGPIPE);
+    sigpending(&pending);
+    bool was_pending = sigismember(&pending, SIGPIPE);
+    sigprocmask(SIG_BLOCK, &pipe_set, &saved);
+#endif
+    
+    while (done < size) {
+        int64_t n = write(fd, buf + done, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            err = errno;
+            break;
+        }
+        done += n;
+    }
+    
+#ifndef _WIN32
+    if (err == EPIPE && !was_pending) {
+        int sig;
+        sigpending(&pending);
+        if (sigismember(&pending, SIGPIPE)) sigwait(&pipe_set, &sig);
+    }
+    sigprocmask(SIG_SETMASK, &saved, NULL);
+#endif
+    
+    if (err && !done) {
+        errno = err;
+        return -1;
+    }
+    return done;
+}
+
+/* Write to file */
+int64_t vfs_write(VFS *vfs, VFile *file, const void *buf, int64_t size) {
+    if (!file || !file->is_open || !buf) return -1;
+    
+    if (file->is_console) {
         FILE *out = (file->host_handle == stdin) ? stdout : (FILE*)file->host_handle;
+        if (vfs->console && out == vfs->console->stream) {
+            return console_write(vfs->console, buf, size);
+        }
         return fwrite(buf, 1, size, out);
     }
     
+    if (file->is_memory) {
+        VMemNode *node = (VMemNode*)file->host_handle;
+        if ((file->mode & 3) == O_RDONLY && !(file->mode & O_CREAT)) {
+            errno = EBADF;
+            return -1;
+        }
+        if (memfs_reserve(node, file->position + size) < 0) return -1;
+        if (file->position > node->size) {
+            /* seek past EOF leaves a zero-filled hole, like a sparse file */
+            memset(node->data + node->size, 0, file->position - node->size);
+        }
+        memcpy(node->data + file->position, buf, size);
+        file->position += size;
+        if (file->position > node->size) node->size = file->position;
+        file->size = node->size;
+        node->mtime = (uint64_t)time(NULL);
+        return size;
+    }
+    
+    if (file->type == FTYPE_PIPE) {
+        if ((file->mode & 3) != O_WRONLY) {
+            errno = EBADF;
+            return -1;
+        }
+        int64_t done = vfs_pipe_write(fileno((FILE*)file->host_handle), buf, size);
+        if (done > 0) file->position += done;
+        return done;
+    }
+    
     if (file->type == FTYPE_FILE && file->host_handle) {
-        int64_t bytes = fwrite(buf, 1, size, (FILE*)file->host_handle);
-        file->position += bytes;
-        if (file->position > file->size) file->size = file->position;
-        return bytes;
+        if ((file->mode & 3) == O_RDONLY && !(file->mode & O_CREAT)) {
+            errno = EBADF;
+            return -1;
+        }
+        if (!vfs_cache_alloc(vfs, file)) {
+            int64_t bytes = vfs_host_pwrite(file, buf, file->position, size);
+            if (bytes > 0) file->position += bytes;
+            if (file->position > file->size) file->size = file->position;
+            return bytes;
+        }
+        return vfs_cache_write(vfs, file, buf, size);
+    }
+    return -1;
+}
+
+/* Seek in file */
+int64_t vfs_seek(VFS *vfs, VFile *file, int64_t offset, int whence) {
+    (void)vfs;
+    if (!file || !file->is_open || !file->host_handle) return -1;
+    if (file->type != FTYPE_FILE && file->type != FTYPE_DIR) return -1;
+    
+    /* host offsets are set per transfer by the block cache, so this is
+       bookkeeping for every backend; on a directory it moves the
+       SYS_READDIR cursor */
+    uint64_t size = file->is_memory ? ((VMemNode*)file->host_handle)->size : file->size;
+    int64_t base = (whence == SEEK_CUR) ? (int64_t)file->position :
+                   (whence == SEEK_END) ? (int64_t)size : 0;
+    if (base + offset < 0) {
+        errno = EINVAL;
+        return -1;
+    }
+    file->position = base + offset;
+    return file->position;
+}
+
+/* Tell file position */
+int64_t vfs_tell(VFS *vfs, VFile *file) {
+    (void)vfs;
+    if (!file || !file->is_open) return -1;
+    return file->position;
+}
+
+/* Make directory */
+int vfs_mkdir(VFS *vfs, const char *path) {
+    vfs_dir_invalidate(vfs, path);
+    if (memfs_is_path(path)) {
+        char key[VFS_MAX_PATH];
+        vfs_dir_key(path, key);
+        if (memfs_lookup(vfs, key)) {
+            errno = EEXIST;
+            return -1;
+        }
+        return memfs_create(vfs, key, FTYPE_DIR) ? 0 : -1;
+    }
+#ifdef _WIN32
+    return mkdir(path);
+#else
+    return mkdir(path, 0755);
+#endif
+}
+
+/* Remove file */
+int vfs_unlink(VFS *vfs, const char *path) {
+    vfs_dir_invalidate(vfs, path);
+    if (memfs_is_path(path)) {
+        VMemNode *node = memfs_lookup(vfs, path);
+        if (!node) {
+            errno = ENOENT;
+            return -1;
+        }
+        /* open handles keep the data alive until their last close */
+        node->unlinked = true;
+        node->open_count++;
+        memfs_release(vfs, node);
+        return 0;
+    }
+    return unlink(path);
+}
+
+/* Kernel-side copy between two host files, starting at the VFS positions.
+   Returns bytes copied, or -1 if the kernel path is unavailable before any
+   byte moved (caller falls back to the buffered loop) */
+static int64_t vfs_copy_host(VFile *in, VFile *out, int64_t size) {
+#ifdef __linux__
+    int fd_in = fileno((FILE*)in->host_handle);
+    int fd_out = fileno((FILE*)out->host_handle);
+    off_t off_in = (off_t)in->position;
+    off_t off_out = (off_t)out->position;
+    int64_t done = 0;
+    
+#ifdef HAVE_COPY_FILE_RANGE
+    while (done < size) {
+        ssize_t n = copy_file_range(fd_in, &off_in, fd_out, &off_out, size - done, 0);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            break;
+        }
+        if (n == 0) return done; /* EOF */
+        done += n;
+    }
+    if (done == size) return done;
+#endif
+    
+    /* sendfile writes at the current offset of fd_out */
+    if (lseek(fd_out, off_out, SEEK_SET) < 0) return done ? done : -1;
+    while (done < size) {
+        ssize_t n = sendfile(fd_out, fd_in, &off_in, size - done);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            return done ? done : -1;
+        }
+        if (n == 0) break;
+        done += n;
+    }
+    return done;
+#else
+    (void)in; (void)out; (void)size;
+    return -1;
+#endif
+}
+
+/* Copy up to `size` bytes from `in` to `out` without touching guest memory */
+int64_t vfs_copy(VFS *vfs, VFile *in, VFile *out, int64_t size) {
+    if (!in || !out || !in->is_open || !out->is_open || size < 0) return -1;
+    
+    /* a node copied onto itself may be reallocated by the write under the
+       source pointer, that case takes the bounce buffer below */
+    if (in->is_memory && !(out->is_memory && out->host_handle == in->host_handle)) {
+        /* source already lives in host memory, hand it over directly */
+        VMemNode *node = (VMemNode*)in->host_handle;
+        int64_t avail = (in->position < node->size) ? (int64_t)(node->size - in->position) : 0;
+        if (size > avail) size = avail;
+        if (size == 0) return 0;
+        int64_t w = vfs_write(vfs, out, node->data + in->position, size);
+        if (w > 0) in->position += w;
+        return w;
+    }
+    
+    if (in->type == FTYPE_FILE && out->type == FTYPE_FILE && !out->is_memory &&
+        in->host_handle && out->host_handle) {
+        /* the host fds must see every byte written so far, and the
+           destination window goes stale once the kernel writes behind it */
+        if (vfs_sync(vfs, in) < 0 || vfs_sync(vfs, out) < 0) return -1;
+        
+        int64_t done = vfs_copy_host(in, out, size);
+        if (done >= 0) {
+            if (out->buffer) vfs_cache_reset(vfs, out, out->position);
+            in->position += done;
+            out->position += done;
+            if (out->position > out->size) out->size = out->position;
+            return done;
+        }
+    }
+    
+    /* generic path: bounce through a host-side buffer */
+    uint8_t *buf = malloc(VFS_COPY_CHUNK);
+    if (!buf) return -1;
+    
+    int64_t done = 0;
+    while (done < size) {
+        int64_t want = size - done;
+        if (want > VFS_COPY_CHUNK) want = VFS_COPY_CHUNK;
+        int64_t n = vfs_read(vfs, in, buf, want);
+        if (n <= 0) break;
+        int64_t w = vfs_write(vfs, out, buf, n);
+        if (w < 0) {
+            free(buf);
+            return done ? done : -1;
+        }
+        done += w;
+        if (w < n || n < want) break;
+    }
+    
+    free(buf);
+    return done;
+}
+
+/* ========== SYSTEM CALL HANDLERS ========== */
+
+/* Copy a (ptr, len) guest string into a VFS_MAX_PATH buffer, truncating */
+static int sys_copy_string(PocolVM *vm, uint64_t ptr, uint64_t len, char *out) {
+    len = (len < VFS_MAX_PATH - 1) ? len : VFS_MAX_PATH - 1;
+    uint8_t *src = pocol_mem_ptr(vm, ptr, len, POCOL_MEM_READ);
+    if (!src) return -1;
+    memcpy(out, src, len);
+    out[len] = '\0';
+    return 0;
+}
+
+int sys_print(SysCallContext *ctx, PocolVM *vm) {
+    uint64_t length = ctx->arg2;
+    uint8_t *str = pocol_mem_ptr(vm, ctx->arg1, length, POCOL_MEM_READ);
+    
+    if (!str) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    if (console_write(&ctx->console, str, length) < 0) {
+        ctx->error = errno;
+        return -1;
+    }
+    
+    ctx->bytes_written += length;
+    ctx->return_value = length;
+    return 0;
+}
+
+int sys_read(SysCallContext *ctx, PocolVM *vm) {
+    uint64_t max_len = ctx->arg2;
+    uint8_t *buf = pocol_mem_ptr(vm, ctx->arg1, max_len, POCOL_MEM_WRITE);
+    
+    if (!buf) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    if (ctx->console.flush_on_read) console_flush(&ctx->console);
+    size_t bytes = fread(buf, 1, max_len, stdin);
+    ctx->bytes_read += bytes;
+    ctx->return_value = bytes;
+    return 0;
+}
+
+int sys_open(SysCallContext *ctx, PocolVM *vm) {
+    int mode = (int)ctx->arg3;
+    
+    char path[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, path) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    VFile *file = vfs_open(&ctx->vfs, path, mode);
+    if (!file) {
+        ctx->error = errno;
+        return -1;
+    }
+    
+    ctx->return_value = file->fd;
+    return 0;
+}
+
+int sys_close(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    int fd = (int)ctx->arg1;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    
+    int result = vfs_close(&ctx->vfs, file);
+    ctx->return_value = result;
+    return result;
+}
+
+int sys_write(SysCallContext *ctx, PocolVM *vm) {
+    int fd = (int)ctx->arg1;
+    uint64_t size = ctx->arg3;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    uint8_t *buf = pocol_mem_ptr(vm, ctx->arg2, size, POCOL_MEM_READ);
+    if (!buf) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    int64_t written = vfs_write(&ctx->vfs, file, buf, size);
+    if (written < 0) ctx->error = errno;
+    if (written > 0) ctx->bytes_written += written;
+    ctx->return_value = written;
+    return (written < 0) ? -1 : 0;
+}
+
+int sys_read_file(SysCallContext *ctx, PocolVM *vm) {
+    int fd = (int)ctx->arg1;
+    uint64_t size = ctx->arg3;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    uint8_t *buf = pocol_mem_ptr(vm, ctx->arg2, size, POCOL_MEM_WRITE);
+    if (!buf) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    int64_t bytes = vfs_read(&ctx->vfs, file, buf, size);
+    if (bytes > 0) ctx->bytes_read += bytes;
+    ctx->return_value = bytes;
+    return (bytes < 0) ? -1 : 0;
+}
+
+int sys_seek(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    int fd = (int)ctx->arg1;
+    int64_t offset = ctx->arg2;
+    int whence = (int)ctx->arg3;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    
+    int64_t result = vfs_seek(&ctx->vfs, file, offset, whence);
+    ctx->return_value = result;
+    return (result < 0) ? -1 : 0;
+}
+
+int sys_tell(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    int fd = (int)ctx->arg1;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    
+    int64_t pos = vfs_tell(&ctx->vfs, file);
+    ctx->return_value = pos;
+    return (pos < 0) ? -1 : 0;
+}
+
+int sys_time(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    time_t now = time(NULL);
+    ctx->return_value = (int64_t)now;
+    return 0;
+}
+
+int sys_clock_ns(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    ctx->return_value = (int64_t)pocol_clock_ns();
+    return 0;
+}
+
+int sys_rdtsc(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    ctx->return_value = (int64_t)pocol_cycles();
+    return 0;
+}
+
+/* r1 = SYS_PERF_* counter, r2 = syscall number for SYS_PERF_SYSCALL */
+int sys_perf(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    switch (ctx->arg1) {
+        case SYS_PERF_INSTRUCTIONS:
+            ctx->return_value = (int64_t)ctx->instruction_count;
+            return 0;
+        case SYS_PERF_BLOCKS:
+            ctx->return_value = (int64_t)ctx->block_entries;
+            return 0;
+        case SYS_PERF_SYSCALLS:
+            ctx->return_value = (int64_t)ctx->syscall_count;
+            return 0;
+        case SYS_PERF_SYSCALL:
+            if (ctx->arg2 >= 0 && ctx->arg2 < SYS_TABLE_SIZE) {
+                ctx->return_value = (int64_t)ctx->table[ctx->arg2].calls;
+                return 0;
+            }
+            break;
+    }
+    ctx->error = EINVAL;
+    ctx->return_value = -1;
+    return -1;
+}
+
+/* r1 = region id, r2/r3 = optional name, only read the first time */
+int sys_prof_begin(SysCallContext *ctx, PocolVM *vm) {
+    int id = (ctx->arg1 >= 0 && ctx->arg1 < PROF_MAX_REGIONS) ? (int)ctx->arg1 : -1;
+    
+    if (id >= 0 && ctx->arg2 && ctx->arg3 > 0 && !ctx->profile.regions[id].name[0]) {
+        uint64_t len = (uint64_t)ctx->arg3 < PROF_NAME_MAX ? (uint64_t)ctx->arg3 : PROF_NAME_MAX - 1;
+        const char *name = (const char *)pocol_mem_ptr(vm, ctx->arg2, len, POCOL_MEM_READ);
+        if (!name) {
+            ctx->error = ERR_ILLEGAL_INST_ACCESS;
+            ctx->return_value = -1;
+            return -1;
+        }
+        prof_set_name(&ctx->profile, id, name, len);
+    }
+    
+    if (prof_begin(&ctx->profile, id, ctx->instruction_count) < 0) {
+        ctx->error = errno;
+        ctx->return_value = -1;
+        return -1;
+    }
+    ctx->return_value = 0;
+    return 0;
+}
+
+/* r1 = region id, must be the innermost open region; returns elapsed ns */
+int sys_prof_end(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    int id = (ctx->arg1 >= 0 && ctx->arg1 < PROF_MAX_REGIONS) ? (int)ctx->arg1 : -1;
+    
+    ctx->return_value = prof_end(&ctx->profile, id, ctx->instruction_count);
+    if (ctx->return_value < 0) {
+        ctx->error = errno;
+        return -1;
+    }
+    return 0;
+}
+
+int sys_sleep(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    uint64_t ms = ctx->arg1;
+#ifdef _WIN32
+    Sleep((DWORD)ms);
+#else
+    struct timespec ts;
+    ts.tv_sec = ms / 1000;
+    ts.tv_nsec = (ms % 1000) * 1000000;
+    /* a profiler signal must not cut the sleep short */
+    while (nanosleep(&ts, &ts) < 0 && errno == EINTR)
+        ;
+#endif
+    ctx->return_value = 0;
+    return 0;
+}
+
+int sys_exit(SysCallContext *ctx, PocolVM *vm) {
+    console_flush(&ctx->console);
+    vm->halt = 1;
+    ctx->return_value = ctx->arg1;
+    return 0;
+}
+
+int sys_flush(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    int fd = (int)ctx->arg1;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    
+    int result = 0;
+    if (file->is_console && (file->host_handle == stdout || file->host_handle == stdin)) {
+        result = console_flush(&ctx->console);
+    } else if (file->host_handle && !file->is_memory) {
+        result = vfs_sync(&ctx->vfs, file);
+    }
+    if (result < 0) ctx->error = errno;
+    ctx->return_value = result;
+    return result;
+}
+
+int sys_opendir(SysCallContext *ctx, PocolVM *vm) {
+    char path[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, path) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    VFile *dir = vfs_opendir(&ctx->vfs, path);
+    if (!dir) {
+        ctx->error = errno;
+        return -1;
+    }
+    
+    ctx->return_value = dir->fd;
+    return 0;
+}
+
+/* Fill up to r3 VDirent records at r2, r0 = records written, 0 at the end */
+int sys_readdir(SysCallContext *ctx, PocolVM *vm) {
+    int fd = (int)ctx->arg1;
+    uint64_t max = ctx->arg3;
+    
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    if (max > SYS_MAX_DIRENTS) {
+        ctx->error = EINVAL;
+        return -1;
+    }
+    uint8_t *buf = pocol_mem_ptr(vm, ctx->arg2, max * sizeof(VDirent), POCOL_MEM_WRITE);
+    if (!buf) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    const VDirEntry *entries;
+    int n = vfs_readdir(&ctx->vfs, file, &entries, (int)max);
+    if (n < 0) {
+        ctx->error = errno;
+        return -1;
+    }
+    
+    for (int i = 0; i < n; i++) {
+        VDirent d;
+        memset(&d, 0, sizeof(d));
+        d.size = entries[i].size;
+        d.mtime = entries[i].mtime;
+        d.type = entries[i].type;
+        d.name_len = (uint8_t)strlen(entries[i].name);
+        memcpy(d.name, entries[i].name, d.name_len);
+        memcpy(buf + i * sizeof(VDirent), &d, sizeof(VDirent));
+    }
+    
+    ctx->return_value = n;
+    return 0;
+}
+
+int sys_stat(SysCallContext *ctx, PocolVM *vm) {
+    char path[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, path) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    uint8_t *out = pocol_mem_ptr(vm, ctx->arg3, sizeof(VStat), POCOL_MEM_WRITE);
+    if (!out) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    VStat st;
+    int result = vfs_stat(&ctx->vfs, path, &st);
+    if (result < 0) {
+        ctx->error = errno;
+        ctx->return_value = -1;
+        return -1;
+    }
+    
+    memcpy(out, &st, sizeof(VStat));
+    ctx->return_value = 0;
+    return 0;
+}
+
+int sys_chdir(SysCallContext *ctx, PocolVM *vm) {
+    char path[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, path) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    int result = chdir(path);
+    if (result == 0) {
+        snprintf(ctx->vfs.current_path, sizeof(ctx->vfs.current_path), "%s", path);
+        /* relative listing keys now name different directories */
+        vfs_dir_flush(&ctx->vfs);
+    }
+    ctx->return_value = result;
+    return result;
+}
+
+int sys_getcwd(SysCallContext *ctx, PocolVM *vm) {
+    uint64_t buf_ptr = ctx->arg1;
+    uint64_t size = ctx->arg2;
+    
+    char cwd[VFS_MAX_PATH];
+    if (!getcwd(cwd, VFS_MAX_PATH)) {
+        ctx->return_value = -1;
+        return -1;
+    }
+    
+    size_t len = strlen(cwd);
+    size_t copy_len = (len < size) ? len : 0;
+    uint8_t *buf = pocol_mem_ptr(vm, buf_ptr, copy_len, POCOL_MEM_WRITE);
+    if (!buf) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    if (copy_len > 0) {
+        memcpy(buf, cwd, copy_len);
     }
-    return -1;
+    ctx->return_value = copy_len;
+    return 0;
 }
 
-/* Seek in file */
-int64_t vfs_seek(VFS *vfs, VFile *file, int64_t offset, int whence) {
-    if (!file || !file->is_open) return -1;
-    if (file->type == FTYPE_FILE && file->host_handle) {
-        if (fseek((FILE*)file->host_handle, offset, whence) != 0) return -1;
-        file->position = ftell((FILE*)file->host_handle);
-        return file->position;
+int sys_mkdir(SysCallContext *ctx, PocolVM *vm) {
+    char path[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, path) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
     }
-    return -1;
+    
+    int result = vfs_mkdir(&ctx->vfs, path);
+    ctx->return_value = result;
+    return result;
 }
 
-/* Tell file position */
-int64_t vfs_tell(VFS *vfs, VFile *file) {
-    if (!file || !file->is_open) return -1;
-    return file->position;
+int sys_unlink(SysCallContext *ctx, PocolVM *vm) {
+    char path[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, path) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    int result = vfs_unlink(&ctx->vfs, path);
+    if (result < 0) ctx->error = errno;
+    ctx->return_value = result;
+    return result;
 }
 
-/* Make directory */
-int vfs_mkdir(VFS *vfs, const char *path) {
+/* Run a command through /bin/sh. posix_spawn keeps this vfork-cheap no
+   matter how big the VM is; the result is the raw wait status, as before */
+int sys_system(SysCallContext *ctx, PocolVM *vm) {
+    char cmd[VFS_MAX_PATH];
+    if (sys_copy_string(vm, ctx->arg1, ctx->arg2, cmd) < 0) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+        return -1;
+    }
+    
+    console_flush(&ctx->console);
 #ifdef _WIN32
-    return mkdir(path);
+    int result = system(cmd);
 #else
-    return mkdir(path, 0755);
+    char *argv[] = {"sh", "-c", cmd, NULL};
+    pid_t pid;
+    int result = posix_spawn(&pid, "/bin/sh", NULL, NULL, argv, environ);
+    if (result != 0) {
+        ctx->error = result;
+        ctx->return_value = -1;
+        return -1;
+    }
+    while (waitpid(pid, &result, 0) < 0 && errno == EINTR)
+        ;
 #endif
+    ctx->return_value = result;
+    return result;
 }
 
-/* ========== SYSTEM CALL HANDLERS ========== */
+/* Both ends close-on-exec from the start, so a child spawned by another
+   thread meanwhile cannot inherit them */
+static int spawn_pipe(int fds[2]) {
+#ifdef __linux__
+    return pipe2(fds, O_CLOEXEC);
+#else
+    if (pipe(fds) < 0) return -1;
+    fcntl(fds[0], F_SETFD, FD_CLOEXEC);
+    fcntl(fds[1], F_SETFD, FD_CLOEXEC);
+    return 0;
+#endif
+}
 
-int sys_print(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t str_ptr = ctx->arg1;
-    uint64_t length = ctx->arg2;
+/* Start a program without a shell. r1 = VIoVec argv array, r2 = argc,
+   r3 = SYS_SPAWN_* flags, r4 = int64[2] receiving the stdin/stdout pipe
+   fds (-1 when not requested). r0 = child pid */
+int sys_spawn(SysCallContext *ctx, PocolVM *vm) {
+#ifdef _WIN32
+    ctx->error = ENOSYS;
+    return -1;
+#else
+    uint64_t argc = ctx->arg2;
+    int flags = (int)ctx->arg3;
     
-    if (str_ptr >= POCOL_MEMORY_SIZE || str_ptr + length >= POCOL_MEMORY_SIZE) {
+    if (argc == 0 || argc > SYS_MAX_ARGS) {
+        ctx->error = EINVAL;
+        return -1;
+    }
+    uint8_t *vec = pocol_mem_ptr(vm, ctx->arg1, argc * sizeof(VIoVec), POCOL_MEM_READ);
+    uint8_t *fds_out = NULL;
+    if (flags & (SYS_SPAWN_PIPE_STDIN | SYS_SPAWN_PIPE_STDOUT))
+        fds_out = pocol_mem_ptr(vm, ctx->arg4, 2 * sizeof(int64_t), POCOL_MEM_WRITE);
+    if (!vec || ((flags & (SYS_SPAWN_PIPE_STDIN | SYS_SPAWN_PIPE_STDOUT)) && !fds_out)) {
         ctx->error = ERR_ILLEGAL_INST_ACCESS;
         return -1;
     }
     
-    fwrite(&vm->memory[str_ptr], 1, length, stdout);
-    fflush(stdout);
+    char **argv = calloc(argc + 1, sizeof(char*));
+    if (!argv) {
+        ctx->error = ENOMEM;
+        return -1;
+    }
     
-    ctx->return_value = length;
-    return 0;
-}
-
-int sys_read(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t buf_ptr = ctx->arg1;
-    uint64_t max_len = ctx->arg2;
+    int error = 0;
+    int in_pipe[2] = {-1, -1};
+    int out_pipe[2] = {-1, -1};
+    posix_spawn_file_actions_t actions;
+    posix_spawn_file_actions_init(&actions);
     
-    if (buf_ptr >= POCOL_MEMORY_SIZE || buf_ptr + max_len >= POCOL_MEMORY_SIZE) {
-        ctx->error = ERR_ILLEGAL_INST_ACCESS;
-        return -1;
+    for (uint64_t i = 0; i < argc && !error; i++) {
+        VIoVec v;
+        memcpy(&v, vec + i * sizeof(VIoVec), sizeof(VIoVec));
+        uint8_t *src = pocol_mem_ptr(vm, v.base, v.len, POCOL_MEM_READ);
+        if (!src) {
+            error = ERR_ILLEGAL_INST_ACCESS;
+        } else if (!(argv[i] = malloc(v.len + 1))) {
+            error = ENOMEM;
+        } else {
+            memcpy(argv[i], src, v.len);
+            argv[i][v.len] = '\0';
+        }
     }
     
-    size_t bytes = fread(&vm->memory[buf_ptr], 1, max_len, stdin);
-    ctx->return_value = bytes;
-    return 0;
-}
-
-int sys_open(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t path_ptr = ctx->arg1;
-    uint64_t path_len = ctx->arg2;
-    int mode = (int)ctx->arg3;
+    /* dup2 in the child clears close-on-exec on the end it keeps */
+    if (!error && (flags & SYS_SPAWN_PIPE_STDIN)) {
+        if (spawn_pipe(in_pipe) < 0) {
+            error = errno;
+        } else {
+            posix_spawn_file_actions_adddup2(&actions, in_pipe[0], 0);
+        }
+    }
+    if (!error && (flags & SYS_SPAWN_PIPE_STDOUT)) {
+        if (spawn_pipe(out_pipe) < 0) {
+            error = errno;
+        } else {
+            posix_spawn_file_actions_adddup2(&actions, out_pipe[1], 1);
+        }
+    }
     
-    if (path_ptr >= POCOL_MEMORY_SIZE || path_ptr + path_len >= POCOL_MEMORY_SIZE) {
-        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+    pid_t pid = -1;
+    if (!error) {
+        /* the child shares our stdout, buffered output goes first */
+        console_flush(&ctx->console);
+        fflush(stderr);
+        error = posix_spawnp(&pid, argv[0], &actions, NULL, argv, environ);
+    }
+    
+    if (!error) {
+        int64_t fds[2] = {-1, -1};
+        char name[VFS_MAX_PATH];
+        if (in_pipe[1] >= 0) {
+            snprintf(name, sizeof(name), "pipe:%d:stdin", (int)pid);
+            VFile *p = vfs_open_pipe(&ctx->vfs, in_pipe[1], O_WRONLY, name);
+            in_pipe[1] = -1;
+            if (p) fds[0] = p->fd;
+        }
+        if (out_pipe[0] >= 0) {
+            snprintf(name, sizeof(name), "pipe:%d:stdout", (int)pid);
+            VFile *p = vfs_open_pipe(&ctx->vfs, out_pipe[0], O_RDONLY, name);
+            out_pipe[0] = -1;
+            if (p) fds[1] = p->fd;
+        }
+        if (fds_out) memcpy(fds_out, fds, sizeof(fds));
+        ctx->return_value = pid;
+    }
+    
+    for (int i = 0; i < 2; i++) {
+        if (in_pipe[i] >= 0) close(in_pipe[i]);
+        if (out_pipe[i] >= 0) close(out_pipe[i]);
+    }
+    posix_spawn_file_actions_destroy(&actions);
+    for (uint64_t i = 0; i < argc; i++) free(argv[i]);
+    free(argv);
+    
+    if (error) {
+        ctx->error = error;
+        ctx->return_value = -1;
         return -1;
     }
+    return 0;
+#endif
+}
+
+/* Reap a child. r1 = pid (-1 for any), r2 = SYS_WAIT_* flags.
+   r0 = exit code, or 128 + signal number if it was killed */
+int sys_wait(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+#ifdef _WIN32
+    ctx->error = ENOSYS;
+    return -1;
+#else
+    pid_t pid = (pid_t)ctx->arg1;
+    int options = (ctx->arg2 & SYS_WAIT_NOHANG) ? WNOHANG : 0;
+    int status;
+    pid_t r;
     
-    char path[VFS_MAX_PATH];
-    path_len = (path_len < VFS_MAX_PATH - 1) ? path_len : VFS_MAX_PATH - 1;
-    memcpy(path, &vm->memory[path_ptr], path_len);
-    path[path_len] = '\0';
+    do {
+        r = waitpid(pid, &status, options);
+    } while (r < 0 && errno == EINTR);
     
-    VFile *file = vfs_open(&ctx->vfs, path, mode);
-    if (!file) {
+    if (r < 0) {
         ctx->error = errno;
+        ctx->return_value = -1;
         return -1;
     }
-    
-    for (int i = 0; i < VFS_MAX_FILES; i++) {
-        if (ctx->vfs.files[i] == file) {
-            ctx->return_value = i;
-            return 0;
-        }
+    if (r == 0) {
+        ctx->error = EAGAIN; /* still running */
+        ctx->return_value = -1;
+        return -1;
     }
     
-    ctx->return_value = -1;
-    return -1;
+    ctx->return_value = WIFEXITED(status) ? WEXITSTATUS(status) : 128 + WTERMSIG(status);
+    return 0;
+#endif
 }
 
-int sys_close(SysCallContext *ctx, PocolVM *vm) {
+int sys_mmap(SysCallContext *ctx, PocolVM *vm) {
     int fd = (int)ctx->arg1;
+    uint64_t offset = ctx->arg2;
+    uint64_t length = ctx->arg3;
+    int flags = (int)ctx->arg4;
     
-    if (fd < 0 || fd >= VFS_MAX_FILES || !ctx->vfs.files[fd]) {
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
+        ctx->error = EBADF;
+        return -1;
+    }
+    if (file->type != FTYPE_FILE || !file->host_handle) {
         ctx->error = EBADF;
         return -1;
     }
+    if (file->is_memory) {
+        ctx->error = ENODEV;
+        return -1;
+    }
+    
+    /* cached writes must reach the file before it is mapped */
+    if (vfs_sync(&ctx->vfs, file) < 0) {
+        ctx->error = errno;
+        return -1;
+    }
+    int64_t addr = pocol_mem_map_file(vm, fileno((FILE*)file->host_handle), offset, length, flags);
+    if (addr < 0) {
+        ctx->error = errno;
+        ctx->return_value = -1;
+        return -1;
+    }
     
-    int result = vfs_close(&ctx->vfs, ctx->vfs.files[fd]);
-    ctx->vfs.files[fd] = NULL;
+    ctx->return_value = addr;
+    return 0;
+}
+
+int sys_munmap(SysCallContext *ctx, PocolVM *vm) {
+    int result = pocol_mem_unmap(vm, ctx->arg1);
+    if (result < 0) ctx->error = errno;
     ctx->return_value = result;
     return result;
 }
 
-int sys_write(SysCallContext *ctx, PocolVM *vm) {
+int sys_readv(SysCallContext *ctx, PocolVM *vm) {
     int fd = (int)ctx->arg1;
-    uint64_t buf_ptr = ctx->arg2;
-    uint64_t size = ctx->arg3;
+    uint64_t count = ctx->arg3;
     
-    if (fd < 0 || fd >= VFS_MAX_FILES || !ctx->vfs.files[fd]) {
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
         ctx->error = EBADF;
         return -1;
     }
-    if (buf_ptr >= POCOL_MEMORY_SIZE || buf_ptr + size >= POCOL_MEMORY_SIZE) {
+    if (count > SYS_MAX_IOV) {
+        ctx->error = EINVAL;
+        return -1;
+    }
+    uint8_t *iov = pocol_mem_ptr(vm, ctx->arg2, count * sizeof(VIoVec), POCOL_MEM_READ);
+    if (!iov) {
         ctx->error = ERR_ILLEGAL_INST_ACCESS;
         return -1;
     }
     
-    int64_t written = vfs_write(&ctx->vfs, ctx->vfs.files[fd], &vm->memory[buf_ptr], size);
-    ctx->return_value = written;
-    return (written < 0) ? -1 : 0;
+    int64_t total = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        VIoVec v;
+        memcpy(&v, iov + i * sizeof(VIoVec), sizeof(VIoVec));
+        uint8_t *buf = pocol_mem_ptr(vm, v.base, v.len, POCOL_MEM_WRITE);
+        if (!buf) {
+            ctx->error = ERR_ILLEGAL_INST_ACCESS;
+            return -1;
+        }
+        errno = 0;
+        int64_t n = vfs_read(&ctx->vfs, file, buf, v.len);
+        if (n < 0) {
+            if (total == 0) {
+                ctx->error = errno ? errno : EBADF; /* not readable */
+                ctx->return_value = -1;
+                return -1;
+            }
+            break;
+        }
+        total += n;
+        if ((uint64_t)n < v.len) break; /* short read: EOF or no more input */
+    }
+    
+    ctx->bytes_read += total;
+    ctx->return_value = total;
+    return 0;
 }
 
-int sys_read_file(SysCallContext *ctx, PocolVM *vm) {
+int sys_writev(SysCallContext *ctx, PocolVM *vm) {
     int fd = (int)ctx->arg1;
-    uint64_t buf_ptr = ctx->arg2;
-    uint64_t size = ctx->arg3;
+    uint64_t count = ctx->arg3;
     
-    if (fd < 0 || fd >= VFS_MAX_FILES || !ctx->vfs.files[fd]) {
+    VFile *file = vfs_get(&ctx->vfs, fd);
+    if (!file) {
         ctx->error = EBADF;
         return -1;
     }
-    if (buf_ptr >= POCOL_MEMORY_SIZE || buf_ptr + size >= POCOL_MEMORY_SIZE) {
+    if (count > SYS_MAX_IOV) {
+        ctx->error = EINVAL;
+        return -1;
+    }
+    uint8_t *iov = pocol_mem_ptr(vm, ctx->arg2, count * sizeof(VIoVec), POCOL_MEM_READ);
+    if (!iov) {
         ctx->error = ERR_ILLEGAL_INST_ACCESS;
         return -1;
     }
     
-    int64_t bytes = vfs_read(&ctx->vfs, ctx->vfs.files[fd], &vm->memory[buf_ptr], size);
-    ctx->return_value = bytes;
-    return (bytes < 0) ? -1 : 0;
+    int64_t total = 0;
+    for (uint64_t i = 0; i < count; i++) {
+        VIoVec v;
+        memcpy(&v, iov + i * sizeof(VIoVec), sizeof(VIoVec));
+        uint8_t *buf = pocol_mem_ptr(vm, v.base, v.len, POCOL_MEM_READ);
+        if (!buf) {
+            ctx->error = ERR_ILLEGAL_INST_ACCESS;
+            return -1;
+        }
+        errno = 0;
+        int64_t n = vfs_write(&ctx->vfs, file, buf, v.len);
+        if (n < 0) {
+            if (total == 0) {
+                ctx->error = errno ? errno : EBADF; /* not writable */
+                ctx->return_value = -1;
+                return -1;
+            }
+            break;
+        }
+        total += n;
+        if ((uint64_t)n < v.len) break;
+    }
+    
+    ctx->bytes_written += total;
+    ctx->return_value = total;
+    return 0;
 }
 
-int sys_seek(SysCallContext *ctx, PocolVM *vm) {
-    int fd = (int)ctx->arg1;
-    int64_t offset = ctx->arg2;
-    int whence = (int)ctx->arg3;
+int sys_copy(SysCallContext *ctx, PocolVM *vm) {
+    (void)vm;
+    int fd_in = (int)ctx->arg1;
+    int fd_out = (int)ctx->arg2;
+    int64_t size = ctx->arg3;
     
-    if (fd < 0 || fd >= VFS_MAX_FILES || !ctx->vfs.files[fd]) {
+    VFile *in = vfs_get(&ctx->vfs, fd_in);
+    VFile *out = vfs_get(&ctx->vfs, fd_out);
+    if (!in || !out) {
         ctx->error = EBADF;
         return -1;
     }
     
-    int64_t result = vfs_seek(&ctx->vfs, ctx->vfs.files[fd], offset, whence);
-    ctx->return_value = result;
-    return (result < 0) ? -1 : 0;
+    int64_t copied = vfs_copy(&ctx->vfs, in, out, size);
+    if (copied < 0) ctx->error = errno;
+    if (copied > 0) {
+        ctx->bytes_read += copied;
+        ctx->bytes_written += copied;
+    }
+    ctx->return_value = copied;
+    return (copied < 0) ? -1 : 0;
 }
 
-int sys_tell(SysCallContext *ctx, PocolVM *vm) {
-    int fd = (int)ctx->arg1;
+/* Run an array of VSyscallDesc in one VM exit. Each entry gets its own
+   result/error written back; r0 receives the number of entries executed.
+   An entry that unmaps the array itself ends the batch with
+   ERR_ILLEGAL_INST_ACCESS */
+int sys_batch(SysCallContext *ctx, PocolVM *vm) {
+    uint64_t base = ctx->arg1;
+    uint64_t count = ctx->arg2;
+    int flags = (int)ctx->arg3;
     
-    if (fd < 0 || fd >= VFS_MAX_FILES || !ctx->vfs.files[fd]) {
-        ctx->error = EBADF;
+    if (count > SYS_MAX_BATCH) {
+        ctx->error = EINVAL;
+        return -1;
+    }
+    if (!pocol_mem_ptr(vm, base, count * sizeof(VSyscallDesc), POCOL_MEM_READ | POCOL_MEM_WRITE)) {
+        ctx->error = ERR_ILLEGAL_INST_ACCESS;
         return -1;
     }
     
-    int64_t pos = vfs_tell(&ctx->vfs, ctx->vfs.files[fd]);
-    ctx->return_value = pos;
-    return (pos < 0) ? -1 : 0;
+    uint64_t done = 0;
+    bool lost = false;
+    while (done < count && !vm->halt) {
+        /* looked up again around every call, a SYS_MUNMAP entry may
+           have taken the array's pages away */
+        uint64_t at = base + done * sizeof(VSyscallDesc);
+        uint8_t *slot = pocol_mem_ptr(vm, at, sizeof(VSyscallDesc), POCOL_MEM_READ);
+        if (!slot) {
+            lost = true;
+            break;
+        }
+        VSyscallDesc d;
+        memcpy(&d, slot, sizeof(VSyscallDesc));
+        
+        ctx->arg1 = d.args[0];
+        ctx->arg2 = d.args[1];
+        ctx->arg3 = d.args[2];
+        ctx->arg4 = d.args[3];
+        ctx->error = 0;
+        ctx->return_value = 0;
+        
+        int result;
+        if (d.num == SYS_BATCH) {
+            ctx->error = EINVAL; /* no nesting */
+            result = -1;
+        } else {
+            result = syscalls_dispatch(ctx, vm, (int)d.num);
+        }
+        
+        d.result = ctx->return_value;
+        d.error = (result < 0) ? ctx->error : 0;
+        done++;
+        slot = pocol_mem_ptr(vm, at, sizeof(VSyscallDesc), POCOL_MEM_WRITE);
+        if (!slot) {
+            lost = true;
+            break;
+        }
+        memcpy(slot, &d, sizeof(VSyscallDesc));
+        
+        if (result < 0 && (flags & SYS_BATCH_STOP_ON_ERROR)) break;
+    }
+    
+    ctx->error = lost ? ERR_ILLEGAL_INST_ACCESS : 0;
+    ctx->return_value = (int64_t)done;
+    return lost ? -1 : 0;
 }
 
-int sys_time(SysCallContext *ctx, PocolVM *vm) {
-    time_t now = time(NULL);
-    ctx->return_value = (int64_t)now;
-    return 0;
-}
+/* ========== SYSCALL REGISTRY ========== */
 
-int sys_sleep(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t ms = ctx->arg1;
-#ifdef _WIN32
-    Sleep((DWORD)ms);
-#else
-    struct timespec ts;
-    ts.tv_sec = ms / 1000;
-    ts.tv_nsec = (ms % 1000) * 1000000;
-    nanosleep(&ts, NULL);
-#endif
-    ctx->return_value = 0;
-    return 0;
-}
+static const struct {
+    int num;
+    SysCallFn fn;
+    uint8_t argc;
+    const char *name;
+} builtin_syscalls[] = {
+    {SYS_PRINT,     sys_print,      2, "print"},
+    {SYS_READ,      sys_read,       2, "read"},
+    {SYS_OPEN,      sys_open,       3, "open"},
+    {SYS_CLOSE,     sys_close,      1, "close"},
+    {SYS_WRITE,     sys_write,      3, "write"},
+    {SYS_READ_FILE, sys_read_file,  3, "read_file"},
+    {SYS_SEEK,      sys_seek,       3, "seek"},
+    {SYS_TELL,      sys_tell,       1, "tell"},
+    {SYS_MMAP,      sys_mmap,       4, "mmap"},
+    {SYS_MUNMAP,    sys_munmap,     1, "munmap"},
+    {SYS_TIME,      sys_time,       0, "time"},
+    {SYS_SLEEP,     sys_sleep,      1, "sleep"},
+    {SYS_EXIT,      sys_exit,       1, "exit"},
+    {SYS_FLUSH,     sys_flush,      1, "flush"},
+    {SYS_OPENDIR,   sys_opendir,    2, "opendir"},
+    {SYS_READDIR,   sys_readdir,    3, "readdir"},
+    {SYS_CHDIR,     sys_chdir,      2, "chdir"},
+    {SYS_GETCWD,    sys_getcwd,     2, "getcwd"},
+    {SYS_READV,     sys_readv,      3, "readv"},
+    {SYS_WRITEV,    sys_writev,     3, "writev"},
+    {SYS_BATCH,     sys_batch,      3, "batch"},
+    {SYS_MKDIR,     sys_mkdir,      2, "mkdir"},
+    {SYS_UNLINK,    sys_unlink,     2, "unlink"},
+    {SYS_COPY,      sys_copy,       3, "copy"},
+    {SYS_SYSTEM,    sys_system,     2, "system"},
+    {SYS_STAT,      sys_stat,       3, "stat"},
+    {SYS_SPAWN,     sys_spawn,      4, "spawn"},
+    {SYS_WAIT,      sys_wait,       2, "wait"},
+    {SYS_CLOCK_NS,  sys_clock_ns,   0, "clock_ns"},
+    {SYS_RDTSC,     sys_rdtsc,      0, "rdtsc"},
+    {SYS_PERF,      sys_perf,       2, "perf"},
+    {SYS_PROF_BEGIN, sys_prof_begin, 3, "prof_begin"},
+    {SYS_PROF_END,  sys_prof_end,   1, "prof_end"},
+};
 
-int sys_exit(SysCallContext *ctx, PocolVM *vm) {
-    vm->halt = 1;
-    ctx->return_value = ctx->arg1;
-    return 0;
+static void syscalls_register_builtins(SysCallContext *ctx) {
+    for (size_t i = 0; i < sizeof(builtin_syscalls) / sizeof(builtin_syscalls[0]); i++) {
+        SysCallEntry *e = &ctx->table[builtin_syscalls[i].num];
+        e->fn = builtin_syscalls[i].fn;
+        e->argc = builtin_syscalls[i].argc;
+        e->name = builtin_syscalls[i].name;
+    }
 }
 
-int sys_chdir(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t path_ptr = ctx->arg1;
-    uint64_t path_len = ctx->arg2;
-    
-    if (path_ptr >= POCOL_MEMORY_SIZE) {
-        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+/* Register a host function under syscall number 1..SYS_TABLE_SIZE-1.
+   Whatever was there, built-in or native, is replaced */
+int syscalls_register(SysCallContext *ctx, int num, SysNativeFn fn, void *userdata,
+                      int argc, const char *name) {
+    if (num <= 0 || num >= SYS_TABLE_SIZE || !fn || argc < 0 || argc > 4) {
+        errno = EINVAL;
         return -1;
     }
-    
-    char path[VFS_MAX_PATH];
-    path_len = (path_len < VFS_MAX_PATH - 1) ? path_len : VFS_MAX_PATH - 1;
-    memcpy(path, &vm->memory[path_ptr], path_len);
-    path[path_len] = '\0';
-    
-    int result = chdir(path);
-    if (result == 0) {
-        strncpy(ctx->vfs.current_path, path, VFS_MAX_PATH - 1);
-    }
-    ctx->return_value = result;
-    return result;
+    SysCallEntry *e = &ctx->table[num];
+    e->fn = NULL;
+    e->native = fn;
+    e->userdata = userdata;
+    e->argc = (uint8_t)argc;
+    e->name = name;
+    return 0;
 }
 
-int sys_getcwd(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t buf_ptr = ctx->arg1;
-    uint64_t size = ctx->arg2;
-    
-    if (buf_ptr >= POCOL_MEMORY_SIZE) {
-        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+const char* syscalls_name(SysCallContext *ctx, int num) {
+    if (num < 0 || num >= SYS_TABLE_SIZE || !ctx->table[num].name) return "unknown";
+    return ctx->table[num].name;
+}
+
+/* Load a shared library and let its pocol_plugin_init() register natives */
+int syscalls_load_plugin(SysCallContext *ctx, const char *path) {
+    if (ctx->plugin_count >= SYS_MAX_PLUGINS) {
+        fprintf(stderr, "%s: too many plugins\n", path);
         return -1;
     }
     
-    char cwd[VFS_MAX_PATH];
-    if (!getcwd(cwd, VFS_MAX_PATH)) {
-        ctx->return_value = -1;
+    PocolPluginInit init;
+#ifdef _WIN32
+    HMODULE handle = LoadLibraryA(path);
+    if (!handle) {
+        fprintf(stderr, "%s: cannot load plugin\n", path);
         return -1;
     }
-    
-    size_t len = strlen(cwd);
-    size_t copy_len = (len < size && len < POCOL_MEMORY_SIZE - buf_ptr) ? len : 0;
-    if (copy_len > 0) {
-        memcpy(&vm->memory[buf_ptr], cwd, copy_len);
+    init = (PocolPluginInit)GetProcAddress(handle, POCOL_PLUGIN_INIT);
+#else
+    void *handle = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+    if (!handle) {
+        fprintf(stderr, "%s\n", dlerror());
+        return -1;
     }
-    ctx->return_value = copy_len;
-    return 0;
-}
-
-int sys_mkdir(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t path_ptr = ctx->arg1;
-    uint64_t path_len = ctx->arg2;
+    /* POSIX-sanctioned way around the object/function pointer cast */
+    *(void **)(&init) = dlsym(handle, POCOL_PLUGIN_INIT);
+#endif
     
-    if (path_ptr >= POCOL_MEMORY_SIZE) {
-        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+    if (!init || init(ctx) != 0) {
+        fprintf(stderr, "%s: %s failed\n", path, init ? POCOL_PLUGIN_INIT : "no " POCOL_PLUGIN_INIT);
+#ifdef _WIN32
+        FreeLibrary(handle);
+#else
+        dlclose(handle);
+#endif
         return -1;
     }
     
-    char path[VFS_MAX_PATH];
-    path_len = (path_len < VFS_MAX_PATH - 1) ? path_len : VFS_MAX_PATH - 1;
-    memcpy(path, &vm->memory[path_ptr], path_len);
-    path[path_len] = '\0';
-    
-    int result = vfs_mkdir(&ctx->vfs, path);
-    ctx->return_value = result;
-    return result;
+    ctx->plugins[ctx->plugin_count++] = (void*)handle;
+    return 0;
 }
 
-int sys_system(SysCallContext *ctx, PocolVM *vm) {
-    uint64_t cmd_ptr = ctx->arg1;
-    uint64_t cmd_len = ctx->arg2;
+static int syscalls_call_native(SysCallContext *ctx, PocolVM *vm, SysCallEntry *e) {
+    int64_t args[4] = {0, 0, 0, 0};
+    const int64_t regs[4] = {ctx->arg1, ctx->arg2, ctx->arg3, ctx->arg4};
+    memcpy(args, regs, e->argc * sizeof(int64_t));
     
-    if (cmd_ptr >= POCOL_MEMORY_SIZE) {
-        ctx->error = ERR_ILLEGAL_INST_ACCESS;
+    int error = 0;
+    int64_t result = e->native(vm, e->userdata, args, &error);
+    if (error) {
+        ctx->error = error;
+        ctx->return_value = -1;
         return -1;
     }
-    
-    char cmd[VFS_MAX_PATH];
-    cmd_len = (cmd_len < VFS_MAX_PATH - 1) ? cmd_len : VFS_MAX_PATH - 1;
-    memcpy(cmd, &vm->memory[cmd_ptr], cmd_len);
-    cmd[cmd_len] = '\0';
-    
-    int result = system(cmd);
     ctx->return_value = result;
-    return result;
+    return 0;
 }
 
 /* Main system call dispatcher */
@@ -520,40 +2420,35 @@ int syscalls_exec(SysCallContext *ctx, PocolVM *vm, int syscall_num) {
     ctx->error = 0;
     ctx->return_value = 0;
     
-    int result;
-    switch (syscall_num) {
-        case SYS_PRINT:    result = sys_print(ctx, vm); break;
-        case SYS_READ:     result = sys_read(ctx, vm); break;
-        case SYS_OPEN:     result = sys_open(ctx, vm); break;
-        case SYS_CLOSE:    result = sys_close(ctx, vm); break;
-        case SYS_WRITE:    result = sys_write(ctx, vm); break;
-        case SYS_READ_FILE:result = sys_read_file(ctx, vm); break;
-        case SYS_SEEK:     result = sys_seek(ctx, vm); break;
-        case SYS_TELL:     result = sys_tell(ctx, vm); break;
-        case SYS_TIME:     result = sys_time(ctx, vm); break;
-        case SYS_SLEEP:    result = sys_sleep(ctx, vm); break;
-        case SYS_EXIT:     result = sys_exit(ctx, vm); break;
-        case SYS_CHDIR:    result = sys_chdir(ctx, vm); break;
-        case SYS_GETCWD:   result = sys_getcwd(ctx, vm); break;
-        case SYS_MKDIR:    result = sys_mkdir(ctx, vm); break;
-        case SYS_SYSTEM:   result = sys_system(ctx, vm); break;
-        default:
-            ctx->error = ENOSYS;
-            result = -1;
-    }
+    ctx->current_syscall = syscall_num;
+    int result = syscalls_dispatch(ctx, vm, syscall_num);
+    ctx->current_syscall = -1;
     
     vm->registers[0] = ctx->return_value;
     return result;
 }
 
+/* Run one syscall with arguments already in ctx->arg1..arg4 */
+int syscalls_dispatch(SysCallContext *ctx, PocolVM *vm, int syscall_num) {
+    if (syscall_num < 0 || syscall_num >= SYS_TABLE_SIZE) {
+        ctx->error = ENOSYS;
+        return -1;
+    }
+    
+    SysCallEntry *e = &ctx->table[syscall_num];
+    ctx->syscall_count++;
+    e->calls++;
+    if (e->fn) return e->fn(ctx, vm);
+    if (e->native) return syscalls_call_native(ctx, vm, e);
+    
+    ctx->error = ENOSYS;
+    return -1;
+}
+
 /* Error string */
 const char* sys_strerror(int error) {
     switch (error) {
         case 0: return "Success";
-        case ERR_ILLEGAL_INST: return "Illegal instruction";
-        case ERR_ILLEGAL_INST_ACCESS: return "Illegal memory access";
-        case ERR_STACK_OVERFLOW: return "Stack overflow";
-        case ERR_STACK_UNDERFLOW: return "Stack underflow";
         case ENOENT: return "No such file or directory";
         case EBADF: return "Bad file descriptor";
         case EACCES: return "Permission denied";
@@ -5,7 +5,7 @@
 #ifndef POCOL_VM_SYSCALLS_H
 #define POCOL_VM_SYSCALLS_H
 
-#include "vm.h"
+#include "vm_profile.h"
 #include <stdio.h>
 #include <stdint.h>
 #include <stdbool.h>
@@ -20,14 +20,67 @@
 #define SYS_READ_FILE  6
 #define SYS_SEEK       7
 #define SYS_TELL       8
+#define SYS_MMAP       9
+#define SYS_MUNMAP     10
 #define SYS_TIME       11
 #define SYS_SLEEP      12
 #define SYS_EXIT       13
+#define SYS_FLUSH      14
+#define SYS_OPENDIR    15
+#define SYS_READDIR    16
 #define SYS_CHDIR      17
 #define SYS_GETCWD     18
+#define SYS_READV      19
+#define SYS_WRITEV     20
+#define SYS_BATCH      21
 #define SYS_MKDIR      22
 #define SYS_UNLINK     23
+#define SYS_COPY       24
 #define SYS_SYSTEM     25
+#define SYS_STAT       26
+#define SYS_SPAWN      27
+#define SYS_WAIT       28
+#define SYS_CLOCK_NS   29
+#define SYS_RDTSC      30
+#define SYS_PERF       31
+#define SYS_PROF_BEGIN 32
+#define SYS_PROF_END   33
+
+/* SYS_BATCH flags */
+#define SYS_BATCH_STOP_ON_ERROR 1
+
+/* SYS_SPAWN flags */
+#define SYS_SPAWN_PIPE_STDIN   1    /* child stdin is a pipe, write end returned */
+#define SYS_SPAWN_PIPE_STDOUT  2    /* child stdout is a pipe, read end returned */
+
+/* SYS_WAIT flags */
+#define SYS_WAIT_NOHANG        1
+
+/* SYS_PERF counters (r1) */
+#define SYS_PERF_INSTRUCTIONS  0    /* guest instructions retired */
+#define SYS_PERF_BLOCKS        1    /* JIT block entries */
+#define SYS_PERF_SYSCALLS      2    /* syscalls dispatched, batch entries included */
+#define SYS_PERF_SYSCALL       3    /* calls of syscall number r2 */
+
+/* Limits for vectored/batched calls */
+#define SYS_MAX_IOV        1024
+#define SYS_MAX_BATCH      4096
+#define SYS_MAX_DIRENTS    4096
+#define SYS_MAX_ARGS       256
+
+/* Guest iovec used by SYS_READV / SYS_WRITEV (16 bytes, little endian) */
+typedef struct {
+    uint64_t base;          /* guest address */
+    uint64_t len;
+} VIoVec;
+
+/* Guest syscall descriptor used by SYS_BATCH (56 bytes) */
+typedef struct {
+    uint64_t num;           /* syscall number */
+    int64_t args[4];        /* r1-r4 */
+    int64_t result;         /* written back: r0 of the call */
+    int64_t error;          /* written back: error code, 0 on success */
+} VSyscallDesc;
 
 /* File modes */
 #define O_RDONLY       0
@@ -40,11 +93,62 @@
 #define FTYPE_FILE     1
 #define FTYPE_DIR      2
 #define FTYPE_DEVICE   3
+#define FTYPE_PIPE     4
 
 /* VFS constants */
-#define VFS_MAX_FILES      256
+#define VFS_MAX_FILES      256              /* initial size of the fd table */
+#define VFS_DEFAULT_FD_LIMIT 65536          /* ceiling the table may grow to */
+#define VFS_HASH_MIN       256              /* initial buckets in the path index */
 #define VFS_MAX_FILENAME   64
 #define VFS_MAX_PATH       256
+#define VFS_COPY_CHUNK     (1024 * 1024)   /* bounce buffer for SYS_COPY fallback */
+#define VFS_MEM_PREFIX     "/mem/"          /* mount point of the in-memory backend */
+#define VFS_MEM_MIN_CAP    4096
+#define VFS_CACHE_MIN      4096             /* first window and read-ahead */
+#define VFS_CACHE_MAX      (256 * 1024)     /* largest per-file window */
+#define VFS_CACHE_BUDGET   (64 * 1024 * 1024)   /* all windows together */
+#define VFS_DIR_CACHE_MAX  32               /* directory listings kept after close */
+
+/* Guest record written by SYS_READDIR (88 bytes, little endian) */
+typedef struct {
+    uint64_t size;
+    uint64_t mtime;
+    uint8_t type;           /* FTYPE_* */
+    uint8_t name_len;
+    uint8_t reserved[6];
+    char name[VFS_MAX_FILENAME];    /* NUL terminated */
+} VDirent;
+
+/* Guest record written by SYS_STAT (24 bytes) */
+typedef struct {
+    uint64_t size;
+    uint64_t mtime;
+    uint32_t mode;          /* permission bits */
+    uint8_t type;           /* FTYPE_* */
+    uint8_t reserved[3];
+} VStat;
+
+/* Console output buffering policy */
+typedef enum {
+    CONSOLE_UNBUFFERED = 0,     /* one write(2) per guest write */
+    CONSOLE_LINE_BUFFERED,      /* drain when a newline is written */
+    CONSOLE_FULL_BUFFERED,      /* drain when full, on SYS_FLUSH, halt and exit */
+} ConsolePolicy;
+
+#define CONSOLE_BUFFER_SIZE (64 * 1024)
+
+/* Per-VM output buffer sitting in front of ctx->console_output */
+typedef struct {
+    FILE *stream;               /* host stream the buffer drains into */
+    uint8_t *data;
+    size_t used;
+    size_t capacity;
+    ConsolePolicy policy;
+    bool flush_on_read;         /* drain before reading the console */
+    bool discard;               /* replaying output the guest already produced */
+    uint64_t write_calls;       /* write(2) calls issued by console_flush */
+    uint64_t bytes_written;
+} ConsoleBuffer;
 
 /* Virtual file */
 typedef struct VFile {
@@ -56,11 +160,35 @@ typedef struct VFile {
     uint8_t mode;
     bool is_open;
     bool is_console;
+    bool is_memory;         /* lives under VFS_MEM_PREFIX, host_handle is a VMemNode */
     void *host_handle;
-    uint8_t *buffer;
+    uint8_t *buffer;        /* block cache window, host files only */
     uint64_t buffer_size;
+    uint64_t cache_offset;  /* file offset of buffer[0] */
+    uint64_t cache_len;     /* valid bytes in buffer */
+    uint64_t dirty_start;   /* range of buffer not yet written back */
+    uint64_t dirty_end;
+    uint64_t readahead;     /* next refill size, doubles on sequential reads */
+    uint64_t cache_fetched; /* bytes of the window read from the host */
+    uint64_t cache_used;    /* high-water mark of guest reads in the window */
+    int fd;                 /* slot in VFS.files */
+    uint32_t path_hash;
+    struct VFile *hash_next;    /* chain in VFS.path_index */
 } VFile;
 
+/* In-memory file or directory, owned by the VFS (tmpfs-style) */
+typedef struct VMemNode {
+    char path[VFS_MAX_PATH];
+    uint8_t type;           /* FTYPE_FILE or FTYPE_DIR */
+    uint8_t *data;
+    uint64_t size;
+    uint64_t capacity;
+    uint64_t mtime;
+    int open_count;
+    bool unlinked;          /* removed while open, freed on last close */
+    struct VMemNode *next;
+} VMemNode;
+
 /* Directory entry */
 typedef struct VDirEntry {
     char name[VFS_MAX_FILENAME];
@@ -75,18 +203,75 @@ typedef struct VDir {
     VDirEntry *entries;
     int entry_count;
     int current_index;
+    uint64_t dir_mtime;     /* host mtime in ns when listed, 0 for /mem/ */
+    int refcount;           /* directory fds sharing this listing */
+    bool cached;            /* still linked from VFS.dir_cache */
+    struct VDir *next;
 } VDir;
 
+/* Block cache counters, summed over all files */
+typedef struct {
+    uint64_t read_calls;
+    uint64_t read_hits;         /* reads served without touching the host */
+    uint64_t bytes_served;
+    uint64_t bytes_fetched;     /* read from the host into cache windows */
+    uint64_t prefetch_used;     /* part of bytes_fetched the guest consumed */
+    uint64_t write_calls;
+    uint64_t bytes_coalesced;   /* written into the cache instead of the host */
+    uint64_t write_backs;       /* host writes issued by the cache */
+} VCacheStats;
+
 /* Virtual File System */
 typedef struct VFS {
-    VFile *files[VFS_MAX_FILES];
-    int file_count;
+    VFile **files;              /* indexed by fd, grows up to fd_limit */
+    int fd_capacity;
+    int fd_limit;
+    int fd_next;                /* lowest fd never handed out */
+    int *free_fds;              /* stack of closed fds, reused first */
+    int free_count;
+    int file_count;             /* fds currently open */
+    VFile **path_index;         /* open files hashed by path */
+    int index_size;             /* power of two */
     VDir *current_dir;
     char current_path[VFS_MAX_PATH];
+    VMemNode *mem_nodes;        /* in-memory backend mounted at VFS_MEM_PREFIX */
+    ConsoleBuffer *console;     /* buffered stdout, owned by SysCallContext */
+    VCacheStats cache;
+    uint64_t cache_bytes;       /* summed window sizes, at most VFS_CACHE_BUDGET */
+    VDir *dir_cache;            /* listings, most recently opened first */
+    int dir_cache_count;
 } VFS;
 
-/* System call context */
+/* Syscall registry */
+#define SYS_TABLE_SIZE     256
+#define SYS_MAX_PLUGINS    16
+#define POCOL_PLUGIN_INIT  "pocol_plugin_init"
+
+struct SysCallContext;
+struct PocolVM;         /* vm.h includes this header before defining it */
+
+/* Built-in handler: arguments in ctx->arg1..arg4, result in ctx->return_value */
+typedef int (*SysCallFn)(struct SysCallContext *ctx, struct PocolVM *vm);
+
+/* Host function registered at runtime. args[] holds r1..r4 (zero past argc),
+   the return value goes to r0. Set *error to fail the call */
+typedef int64_t (*SysNativeFn)(struct PocolVM *vm, void *userdata, const int64_t *args, int *error);
+
 typedef struct {
+    SysCallFn fn;           /* built-in, or NULL */
+    SysNativeFn native;     /* registered host function, or NULL */
+    void *userdata;
+    uint8_t argc;
+    const char *name;
+    uint64_t calls;
+} SysCallEntry;
+
+/* Plugins export `int pocol_plugin_init(SysCallContext *ctx)` and call
+   syscalls_register() from it; non-zero aborts the load */
+typedef int (*PocolPluginInit)(struct SysCallContext *ctx);
+
+/* System call context */
+typedef struct SysCallContext {
     int64_t return_value;
     int error;
     int64_t arg1;
@@ -95,26 +280,61 @@ typedef struct {
     int64_t arg4;
     FILE *console_input;
     FILE *console_output;
+    ConsoleBuffer console;
     VFS vfs;
-    uint64_t instruction_count;
+    uint64_t instruction_count;     /* committed by the executors before each SYS and at exit */
+    uint64_t block_entries;
+    uint64_t syscall_count;
+    uint64_t bytes_read;            /* guest data moved by the read/write syscalls */
+    uint64_t bytes_written;
+    volatile int current_syscall;   /* -1 outside a syscall (read by the sampler) */
+    PocolProfile profile;           /* SYS_PROF_BEGIN / SYS_PROF_END regions */
     uint64_t start_time;
     bool debug_mode;
+    SysCallEntry table[SYS_TABLE_SIZE];    /* indexed by syscall number */
+    void *plugins[SYS_MAX_PLUGINS];
+    int plugin_count;
 } SysCallContext;
 
 /* Functions */
 void syscalls_init(SysCallContext *ctx);
 void syscalls_free(SysCallContext *ctx);
-int syscalls_exec(SysCallContext *ctx, PocolVM *vm, int syscall_num);
+int syscalls_exec(SysCallContext *ctx, struct PocolVM *vm, int syscall_num);
+int syscalls_dispatch(SysCallContext *ctx, struct PocolVM *vm, int syscall_num);
+void syscalls_print_stats(SysCallContext *ctx);
+int syscalls_register(SysCallContext *ctx, int num, SysNativeFn fn, void *userdata,
+                      int argc, const char *name);
+int syscalls_load_plugin(SysCallContext *ctx, const char *path);
+const char* syscalls_name(SysCallContext *ctx, int num);
+
+uint64_t pocol_clock_ns(void);
+uint64_t pocol_cycles(void);
+
+void console_init(ConsoleBuffer *con, FILE *stream);
+void console_free(ConsoleBuffer *con);
+void console_set_policy(ConsoleBuffer *con, ConsolePolicy policy);
+int64_t console_write(ConsoleBuffer *con, const void *buf, size_t size);
+void console_write_u64(ConsoleBuffer *con, uint64_t value);
+int console_flush(ConsoleBuffer *con);
 
 void vfs_init(VFS *vfs);
 void vfs_free(VFS *vfs);
+VFile* vfs_get(VFS *vfs, int fd);
+int vfs_set_fd_limit(VFS *vfs, int limit);
 VFile* vfs_open(VFS *vfs, const char *path, int mode);
 int vfs_close(VFS *vfs, VFile *file);
 int64_t vfs_read(VFS *vfs, VFile *file, void *buf, int64_t size);
 int64_t vfs_write(VFS *vfs, VFile *file, const void *buf, int64_t size);
 int64_t vfs_seek(VFS *vfs, VFile *file, int64_t offset, int whence);
 int64_t vfs_tell(VFS *vfs, VFile *file);
+int vfs_sync(VFS *vfs, VFile *file);
 int vfs_mkdir(VFS *vfs, const char *path);
+int vfs_unlink(VFS *vfs, const char *path);
+VFile* vfs_open_pipe(VFS *vfs, int host_fd, int mode, const char *path);
+VFile* vfs_opendir(VFS *vfs, const char *path);
+int vfs_readdir(VFS *vfs, VFile *file, const VDirEntry **entries, int max);
+int vfs_stat(VFS *vfs, const char *path, VStat *out);
+int64_t vfs_copy(VFS *vfs, VFile *in, VFile *out, int64_t size);
 
 const char* sys_strerror(int error);
 
@@ -0,0 +1,146 @@
+/* vm_trace.c -- Binary execution trace recorder (pm --trace) */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#include "vm_trace.h"
+#include "../common.h"
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+
+/* The recorder is a PocolHooks `after` callback, so tracing runs the
+   hooked interpreter and a normal run keeps the lean one. Per
+   instruction it appends one byte for a fall-through pc, compares eight
+   registers against a shadow copy and writes the changed ones. Nothing
+   touches the FILE until the buffer is nearly full. */
+
+ST_FUNC void trace_flush(PocolTrace *t)
+{
+	errno = 0;
+	if (t->len && fwrite(t->buf, 1, t->len, t->fp) != t->len && !t->error)
+		t->error = errno ? errno : EIO;
+	t->len = 0;
+}
+
+ST_INLN uint8_t *trace_regs(PocolTrace *t, PocolVM *vm, uint8_t *p)
+{
+	for (int r = 0; r < 8; r++) {
+		if (vm->registers[r] != t->regs[r]) {
+			*p++ = (uint8_t)(r << 2 | TRACE_REG);
+			p += trace_put_varint(p, trace_zigzag((int64_t)(vm->registers[r] - t->regs[r])));
+			t->regs[r] = vm->registers[r];
+		}
+	}
+	return p;
+}
+
+ST_FUNC void trace_after(PocolVM *vm, Inst_Addr pc, uint8_t op, void *user)
+{
+	PocolTrace *t = user;
+	(void)op;
+
+	if (t->len > TRACE_BUFFER_SIZE - TRACE_RECORD_MAX)
+		trace_flush(t);
+
+	uint8_t *p = t->buf + t->len;
+	uint64_t z = trace_zigzag((int64_t)(pc - t->last_pc));
+	if (z < TRACE_INST_LONG) {
+		*p++ = (uint8_t)(z << 2 | TRACE_INST);
+	} else {
+		*p++ = TRACE_INST_LONG << 2 | TRACE_INST;
+		p += trace_put_varint(p, z);
+	}
+	t->last_pc = pc;
+	t->instructions++;
+
+	p = trace_regs(t, vm, p);
+	t->len = p - t->buf;
+}
+
+int trace_open(PocolTrace *t, PocolVM *vm, const char *path, int flags)
+{
+	TraceHeader h;
+
+	memset(t, 0, sizeof(*t));
+	t->buf = malloc(TRACE_BUFFER_SIZE);
+	if (!t->buf) {
+		errno = ENOMEM;
+		return -1;
+	}
+	t->fp = fopen(path, "wb");
+	if (!t->fp) {
+		free(t->buf);
+		t->buf = NULL;
+		return -1;
+	}
+
+	memset(&h, 0, sizeof(h));
+	memcpy(h.magic, TRACE_MAGIC, 4);
+	h.version = TRACE_VERSION;
+	h.flags = (uint16_t)flags;
+	h.entry = vm->pc;
+	memcpy(h.registers, vm->registers, sizeof(h.registers));
+	/* a failed header is reported by trace_close(), like any other write */
+	errno = 0;
+	if (fwrite(&h, sizeof(h), 1, t->fp) != 1)
+		t->error = errno ? errno : EIO;
+
+	t->vm = vm;
+	t->last_pc = vm->pc;
+	memcpy(t->regs, vm->registers, sizeof(t->regs));
+	t->hooks.after = trace_after;
+	t->hooks.user = t;
+	if (pocol_add_hooks(vm, &t->hooks) < 0) {
+		fclose(t->fp);
+		free(t->buf);
+		memset(t, 0, sizeof(*t));
+		errno = EBUSY;
+		return -1;
+	}
+	vm->trace = t;
+	return 0;
+}
+
+void trace_block(PocolTrace *t, Inst_Addr start, unsigned int count)
+{
+	if (t->len > TRACE_BUFFER_SIZE - TRACE_RECORD_MAX)
+		trace_flush(t);
+
+	uint8_t *p = t->buf + t->len;
+	*p++ = TRACE_BLOCK;
+	p += trace_put_varint(p, trace_zigzag((int64_t)(start - t->last_pc)));
+	p += trace_put_varint(p, count);
+	t->last_pc = start;
+	t->instructions += count;
+
+	p = trace_regs(t, t->vm, p);
+	t->len = p - t->buf;
+}
+
+int trace_close(PocolTrace *t)
+{
+	if (!t->fp)
+		return 0;
+
+	pocol_remove_hooks(t->vm, &t->hooks);
+	if (t->vm->trace == t)
+		t->vm->trace = NULL;
+
+	t->buf[t->len++] = TRACE_END;
+	t->len += trace_put_varint(t->buf + t->len, t->instructions);
+	trace_flush(t);
+	if (fclose(t->fp) != 0 && !t->error)
+		t->error = errno;
+	free(t->buf);
+
+	int error = t->error;
+	memset(t, 0, sizeof(*t));
+	if (error) {
+		errno = error;
+		return -1;
+	}
+	return 0;
+}
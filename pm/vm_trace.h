@@ -0,0 +1,42 @@
+/* vm_trace.h -- Binary execution trace recorder (pm --trace) */
+
+/* Copyright (C) 2026 Bayu Setiawan and Rasya Andrean
+   This file is part of Pocol, the Pocol Virtual Machine.
+   SPDX-License-Identifier: MIT
+*/
+
+#ifndef POCOL_VM_TRACE_H
+#define POCOL_VM_TRACE_H
+
+#include "vm.h"
+#include "trace_format.h"
+#include <stdio.h>
+#include <stdint.h>
+
+#define TRACE_BUFFER_SIZE   (256 * 1024)
+#define TRACE_RECORD_MAX    128     /* one INST plus eight REG records, worst case */
+
+typedef struct PocolTrace {
+	FILE *fp;
+	uint8_t *buf;                   /* records are built here and written in bulk */
+	size_t len;
+	Inst_Addr last_pc;
+	uint64_t regs[8];               /* register values as of the last record */
+	uint64_t instructions;
+	int error;                      /* errno of the first failed write, 0 if none */
+	PocolHooks hooks;
+	PocolVM *vm;
+} PocolTrace;
+
+/* Start recording every instruction `vm` runs into `path`. `flags` are
+   TRACE_FLAG_* for the header. Returns 0, or -1 with errno set */
+int trace_open(PocolTrace *t, PocolVM *vm, const char *path, int flags);
+
+/* A JIT block starting at `start` ran `count` instructions */
+void trace_block(PocolTrace *t, Inst_Addr start, unsigned int count);
+
+/* Write the END record and close. Returns 0, or -1 with errno set if
+   any write failed */
+int trace_close(PocolTrace *t);
+
+#endif /* POCOL_VM_TRACE_H */
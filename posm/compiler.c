@@ -29,6 +29,7 @@ const Inst_Def inst_table[COUNT_INST] = {
     [INST_ADD]   = { .type = INST_ADD,   .name = "add", .operand = 2, },
     [INST_JMP]   = { .type = INST_JMP,   .name = "jmp", .operand = 1, },
     [INST_PRINT] = { .type = INST_PRINT, .name = "print", .operand = 1, },
+    [INST_SYS]   = { .type = INST_SYS,   .name = "sys", .operand = 0 },
 };
 
 void compiler_error(CompilerCtx *ctx, const char *fmt, ...)
@@ -56,6 +57,80 @@ void compiler_error(CompilerCtx *ctx, const char *fmt, ...)
 	consume_until_newline(ctx);
 }
 
+/*********************** Debug info *************************/
+
+/* remember where the instruction at virtual_pc came from (pass 2, -g only) */
+ST_FUNC void record_line(CompilerCtx *ctx)
+{
+	if (ctx->line_count == ctx->line_cap) {
+		unsigned int cap = ctx->line_cap ? ctx->line_cap * 2 : 256;
+		LineEntry *p = realloc(ctx->lines, cap * sizeof(LineEntry));
+		if (!p)
+			return; /* a short line table is not worth failing the build */
+		ctx->lines = p;
+		ctx->line_cap = cap;
+	}
+
+	ctx->lines[ctx->line_count].pc = ctx->virtual_pc;
+	ctx->lines[ctx->line_count].line = ctx->line;
+	ctx->line_count++;
+}
+
+ST_FUNC int label_cmp(const void *a, const void *b)
+{
+	const SymData *x = *(SymData * const *)a, *y = *(SymData * const *)b;
+	return (x->as.label.pc > y->as.label.pc) - (x->as.label.pc < y->as.label.pc);
+}
+
+/* write foo.map next to foo.pob, same naming rule as symbols_map_path() in pm:
+
+     POCOLMAP 1
+     source <path>
+     sym <start> <end> <name>
+     line <addr> <line>
+*/
+ST_FUNC int write_map(CompilerCtx *ctx, const char *out, Inst_Addr code_end)
+{
+	char path[1024];
+	size_t len = strlen(out);
+	SymData *labels[COMPILER_MAX_SYMBOL];
+	unsigned int count = 0;
+
+	if (len > 4 && strcmp(out + len - 4, ".pob") == 0)
+		len -= 4;
+	snprintf(path, sizeof(path), "%.*s.map", (int)len, out);
+
+	FILE *fp = fopen(path, "w");
+	if (!fp)
+		return -1;
+
+	for (unsigned int i = 0; i < ctx->symbols.symbol_count; i++)
+		if (ctx->symbols.symbols[i].kind == SYM_LABEL)
+			labels[count++] = &ctx->symbols.symbols[i];
+	qsort(labels, count, sizeof(SymData *), label_cmp);
+
+	fprintf(fp, "POCOLMAP 1\n");
+	fprintf(fp, "source %s\n", ctx->path);
+
+	/* a label runs up to the next label at a higher address */
+	for (unsigned int i = 0; i < count; i++) {
+		Inst_Addr start = labels[i]->as.label.pc;
+		Inst_Addr end = code_end;
+		for (unsigned int j = i + 1; j < count; j++) {
+			if (labels[j]->as.label.pc > start) {
+				end = labels[j]->as.label.pc;
+				break;
+			}
+		}
+		fprintf(fp, "sym %jx %jx %s\n", (uintmax_t)start, (uintmax_t)end, labels[i]->name);
+	}
+
+	for (unsigned int i = 0; i < ctx->line_count; i++)
+		fprintf(fp, "line %jx %u\n", (uintmax_t)ctx->lines[i].pc, ctx->lines[i].line);
+
+	return fclose(fp);
+}
+
 /*********************** Parser *****************************/
 
 /* take the next token from cursor and store it into parser lookahead */
@@ -97,6 +172,9 @@ ST_FUNC int parse_inst(CompilerCtx *ctx)
 		else if (t.type == TOK_INT || t.type == TOK_IDENT) types[i] = OPR_IMM;
 	}
 
+	if (ctx->pass == 2 && ctx->debug_info)
+		record_line(ctx);
+
 	/* write opcode & byte descriptor (only if pass 2) */
 	if (ctx->pass == 2) {
 		uint8_t opcode = (uint8_t)inst->type;
@@ -260,6 +338,17 @@ int pocol_compile_file(CompilerCtx *ctx, char *out)
 	/* mark executable */
 	chmod(out, S_IRUSR | S_IWUSR | S_IXUSR | S_IRGRP | S_IWGRP
 		| S_IXGRP | S_IROTH | S_IWOTH | S_IXOTH);
+
+	if (ctx->debug_info) {
+		int failed = write_map(ctx, out, sizeof(PocolHeader) + header.code_size);
+		free(ctx->lines);
+		ctx->lines = NULL;
+		if (failed) {
+			ctx->line = 0;
+			compiler_error(ctx, "failed to write symbol map: %s", strerror(errno));
+			return -1;
+		}
+	}
 	return 0;
 
 error:
@@ -27,6 +27,12 @@ typedef struct {
 	int64_t value; /* if tok == TOK_INT or TOK_REGISTER r[digit] */
 } Token;
 
+/* line table entry, one per emitted instruction (posm -g) */
+typedef struct {
+	Inst_Addr pc;
+	unsigned int line;
+} LineEntry;
+
 typedef struct {
 	FILE *out;
 	Token lookahead; /* Curent parsed token */
@@ -39,6 +45,10 @@ typedef struct {
 	unsigned int pass : 2; /* pass mode (1 or 1) */
 	Inst_Addr virtual_pc; /* program counter for pass 1 */
 	PocolSymbol symbols; /* Compiler symbol table */
+	unsigned int debug_info : 1; /* -g: write a .map sidecar next to the output */
+	LineEntry *lines; /* pc -> source line, filled in pass 2 with -g */
+	unsigned int line_count;
+	unsigned int line_cap;
 } CompilerCtx;
 
 int pocol_compile_file(CompilerCtx *ctx, char *out);
@@ -1,8 +1,11 @@
 #include "compiler.h"
+#include <string.h>
 
 int main(int argc, char **argv)
 {
-	char *output = (argc > 2) ? argv[2] : "out.pob";
+	char *input = NULL;
+	char *output = "out.pob";
+	int positional = 0;
 
 	CompilerCtx ctx = {
 		.path = NULL,
@@ -12,15 +15,29 @@ int main(int argc, char **argv)
 		.col = 1,
 		.total_error = 0,
 		.virtual_pc = 0,
-		.symbols = { .symbol_count = 0 }
+		.symbols = { .symbol_count = 0 },
+		.debug_info = 0,
+		.lines = NULL,
 
 	};
 
-	if (argc == 1) {
+	/* posm [-g] input.pcl [[-o] output.pob] */
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "-g") == 0)
+			ctx.debug_info = 1; /* also write output.map for pm */
+		else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc)
+			output = argv[++i];
+		else if (positional++ == 0)
+			input = argv[i];
+		else
+			output = argv[i];
+	}
+
+	if (input == NULL) {
 		compiler_error(&ctx, "No input files");
 		return 1;
 	}
 
-	ctx.path = argv[1];
+	ctx.path = input;
 	pocol_compile_file(&ctx, output);
 }